@@ -0,0 +1,22 @@
+#include "Arena.h"
+
+#include <string.h>
+
+Arena::Arena(uint8_t *pool, size_t size)
+  : _pool(pool), _size(size), _used(0), _sealed(false), _failures(0), _entryCount(0) {
+}
+
+void *Arena::allocate(const char *owner, size_t size, size_t align) {
+  size_t offset = (_used + align - 1) & ~(align - 1);
+  if (_sealed || _entryCount >= ARENA_MAX_ENTRIES || offset + size > _size) {
+    if (_failures < 255) _failures++;
+    return NULL;
+  }
+  ArenaEntry &e = _entries[_entryCount++];
+  e.owner = owner;
+  e.offset = offset;
+  e.size = size;
+  _used = offset + size;
+  memset(_pool + offset, 0, size);
+  return _pool + offset;
+}
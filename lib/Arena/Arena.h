@@ -0,0 +1,57 @@
+/**
+* Boot time arena for all runtime buffers.
+* Subsystems carve their fixed budget out of one static pool during setup(),
+* then the arena is sealed and nothing is allocated for the rest of the run.
+* Every carve-up is recorded with its owner so the memory map can be printed.
+* There is no free: long running sensors never fragment the heap this way.
+*/
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ARENA_MAX_ENTRIES 24
+
+struct ArenaEntry {
+  const char *owner;
+  uint32_t offset;
+  uint32_t size;
+};
+
+class Arena {
+public:
+  Arena(uint8_t *pool, size_t size);
+
+  // Returns NULL (and counts a failure) when the budget doesn't fit or the
+  // arena is sealed. Memory is zeroed.
+  void *allocate(const char *owner, size_t size, size_t align = 4);
+  template <typename T>
+  T *allocateArray(const char *owner, size_t count) {
+    return static_cast<T *>(allocate(owner, sizeof(T) * count, alignof(T)));
+  }
+
+  // No allocations after this, see failures().
+  void seal() { _sealed = true; }
+  bool sealed() const { return _sealed; }
+
+  size_t size() const { return _size; }
+  size_t used() const { return _used; }
+  size_t available() const { return _size - _used; }
+  uint8_t failures() const { return _failures; }
+
+  uint8_t entryCount() const { return _entryCount; }
+  const ArenaEntry &entry(uint8_t i) const { return _entries[i]; }
+
+private:
+  uint8_t *_pool;
+  size_t _size;
+  size_t _used;
+  bool _sealed;
+  uint8_t _failures;
+  uint8_t _entryCount;
+  ArenaEntry _entries[ARENA_MAX_ENTRIES];
+};
+
+#endif
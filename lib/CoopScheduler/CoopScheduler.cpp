@@ -0,0 +1,82 @@
+#include "CoopScheduler.h"
+
+#include <string.h>
+
+CoopScheduler::CoopScheduler(CoopClockFn clock)
+  : _clock(clock), _tasks(NULL), _count(0), _capacity(0), _iterations(0) {
+}
+
+bool CoopScheduler::begin(Arena &arena, uint8_t maxTasks) {
+  if (maxTasks > COOP_MAX_TASKS) return false;
+  _tasks = arena.allocateArray<CoopTask>("scheduler", maxTasks);
+  _capacity = _tasks != NULL ? maxTasks : 0;
+  return _tasks != NULL;
+}
+
+int8_t CoopScheduler::addTask(const char *name, CoopTaskFn fn, void *ctx, uint8_t priority,
+                              uint32_t budgetUs, uint32_t periodUs) {
+  if (_count >= _capacity) return -1;
+  CoopTask &t = _tasks[_count];
+  memset(&t, 0, sizeof(t));
+  t.name = name;
+  t.fn = fn;
+  t.ctx = ctx;
+  t.priority = priority;
+  t.budgetUs = budgetUs;
+  t.periodUs = periodUs;
+  t.nextRunUs = _clock() + periodUs;
+  return _count++;
+}
+
+void CoopScheduler::wake(int8_t id) {
+  if (id >= 0 && id < _count) _tasks[id].pending = true;
+}
+
+bool CoopScheduler::eligible(const CoopTask &t, uint32_t now) const {
+  if (t.pending) return true;
+  return t.periodUs != 0 && (int32_t)(now - t.nextRunUs) >= 0;
+}
+
+uint32_t CoopScheduler::runOnce(uint32_t sliceUs) {
+  uint32_t start = _clock();
+  uint32_t now = start;
+  uint32_t ran = 0;
+  _iterations++;
+
+  while ((uint32_t)(now - start) < sliceUs) {
+    // Tasks are few, a scan beats keeping a priority queue. Ties go to table order.
+    int8_t best = -1;
+    for (uint8_t i = 0; i < _count; i++) {
+      if ((ran & (1UL << i)) || !eligible(_tasks[i], now)) continue;
+      if (best < 0 || _tasks[i].priority < _tasks[best].priority) best = i;
+    }
+    if (best < 0) break;
+    ran |= 1UL << best;
+
+    CoopTask &t = _tasks[best];
+    uint32_t remaining = sliceUs - (now - start);
+    uint32_t budget = t.budgetUs < remaining ? t.budgetUs : remaining;
+
+    t.pending = false;
+    if (t.periodUs != 0) t.nextRunUs = now + t.periodUs;
+    bool more = t.fn(t.ctx, budget);
+    uint32_t end = _clock();
+    uint32_t used = end - now;
+    t.pending = t.pending || more;
+    t.runs++;
+    t.usedUs += used;
+    if (used > t.maxUs) t.maxUs = used;
+    if (used > t.budgetUs) t.overruns++;
+    now = end;
+  }
+  return now - start;
+}
+
+void CoopScheduler::resetStats() {
+  for (uint8_t i = 0; i < _count; i++) {
+    _tasks[i].runs = 0;
+    _tasks[i].usedUs = 0;
+    _tasks[i].maxUs = 0;
+    _tasks[i].overruns = 0;
+  }
+}
@@ -0,0 +1,73 @@
+/**
+* Cooperative time budgeted scheduler for loop().
+* Tasks are resumable functions that do a bounded chunk of work per call and
+* report whether they have more to do. Every loop() iteration runs eligible
+* tasks in priority order until its time slice is used, then returns so the
+* SDK (WiFi stack, watchdog) gets the CPU back.
+* The clock is injected: micros() on the board, a virtual clock on the host
+* so schedules are deterministic.
+*/
+
+#ifndef COOP_SCHEDULER_H
+#define COOP_SCHEDULER_H
+
+#include <stdint.h>
+#include <Arena.h>
+
+#define COOP_MAX_TASKS 32
+
+// Does at most budgetUs of work. Returns true while more work is pending.
+typedef bool (*CoopTaskFn)(void *ctx, uint32_t budgetUs);
+// Monotonic microseconds, wrapping.
+typedef uint32_t (*CoopClockFn)();
+
+struct CoopTask {
+  const char *name;
+  CoopTaskFn fn;
+  void *ctx;
+  uint8_t priority;       // 0 runs first
+  uint32_t budgetUs;      // time a single call may take
+  uint32_t periodUs;      // 0 --> runs only while pending (see wake())
+  bool pending;
+  uint32_t nextRunUs;
+  // Instrumentation
+  uint32_t runs;
+  uint32_t usedUs;
+  uint32_t maxUs;
+  uint32_t overruns;
+};
+
+class CoopScheduler {
+public:
+  explicit CoopScheduler(CoopClockFn clock);
+
+  bool begin(Arena &arena, uint8_t maxTasks);
+
+  // Returns the task id, or -1 when the table is full.
+  int8_t addTask(const char *name, CoopTaskFn fn, void *ctx, uint8_t priority,
+                 uint32_t budgetUs, uint32_t periodUs);
+  // Marks a task as having work. Safe from callbacks: it only sets a flag.
+  void wake(int8_t id);
+
+  // Runs each eligible task at most once, highest priority first, until
+  // sliceUs is used. A task gets min(budgetUs, rest of the slice) as its
+  // budget; taking longer than budgetUs counts as an overrun.
+  // Returns the time spent.
+  uint32_t runOnce(uint32_t sliceUs);
+
+  uint8_t taskCount() const { return _count; }
+  const CoopTask &task(uint8_t i) const { return _tasks[i]; }
+  uint32_t iterations() const { return _iterations; }
+  void resetStats();
+
+private:
+  bool eligible(const CoopTask &t, uint32_t now) const;
+
+  CoopClockFn _clock;
+  CoopTask *_tasks;
+  uint8_t _count;
+  uint8_t _capacity;
+  uint32_t _iterations;
+};
+
+#endif
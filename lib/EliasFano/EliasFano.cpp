@@ -0,0 +1,140 @@
+#include "EliasFano.h"
+
+#include <string.h>
+
+static uint8_t lowBitsFor(uint64_t span, uint16_t n) {
+  uint64_t q = span / n;
+  uint8_t l = 0;
+  while (q > 1) {
+    q >>= 1;
+    l++;
+  }
+  return l;
+}
+
+size_t efEncodedLength(const uint64_t *ids, uint16_t n) {
+  if (n == 0) return EF_HEADER_LENGTH;
+  uint64_t span = ids[n - 1] - ids[0] + 1;
+  uint8_t l = lowBitsFor(span, n);
+  uint64_t highBits = n + ((ids[n - 1] - ids[0]) >> l);
+  return EF_HEADER_LENGTH + ((uint32_t)n * l + 7) / 8 + (highBits + 7) / 8;
+}
+
+size_t efEncode(const uint64_t *ids, uint16_t n, uint8_t *out, size_t room) {
+  size_t length = efEncodedLength(ids, n);
+  if (length > room) return 0;
+  memset(out, 0, length);
+  uint64_t base = n ? ids[0] : 0;
+  uint8_t l = n ? lowBitsFor(ids[n - 1] - base + 1, n) : 0;
+  size_t lowBytes = ((uint32_t)n * l + 7) / 8;
+  uint16_t highBytes = length - EF_HEADER_LENGTH - lowBytes;
+
+  out[0] = n;
+  out[1] = n >> 8;
+  out[2] = l;
+  out[3] = highBytes;
+  out[4] = highBytes >> 8;
+  for (int i = 0; i < 6; i++) out[5 + i] = base >> (8 * i);
+
+  uint8_t *low = out + EF_HEADER_LENGTH;
+  uint8_t *high = low + lowBytes;
+  for (uint16_t i = 0; i < n; i++) {
+    uint64_t delta = ids[i] - base;
+    uint32_t bit = (uint32_t)i * l;
+    for (uint8_t b = 0; b < l; b++, bit++) {
+      if ((delta >> b) & 1) low[bit >> 3] |= 1 << (bit & 7);
+    }
+    uint32_t h = (delta >> l) + i;
+    high[h >> 3] |= 1 << (h & 7);
+  }
+  return length;
+}
+
+EfReader::EfReader()
+  : _low(NULL), _high(NULL), _highBytes(0), _count(0), _lowBits(0), _base(0), _blockLength(0),
+    _index(0), _highPos(0) {
+}
+
+bool EfReader::begin(const uint8_t *data, size_t length) {
+  if (length < EF_HEADER_LENGTH) return false;
+  _count = data[0] | (data[1] << 8);
+  _lowBits = data[2];
+  _highBytes = data[3] | (data[4] << 8);
+  _base = 0;
+  for (int i = 0; i < 6; i++) _base |= (uint64_t)data[5 + i] << (8 * i);
+  size_t lowBytes = ((uint32_t)_count * _lowBits + 7) / 8;
+  _blockLength = EF_HEADER_LENGTH + lowBytes + _highBytes;
+  if (_lowBits > 48 || _blockLength > length) return false;
+  _low = data + EF_HEADER_LENGTH;
+  _high = _low + lowBytes;
+  _index = 0;
+  _highPos = 0;
+  return true;
+}
+
+uint64_t EfReader::lowBits(uint16_t i) const {
+  uint64_t v = 0;
+  uint32_t bit = (uint32_t)i * _lowBits;
+  for (uint8_t b = 0; b < _lowBits; b++, bit++) {
+    v |= (uint64_t)((_low[bit >> 3] >> (bit & 7)) & 1) << b;
+  }
+  return v;
+}
+
+bool EfReader::next(uint64_t &id) {
+  if (_index >= _count) return false;
+  // next set bit of the high vector, a byte at a time over zeros.
+  uint32_t end = (uint32_t)_highBytes * 8;
+  while (_highPos < end) {
+    uint8_t byte = _high[_highPos >> 3] >> (_highPos & 7);
+    if (byte == 0) {
+      _highPos = (_highPos | 7) + 1;
+      continue;
+    }
+    while (!(byte & 1)) {
+      byte >>= 1;
+      _highPos++;
+    }
+    uint64_t high = _highPos - _index;
+    id = _base + ((high << _lowBits) | lowBits(_index));
+    _highPos++;
+    _index++;
+    return true;
+  }
+  return false;
+}
+
+bool EfReader::nextGEQ(uint64_t target, uint64_t &id) {
+  if (target > _base && _index < _count) {
+    // Jump over the IDs whose high part is below target's: the position
+    // after the h-th zero of the high vector, counted from the start.
+    uint64_t h = (target - _base) >> _lowBits;
+    uint32_t end = (uint32_t)_highBytes * 8;
+    uint32_t pos = _highPos;
+    uint16_t index = _index;
+    uint64_t zeros = pos - index;   // zeros before pos
+    while (zeros < h && pos < end) {
+      if ((pos & 7) == 0 && pos + 8 <= end) {
+        uint8_t byte = _high[pos >> 3];
+        uint8_t ones = __builtin_popcount(byte);
+        if (zeros + (8 - ones) < h) {
+          zeros += 8 - ones;
+          index += ones;
+          pos += 8;
+          continue;
+        }
+      }
+      if ((_high[pos >> 3] >> (pos & 7)) & 1) index++;
+      else zeros++;
+      pos++;
+    }
+    if (index > _index) {
+      _index = index;
+      _highPos = pos;
+    }
+  }
+  while (next(id)) {
+    if (id >= target) return true;
+  }
+  return false;
+}
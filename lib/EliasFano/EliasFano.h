@@ -0,0 +1,56 @@
+/**
+* Elias-Fano coding of sorted 48-bit IDs in independent blocks.
+* A block of n distinct IDs stores the first as a base and the rest as
+* offsets from it: the low L bits of each offset verbatim, the high bits
+* in unary (a set bit per ID in a bit vector of n + max_offset >> L bits),
+* with L = floor(log2(span / n)). That is under 2 + log2(span / n) bits per
+* ID, and the decoder can skip ahead (nextGEQ) without decoding everything
+* in between, so sets can be intersected in the compressed form.
+* Block: uint16 count, uint8 L, uint16 high bytes, 6 byte base, low bits,
+* high bits. Little endian, bit vectors LSB first.
+*/
+
+#ifndef ELIAS_FANO_H
+#define ELIAS_FANO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define EF_HEADER_LENGTH  11
+#define EF_ID_MASK        0xffffffffffffULL
+
+// Bytes efEncode() needs for ids[0..n).
+size_t efEncodedLength(const uint64_t *ids, uint16_t n);
+// Encodes n sorted distinct IDs; returns the block length, 0 if it doesn't fit.
+size_t efEncode(const uint64_t *ids, uint16_t n, uint8_t *out, size_t room);
+
+class EfReader {
+public:
+  EfReader();
+
+  // False if data doesn't start with a whole block.
+  bool begin(const uint8_t *data, size_t length);
+  // Bytes of the block, the next one starts there.
+  size_t blockLength() const { return _blockLength; }
+  uint16_t count() const { return _count; }
+  uint64_t base() const { return _base; }
+
+  bool next(uint64_t &id);
+  // First ID >= target from the current position on.
+  bool nextGEQ(uint64_t target, uint64_t &id);
+
+private:
+  uint64_t lowBits(uint16_t i) const;
+
+  const uint8_t *_low;
+  const uint8_t *_high;
+  uint16_t _highBytes;
+  uint16_t _count;
+  uint8_t _lowBits;
+  uint64_t _base;
+  size_t _blockLength;
+  uint16_t _index;          // IDs returned so far
+  uint32_t _highPos;        // next bit of the high vector to look at
+};
+
+#endif
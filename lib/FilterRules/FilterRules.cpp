@@ -0,0 +1,408 @@
+#include "FilterRules.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define OP_ACCEPT   0x01
+#define OP_DROP     0x02
+#define OP_EQ       0x10
+#define OP_NE       0x11
+#define OP_LT       0x12
+#define OP_LE       0x13
+#define OP_GT       0x14
+#define OP_GE       0x15
+#define OP_IN_MASK  0x16    // value is a bit mask of field values 0-31
+#define OP_IN_OUI   0x17    // value is (first OUI << 8) | count in the OUI table
+#define OP_NOT      0x80
+
+#define FIELD_TYPE     0
+#define FIELD_SUBTYPE  1
+#define FIELD_KIND     2    // type << 4 | subtype
+#define FIELD_CHANNEL  3
+#define FIELD_LOCAL    4
+#define FIELD_RSSI     5
+#define FIELD_LEN      6
+#define FIELD_OUI      7
+
+void ruleFrame(const uint8_t *frame, uint16_t capturedLen, uint16_t origLen, int8_t rssi,
+               uint8_t channel, RuleFrame &out) {
+  out.type = (frame[0] & 0b00001100) >> 2;
+  out.subtype = (frame[0] & 0b11110000) >> 4;
+  out.channel = channel;
+  out.rssi = rssi;
+  out.len = origLen;
+  if (capturedLen >= 16) {
+    out.local = (frame[10] & 0x02) >> 1;
+    out.oui = ((uint32_t)frame[10] << 16) | (frame[11] << 8) | frame[12];
+  } else {
+    out.local = 0;
+    out.oui = 0;
+  }
+}
+
+FilterRules::FilterRules() : _active(&_programs[0]), _maxInsns(0), _maxOuis(0), _generation(0) {
+  memset(_programs, 0, sizeof(_programs));
+}
+
+bool FilterRules::begin(Arena &arena, uint16_t maxInsns, uint16_t maxOuis) {
+  for (int i = 0; i < 2; i++) {
+    _programs[i].insns = arena.allocateArray<RuleInsn>(i ? "rules load" : "rules", maxInsns);
+    _programs[i].ouis = maxOuis ? arena.allocateArray<uint32_t>(i ? "rule ouis load" : "rule ouis", maxOuis) : NULL;
+    _programs[i].length = 0;
+    if (_programs[i].insns == NULL || (maxOuis && _programs[i].ouis == NULL)) return false;
+  }
+  _maxInsns = maxInsns;
+  _maxOuis = maxOuis;
+  return true;
+}
+
+void FilterRules::clear() {
+  Program *standby = _active == &_programs[0] ? &_programs[1] : &_programs[0];
+  standby->length = 0;
+  standby->ouiCount = 0;
+  standby->worstCase = 0;
+  _active = standby;
+  _generation++;
+}
+
+static int32_t fieldValue(const RuleFrame &f, uint8_t field) {
+  switch (field) {
+    case FIELD_TYPE: return f.type;
+    case FIELD_SUBTYPE: return f.subtype;
+    case FIELD_KIND: return (f.type << 4) | f.subtype;
+    case FIELD_CHANNEL: return f.channel;
+    case FIELD_LOCAL: return f.local;
+    case FIELD_RSSI: return f.rssi;
+    case FIELD_LEN: return f.len;
+    default: return f.oui;
+  }
+}
+
+static bool ouiListed(const uint32_t *ouis, uint8_t count, uint32_t oui) {
+  uint8_t lo = 0;
+  uint8_t hi = count;
+  while (lo < hi) {
+    uint8_t mid = (lo + hi) / 2;
+    if (ouis[mid] == oui) return true;
+    if (ouis[mid] < oui) lo = mid + 1;
+    else hi = mid;
+  }
+  return false;
+}
+
+bool FilterRules::accept(const RuleFrame &frame) const {
+  const Program *p = _active;
+  uint16_t pc = 0;
+  while (pc < p->length) {
+    const RuleInsn &in = p->insns[pc];
+    uint8_t op = in.op & ~OP_NOT;
+    if (op == OP_ACCEPT) return true;
+    if (op == OP_DROP) return false;
+    int32_t v = fieldValue(frame, in.field);
+    int32_t arg = (int32_t)in.value;
+    bool hit;
+    switch (op) {
+      case OP_EQ: hit = v == arg; break;
+      case OP_NE: hit = v != arg; break;
+      case OP_LT: hit = v < arg; break;
+      case OP_LE: hit = v <= arg; break;
+      case OP_GT: hit = v > arg; break;
+      case OP_GE: hit = v >= arg; break;
+      case OP_IN_MASK: hit = v >= 0 && v < 32 && ((in.value >> v) & 1); break;
+      default: hit = ouiListed(p->ouis + (in.value >> 8), in.value & 0xff, (uint32_t)v); break;
+    }
+    if (in.op & OP_NOT) hit = !hit;
+    pc += hit ? 1 : in.skip;
+  }
+  return false;
+}
+
+// Compiler: a hand written lexer and recursive descent over the source,
+// writing straight into the standby program.
+
+#define TOKEN_END    0
+#define TOKEN_SEP    1      // ';' or new line
+#define TOKEN_COMMA  2
+#define TOKEN_OP     3
+#define TOKEN_WORD   4
+
+struct RuleToken {
+  uint8_t kind;
+  uint8_t op;
+  uint16_t start;
+  uint16_t length;
+};
+
+class RuleCompiler {
+public:
+  RuleCompiler(const char *src, uint16_t len, FilterRules::Program &out, uint16_t maxInsns,
+               uint16_t maxOuis, RuleError &error)
+    : _src(src), _len(len), _pos(0), _out(out), _maxInsns(maxInsns), _maxOuis(maxOuis), _error(error) {
+    _out.length = 0;
+    _out.ouiCount = 0;
+    _out.worstCase = 0;
+    next();
+  }
+
+  bool compile();
+
+private:
+  void next();
+  bool fail(const char *message) {
+    _error.position = _tok.start;
+    _error.message = message;
+    return false;
+  }
+  bool word(const char *w) const {
+    return _tok.kind == TOKEN_WORD && _tok.length == strlen(w) && strncmp(_src + _tok.start, w, _tok.length) == 0;
+  }
+  bool number(int32_t &value);
+  bool emit(uint8_t op, uint8_t field, uint32_t value);
+  bool condition();
+  bool list(uint8_t field, uint8_t op);
+  bool compare(uint8_t field);
+  bool ouiList(uint8_t op);
+
+  const char *_src;
+  uint16_t _len;
+  uint16_t _pos;
+  RuleToken _tok;
+  FilterRules::Program &_out;
+  uint16_t _maxInsns;
+  uint16_t _maxOuis;
+  RuleError &_error;
+};
+
+void RuleCompiler::next() {
+  while (_pos < _len) {
+    char c = _src[_pos];
+    if (c == '#') {
+      while (_pos < _len && _src[_pos] != '\n') _pos++;
+    } else if (c == ' ' || c == '\t' || c == '\r') {
+      _pos++;
+    } else {
+      break;
+    }
+  }
+  _tok.start = _pos;
+  _tok.length = 0;
+  if (_pos >= _len || _src[_pos] == 0) {
+    _tok.kind = TOKEN_END;
+    return;
+  }
+  char c = _src[_pos];
+  if (c == ';' || c == '\n') {
+    _tok.kind = TOKEN_SEP;
+    _pos++;
+  } else if (c == ',') {
+    _tok.kind = TOKEN_COMMA;
+    _pos++;
+  } else if (c == '<' || c == '>' || c == '=' || c == '!') {
+    bool eq = _pos + 1 < _len && _src[_pos + 1] == '=';
+    _tok.kind = TOKEN_OP;
+    switch (c) {
+      case '<': _tok.op = eq ? OP_LE : OP_LT; break;
+      case '>': _tok.op = eq ? OP_GE : OP_GT; break;
+      case '=': _tok.op = OP_EQ; break;
+      default: _tok.op = eq ? OP_NE : 0; break;
+    }
+    _pos += eq ? 2 : 1;
+  } else {
+    _tok.kind = TOKEN_WORD;
+    while (_pos < _len) {
+      c = _src[_pos];
+      if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+            c == ':' || c == '-' || c == '_')) break;
+      _pos++;
+    }
+    if (_pos == _tok.start) {
+      _tok.kind = TOKEN_OP;      // stray character, reported by the parser
+      _tok.op = 0;
+      _pos++;
+    }
+  }
+  _tok.length = _pos - _tok.start;
+}
+
+bool RuleCompiler::number(int32_t &value) {
+  if (_tok.kind != TOKEN_WORD || _tok.length > 11) return fail("expected a number");
+  char buf[12];
+  memcpy(buf, _src + _tok.start, _tok.length);
+  buf[_tok.length] = 0;
+  char *end;
+  value = strtol(buf, &end, 0);
+  if (*end != 0) return fail("expected a number");
+  next();
+  return true;
+}
+
+bool RuleCompiler::emit(uint8_t op, uint8_t field, uint32_t value) {
+  if (_out.length >= _maxInsns) return fail("rules too long");
+  RuleInsn &in = _out.insns[_out.length++];
+  in.op = op;
+  in.field = field;
+  in.skip = 1;
+  in.value = value;
+  return true;
+}
+
+static const char *typeNames[] = { "mgmt", "ctrl", "data", NULL };
+static const char *subtypeNames[] = {
+  "assoc", "assocresp", "reassoc", "reassocresp", "probe", "proberesp", "", "",
+  "beacon", "atim", "disassoc", "auth", "deauth", "action", NULL
+};
+
+bool RuleCompiler::list(uint8_t field, uint8_t op) {
+  uint32_t mask = 0;
+  for (;;) {
+    const char **names = field == FIELD_TYPE ? typeNames : field == FIELD_SUBTYPE ? subtypeNames : NULL;
+    int32_t v = -1;
+    for (int i = 0; names && names[i]; i++) {
+      if (names[i][0] && word(names[i])) v = i;
+    }
+    if (v >= 0) {
+      next();
+    } else {
+      uint16_t at = _tok.start;
+      if (!number(v)) return false;
+      int32_t max = field == FIELD_CHANNEL ? 14 : field == FIELD_TYPE ? 3 : 15;
+      if (v < (field == FIELD_CHANNEL ? 1 : 0) || v > max) {
+        _tok.start = at;
+        return fail("value out of range");
+      }
+    }
+    mask |= 1UL << v;
+    if (_tok.kind != TOKEN_COMMA) break;
+    next();
+  }
+  return emit(op | OP_IN_MASK, field, mask);
+}
+
+bool RuleCompiler::compare(uint8_t field) {
+  if (_tok.kind != TOKEN_OP || _tok.op == 0) return fail("expected < <= > >= == or !=");
+  uint8_t op = _tok.op;
+  next();
+  int32_t v;
+  if (!number(v)) return false;
+  return emit(op, field, (uint32_t)v);
+}
+
+static bool parseOui(const char *s, uint16_t len, uint32_t &oui) {
+  if (len != 8 || s[2] != ':' || s[5] != ':') return false;
+  oui = 0;
+  for (int i = 0; i < 8; i++) {
+    if (i == 2 || i == 5) continue;
+    char c = s[i];
+    uint8_t d;
+    if (c >= '0' && c <= '9') d = c - '0';
+    else if (c >= 'a' && c <= 'f') d = c - 'a' + 10;
+    else if (c >= 'A' && c <= 'F') d = c - 'A' + 10;
+    else return false;
+    oui = (oui << 4) | d;
+  }
+  return true;
+}
+
+bool RuleCompiler::ouiList(uint8_t op) {
+  uint16_t first = _out.ouiCount;
+  for (;;) {
+    uint32_t oui;
+    if (_tok.kind != TOKEN_WORD || !parseOui(_src + _tok.start, _tok.length, oui)) return fail("expected an OUI like 00:1a:11");
+    if (_out.ouiCount >= _maxOuis) return fail("too many OUIs");
+    // insertion sort, lists are short
+    uint16_t i = _out.ouiCount++;
+    while (i > first && _out.ouis[i - 1] > oui) {
+      _out.ouis[i] = _out.ouis[i - 1];
+      i--;
+    }
+    _out.ouis[i] = oui;
+    next();
+    if (_tok.kind != TOKEN_COMMA) break;
+    next();
+  }
+  uint16_t count = _out.ouiCount - first;
+  if (count > 255) return fail("more than 255 OUIs in one list");
+  return emit(op | OP_IN_OUI, FIELD_OUI, ((uint32_t)first << 8) | count);
+}
+
+bool RuleCompiler::condition() {
+  uint8_t op = 0;
+  if (word("not")) {
+    op = OP_NOT;
+    next();
+  }
+  if (word("probe")) {
+    next();
+    return emit(op | OP_EQ, FIELD_KIND, (0 << 4) | 4);
+  }
+  if (word("local") || word("global")) {
+    uint32_t local = word("local");
+    next();
+    return emit(op | OP_EQ, FIELD_LOCAL, local);
+  }
+  if (word("type")) { next(); return list(FIELD_TYPE, op); }
+  if (word("subtype")) { next(); return list(FIELD_SUBTYPE, op); }
+  if (word("channel")) { next(); return list(FIELD_CHANNEL, op); }
+  if (word("oui")) { next(); return ouiList(op); }
+  if (word("rssi") || word("len")) {
+    uint8_t field = word("rssi") ? FIELD_RSSI : FIELD_LEN;
+    next();
+    if (op) {
+      // not rssi < x is rssi >= x, keep it one instruction
+      uint16_t at = _out.length;
+      if (!compare(field)) return false;
+      _out.insns[at].op |= OP_NOT;
+      return true;
+    }
+    return compare(field);
+  }
+  return fail("expected a condition");
+}
+
+bool RuleCompiler::compile() {
+  uint8_t defaultOp = OP_DROP;
+  for (;;) {
+    while (_tok.kind == TOKEN_SEP) next();
+    if (_tok.kind == TOKEN_END) break;
+    if (word("default")) {
+      next();
+      if (!word("accept") && !word("drop")) return fail("expected accept or drop");
+      defaultOp = word("accept") ? OP_ACCEPT : OP_DROP;
+      next();
+    } else if (word("accept") || word("drop")) {
+      uint8_t action = word("accept") ? OP_ACCEPT : OP_DROP;
+      next();
+      uint16_t first = _out.length;
+      while (_tok.kind != TOKEN_SEP && _tok.kind != TOKEN_END) {
+        if (!condition()) return false;
+      }
+      if (!emit(action, 0, 0)) return false;
+      // a failed test skips to the first instruction after the action.
+      for (uint16_t i = first; i + 1 < _out.length; i++) {
+        _out.insns[i].skip = _out.length - i;
+      }
+    } else {
+      return fail("expected accept, drop or default");
+    }
+    if (_tok.kind != TOKEN_SEP && _tok.kind != TOKEN_END) return fail("expected ';' or a new line");
+  }
+  if (!emit(defaultOp, 0, 0)) return false;
+  // Jumps only go forward: no frame runs more instructions than there are.
+  _out.worstCase = _out.length;
+  return true;
+}
+
+bool FilterRules::load(const char *source, uint16_t length, RuleError &error) {
+  Program *standby = _active == &_programs[0] ? &_programs[1] : &_programs[0];
+  error.position = 0;
+  error.message = NULL;
+  if (_maxInsns == 0) {
+    error.message = "no room for rules";
+    return false;
+  }
+  RuleCompiler compiler(source, length, *standby, _maxInsns, _maxOuis, error);
+  if (!compiler.compile()) return false;
+  _active = standby;
+  _generation++;
+  return true;
+}
@@ -0,0 +1,90 @@
+/**
+* Receive filter rules, set at runtime and compiled to a small bytecode.
+* Rules are tried in order, the first whose conditions all hold decides;
+* frames no rule matches get the default (drop unless "default accept").
+*   drop rssi < -85; drop local
+*   accept probe channel 1,6,11 oui 00:1a:11,3c:5a:b4
+*   default drop
+* Conditions: probe, local, global, type mgmt|ctrl|data, subtype <name|n>,...,
+* channel <n>,..., oui <xx:xx:xx>,..., rssi <op> <n>, len <op> <n>, with
+* op one of < <= > >= == != and "not" in front of any condition.
+* Rules are separated by ';' or new lines, '#' starts a comment.
+* Each condition is one instruction (OUI lists: a binary search) and jumps
+* only go forward, so the cost per frame is bounded by the program length,
+* reported as worst case steps. Programs are double buffered like the
+* watchlist: a new one compiles aside and is swapped in with one store.
+*/
+
+#ifndef FILTER_RULES_H
+#define FILTER_RULES_H
+
+#include <stdint.h>
+#include <Arena.h>
+
+// What the rules look at, taken from the frame once.
+struct RuleFrame {
+  uint8_t type;
+  uint8_t subtype;
+  uint8_t channel;
+  uint8_t local;              // 1 if the transmitter address is locally administered
+  int8_t rssi;
+  uint16_t len;
+  uint32_t oui;               // first three bytes of the transmitter address
+};
+
+struct RuleInsn {
+  uint8_t op;
+  uint8_t field;
+  uint16_t skip;              // instructions to the next rule when the test fails
+  uint32_t value;
+};
+
+struct RuleError {
+  uint16_t position;          // offset in the source
+  const char *message;
+};
+
+// Extracts the fields from an 802.11 frame of capturedLen bytes (origLen on air).
+void ruleFrame(const uint8_t *frame, uint16_t capturedLen, uint16_t origLen, int8_t rssi,
+               uint8_t channel, RuleFrame &out);
+
+class FilterRules {
+public:
+  FilterRules();
+
+  // Room for programs of maxInsns instructions and maxOuis OUIs, twice.
+  bool begin(Arena &arena, uint16_t maxInsns, uint16_t maxOuis);
+
+  // Compiles source and makes it the active program. On error the active
+  // program is kept and error tells what and where.
+  bool load(const char *source, uint16_t length, RuleError &error);
+  // Back to no rules.
+  void clear();
+
+  // True when a program is loaded; accept() is meaningless otherwise.
+  bool active() const { return _active->length > 0; }
+  bool accept(const RuleFrame &frame) const;
+
+  uint16_t length() const { return _active->length; }
+  uint16_t worstCaseSteps() const { return _active->worstCase; }
+  uint32_t generation() const { return _generation; }
+
+private:
+  struct Program {
+    RuleInsn *insns;
+    uint32_t *ouis;
+    uint16_t length;
+    uint16_t ouiCount;
+    uint16_t worstCase;
+  };
+
+  Program _programs[2];
+  Program * volatile _active;
+  uint16_t _maxInsns;
+  uint16_t _maxOuis;
+  uint32_t _generation;
+
+  friend class RuleCompiler;
+};
+
+#endif
@@ -0,0 +1,107 @@
+#include "FrameDigest.h"
+
+#include <string.h>
+
+#define MGMT_HEADER_LENGTH 24
+
+#define IE_SUPPORTED_RATES 1
+#define IE_HT_CAPABILITIES 45
+#define IE_EXT_SUPPORTED_RATES 50
+#define IE_EXT_CAPABILITIES 127
+#define IE_VHT_CAPABILITIES 191
+#define IE_VENDOR 221
+
+static inline uint32_t fnv1a(uint32_t h, uint8_t b) {
+  return (h ^ b) * 16777619UL;
+}
+
+uint16_t ieFingerprint(const uint8_t *ies, uint16_t len, bool *truncated) {
+  uint32_t h = 2166136261UL;
+  uint16_t i = 0;
+  *truncated = false;
+  while (i + 2 <= len) {
+    uint8_t id = ies[i];
+    uint8_t ieLen = ies[i + 1];
+    h = fnv1a(h, id);
+    h = fnv1a(h, ieLen);
+    const uint8_t *value = ies + i + 2;
+    uint16_t hashed = 0;
+    switch (id) {
+      case IE_SUPPORTED_RATES:
+      case IE_HT_CAPABILITIES:
+      case IE_EXT_SUPPORTED_RATES:
+      case IE_EXT_CAPABILITIES:
+      case IE_VHT_CAPABILITIES:
+        hashed = ieLen;
+        break;
+      case IE_VENDOR:
+        hashed = ieLen < 4 ? ieLen : 4;  // OUI and type
+        break;
+    }
+    if (i + 2 + ieLen > len) {
+      *truncated = true;
+      hashed = len - i - 2 < hashed ? len - i - 2 : hashed;
+    }
+    for (uint16_t k = 0; k < hashed; k++) {
+      h = fnv1a(h, value[k]);
+    }
+    i += 2 + ieLen;
+  }
+  if (i < len) *truncated = true;
+  return (uint16_t)(h ^ (h >> 16));
+}
+
+bool makeDigest(const uint8_t *frame, uint16_t capturedLen, int8_t rssi, uint8_t channel,
+                uint32_t timestampMs, FrameDigest &out) {
+  if (capturedLen < MGMT_HEADER_LENGTH) return false;
+  memcpy(out.mac, frame + 10, 6);
+  out.rssi = rssi;
+  out.channelFlags = channel & 0x0f;
+  if (frame[10] & 0x02) out.channelFlags |= DIGEST_FLAG_LOCAL_MAC;
+  out.seq = frame[22] | (frame[23] << 8);
+  bool truncated;
+  out.ieFingerprint = ieFingerprint(frame + MGMT_HEADER_LENGTH, capturedLen - MGMT_HEADER_LENGTH, &truncated);
+  if (truncated) out.channelFlags |= DIGEST_FLAG_TRUNCATED;
+  out.timestampMs = timestampMs;
+  return true;
+}
+
+DigestQueue::DigestQueue() : _ring(NULL), _mask(0), _head(0), _tail(0) {
+}
+
+bool DigestQueue::begin(Arena &arena, uint16_t capacity) {
+  uint16_t size = 1;
+  while ((uint32_t)size * 2 <= capacity) size *= 2;
+  _ring = arena.allocateArray<FrameDigest>("digest queue", size);
+  _mask = size - 1;
+  _head = _tail = 0;
+  return _ring != NULL;
+}
+
+bool DigestQueue::push(const FrameDigest &digest) {
+  uint16_t head = _head;
+  if ((uint16_t)(head - _tail) > _mask) return false;
+  _ring[head & _mask] = digest;
+  __sync_synchronize();  // digest visible before the index
+  _head = head + 1;
+  return true;
+}
+
+uint16_t DigestQueue::available() const {
+  return _head - _tail;
+}
+
+uint16_t DigestQueue::peek(const FrameDigest **first, uint16_t max) const {
+  uint16_t n = available();
+  uint16_t toEnd = _mask + 1 - (_tail & _mask);
+  if (n > toEnd) n = toEnd;
+  if (n > max) n = max;
+  __sync_synchronize();
+  *first = &_ring[_tail & _mask];
+  return n;
+}
+
+void DigestQueue::consume(uint16_t count) {
+  __sync_synchronize();
+  _tail += count;
+}
@@ -0,0 +1,77 @@
+/**
+* Compact per-frame digests for thin-sensor mode.
+* Every accepted probe request becomes a 16 byte digest which the host
+* analyses; the sensor does no dedup. Digests go through a single producer /
+* single consumer ring from the WiFi callback to loop(), where they are
+* batched into binary frames.
+* All multi-byte fields are little endian, as on the ESP8266 and x86 hosts.
+*/
+
+#ifndef FRAME_DIGEST_H
+#define FRAME_DIGEST_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <Arena.h>
+
+#define DIGEST_FLAG_LOCAL_MAC 0x10    // locally administered transmitter address
+#define DIGEST_FLAG_TRUNCATED 0x20    // IEs ran past the captured bytes
+#define DIGEST_FLAG_WATCHED   0x40    // transmitter is flagged in the watchlist
+
+struct FrameDigest {
+  uint8_t mac[6];             // transmitter address
+  int8_t rssi;
+  uint8_t channelFlags;       // channel in the low nibble, DIGEST_FLAG_* above
+  uint16_t seq;               // 802.11 sequence control (sequence << 4 | fragment)
+  uint16_t ieFingerprint;     // hash of the IE layout, stable across MAC randomization
+  uint32_t timestampMs;       // sensor millis()
+};
+
+static_assert(sizeof(FrameDigest) == 16, "FrameDigest must stay 16 bytes");
+
+// Why a frame did not produce a digest (filtered) or a digest was lost (dropped).
+enum DigestCounter {
+  DIGEST_ACCEPTED,
+  DIGEST_EMITTED,
+  DIGEST_DROP_QUEUE_FULL,      // callback outran the output link
+  DIGEST_FILTER_NOT_PROBE,
+  DIGEST_FILTER_LOCAL_MAC,
+  DIGEST_FILTER_SHORT,         // frame shorter than a management header
+  DIGEST_FILTER_WATCH_EXCLUDE, // staff device on the watchlist
+  DIGEST_FILTER_RULES,         // dropped by the filter rules
+  DIGEST_COUNTER_COUNT
+};
+
+// Builds a digest from a management frame of capturedLen bytes.
+bool makeDigest(const uint8_t *frame, uint16_t capturedLen, int8_t rssi, uint8_t channel,
+                uint32_t timestampMs, FrameDigest &out);
+
+// 16-bit hash of IE ids, lengths and the values of capability IEs. SSID,
+// channel and vendor payloads are left out so it doesn't change between probes.
+uint16_t ieFingerprint(const uint8_t *ies, uint16_t len, bool *truncated);
+
+class DigestQueue {
+public:
+  DigestQueue();
+
+  // capacity is rounded down to a power of two.
+  bool begin(Arena &arena, uint16_t capacity);
+
+  // Producer side (WiFi callback).
+  bool push(const FrameDigest &digest);
+
+  // Consumer side (loop()). Digests are contiguous up to the ring end, so
+  // peek() may return fewer than available().
+  uint16_t available() const;
+  uint16_t peek(const FrameDigest **first, uint16_t max) const;
+  void consume(uint16_t count);
+  uint16_t capacity() const { return _mask + 1; }
+
+private:
+  FrameDigest *_ring;
+  uint16_t _mask;
+  volatile uint16_t _head;   // written by the producer
+  volatile uint16_t _tail;   // written by the consumer
+};
+
+#endif
@@ -0,0 +1,106 @@
+#include "FrameSample.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+FrameSample::FrameSample()
+  : _records(NULL), _size(0), _filling(0), _seen(0), _next(0), _w(0), _rng(1),
+    _exporting(false), _sweep(0), _exportSweep(0), _exportSeen(0), _exportCount(0), _exportIndex(0), _skipped(0) {
+}
+
+bool FrameSample::begin(Arena &arena, uint8_t size, uint32_t seed) {
+  if (size == 0 || size > FRAME_SAMPLE_MAX) return false;
+  _records = arena.allocateArray<SampledFrame>("frame sample", 2 * size);
+  _size = size;
+  _rng = seed ? seed : 1;
+  return _records != NULL;
+}
+
+uint32_t FrameSample::random() {
+  _rng ^= _rng << 13;
+  _rng ^= _rng >> 17;
+  _rng ^= _rng << 5;
+  return _rng;
+}
+
+// In (0, 1), never 0: it goes into a log.
+float FrameSample::uniform() {
+  return ((random() >> 8) + 0.5f) / 16777216.0f;
+}
+
+// Frames to skip until the next replacement, geometric with the current key.
+void FrameSample::drawNext() {
+  float skip = floorf(logf(uniform()) / logf(1 - _w));
+  _next = _seen + 1 + (skip < 1e9f ? (uint32_t)skip : 1000000000UL);
+}
+
+void FrameSample::replace(uint32_t nowMs, const uint8_t *data, uint16_t captured, uint16_t length,
+                          uint8_t channel, int8_t rssi) {
+  uint8_t slot = _seen <= _size ? _seen - 1 : random() % _size;
+  SampledFrame &r = _records[_filling * _size + slot];
+  if (captured > FRAME_SAMPLE_CAPTURE) captured = FRAME_SAMPLE_CAPTURE;
+  r.timestampMs = nowMs;
+  r.length = length;
+  r.captured = captured;
+  r.channel = channel;
+  r.rssi = rssi;
+  memcpy(r.data, data, captured);
+  if (_seen < _size) return;
+  // the reservoir is full from here on: W shrinks, the skips grow.
+  if (_seen == _size) _w = expf(logf(uniform()) / _size);
+  else _w *= expf(logf(uniform()) / _size);
+  drawNext();
+}
+
+void FrameSample::close() {
+  if (_records == NULL) return;
+  if (_exporting) {
+    _skipped++;
+  } else {
+    _exporting = true;
+    _exportSweep = _sweep;
+    _exportSeen = _seen;
+    _exportCount = _seen < _size ? _seen : _size;
+    _exportIndex = 0;
+    _filling ^= 1;
+    // in time order, as a capture would have them.
+    SampledFrame *closed = _records + (_filling ^ 1) * _size;
+    for (uint8_t i = 1; i < _exportCount; i++) {
+      SampledFrame r = closed[i];
+      uint8_t j = i;
+      for (; j > 0 && (int32_t)(closed[j - 1].timestampMs - r.timestampMs) > 0; j--) closed[j] = closed[j - 1];
+      closed[j] = r;
+    }
+  }
+  _sweep++;
+  _seen = 0;
+  _next = 0;
+}
+
+bool FrameSample::exportNext(SensorLink &link) {
+  if (!_exporting) return false;
+  uint8_t frame[FRAME_SAMPLE_FRAME_MAX];
+  memcpy(frame, &_exportSweep, 4);
+  memcpy(frame + 4, &_exportSeen, 4);
+  frame[8] = _exportIndex;
+  frame[9] = _exportCount;
+  uint16_t length = FRAME_SAMPLE_HEADER;
+  if (_exportCount) {
+    const SampledFrame &r = _records[(_filling ^ 1) * _size + _exportIndex];
+    PcapRecordHeader record;
+    record.tsSec = r.timestampMs / 1000;
+    record.tsUsec = r.timestampMs % 1000 * 1000;
+    record.inclLen = RADIOTAP_SENSOR_LENGTH + r.captured;
+    record.origLen = RADIOTAP_SENSOR_LENGTH + r.length;
+    memcpy(frame + length, &record, sizeof(record));
+    length += sizeof(record);
+    length += radiotapBuild(frame + length, r.channel, r.rssi);
+    memcpy(frame + length, r.data, r.captured);
+    length += r.captured;
+  }
+  if (link.txRoom() < length) return true;
+  link.send(FRAME_SAMPLE, frame, length);
+  if (++_exportIndex >= _exportCount) _exporting = false;
+  return _exporting;
+}
@@ -0,0 +1,86 @@
+/**
+* A uniform random sample of each sweep's accepted frames, for auditing the
+* counts against what was actually heard. Reservoir sampling with Algorithm
+* L: once the reservoir is full the number of frames to skip before the next
+* replacement is drawn at once, so most frames cost a counter compare and
+* the random draws (xorshift32) grow only with the log of the sweep's frames.
+* When the sweep closes its sample is sent from loop() as FRAME_SAMPLE
+* frames, one per sampled frame, while the next sweep fills the other half
+* of the buffer. Each frame carries a pcap record (lib/PcapFormat) with the
+* sensor's radiotap header: written behind a radiotap pcap file header they
+* make a capture any 802.11 tool reads.
+* Frame: uint32 sweep, uint32 frames in the sweep, uint8 index, uint8 count,
+* pcap record (none for an empty sweep). Timestamps are sensor millis().
+*/
+
+#ifndef FRAME_SAMPLE_H
+#define FRAME_SAMPLE_H
+
+#include <stdint.h>
+#include <Arena.h>
+#include <PcapFormat.h>
+#include <SensorLink.h>
+
+#define FRAME_SAMPLE            0x0e
+#define FRAME_SAMPLE_HEADER     10
+#define FRAME_SAMPLE_CAPTURE    64        // bytes of each frame kept: the header and the first IEs
+#define FRAME_SAMPLE_MAX        32
+#define FRAME_SAMPLE_FRAME_MAX  (FRAME_SAMPLE_HEADER + sizeof(PcapRecordHeader) + RADIOTAP_SENSOR_LENGTH + \
+                                 FRAME_SAMPLE_CAPTURE)
+
+struct SampledFrame {
+  uint32_t timestampMs;
+  uint16_t length;            // of the whole frame
+  uint8_t captured;
+  uint8_t channel;
+  int8_t rssi;
+  uint8_t data[FRAME_SAMPLE_CAPTURE];
+};
+
+class FrameSample {
+public:
+  FrameSample();
+
+  // size frames per sweep, up to FRAME_SAMPLE_MAX.
+  bool begin(Arena &arena, uint8_t size, uint32_t seed);
+
+  // An accepted frame, from the WiFi callback.
+  void offer(uint32_t nowMs, const uint8_t *data, uint16_t captured, uint16_t length, uint8_t channel, int8_t rssi) {
+    if (_records == NULL) return;
+    if (++_seen > _size && _seen != _next) return;
+    replace(nowMs, data, captured, length, channel, rssi);
+  }
+  // Ends the sweep. Its export starts on the next exportNext(); if the
+  // previous one is still being sent, the closed sweep is skipped.
+  void close();
+  // From loop(): sends the next frame of a closed sweep if the link has
+  // room. Returns true while there is more to send.
+  bool exportNext(SensorLink &link);
+
+  uint32_t seen() const { return _seen; }
+  uint32_t skipped() const { return _skipped; }
+
+private:
+  void replace(uint32_t nowMs, const uint8_t *data, uint16_t captured, uint16_t length, uint8_t channel, int8_t rssi);
+  uint32_t random();
+  float uniform();
+  void drawNext();
+
+  SampledFrame *_records;     // two halves: filling and exporting
+  uint8_t _size;
+  uint8_t _filling;           // half being filled
+  uint32_t _seen;             // frames offered this sweep
+  uint32_t _next;             // the frame that replaces a sampled one next
+  float _w;                   // Algorithm L's W: the largest key in the reservoir
+  uint32_t _rng;
+
+  bool _exporting;
+  uint32_t _sweep;            // sweeps closed so far
+  uint32_t _exportSweep;
+  uint32_t _exportSeen;
+  uint8_t _exportCount;
+  uint8_t _exportIndex;
+  uint32_t _skipped;          // sweeps closed during an export
+};
+
+#endif
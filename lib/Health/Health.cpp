@@ -0,0 +1,39 @@
+#include "Health.h"
+
+#include <string.h>
+
+HealthMonitor::HealthMonitor()
+  : _intervalStartMs(0), _callbacks(0), _loops(0), _lowestSp(0xffffffff), _minFreeHeap(0xffffffff),
+    _channel(0), _channelChanged(false) {
+  memset(_expected, 0, sizeof(_expected));
+}
+
+void HealthMonitor::begin(uint32_t nowMs, uint8_t channel) {
+  _intervalStartMs = nowMs;
+  _channel = channel;
+  _channelChanged = false;
+}
+
+void HealthMonitor::report(uint32_t nowMs, uint32_t freeHeap, HealthRecord &r) {
+  sampleHeap(freeHeap);
+  uint32_t elapsed = nowMs - _intervalStartMs;
+  r.uptimeMs = nowMs;
+  r.freeHeap = freeHeap;
+  r.minFreeHeap = _minFreeHeap;
+  r.loopsPerS = elapsed ? (uint64_t)_loops * 1000 / elapsed : 0;
+  r.callbacksPerS = elapsed ? (uint64_t)_callbacks * 1000 / elapsed : 0;
+  r.channel = _channel;
+  r.reserved = 0;
+
+  float &expected = _expected[_channel < HEALTH_CHANNELS ? _channel : 0];
+  r.expectedPerS = (uint32_t)(expected + 0.5f);
+  if (!_channelChanged && elapsed) {
+    float rate = _callbacks * 1000.0f / elapsed;
+    expected = expected == 0 ? rate : expected + HEALTH_EWMA_ALPHA * (rate - expected);
+  }
+
+  _intervalStartMs = nowMs;
+  _callbacks = 0;
+  _loops = 0;
+  _channelChanged = false;
+}
@@ -0,0 +1,80 @@
+/**
+* Periodic health record of the sensor, sent to the host as FRAME_HEALTH.
+* Between reports the only work is two counter increments per WiFi callback
+* and per loop(), and a stack pointer comparison in the callback; the heap
+* is sampled once a second for its low-water mark. The platform values
+* (heap, reset cause, stacks) are filled in by the caller, the monitor adds
+* the rates and the callback rate expected on the tuned channel: a moving
+* average of earlier intervals spent wholly on that channel, so a rate far
+* below it points at a starved SDK rather than a quiet channel.
+* All fields little endian.
+*/
+
+#ifndef HEALTH_H
+#define HEALTH_H
+
+#include <stdint.h>
+
+#define FRAME_HEALTH          0x07
+#define HEALTH_CHANNELS       15        // index by channel 1-14
+#define HEALTH_EWMA_ALPHA     0.2f
+
+struct HealthRecord {
+  uint32_t uptimeMs;
+  uint32_t freeHeap;
+  uint32_t minFreeHeap;       // lowest sampled since boot
+  uint32_t maxFreeBlock;
+  uint32_t loopsPerS;
+  uint32_t callbacksPerS;
+  uint32_t expectedPerS;      // on this channel before this interval, 0 not known yet
+  uint32_t resetExcCause;     // of the last reset, when it was an exception
+  uint32_t resetEpc1;
+  uint16_t callbackStack;     // deepest stack use at the WiFi callback, bytes
+  uint16_t loopStackFree;     // unused loop() stack since boot, bytes
+  uint8_t heapFragmentation;  // percent
+  uint8_t resetReason;        // rst_info reason: 0 power on, 1 hw wdt, 2 exception, 3 soft wdt, 4 restart, 6 ext
+  uint8_t channel;            // tuned at the report
+  uint8_t reserved;
+};
+
+static_assert(sizeof(HealthRecord) == 44, "HealthRecord must stay 44 bytes");
+
+class HealthMonitor {
+public:
+  HealthMonitor();
+
+  void begin(uint32_t nowMs, uint8_t channel);
+
+  // WiFi callback, sp its stack pointer.
+  void onCallback(uint32_t sp) {
+    _callbacks++;
+    if (sp < _lowestSp) _lowestSp = sp;
+  }
+  void onLoop() { _loops++; }
+  // Also sampled at every report.
+  void sampleHeap(uint32_t freeHeap) {
+    if (freeHeap < _minFreeHeap) _minFreeHeap = freeHeap;
+  }
+  // Called when the tuned channel changes, so its interval isn't learned.
+  void onChannel(uint8_t channel) {
+    if (channel != _channel) _channelChanged = true;
+    _channel = channel;
+  }
+
+  // Rates over the interval since the last report, then starts the next one.
+  void report(uint32_t nowMs, uint32_t freeHeap, HealthRecord &r);
+  // Lowest stack pointer seen in the callback, 0xffffffff before any.
+  uint32_t lowestCallbackSp() const { return _lowestSp; }
+
+private:
+  uint32_t _intervalStartMs;
+  uint32_t _callbacks;
+  uint32_t _loops;
+  uint32_t _lowestSp;
+  uint32_t _minFreeHeap;
+  uint8_t _channel;
+  bool _channelChanged;
+  float _expected[HEALTH_CHANNELS];
+};
+
+#endif
@@ -0,0 +1,100 @@
+#include "PcapFormat.h"
+
+#include <string.h>
+
+#define RADIOTAP_TSFT        0
+#define RADIOTAP_FLAGS       1
+#define RADIOTAP_RATE        2
+#define RADIOTAP_CHANNEL     3
+#define RADIOTAP_FHSS        4
+#define RADIOTAP_DBM_SIGNAL  5
+#define RADIOTAP_EXT         31
+
+#define RADIOTAP_FLAG_FCS    0x10
+#define RADIOTAP_CHAN_2GHZ   0x0080
+
+void pcapFileHeader(PcapFileHeader &header, uint32_t snapLen, uint32_t linkType) {
+  header.magic = PCAP_MAGIC;
+  header.versionMajor = 2;
+  header.versionMinor = 4;
+  header.thisZone = 0;
+  header.sigFigs = 0;
+  header.snapLen = snapLen;
+  header.linkType = linkType;
+}
+
+uint16_t channelFrequency(uint8_t channel) {
+  if (channel == 14) return 2484;
+  return 2407 + 5 * channel;
+}
+
+uint8_t frequencyChannel(uint16_t mhz) {
+  if (mhz == 2484) return 14;
+  if (mhz >= 2412 && mhz < 2484) return (mhz - 2407) / 5;
+  return 0;
+}
+
+uint16_t radiotapBuild(uint8_t *out, uint8_t channel, int8_t rssi) {
+  uint32_t present = (1UL << RADIOTAP_FLAGS) | (1UL << RADIOTAP_CHANNEL) | (1UL << RADIOTAP_DBM_SIGNAL);
+  uint16_t freq = channelFrequency(channel);
+  uint16_t chanFlags = RADIOTAP_CHAN_2GHZ;
+  out[0] = 0;                 // version
+  out[1] = 0;                 // pad
+  out[2] = RADIOTAP_SENSOR_LENGTH;
+  out[3] = 0;
+  out[4] = present;
+  out[5] = present >> 8;
+  out[6] = present >> 16;
+  out[7] = present >> 24;
+  out[8] = 0;                 // flags, no FCS
+  out[9] = 0;                 // pad: channel is 2-byte aligned
+  out[10] = freq;
+  out[11] = freq >> 8;
+  out[12] = chanFlags;
+  out[13] = chanFlags >> 8;
+  out[14] = (uint8_t)rssi;
+  return RADIOTAP_SENSOR_LENGTH;
+}
+
+static uint32_t align(uint32_t offset, uint32_t alignment) {
+  return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+bool radiotapParse(const uint8_t *data, uint32_t len, RadiotapInfo &info) {
+  memset(&info, 0, sizeof(info));
+  if (len < 8 || data[0] != 0) return false;
+  info.length = data[2] | (data[3] << 8);
+  if (info.length > len) return false;
+
+  uint32_t present = data[4] | (data[5] << 8) | ((uint32_t)data[6] << 16) | ((uint32_t)data[7] << 24);
+  // Skip extended present bitmaps, fields of the first one are all we read.
+  uint32_t offset = 8;
+  uint32_t word = present;
+  while (word & (1UL << RADIOTAP_EXT)) {
+    if (offset + 4 > info.length) return false;
+    word = data[offset] | (data[offset + 1] << 8) | ((uint32_t)data[offset + 2] << 16) | ((uint32_t)data[offset + 3] << 24);
+    offset += 4;
+  }
+
+  if (present & (1UL << RADIOTAP_TSFT)) offset = align(offset, 8) + 8;
+  if (present & (1UL << RADIOTAP_FLAGS)) {
+    if (offset + 1 > info.length) return true;
+    info.hasFcs = (data[offset] & RADIOTAP_FLAG_FCS) != 0;
+    offset += 1;
+  }
+  if (present & (1UL << RADIOTAP_RATE)) offset += 1;
+  if (present & (1UL << RADIOTAP_CHANNEL)) {
+    offset = align(offset, 2);
+    if (offset + 4 > info.length) return true;
+    info.channel = frequencyChannel(data[offset] | (data[offset + 1] << 8));
+    info.hasChannel = info.channel != 0;
+    offset += 4;
+  }
+  if (present & (1UL << RADIOTAP_FHSS)) offset += 2;
+  if (present & (1UL << RADIOTAP_DBM_SIGNAL)) {
+    if (offset + 1 > info.length) return true;
+    info.signal = (int8_t)data[offset];
+    info.hasSignal = true;
+  }
+  return true;
+}
@@ -0,0 +1,57 @@
+/**
+* pcap file format and radiotap headers for 802.11 captures.
+* Only the parts the sensor needs: the file and record headers, and a
+* radiotap header carrying channel and signal strength (what RxControl
+* knows about a frame). Parsing accepts radiotap headers from other tools
+* and skips the fields it doesn't use.
+*/
+
+#ifndef PCAP_FORMAT_H
+#define PCAP_FORMAT_H
+
+#include <stdint.h>
+
+#define PCAP_MAGIC                    0xa1b2c3d4UL
+#define PCAP_MAGIC_NANOSECONDS        0xa1b23c4dUL
+#define LINKTYPE_IEEE802_11           105
+#define LINKTYPE_IEEE802_11_RADIOTAP  127
+
+struct PcapFileHeader {
+  uint32_t magic;
+  uint16_t versionMajor;
+  uint16_t versionMinor;
+  int32_t thisZone;
+  uint32_t sigFigs;
+  uint32_t snapLen;
+  uint32_t linkType;
+};
+
+struct PcapRecordHeader {
+  uint32_t tsSec;
+  uint32_t tsUsec;
+  uint32_t inclLen;
+  uint32_t origLen;
+};
+
+struct RadiotapInfo {
+  uint16_t length;        // bytes before the 802.11 header
+  bool hasChannel;
+  uint8_t channel;
+  bool hasSignal;
+  int8_t signal;          // dBm
+  bool hasFcs;            // frame ends with a 4 byte FCS
+};
+
+#define RADIOTAP_SENSOR_LENGTH 15
+
+void pcapFileHeader(PcapFileHeader &header, uint32_t snapLen, uint32_t linkType);
+
+// Writes the sensor's radiotap header (flags, channel, antenna signal),
+// RADIOTAP_SENSOR_LENGTH bytes.
+uint16_t radiotapBuild(uint8_t *out, uint8_t channel, int8_t rssi);
+bool radiotapParse(const uint8_t *data, uint32_t len, RadiotapInfo &info);
+
+uint16_t channelFrequency(uint8_t channel);
+uint8_t frequencyChannel(uint16_t mhz);
+
+#endif
@@ -0,0 +1,323 @@
+#include "QuotientFilter.h"
+
+#include <string.h>
+
+// Slot metadata bits. The remainder is stored above them.
+#define QF_OCCUPIED     0x1
+#define QF_CONTINUATION 0x2
+#define QF_SHIFTED      0x4
+#define QF_META_BITS    3
+
+static inline bool isOccupied(uint32_t e)     { return e & QF_OCCUPIED; }
+static inline bool isContinuation(uint32_t e) { return e & QF_CONTINUATION; }
+static inline bool isShifted(uint32_t e)      { return e & QF_SHIFTED; }
+static inline bool isEmpty(uint32_t e)        { return (e & 0x7) == 0; }
+static inline bool isClusterStart(uint32_t e) { return isOccupied(e) && !isContinuation(e) && !isShifted(e); }
+static inline bool isRunStart(uint32_t e)     { return !isContinuation(e) && (isOccupied(e) || isShifted(e)); }
+static inline uint32_t remainderOf(uint32_t e) { return e >> QF_META_BITS; }
+
+QuotientFilter::QuotientFilter()
+  : _table(NULL), _qbits(0), _rbits(0), _slotBits(0), _slotMask(0), _indexMask(0),
+    _remainderMask(0), _slots(0), _entries(0), _maxEntries(0) {
+}
+
+size_t QuotientFilter::storageBytes(uint8_t qbits, uint8_t rbits) {
+  return (((size_t)1 << qbits) * (rbits + QF_META_BITS) + 7) / 8;
+}
+
+uint32_t QuotientFilter::fingerprintMAC(const uint8_t *mac, uint8_t qbits, uint8_t rbits) {
+  uint64_t h = 0;
+  for (uint8_t i = 0; i < 6; i++) {
+    h = (h << 8) | mac[i];
+  }
+  // splitmix64 finalizer spreads the OUI and NIC bytes over all fingerprint bits.
+  h += 0x9e3779b97f4a7c15ULL;
+  h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+  h ^= h >> 31;
+  uint8_t bits = qbits + rbits;
+  return bits >= 32 ? (uint32_t)h : (uint32_t)h & ((1UL << bits) - 1);
+}
+
+bool QuotientFilter::setGeometry(uint8_t qbits, uint8_t rbits, uint8_t *storage) {
+  // a slot (remainder and metadata) is handled as a uint32_t.
+  if (storage == NULL || qbits == 0 || qbits > 24 || rbits == 0 || rbits > 32 - QF_META_BITS ||
+      qbits + rbits > 32) {
+    return false;
+  }
+  _table = storage;
+  _qbits = qbits;
+  _rbits = rbits;
+  _slotBits = rbits + QF_META_BITS;
+  _slotMask = _slotBits >= 32 ? 0xffffffffUL : (1UL << _slotBits) - 1;
+  _remainderMask = (1UL << rbits) - 1;
+  _slots = 1UL << qbits;
+  _indexMask = _slots - 1;
+  // Keep some slots free: clusters grow quickly past ~94% load.
+  _maxEntries = _slots - (_slots >> 4);
+  if (_maxEntries == _slots) _maxEntries--;
+  return true;
+}
+
+bool QuotientFilter::begin(uint8_t qbits, uint8_t rbits, uint8_t *storage) {
+  if (!setGeometry(qbits, rbits, storage)) return false;
+  clear();
+  return true;
+}
+
+bool QuotientFilter::attach(uint8_t qbits, uint8_t rbits, uint8_t *storage) {
+  if (!setGeometry(qbits, rbits, storage)) return false;
+  _entries = 0;
+  for (uint32_t i = 0; i < _slots; i++) {
+    if (!isEmpty(getSlot(i))) _entries++;
+  }
+  return _entries <= _maxEntries;
+}
+
+void QuotientFilter::clear() {
+  if (_table != NULL) memset(_table, 0, tableBytes());
+  _entries = 0;
+}
+
+uint32_t QuotientFilter::getSlot(uint32_t i) const {
+  uint32_t bit = i * _slotBits;
+  const uint8_t *p = _table + (bit >> 3);
+  uint8_t shift = bit & 7;
+  uint8_t bytes = (shift + _slotBits + 7) >> 3;
+  uint64_t v = 0;
+  for (uint8_t k = 0; k < bytes; k++) {
+    v |= (uint64_t)p[k] << (8 * k);
+  }
+  return (uint32_t)(v >> shift) & _slotMask;
+}
+
+void QuotientFilter::setSlot(uint32_t i, uint32_t value) {
+  uint32_t bit = i * _slotBits;
+  uint8_t *p = _table + (bit >> 3);
+  uint8_t shift = bit & 7;
+  uint8_t bytes = (shift + _slotBits + 7) >> 3;
+  uint64_t v = 0;
+  for (uint8_t k = 0; k < bytes; k++) {
+    v |= (uint64_t)p[k] << (8 * k);
+  }
+  v &= ~((uint64_t)_slotMask << shift);
+  v |= (uint64_t)(value & _slotMask) << shift;
+  for (uint8_t k = 0; k < bytes; k++) {
+    p[k] = (uint8_t)(v >> (8 * k));
+  }
+}
+
+// Index of the first slot of the run belonging to quotient fq.
+uint32_t QuotientFilter::findRunIndex(uint32_t fq) const {
+  // Walk back to the start of the cluster.
+  uint32_t b = fq;
+  while (isShifted(getSlot(b))) {
+    b = decr(b);
+  }
+  // Walk forward run by run until the run of fq.
+  uint32_t s = b;
+  while (b != fq) {
+    do { s = incr(s); } while (isContinuation(getSlot(s)));
+    do { b = incr(b); } while (!isOccupied(getSlot(b)));
+  }
+  return s;
+}
+
+// Insert entry at slot s, shifting the rest of the cluster one slot forward.
+void QuotientFilter::insertInto(uint32_t s, uint32_t entry) {
+  uint32_t curr = entry;
+  bool empty;
+  do {
+    uint32_t prev = getSlot(s);
+    empty = isEmpty(prev);
+    if (!empty) {
+      // Occupied bits belong to the slot, everything else moves with the entry.
+      prev |= QF_SHIFTED;
+      if (isOccupied(prev)) {
+        curr |= QF_OCCUPIED;
+        prev &= ~QF_OCCUPIED;
+      }
+    }
+    setSlot(s, curr);
+    curr = prev;
+    s = incr(s);
+  } while (!empty);
+}
+
+bool QuotientFilter::insertFingerprint(uint32_t fingerprint) {
+  if (_table == NULL) return false;
+  uint32_t fq = (fingerprint >> _rbits) & _indexMask;
+  uint32_t fr = fingerprint & _remainderMask;
+  uint32_t tfq = getSlot(fq);
+  uint32_t entry = fr << QF_META_BITS;
+
+  if (isEmpty(tfq)) {
+    if (_entries >= _maxEntries) return false;
+    setSlot(fq, entry | QF_OCCUPIED);
+    _entries++;
+    return true;
+  }
+
+  uint32_t start;
+  uint32_t s;
+  if (isOccupied(tfq)) {
+    start = findRunIndex(fq);
+    s = start;
+    // Runs are sorted by remainder: find the insert position.
+    do {
+      uint32_t rem = remainderOf(getSlot(s));
+      if (rem == fr) return true;
+      if (rem > fr) break;
+      s = incr(s);
+    } while (isContinuation(getSlot(s)));
+    if (_entries >= _maxEntries) return false;
+    if (s == start) {
+      // The old head of the run becomes a continuation.
+      setSlot(start, getSlot(start) | QF_CONTINUATION);
+    } else {
+      entry |= QF_CONTINUATION;
+    }
+  } else {
+    if (_entries >= _maxEntries) return false;
+    setSlot(fq, tfq | QF_OCCUPIED);
+    start = findRunIndex(fq);
+    s = start;
+  }
+
+  if (s != fq) entry |= QF_SHIFTED;
+  insertInto(s, entry);
+  _entries++;
+  return true;
+}
+
+bool QuotientFilter::containsFingerprint(uint32_t fingerprint) const {
+  if (_table == NULL) return false;
+  uint32_t fq = (fingerprint >> _rbits) & _indexMask;
+  uint32_t fr = fingerprint & _remainderMask;
+  if (!isOccupied(getSlot(fq))) return false;
+
+  uint32_t s = findRunIndex(fq);
+  do {
+    uint32_t rem = remainderOf(getSlot(s));
+    if (rem == fr) return true;
+    if (rem > fr) return false;
+    s = incr(s);
+  } while (isContinuation(getSlot(s)));
+  return false;
+}
+
+// Remove the entry at slot s and shift the rest of the cluster back.
+void QuotientFilter::deleteEntry(uint32_t s, uint32_t quot) {
+  uint32_t curr = getSlot(s);
+  uint32_t sp = incr(s);
+  uint32_t orig = s;
+
+  while (true) {
+    uint32_t next = getSlot(sp);
+    bool currOccupied = isOccupied(curr);
+
+    if (isEmpty(next) || isClusterStart(next) || sp == orig) {
+      setSlot(s, 0);
+      return;
+    }
+
+    // Entries which slide back into their canonical slot are no longer shifted.
+    uint32_t updated = next;
+    if (isRunStart(next)) {
+      do { quot = incr(quot); } while (!isOccupied(getSlot(quot)));
+      if (currOccupied && quot == s) updated &= ~QF_SHIFTED;
+    }
+    setSlot(s, currOccupied ? (updated | QF_OCCUPIED) : (updated & ~QF_OCCUPIED));
+    s = sp;
+    sp = incr(sp);
+    curr = next;
+  }
+}
+
+bool QuotientFilter::removeFingerprint(uint32_t fingerprint) {
+  if (_table == NULL || _entries == 0) return false;
+  uint32_t fq = (fingerprint >> _rbits) & _indexMask;
+  uint32_t fr = fingerprint & _remainderMask;
+  uint32_t tfq = getSlot(fq);
+  if (!isOccupied(tfq)) return false;
+
+  uint32_t s = findRunIndex(fq);
+  uint32_t rem;
+  do {
+    rem = remainderOf(getSlot(s));
+    if (rem >= fr) break;
+    s = incr(s);
+  } while (isContinuation(getSlot(s)));
+  if (rem != fr) return false;
+
+  uint32_t kill = (s == fq) ? tfq : getSlot(s);
+  bool replaceRunStart = isRunStart(kill);
+
+  // Deleting the last entry of a run clears the occupied bit of its quotient.
+  if (replaceRunStart && !isContinuation(getSlot(incr(s)))) {
+    setSlot(fq, getSlot(fq) & ~QF_OCCUPIED);
+  }
+
+  deleteEntry(s, fq);
+
+  if (replaceRunStart) {
+    uint32_t next = getSlot(s);
+    uint32_t updated = next & ~QF_CONTINUATION;
+    if (s == fq && isRunStart(updated)) updated &= ~QF_SHIFTED;
+    if (updated != next) setSlot(s, updated);
+  }
+
+  _entries--;
+  return true;
+}
+
+bool QuotientFilter::insert(const uint8_t *mac) {
+  return insertFingerprint(fingerprintMAC(mac));
+}
+
+bool QuotientFilter::contains(const uint8_t *mac) const {
+  return containsFingerprint(fingerprintMAC(mac));
+}
+
+bool QuotientFilter::remove(const uint8_t *mac) {
+  return removeFingerprint(fingerprintMAC(mac));
+}
+
+bool QuotientFilter::merge(const QuotientFilter &other) {
+  if (other._qbits != _qbits || other._rbits != _rbits) return false;
+  Iterator it(other);
+  uint32_t fingerprint;
+  while (it.next(fingerprint)) {
+    if (!insertFingerprint(fingerprint)) return false;
+  }
+  return true;
+}
+
+QuotientFilter::Iterator::Iterator(const QuotientFilter &filter)
+  : _filter(filter), _index(0), _quotient(0), _visited(0) {
+  // Start from the first cluster start so run quotients can be tracked.
+  if (filter._entries == 0) return;
+  while (_index < filter._slots && !isClusterStart(filter.getSlot(_index))) {
+    _index++;
+  }
+}
+
+bool QuotientFilter::Iterator::next(uint32_t &fingerprint) {
+  while (_visited < _filter._entries) {
+    uint32_t e = _filter.getSlot(_index);
+    if (isClusterStart(e)) {
+      _quotient = _index;
+    } else if (isRunStart(e)) {
+      do {
+        _quotient = _filter.incr(_quotient);
+      } while (!isOccupied(_filter.getSlot(_quotient)));
+    }
+    _index = _filter.incr(_index);
+    if (!isEmpty(e)) {
+      _visited++;
+      fingerprint = (_quotient << _filter._rbits) | remainderOf(e);
+      return true;
+    }
+  }
+  return false;
+}
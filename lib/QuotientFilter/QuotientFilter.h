@@ -0,0 +1,89 @@
+/**
+* Quotient filter for 48-bit MAC addresses.
+* Approximate set membership with insert, query, delete and merge. Each slot
+* holds a remainder of QF remainder bits plus 3 metadata bits, packed back to
+* back in a caller supplied table, so a filter with 2^q slots and r remainder
+* bits costs (2^q * (r + 3) + 7) / 8 bytes. False positive rate is roughly
+* load / 2^r.
+* The table layout is also the export format: a filter attached to a received
+* table (see attach()) can be queried or merged into another filter directly.
+* Based on Bender et al. "Don't Thrash: How to Cache Your Hash on Flash".
+*/
+
+#ifndef QUOTIENT_FILTER_H
+#define QUOTIENT_FILTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+class QuotientFilter {
+public:
+  // Walks fingerprints of a filter in ascending quotient order.
+  class Iterator {
+  public:
+    explicit Iterator(const QuotientFilter &filter);
+    bool next(uint32_t &fingerprint);
+  private:
+    const QuotientFilter &_filter;
+    uint32_t _index;
+    uint32_t _quotient;
+    uint32_t _visited;
+  };
+
+  QuotientFilter();
+
+  // Bytes of table storage needed for 2^qbits slots of rbits remainders.
+  static size_t storageBytes(uint8_t qbits, uint8_t rbits);
+  // Fingerprint of a 6-byte MAC address for a filter of given geometry.
+  static uint32_t fingerprintMAC(const uint8_t *mac, uint8_t qbits, uint8_t rbits);
+
+  // Initialize an empty filter on top of storage (storageBytes() long).
+  // False unless qbits is 1..24, rbits 1..29 and both together at most 32.
+  bool begin(uint8_t qbits, uint8_t rbits, uint8_t *storage);
+  // Use an existing table, eg. one received from another sensor.
+  bool attach(uint8_t qbits, uint8_t rbits, uint8_t *storage);
+  void clear();
+
+  bool insert(const uint8_t *mac);
+  bool contains(const uint8_t *mac) const;
+  bool remove(const uint8_t *mac);
+
+  bool insertFingerprint(uint32_t fingerprint);
+  bool containsFingerprint(uint32_t fingerprint) const;
+  bool removeFingerprint(uint32_t fingerprint);
+
+  // Adds every fingerprint of other. Both filters must have the same geometry.
+  bool merge(const QuotientFilter &other);
+
+  uint32_t fingerprintMAC(const uint8_t *mac) const { return fingerprintMAC(mac, _qbits, _rbits); }
+  uint32_t count() const { return _entries; }
+  uint32_t capacity() const { return _maxEntries; }
+  uint32_t slots() const { return _slots; }
+  uint8_t qbits() const { return _qbits; }
+  uint8_t rbits() const { return _rbits; }
+  const uint8_t *table() const { return _table; }
+  size_t tableBytes() const { return storageBytes(_qbits, _rbits); }
+
+private:
+  uint32_t getSlot(uint32_t i) const;
+  void setSlot(uint32_t i, uint32_t value);
+  uint32_t incr(uint32_t i) const { return (i + 1) & _indexMask; }
+  uint32_t decr(uint32_t i) const { return (i - 1) & _indexMask; }
+  uint32_t findRunIndex(uint32_t fq) const;
+  void insertInto(uint32_t s, uint32_t entry);
+  void deleteEntry(uint32_t s, uint32_t fq);
+  bool setGeometry(uint8_t qbits, uint8_t rbits, uint8_t *storage);
+
+  uint8_t *_table;
+  uint8_t _qbits;
+  uint8_t _rbits;
+  uint8_t _slotBits;
+  uint32_t _slotMask;
+  uint32_t _indexMask;
+  uint32_t _remainderMask;
+  uint32_t _slots;
+  uint32_t _entries;
+  uint32_t _maxEntries;
+};
+
+#endif
@@ -0,0 +1,235 @@
+#include "SensorLink.h"
+
+#include <string.h>
+
+#define LINK_RX_MAX_BYTES_PER_POLL 512
+
+// CRC-16/CCITT-FALSE, a nibble at a time: 32 bytes of table instead of 512.
+static const uint16_t crcNibble[16] = {
+  0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+  0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
+};
+
+uint16_t linkCrc16(uint16_t crc, const uint8_t *data, size_t len) {
+  while (len--) {
+    uint8_t b = *data++;
+    crc = (crc << 4) ^ crcNibble[(crc >> 12) ^ (b >> 4)];
+    crc = (crc << 4) ^ crcNibble[(crc >> 12) ^ (b & 0x0f)];
+  }
+  return crc;
+}
+
+static void putLE32(uint8_t *p, uint32_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
+
+static uint32_t getLE32(const uint8_t *p) {
+  return p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+SensorLink::SensorLink(LinkPort &port)
+  : _port(port), _handler(NULL), _handlerCtx(NULL), _maxBaud(0),
+    _tx(NULL), _txSize(0), _txHead(0), _txTail(0), _txSeq(0),
+    _rx(NULL), _rxSize(0), _rxPos(0), _rxLength(0), _rxSeqValid(false), _rxSeq(0),
+    _pendingBaud(0), _previousBaud(0), _switchedAt(0), _awaitingPing(false),
+    _lastControl(0), _lastControlValue(0) {
+  memset(&_stats, 0, sizeof(_stats));
+}
+
+bool SensorLink::begin(Arena &arena, uint16_t txBufferSize, uint16_t maxRxPayload, uint32_t baud, uint32_t maxBaud) {
+  _tx = arena.allocateArray<uint8_t>("link tx", txBufferSize);
+  _rx = arena.allocateArray<uint8_t>("link rx", maxRxPayload + LINK_OVERHEAD);
+  _txSize = txBufferSize;
+  _rxSize = maxRxPayload + LINK_OVERHEAD;
+  _stats.baud = baud;
+  _maxBaud = maxBaud;
+  return _tx != NULL && _rx != NULL;
+}
+
+void SensorLink::onFrame(LinkFrameHandler handler, void *ctx) {
+  _handler = handler;
+  _handlerCtx = ctx;
+}
+
+uint16_t SensorLink::txRoom() const {
+  // One byte stays free to tell a full ring from an empty one.
+  uint16_t used = (uint16_t)(_txHead + _txSize - _txTail) % _txSize;
+  uint16_t room = _txSize - 1 - used;
+  return room > LINK_OVERHEAD ? room - LINK_OVERHEAD : 0;
+}
+
+void SensorLink::txPut(const uint8_t *data, uint16_t len) {
+  while (len > 0) {
+    uint16_t chunk = _txSize - _txHead;
+    if (chunk > len) chunk = len;
+    memcpy(_tx + _txHead, data, chunk);
+    _txHead = (_txHead + chunk) % _txSize;
+    data += chunk;
+    len -= chunk;
+  }
+}
+
+bool SensorLink::send(uint8_t type, const uint8_t *payload, uint16_t length) {
+  if (_tx == NULL || length > txRoom()) {
+    _stats.txDropped++;
+    return false;
+  }
+  uint8_t header[LINK_HEADER_LENGTH] = {
+    LINK_SYNC0, LINK_SYNC1, type, _txSeq++, (uint8_t)(length & 0xff), (uint8_t)(length >> 8)
+  };
+  uint16_t crc = linkCrc16(0xffff, header + 2, LINK_HEADER_LENGTH - 2);
+  crc = linkCrc16(crc, payload, length);
+  uint8_t trailer[LINK_CRC_LENGTH] = { (uint8_t)(crc & 0xff), (uint8_t)(crc >> 8) };
+  txPut(header, sizeof(header));
+  txPut(payload, length);
+  txPut(trailer, sizeof(trailer));
+  _stats.txFrames++;
+  return true;
+}
+
+void SensorLink::decode(uint8_t b) {
+  if (_rxPos == 0) {
+    if (b == LINK_SYNC0) _rx[_rxPos++] = b;
+    else _stats.rxResyncBytes++;
+    return;
+  }
+  if (_rxPos == 1) {
+    if (b == LINK_SYNC1) {
+      _rx[_rxPos++] = b;
+    } else {
+      _stats.rxResyncBytes++;
+      _rxPos = 0;
+      decode(b);
+    }
+    return;
+  }
+
+  _rx[_rxPos++] = b;
+  if (_rxPos == LINK_HEADER_LENGTH) {
+    _rxLength = _rx[4] | (_rx[5] << 8);
+    if (_rxLength + LINK_OVERHEAD > _rxSize) {
+      _stats.rxOversize++;
+      _rxPos = 0;
+    }
+    return;
+  }
+  if (_rxPos < LINK_OVERHEAD + _rxLength) return;
+
+  _rxPos = 0;
+  uint16_t crc = linkCrc16(0xffff, _rx + 2, LINK_HEADER_LENGTH - 2 + _rxLength);
+  uint16_t received = _rx[LINK_HEADER_LENGTH + _rxLength] | (_rx[LINK_HEADER_LENGTH + _rxLength + 1] << 8);
+  if (crc != received) {
+    _stats.rxCrcErrors++;
+    return;
+  }
+  uint8_t seq = _rx[3];
+  if (_rxSeqValid) _stats.rxLost += (uint8_t)(seq - _rxSeq - 1);
+  _rxSeq = seq;
+  _rxSeqValid = true;
+  _stats.rxFrames++;
+  handleFrame(_rx[2], _rx + LINK_HEADER_LENGTH, _rxLength);
+}
+
+void SensorLink::handleFrame(uint8_t type, const uint8_t *payload, uint16_t length) {
+  uint8_t reply[4];
+  switch (type) {
+    case LINK_PING:
+      _awaitingPing = false;
+      send(LINK_PONG, payload, length);
+      return;
+    case LINK_BAUD_REQUEST:
+      if (length < 4) return;
+      {
+        uint32_t baud = getLE32(payload);
+        bool ok = baud >= 9600 && baud <= _maxBaud;
+        putLE32(reply, ok ? baud : 0);
+        send(LINK_BAUD_ACK, reply, sizeof(reply));
+        if (ok && baud != _stats.baud) _pendingBaud = baud;
+      }
+      return;
+    case LINK_PONG:
+    case LINK_BAUD_ACK:
+      _lastControl = type;
+      _lastControlValue = length >= 4 ? getLE32(payload) : 0;
+      return;
+  }
+  if (_handler != NULL) _handler(_handlerCtx, type, payload, length);
+}
+
+void SensorLink::checkBaudConfirm() {
+  uint32_t now = _port.millis();
+  if (_pendingBaud != 0 && _txHead == _txTail && _port.txIdle()) {
+    _previousBaud = _stats.baud;
+    _port.setBaud(_pendingBaud);
+    _stats.baud = _pendingBaud;
+    _pendingBaud = 0;
+    _awaitingPing = true;
+    _switchedAt = now;
+  }
+  if (_awaitingPing && now - _switchedAt > LINK_BAUD_CONFIRM_MS) {
+    _awaitingPing = false;
+    _port.setBaud(_previousBaud);
+    _stats.baud = _previousBaud;
+  }
+}
+
+bool SensorLink::poll(uint32_t budgetUs) {
+  if (_tx == NULL) return false;
+  uint32_t start = _port.millis();
+
+  while (_txTail != _txHead) {
+    uint16_t chunk = _txHead > _txTail ? _txHead - _txTail : _txSize - _txTail;
+    size_t n = _port.write(_tx + _txTail, chunk);
+    if (n == 0) break;
+    _stats.txBytes += n;
+    _txTail = (_txTail + n) % _txSize;
+  }
+
+  for (uint16_t i = 0; i < LINK_RX_MAX_BYTES_PER_POLL; i++) {
+    int b = _port.read();
+    if (b < 0) break;
+    _stats.rxBytes++;
+    decode((uint8_t)b);
+    if ((_port.millis() - start) * 1000 > budgetUs) break;
+  }
+
+  checkBaudConfirm();
+  return _txTail != _txHead;
+}
+
+bool SensorLink::negotiateBaud(uint32_t baud, uint32_t timeoutMs) {
+  uint8_t payload[4];
+  putLE32(payload, baud);
+  _lastControl = 0;
+  if (!send(LINK_BAUD_REQUEST, payload, sizeof(payload))) return false;
+  uint32_t start = _port.millis();
+  while (_lastControl != LINK_BAUD_ACK && _port.millis() - start < timeoutMs) {
+    poll(1000);
+  }
+  if (_lastControl != LINK_BAUD_ACK || _lastControlValue != baud) return false;
+
+  while (poll(1000) || !_port.txIdle()) {
+  }
+  uint32_t previous = _stats.baud;
+  _port.setBaud(baud);
+  _stats.baud = baud;
+
+  // The sensor switches once its ack is out; ping until it answers at the new rate.
+  _lastControl = 0;
+  start = _port.millis();
+  while (_port.millis() - start < timeoutMs) {
+    putLE32(payload, start);
+    send(LINK_PING, payload, sizeof(payload));
+    uint32_t sent = _port.millis();
+    while (_lastControl != LINK_PONG && _port.millis() - sent < 50) {
+      poll(1000);
+    }
+    if (_lastControl == LINK_PONG) return true;
+  }
+  _port.setBaud(previous);
+  _stats.baud = previous;
+  return false;
+}
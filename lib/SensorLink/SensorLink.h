@@ -0,0 +1,131 @@
+/**
+* Framed binary link between the sensor and the host.
+* Frame: 0xA5 0x5A, type, sequence number, payload length (16 bit), payload,
+* CRC-16/CCITT over type..payload. Multi-byte fields are little endian.
+* Each direction numbers its frames so the receiver counts lost frames; bad
+* CRCs and bytes skipped while resyncing are counted too.
+* Transmit goes through a ring so several producers can queue whole frames
+* without interleaving, poll() moves bytes to the port without blocking.
+* Link speed is negotiated: the host asks for a baud rate, the sensor acks,
+* both switch and the host confirms with a ping. A sensor that hears no ping
+* in LINK_BAUD_CONFIRM_MS falls back to its previous rate.
+* The same class runs on the sensor and on the host.
+*/
+
+#ifndef SENSOR_LINK_H
+#define SENSOR_LINK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <Arena.h>
+
+#define LINK_SYNC0            0xA5
+#define LINK_SYNC1            0x5A
+#define LINK_HEADER_LENGTH    6
+#define LINK_CRC_LENGTH       2
+#define LINK_OVERHEAD         (LINK_HEADER_LENGTH + LINK_CRC_LENGTH)
+
+#define LINK_BAUD_CONFIRM_MS  500
+#define LINK_DEFAULT_BAUD     115200
+
+// Link control frames. Application frames use types below 0x10.
+#define LINK_PING             0x10    // any payload, echoed in LINK_PONG
+#define LINK_PONG             0x11
+#define LINK_BAUD_REQUEST     0x12    // uint32 baud
+#define LINK_BAUD_ACK         0x13    // uint32 baud, 0 if refused
+#define LINK_STATS            0x14    // LinkStats of the sender
+
+// Byte transport under the link: a UART on the board, a tty or pipe on the host.
+class LinkPort {
+public:
+  virtual ~LinkPort() {}
+  // Non-blocking, returns the bytes taken.
+  virtual size_t write(const uint8_t *data, size_t len) = 0;
+  // Next received byte or -1.
+  virtual int read() = 0;
+  // True when everything written has left the wire.
+  virtual bool txIdle() = 0;
+  virtual void setBaud(uint32_t baud) = 0;
+  virtual uint32_t millis() = 0;
+};
+
+struct LinkStats {
+  uint32_t txFrames;
+  uint32_t txBytes;
+  uint32_t txDropped;       // frames that didn't fit the transmit ring
+  uint32_t rxFrames;
+  uint32_t rxBytes;
+  uint32_t rxCrcErrors;
+  uint32_t rxLost;          // gaps in the peer's sequence numbers
+  uint32_t rxResyncBytes;   // bytes skipped looking for a frame start
+  uint32_t rxOversize;      // frames longer than the receive buffer
+  uint32_t baud;
+};
+
+typedef void (*LinkFrameHandler)(void *ctx, uint8_t type, const uint8_t *payload, uint16_t length);
+
+uint16_t linkCrc16(uint16_t crc, const uint8_t *data, size_t len);
+
+class SensorLink {
+public:
+  explicit SensorLink(LinkPort &port);
+
+  // Ring for queued frames and a buffer for the largest frame received.
+  bool begin(Arena &arena, uint16_t txBufferSize, uint16_t maxRxPayload, uint32_t baud, uint32_t maxBaud);
+  // Called for every good frame that isn't link control.
+  void onFrame(LinkFrameHandler handler, void *ctx);
+
+  // Largest payload send() accepts right now.
+  uint16_t txRoom() const;
+  // Queues a whole frame, or drops it (counted) when the ring is full.
+  bool send(uint8_t type, const uint8_t *payload, uint16_t length);
+
+  // Writes queued bytes and decodes received ones for up to budgetUs
+  // (measured in port milliseconds, so at least one pass). True while
+  // transmit bytes are pending.
+  bool poll(uint32_t budgetUs);
+
+  // Host side: asks the sensor for baud, switching both ends on success.
+  // Blocks, polling the port, for up to timeoutMs per step.
+  bool negotiateBaud(uint32_t baud, uint32_t timeoutMs);
+
+  const LinkStats &stats() const { return _stats; }
+  // A good frame has come from the peer: on the sensor, the host has opened the link.
+  bool opened() const { return _rxSeqValid; }
+  uint32_t baud() const { return _stats.baud; }
+
+private:
+  void decode(uint8_t b);
+  void handleFrame(uint8_t type, const uint8_t *payload, uint16_t length);
+  void txPut(const uint8_t *data, uint16_t len);
+  void checkBaudConfirm();
+
+  LinkPort &_port;
+  LinkFrameHandler _handler;
+  void *_handlerCtx;
+  LinkStats _stats;
+  uint32_t _maxBaud;
+
+  uint8_t *_tx;
+  uint16_t _txSize;
+  uint16_t _txHead;
+  uint16_t _txTail;
+  uint8_t _txSeq;
+
+  uint8_t *_rx;
+  uint16_t _rxSize;
+  uint16_t _rxPos;
+  uint16_t _rxLength;
+  bool _rxSeqValid;
+  uint8_t _rxSeq;
+
+  // Baud negotiation state.
+  uint32_t _pendingBaud;     // sensor: switch after the ack is out
+  uint32_t _previousBaud;    // sensor: fallback until the host pings
+  uint32_t _switchedAt;
+  bool _awaitingPing;
+  uint8_t _lastControl;      // host: last control frame seen
+  uint32_t _lastControlValue;
+};
+
+#endif
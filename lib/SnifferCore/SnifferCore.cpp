@@ -0,0 +1,596 @@
+#include "SnifferCore.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+// Stale sweep tracker slots looked at per tick().
+#define SWEEP_CLEAN_SLOTS 64
+
+SnifferCore::SnifferCore(SnifferHal &hal, const SnifferConfig &config)
+  : _hal(hal), _config(config), _clientCount(0), _macs(NULL), _macWindow(NULL), _macWindowHead(0),
+    _link(NULL), _digestStatsPending(false),
+    _rulesSource(NULL), _rulesSourceSize(0), _rulesSourceLength(0), _rulesSourceBroken(true),
+    _sweepStartMs(0), _hopWaiting(false), _hopDueMs(0), _lastFrameUs(0), _switchedUs(0), _gapOpen(false),
+    _deadUs(0), _dwellFrames(0), _talkerFrame(NULL), _talkerFrameLength(0), _talkerFramePending(false) {
+  memset(_digestCounters, 0, sizeof(_digestCounters));
+  memset(&_hopStats, 0, sizeof(_hopStats));
+}
+
+bool SnifferCore::begin(Arena &arena) {
+  _surge.begin(_config.surge, _hal.millis());
+  if (_config.watchlistSize > 0 && !_watchlist.begin(arena, _config.watchlistSize)) return false;
+  if (_config.rulesMaxInsns > 0) {
+    if (!_rules.begin(arena, _config.rulesMaxInsns, _config.rulesMaxOuis)) return false;
+    if (_config.rulesMaxSource > 0) {
+      _rulesSource = arena.allocateArray<char>("rules source", _config.rulesMaxSource);
+      if (_rulesSource == NULL) return false;
+      _rulesSourceSize = _config.rulesMaxSource;
+    }
+    if (_config.rules && _config.rules[0]) loadRules(_config.rules, strlen(_config.rules));
+  }
+  _sweepStartMs = _hal.millis();
+  if (_config.sampleFrames > 0 &&
+      !_samples.begin(arena, _config.sampleFrames, _config.sweepSetSalt ^ _hal.micros())) return false;
+  if (_config.talkerSlots > 0) {
+    // words: the Talker records after the 12 byte head are written through a Talker *.
+    _talkerFrame = (uint8_t *)arena.allocateArray<uint32_t>("talker report",
+      3 + _config.talkerReport * sizeof(Talker) / 4);
+    if (_talkerFrame == NULL || !_talkers.begin(arena, _config.talkerSlots)) return false;
+  }
+  if (_config.thinSensor) {
+    return _digests.begin(arena, _config.digestQueueSize);
+  }
+  if (_config.sweepTrackerSlots > 0 && !_sweeps.begin(arena, _config.sweepTrackerSlots)) return false;
+  if (_config.sweepTrackerSlots > 0 && _config.sweepSetSize > 0 &&
+      !_sweepSet.begin(arena, _config.sweepSetSize, _config.sweepSetSalt)) return false;
+  if (_config.dedupQuotientFilter) {
+    if (_config.qfWindowSize > (1UL << _config.qfQuotientBits) * 15 / 16) return false;
+    uint8_t *table = arena.allocateArray<uint8_t>("qf table",
+      QuotientFilter::storageBytes(_config.qfQuotientBits, _config.qfRemainderBits));
+    _macWindow = arena.allocateArray<uint32_t>("qf window", _config.qfWindowSize);
+    return table != NULL && _macWindow != NULL &&
+      _macFilter.begin(_config.qfQuotientBits, _config.qfRemainderBits, table);
+  }
+  _macs = arena.allocateArray<char[18]>("macs", _config.bufferSize);
+  return _macs != NULL;
+}
+
+static void getMAC(char *addr, uint8_t* data, uint16_t offset) {
+  sprintf(addr, "%02x:%02x:%02x:%02x:%02x:%02x", data[offset+0], data[offset+1], data[offset+2], data[offset+3], data[offset+4], data[offset+5]);
+}
+
+static bool isLocalMAC(uint8_t* data) {
+  uint8_t local = (data[10] & 0b00000010) >> 1;
+  if (local) return true;
+  return false;
+}
+
+// MAC buffer functions. These administer the local buffer so that each addresses
+// is taken into account only once.
+bool SnifferCore::bufferCheckMAC(char newmac[]){
+  for (int i=0;i<_clientCount;i++) {
+    if (strcmp(newmac, _macs[i]) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void SnifferCore::bufferRollBack() {
+  if (_clientCount >= _config.bufferSize) {
+    _hal.println("Buffer rollback.");
+    for (int i=1; i<_clientCount; i++) {
+      strcpy(_macs[i-1], _macs[i]);
+    }
+    _clientCount--;
+  }
+}
+
+void SnifferCore::bufferAdd(char newmac[]) {
+  bufferRollBack();
+  strcpy(_macs[_clientCount++],newmac);
+}
+
+void SnifferCore::bufferReset() {
+  _hal.println("Resetting buffer.");
+  for (int i=0; i<_clientCount; i++) {
+    strcpy(_macs[i], "");
+  }
+  _clientCount = 0;
+}
+
+// Quotient filter dedup. Fingerprints are also kept in arrival order so the
+// oldest MAC can be deleted from the filter when the window is full.
+bool SnifferCore::filterCheckMAC(uint8_t* mac) {
+  return _macFilter.contains(mac);
+}
+
+void SnifferCore::filterAdd(uint8_t* mac) {
+  if (_clientCount >= _config.qfWindowSize) {
+    _hal.println("Filter rollback.");
+    _macFilter.removeFingerprint(_macWindow[_macWindowHead]);
+    _macWindowHead = (_macWindowHead + 1) % _config.qfWindowSize;
+    _clientCount--;
+  }
+  uint32_t fingerprint = _macFilter.fingerprintMAC(mac);
+  _macFilter.insertFingerprint(fingerprint);
+  _macWindow[(_macWindowHead + _clientCount++) % _config.qfWindowSize] = fingerprint;
+}
+
+void SnifferCore::filterReset() {
+  _macFilter.clear();
+  _macWindowHead = 0;
+  _clientCount = 0;
+}
+
+void SnifferCore::showMetadata(SnifferPacket *snifferPacket) {
+
+  if (_rules.active()) {
+    if (!rulesAccept(snifferPacket)) return;
+  } else {
+    unsigned int frameControl = ((unsigned int)snifferPacket->data[1] << 8) + snifferPacket->data[0];
+
+    uint8_t frameType    = (frameControl & 0b0000000000001100) >> 2;
+    uint8_t frameSubType = (frameControl & 0b0000000011110000) >> 4;
+
+    // Only look for probe request packets
+    if (frameType != TYPE_MANAGEMENT ||
+        frameSubType != SUBTYPE_PROBE_REQUEST)
+          return;
+
+    if (isLocalMAC(snifferPacket->data) && _config.ignoreLocalMacs) return;
+  }
+
+  uint8_t watch = _watchlist.lookup(snifferPacket->data + 10);
+  if (watch & WATCH_EXCLUDE) return;
+  sampleFrame(snifferPacket);
+
+  // every frame: the dedup buffer may still hold devices of earlier sweeps.
+  if (_config.sweepTrackerSlots && _sweeps.observe(snifferPacket->data + 10)) {
+    _sweepSet.add(snifferPacket->data + 10);
+  }
+
+  char addr[] = "00:00:00:00:00:00";
+  getMAC(addr, snifferPacket->data, 10);
+  RxControl rxControl = snifferPacket->rx_ctrl;
+
+  bool seen;
+  uint8_t* mac = snifferPacket->data + 10;
+  if (_config.dedupQuotientFilter) {
+    seen = filterCheckMAC(mac);
+    if (!seen) filterAdd(mac);
+  } else {
+    seen = bufferCheckMAC(addr);
+    if (!seen) bufferAdd(addr);
+  }
+
+  if (!seen) {
+    char msg [60];
+    sprintf(msg, "MAC: %s RSSI: %d Ch: %d cnt: %d%s", addr, rxControl.rssi, rxControl.channel, _clientCount,
+      (watch & WATCH_FLAG) ? " watched" : "");
+    _hal.println(msg);
+    if (_config.spiSendAddresses) _hal.spiSetData(addr);
+    if (_config.surgeDetect && _surge.newDevice(_hal.millis())) surgeAlert();
+  }
+}
+
+void SnifferCore::surgeAlert() {
+  const SurgeAlert &alert = _surge.lastAlert();
+  unsigned baseline = (unsigned)(alert.baseline * 10 + 0.5f);
+  unsigned cusum = (unsigned)(alert.cusum * 10 + 0.5f);
+  char msg [80];
+  sprintf(msg, "Surge alert: %u new/s baseline %u.%u/s cusum %u.%u",
+    alert.rate, baseline / 10, baseline % 10, cusum / 10, cusum % 10);
+  _hal.println(msg);
+}
+
+void SnifferCore::tick() {
+  // static mode has no sweeps, use the time one would take.
+  bool sweepDone = _config.staticMode && _hal.millis() - _sweepStartMs >= 14 * _config.hopIntervalMs;
+  if (_config.thinSensor) {
+    if (sweepDone) {
+      _sweepStartMs = _hal.millis();
+      endSweepReports();
+    }
+    return;
+  }
+  if (_config.surgeDetect && _surge.tick(_hal.millis())) surgeAlert();
+  if (_config.sweepTrackerSlots) _sweeps.clean(SWEEP_CLEAN_SLOTS);
+  if (sweepDone) endSweep();
+}
+
+// What ends with a sweep in thin-sensor mode too.
+void SnifferCore::endSweepReports() {
+  reportTalkers();
+  _samples.close();
+}
+
+bool SnifferCore::exportSamples() {
+  if (_link == NULL) return false;
+  return _samples.exportNext(*_link);
+}
+
+void SnifferCore::endSweep() {
+  _sweepStartMs = _hal.millis();
+  endSweepReports();
+  if (!_config.sweepTrackerSlots) return;
+  const SweepCounts &c = _sweeps.endSweep();
+  char msg [80];
+  sprintf(msg, "Sweep %u: new %u returning %u departed %u", (unsigned)c.sweep, c.newDevices, c.returning, c.departed);
+  if (c.untracked) sprintf(msg + strlen(msg), " untracked %u", c.untracked);
+  _hal.println(msg);
+  _sweepSet.close(c.sweep, c.untracked);
+}
+
+bool SnifferCore::exportSweepSet() {
+  if (_link == NULL) return false;
+  return _sweepSet.exportNext(*_link);
+}
+
+// Thin-sensor mode: every accepted probe becomes a digest, the host dedups.
+void SnifferCore::thinSensorPacket(SnifferPacket *snifferPacket) {
+  if (_rules.active()) {
+    if (!rulesAccept(snifferPacket)) {
+      _digestCounters[DIGEST_FILTER_RULES]++;
+      return;
+    }
+  } else {
+    uint8_t frameType    = (snifferPacket->data[0] & 0b00001100) >> 2;
+    uint8_t frameSubType = (snifferPacket->data[0] & 0b11110000) >> 4;
+    if (frameType != TYPE_MANAGEMENT || frameSubType != SUBTYPE_PROBE_REQUEST) {
+      _digestCounters[DIGEST_FILTER_NOT_PROBE]++;
+      return;
+    }
+    if (isLocalMAC(snifferPacket->data) && _config.ignoreLocalMacs) {
+      _digestCounters[DIGEST_FILTER_LOCAL_MAC]++;
+      return;
+    }
+  }
+  uint8_t watch = _watchlist.lookup(snifferPacket->data + 10);
+  if (watch & WATCH_EXCLUDE) {
+    _digestCounters[DIGEST_FILTER_WATCH_EXCLUDE]++;
+    return;
+  }
+  sampleFrame(snifferPacket);
+
+  uint16_t captured = snifferPacket->len < DATA_LENGTH ? snifferPacket->len : DATA_LENGTH;
+  FrameDigest digest;
+  if (!makeDigest(snifferPacket->data, captured, snifferPacket->rx_ctrl.rssi,
+                  snifferPacket->rx_ctrl.channel, _hal.millis(), digest)) {
+    _digestCounters[DIGEST_FILTER_SHORT]++;
+    return;
+  }
+  if (watch & WATCH_FLAG) digest.channelFlags |= DIGEST_FLAG_WATCHED;
+  _digestCounters[DIGEST_ACCEPTED]++;
+  if (!_digests.push(digest)) _digestCounters[DIGEST_DROP_QUEUE_FULL]++;
+}
+
+void SnifferCore::handlePacket(uint8_t *buffer, uint16_t length) {
+  (void)length;
+  uint32_t nowUs = _hal.micros();
+  if (_gapOpen) {
+    _gapOpen = false;
+    _deadUs = nowUs - _switchedUs;
+    uint32_t gapMs = (nowUs - _lastFrameUs) / 1000;
+    _hopStats.gaps++;
+    _hopStats.gapMsTotal += gapMs;
+    if (gapMs > _hopStats.gapMsMax) _hopStats.gapMsMax = gapMs;
+  }
+  _lastFrameUs = nowUs;
+  _dwellFrames++;
+  if (_hopWaiting) _hopStats.framesSaved++;
+  if (length != sizeof(SnifferPacket)) {
+    if (length >= sizeof(SnifferDataPacket)) dataPacket((SnifferDataPacket *)buffer, length);
+    if (_config.thinSensor) _digestCounters[DIGEST_FILTER_NOT_PROBE]++;
+    return;
+  }
+  struct SnifferPacket *snifferPacket = (struct SnifferPacket*) buffer;
+  // captures hand data frames over whole.
+  if (_config.talkerSlots && (snifferPacket->data[0] & 0b00001100) >> 2 == TYPE_DATA) {
+    countTalker(snifferPacket->data, snifferPacket->rx_ctrl, 1, snifferPacket->len);
+  }
+  if (_config.thinSensor) thinSensorPacket(snifferPacket);
+  else showMetadata(snifferPacket);
+}
+
+void SnifferCore::sampleFrame(SnifferPacket *snifferPacket) {
+  uint16_t captured = snifferPacket->len < DATA_LENGTH ? snifferPacket->len : DATA_LENGTH;
+  _samples.offer(_hal.millis(), snifferPacket->data, captured, snifferPacket->len, snifferPacket->rx_ctrl.channel,
+                 snifferPacket->rx_ctrl.rssi);
+}
+
+void SnifferCore::dataPacket(SnifferDataPacket *dataPacket, uint16_t length) {
+  if (!_config.talkerSlots) return;
+  uint16_t records = (length - offsetof(SnifferDataPacket, lenseq)) / sizeof(LenSeq);
+  uint16_t frames = dataPacket->cnt == 0 ? 1 : dataPacket->cnt;
+  if (frames > records) frames = records;
+  const LenSeq *lenseq = dataPacket->lenseq;
+  uint32_t bytes = 0;
+  for (uint16_t i = 0; i < frames; i++) bytes += lenseq[i].length;
+  countTalker(dataPacket->data, dataPacket->rx_ctrl, frames, bytes);
+}
+
+// Stations only: frames from the distribution system are the AP sending.
+void SnifferCore::countTalker(const uint8_t *header, const RxControl &rx, uint32_t frames, uint32_t bytes) {
+  if ((header[0] & 0b00001100) >> 2 != TYPE_DATA || (header[1] & 0x02)) return;
+  _talkers.add(header + 10, rx.channel, rx.rssi, frames, bytes);
+}
+
+// The sweep's top talkers: printed, or queued for the link in thin-sensor mode.
+void SnifferCore::reportTalkers() {
+  if (!_config.talkerSlots) return;
+  uint32_t head[3] = { _hal.millis(), _talkers.totalFrames(), _talkers.totalBytes() };
+  memcpy(_talkerFrame, head, sizeof(head));
+  Talker *top = (Talker *)(_talkerFrame + sizeof(head));
+  uint8_t n = _talkers.top(top, _config.talkerReport);
+  _talkers.clear();
+  if (_config.thinSensor) {
+    // a report the link didn't take yet is replaced.
+    _talkerFrameLength = sizeof(head) + n * sizeof(Talker);
+    _talkerFramePending = true;
+    return;
+  }
+  char msg [80];
+  sprintf(msg, "Data frames: %u, %u kB", (unsigned)head[1], (unsigned)(head[2] / 1024));
+  _hal.println(msg);
+  for (uint8_t i = 0; i < n; i++) {
+    char addr[] = "00:00:00:00:00:00";
+    getMAC(addr, top[i].mac, 0);
+    sprintf(msg, "Talker: %s frames %u kB %u (+%u) Ch: %u RSSI: %d", addr, (unsigned)top[i].frames,
+      (unsigned)(top[i].bytes / 1024), (unsigned)(top[i].error / 1024), top[i].channel, top[i].rssi);
+    _hal.println(msg);
+  }
+}
+
+// Filter rules replace the built-in probe request and local MAC checks.
+bool SnifferCore::rulesAccept(SnifferPacket *snifferPacket) {
+  uint16_t captured = snifferPacket->len < DATA_LENGTH ? snifferPacket->len : DATA_LENGTH;
+  RuleFrame frame;
+  ruleFrame(snifferPacket->data, captured, snifferPacket->len, snifferPacket->rx_ctrl.rssi,
+            snifferPacket->rx_ctrl.channel, frame);
+  return _rules.accept(frame);
+}
+
+void SnifferCore::loadRules(const char *source, uint16_t length) {
+  RuleError error;
+  bool loaded;
+  if (length == 0) {
+    _rules.clear();
+    loaded = true;
+  } else {
+    loaded = _rules.load(source, length, error);
+  }
+  rulesAck(loaded, length == 0, error);
+}
+
+// The pieces come in order from offset 0; the one ending the source loads
+// it, or answers the error if a piece was missing or the source is too long.
+void SnifferCore::rulesPiece(const uint8_t *payload, uint16_t length) {
+  if (length < 4) return;
+  uint16_t offset, total;
+  memcpy(&offset, payload, 2);
+  memcpy(&total, payload + 2, 2);
+  uint16_t n = length - 4;
+  if (offset == 0) {
+    _rulesSourceLength = 0;
+    _rulesSourceBroken = false;
+  }
+  if (total > _rulesSourceSize || offset != _rulesSourceLength || (uint32_t)offset + n > total) {
+    _rulesSourceBroken = true;
+  } else {
+    memcpy(_rulesSource + offset, payload + 4, n);
+    _rulesSourceLength += n;
+  }
+  if ((uint32_t)offset + n < total) return;
+  if (_rulesSourceBroken) {
+    RuleError error;
+    error.position = _rulesSourceLength;
+    error.message = total > _rulesSourceSize ? "source too long" : "source piece missing";
+    rulesAck(false, false, error);
+  } else {
+    loadRules(_rulesSource, total);
+  }
+  // stray pieces of this source don't load it again.
+  _rulesSourceBroken = true;
+}
+
+void SnifferCore::rulesAck(bool loaded, bool cleared, const RuleError &error) {
+  uint8_t ack[7 + 40];
+  uint32_t generation = _rules.generation();
+  uint16_t detail = loaded ? _rules.worstCaseSteps() : error.position;
+  uint16_t messageLength = loaded ? 0 : strlen(error.message);
+  if (messageLength > sizeof(ack) - 7) messageLength = sizeof(ack) - 7;
+  memcpy(ack, &generation, 4);
+  ack[4] = loaded;
+  memcpy(ack + 5, &detail, 2);
+  if (!loaded) memcpy(ack + 7, error.message, messageLength);
+  if (_link) _link->send(FRAME_RULES_ACK, ack, 7 + messageLength);
+
+  if (!_config.thinSensor) {
+    char msg [80];
+    if (!loaded) sprintf(msg, "Rules error at %u: %s", detail, error.message);
+    else if (cleared) sprintf(msg, "Rules cleared");
+    else sprintf(msg, "Rules loaded: %u instructions", detail);
+    _hal.println(msg);
+  }
+}
+
+void SnifferCore::handleFrame(uint8_t type, const uint8_t *payload, uint16_t length) {
+  switch (type) {
+    case FRAME_WATCHLIST_BEGIN:
+      _watchlist.loadBegin();
+      break;
+    case FRAME_WATCHLIST_DATA:
+      for (uint16_t off = 0; off + WATCH_RECORD_LENGTH <= length; off += WATCH_RECORD_LENGTH) {
+        _watchlist.loadAdd(payload + off, payload[off + 6]);
+      }
+      break;
+    case FRAME_RULES:
+      loadRules((const char *)payload, length);
+      break;
+    case FRAME_RULES_DATA:
+      rulesPiece(payload, length);
+      break;
+    case FRAME_TIME_SYNC: {
+      // the host pairs this with its send and receive times to place millis() on its clock.
+      uint8_t ack[4 + TIME_SYNC_MAX_ECHO];
+      uint32_t now = _hal.millis();
+      uint16_t n = length < TIME_SYNC_MAX_ECHO ? length : TIME_SYNC_MAX_ECHO;
+      memcpy(ack, &now, 4);
+      memcpy(ack + 4, payload, n);
+      if (_link) _link->send(FRAME_TIME_SYNC_ACK, ack, 4 + n);
+      break;
+    }
+    case FRAME_WATCHLIST_COMMIT: {
+      // a lost DATA frame leaves the load short of the records sent.
+      uint16_t expected = 0;
+      if (length >= 2) memcpy(&expected, payload, 2);
+      if (length < 2 || !_watchlist.loadCommit(expected)) watchlistAck(false);
+      break;
+    }
+  }
+}
+
+bool SnifferCore::commitWatchlist(uint32_t budgetUs) {
+  if (!_watchlist.committing()) return false;
+  uint32_t start = _hal.micros();
+  while (_watchlist.commitStep()) {
+    if (_hal.micros() - start >= budgetUs) return true;
+  }
+  watchlistAck(true);
+  return false;
+}
+
+void SnifferCore::watchlistAck(bool committed) {
+  uint8_t ack[7];
+  uint32_t generation = _watchlist.generation();
+  uint16_t count = _watchlist.count();
+  memcpy(ack, &generation, 4);
+  memcpy(ack + 4, &count, 2);
+  ack[6] = committed;
+  if (_link) _link->send(FRAME_WATCHLIST_ACK, ack, sizeof(ack));
+  if (!_config.thinSensor) {
+    char msg [48];
+    sprintf(msg, "Watchlist %s: %u MACs", committed ? "loaded" : "rejected", count);
+    _hal.println(msg);
+  }
+}
+
+bool SnifferCore::drainDigests(uint32_t budgetUs) {
+  (void)budgetUs;  // bounded by the link: one batch per call at most
+  if (_link == NULL) return false;
+
+  uint32_t now = _hal.millis();
+  const FrameDigest *first;
+  uint16_t n = _digests.peek(&first, _config.digestBatchSize);
+  if (n > 0 && (n == _config.digestBatchSize || _digests.available() > n ||
+                now - first->timestampMs >= _config.digestBatchMaxMs) &&
+      _link->txRoom() >= n * sizeof(FrameDigest)) {
+    // peek() hands out contiguous ring memory, no copy needed.
+    _link->send(FRAME_DIGESTS, (const uint8_t *)first, n * sizeof(FrameDigest));
+    _digests.consume(n);
+    _digestCounters[DIGEST_EMITTED] += n;
+  }
+
+  uint8_t stats[4 + sizeof(_digestCounters) + sizeof(HopStats)];
+  if (_talkerFramePending && _link->txRoom() >= _talkerFrameLength) {
+    _talkerFramePending = false;
+    _link->send(FRAME_TOP_TALKERS, _talkerFrame, _talkerFrameLength);
+  }
+  if (_digestStatsPending && _link->txRoom() >= sizeof(stats)) {
+    _digestStatsPending = false;
+    memcpy(stats, &now, 4);
+    memcpy(stats + 4, _digestCounters, sizeof(_digestCounters));
+    memcpy(stats + 4 + sizeof(_digestCounters), &_hopStats, sizeof(HopStats));
+    _link->send(FRAME_DIGEST_STATS, stats, sizeof(stats));
+  }
+  return _digests.available() >= _config.digestBatchSize || _digestStatsPending || _talkerFramePending;
+}
+
+// A hop in the middle of a probe burst loses the rest of it, so with
+// hopQuietGapMs the hop waits for the burst to end, up to hopDeferMaxMs.
+bool SnifferCore::channelHop() {
+  if (_config.hopQuietGapMs) {
+    uint32_t nowMs = _hal.millis();
+    if (!_hopWaiting) _hopDueMs = nowMs;
+    bool quiet = _hal.micros() - _lastFrameUs >= _config.hopQuietGapMs * 1000UL;
+    if (!quiet && nowMs - _hopDueMs < _config.hopDeferMaxMs) {
+      _hopWaiting = true;
+      return false;
+    }
+    if (nowMs != _hopDueMs) {
+      _hopStats.deferred++;
+      if (!quiet) _hopStats.forced++;
+    }
+    _hopWaiting = false;
+  }
+  hop();
+  return true;
+}
+
+void SnifferCore::switchChannel(uint8_t channel) {
+  uint32_t startUs = _hal.micros();
+  // the dwell ending here: its frame rate prices the dead time at its start.
+  uint32_t dwellUs = startUs - _switchedUs;
+  if (_deadUs && _dwellFrames && dwellUs >= _deadUs) {
+    _hopStats.lostMilliFrames += (uint64_t)_dwellFrames * _deadUs * 1000 / dwellUs;
+  }
+  _hal.setChannel(channel);
+  _switchedUs = _hal.micros();
+  uint32_t switchUs = _switchedUs - startUs;
+  _hopStats.hops++;
+  _hopStats.switchUsTotal += switchUs;
+  if (switchUs > _hopStats.switchUsMax) _hopStats.switchUsMax = switchUs;
+  _deadUs = 0;
+  _dwellFrames = 0;
+  _gapOpen = true;
+}
+
+void SnifferCore::printHopStats() {
+  const HopStats &h = _hopStats;
+  char msg [120];
+  sprintf(msg, "Hops %u: switch avg %u us max %u us, gap avg %u ms max %u ms, lost ~%u.%u frames",
+    (unsigned)h.hops, (unsigned)(h.hops ? h.switchUsTotal / h.hops : 0), (unsigned)h.switchUsMax,
+    (unsigned)(h.gaps ? h.gapMsTotal / h.gaps : 0), (unsigned)h.gapMsMax,
+    (unsigned)(h.lostMilliFrames / 1000), (unsigned)(h.lostMilliFrames % 1000 / 100));
+  if (_config.hopQuietGapMs) {
+    sprintf(msg + strlen(msg), ", deferred %u (%u at deadline) saved %u", (unsigned)h.deferred, (unsigned)h.forced,
+      (unsigned)h.framesSaved);
+  }
+  _hal.println(msg);
+}
+
+void SnifferCore::hop() {
+  // hoping channels 1-14
+  uint8_t new_channel = _hal.getChannel() + 1;
+  if (_config.thinSensor) {
+    // the output link carries binary frames only, digests have the channel.
+    if (new_channel > 14) endSweepReports();
+    switchChannel(new_channel > 14 ? 1 : new_channel);
+    return;
+  }
+  if (new_channel > 14) {
+    new_channel = 1;
+    endSweep();
+    printHopStats();
+    char msg [32];
+    sprintf(msg, "Total clients:%d", _clientCount);
+    _hal.println(msg);
+
+    if (_config.spiSendClientCount) {
+      sprintf(msg, "%d", _clientCount);
+      _hal.spiSetData(msg);
+      if (_config.dedupQuotientFilter) filterReset();
+      else bufferReset();
+      // every device is new again after a reset, learn the baseline anew.
+      _surge.begin(_config.surge, _hal.millis());
+    }
+  }
+
+  switchChannel(new_channel);
+
+  char msg [16];
+  sprintf(msg, "Channel: %d", _hal.getChannel());
+  _hal.println(msg);
+}
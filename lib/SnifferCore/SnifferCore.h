@@ -0,0 +1,278 @@
+/**
+* Sniffer core: probe request parsing, MAC dedup and channel hopping, and
+* per-station data frame volume (lib/TopTalkers).
+* Hardware access goes through SnifferHal and all buffers come from the boot
+* time Arena, so the core itself never touches the heap.
+*/
+
+#ifndef SNIFFER_CORE_H
+#define SNIFFER_CORE_H
+
+#include <stdint.h>
+#include <Arena.h>
+#include <FilterRules.h>
+#include <FrameSample.h>
+#include <FrameDigest.h>
+#include <QuotientFilter.h>
+#include <SensorLink.h>
+#include <SurgeDetector.h>
+#include <SweepSet.h>
+#include <SweepTracker.h>
+#include <TopTalkers.h>
+#include <Watchlist.h>
+#include "SnifferHal.h"
+
+#define DATA_LENGTH           112
+
+#define TYPE_MANAGEMENT       0x00
+#define TYPE_CONTROL          0x01
+#define TYPE_DATA             0x02
+#define SUBTYPE_PROBE_REQUEST 0x04
+
+// SensorLink frame types sent by the core.
+#define FRAME_DIGESTS         0x01    // FrameDigest records
+#define FRAME_DIGEST_STATS    0x02    // uint32 millis, uint32 DigestCounter values, HopStats
+#define FRAME_WATCHLIST_ACK   0x03    // uint32 generation, uint16 entries, uint8 1 if committed
+#define FRAME_RULES_ACK       0x04    // uint32 generation, uint8 1 if loaded, uint16 worst case steps
+                                      // or error position, error message
+// FRAME_SWEEP_SET           0x05    // a sweep's device IDs, see lib/SweepSet
+#define FRAME_TIME_SYNC_ACK   0x06    // uint32 millis when the request arrived, the request payload
+// FRAME_HEALTH              0x07    // heap, resets, loop and callback rates, see lib/Health
+#define FRAME_TOP_TALKERS     0x0d    // per sweep: uint32 millis, uint32 data frames, uint32 bytes, Talker records
+// FRAME_SAMPLE              0x0e    // a sampled frame of the last sweep, see lib/FrameSample
+
+// Frames from the host, over the link or SPI.
+#define FRAME_WATCHLIST_BEGIN  0x08   // starts loading a new watchlist, no payload
+#define FRAME_WATCHLIST_DATA   0x09   // WatchRecords: MAC, WATCH_* flags
+#define FRAME_WATCHLIST_COMMIT 0x0a   // uint16 records sent; activates the loaded list, answered with FRAME_WATCHLIST_ACK
+#define FRAME_RULES            0x0b   // filter rules source, empty clears; answered with FRAME_RULES_ACK
+#define FRAME_TIME_SYNC        0x0c   // up to TIME_SYNC_MAX_ECHO bytes of host data, answered with FRAME_TIME_SYNC_ACK
+#define FRAME_RULES_DATA       0x0f   // uint16 offset, uint16 length of the whole source, a piece of a rules
+                                      // source too long for FRAME_RULES; the last piece loads it, answered
+                                      // with FRAME_RULES_ACK
+
+#define TIME_SYNC_MAX_ECHO     16
+
+#define HOP_RETRY_MS           2      // how often a hop waiting for a quiet gap is tried again
+
+// Sniffer packet data structure
+struct RxControl {
+ signed rssi:8; // signal intensity of packet
+ unsigned rate:4;
+ unsigned is_group:1;
+ unsigned:1;
+ unsigned sig_mode:2; // 0:is 11n packet; 1:is not 11n packet;
+ unsigned legacy_length:12; // if not 11n packet, shows length of packet.
+ unsigned damatch0:1;
+ unsigned damatch1:1;
+ unsigned bssidmatch0:1;
+ unsigned bssidmatch1:1;
+ unsigned MCS:7; // if is 11n packet, shows the modulation and code used (range from 0 to 76)
+ unsigned CWB:1; // if is 11n packet, shows if is HT40 packet or not
+ unsigned HT_length:16;// if is 11n packet, shows length of packet.
+ unsigned Smoothing:1;
+ unsigned Not_Sounding:1;
+ unsigned:1;
+ unsigned Aggregation:1;
+ unsigned STBC:2;
+ unsigned FEC_CODING:1; // if is 11n packet, shows if is LDPC packet or not.
+ unsigned SGI:1;
+ unsigned rxend_state:8;
+ unsigned ampdu_cnt:8;
+ unsigned channel:4; //which channel this packet in.
+ unsigned:12;
+};
+
+// Sniffer packet structure
+struct SnifferPacket{
+    struct RxControl rx_ctrl;
+    uint8_t data[DATA_LENGTH];
+    uint16_t cnt;
+    uint16_t len;
+};
+
+// Data frames come as the first 36 bytes of the header and a LenSeq per
+// frame of an AMPDU, 50 + 10 * cnt bytes; shorter buffers have no header.
+struct LenSeq {
+  uint16_t length;
+  uint16_t seq;
+  uint8_t address3[6];
+};
+
+struct SnifferDataPacket {
+  struct RxControl rx_ctrl;
+  uint8_t data[36];
+  uint16_t cnt;
+  struct LenSeq lenseq[1];
+};
+
+static_assert(sizeof(SnifferDataPacket) == 60, "SnifferDataPacket must match the SDK's 60 bytes");
+
+// Run time configuration, main.cpp fills it from its #defines.
+struct SnifferConfig {
+  bool ignoreLocalMacs;          // locally administred MAC-addresses are ignored.
+  bool staticMode;               // no channel hopping.
+  uint8_t initialChannel;
+  uint32_t hopIntervalMs;
+  uint16_t bufferSize;           // MAC entry buffer size
+  bool spiSendAddresses;
+  bool spiSendClientCount;
+  bool dedupQuotientFilter;      // dedup with a quotient filter instead of the MAC string buffer.
+  uint8_t qfQuotientBits;
+  uint8_t qfRemainderBits;
+  uint16_t qfWindowSize;         // MACs kept in the quotient filter window.
+  bool thinSensor;               // no dedup, stream a FrameDigest per accepted probe.
+  uint16_t digestQueueSize;      // digests buffered between the callback and loop().
+  uint8_t digestBatchSize;       // digests per output frame.
+  uint16_t digestBatchMaxMs;     // send a partial batch when its oldest digest is this old.
+  bool surgeDetect;              // alert on surges of the new-device rate (not in thin-sensor mode).
+  SurgeConfig surge;
+  uint16_t watchlistSize;        // MACs the watchlist holds, 0 --> no watchlist.
+  const char *rules;             // filter rules at boot, "" --> probe requests (and ignoreLocalMacs).
+  uint8_t rulesMaxInsns;         // compiled rule program size, 0 --> no rules.
+  uint8_t rulesMaxOuis;
+  uint16_t rulesMaxSource;       // longest rules source taken in FRAME_RULES_DATA pieces, 0 --> one frame only.
+  uint16_t sweepTrackerSlots;    // devices tracked for new/returning/departed per sweep, 0 --> off.
+  uint16_t sweepSetSize;         // device IDs exported per sweep over the link (needs the tracker), 0 --> off.
+  uint32_t sweepSetSalt;         // salt of the exported IDs.
+  uint16_t hopQuietGapMs;        // hop only after this long without frames, 0 --> hop on time.
+  uint16_t hopDeferMaxMs;        // longest a hop waits for the quiet gap.
+  uint8_t talkerSlots;           // data frame transmitters counted, 0 --> off.
+  uint8_t talkerReport;          // top talkers reported per sweep.
+  uint8_t sampleFrames;          // accepted frames sampled per sweep and sent over the link, 0 --> off.
+};
+
+// Channel switch cost since boot. A gap runs from the last frame before a
+// hop to the first one after it; the frames lost are estimated from the
+// time between the switch and that first frame, at the rate the new channel
+// then showed over its dwell.
+struct HopStats {
+  uint32_t hops;
+  uint32_t switchUsTotal;        // in setChannel()
+  uint32_t switchUsMax;
+  uint32_t gaps;                 // hops followed by a frame on the new channel
+  uint32_t gapMsTotal;
+  uint32_t gapMsMax;
+  uint32_t lostMilliFrames;      // estimated, in thousandths of a frame
+  uint32_t deferred;             // hops that waited for a quiet gap
+  uint32_t forced;               // of those, hopped at hopDeferMaxMs without one
+  uint32_t framesSaved;          // heard while a hop waited, an on time hop would have missed them
+};
+
+class SnifferCore {
+public:
+  SnifferCore(SnifferHal &hal, const SnifferConfig &config);
+
+  // Takes the buffers from the arena. False if they don't fit.
+  bool begin(Arena &arena);
+
+  // Promiscuous mode callback.
+  void handlePacket(uint8_t *buffer, uint16_t length);
+  // Channel hop timer callback. With hopQuietGapMs it returns false while
+  // the hop waits for a gap in the frames; call it again after HOP_RETRY_MS.
+  bool channelHop();
+  // Periodic work from loop(), a few times a second.
+  void tick();
+
+  // Binary output goes through this link (thin-sensor mode).
+  void setLink(SensorLink *link) { _link = link; }
+  // Frames from the host, run from loop().
+  void handleFrame(uint8_t type, const uint8_t *payload, uint16_t length);
+  // Boot time loading from flash.
+  Watchlist &watchlist() { return _watchlist; }
+  // Sorts a committed watchlist, run from loop(); activates and acks it once
+  // done. Returns true while the commit is pending.
+  bool commitWatchlist(uint32_t budgetUs);
+
+  // Thin-sensor output, run from loop(). Queues digest batches (and a stats
+  // frame after requestDigestStats()) as long as the link has room; digests
+  // wait in their queue while it is busy. Returns true while output is pending.
+  bool drainDigests(uint32_t budgetUs);
+  void requestDigestStats() { _digestStatsPending = true; }
+  // Sends the last sweep's device set (FRAME_SWEEP_SET), run from loop().
+  // Returns true while frames are pending.
+  bool exportSweepSet();
+  // Sends the last sweep's sampled frames (FRAME_SAMPLE), run from loop().
+  // Returns true while frames are pending.
+  bool exportSamples();
+  uint32_t digestCounter(DigestCounter counter) const { return _digestCounters[counter]; }
+
+  int clientCount() const { return _clientCount; }
+  const SurgeDetector &surge() const { return _surge; }
+  const SweepTracker &sweeps() const { return _sweeps; }
+  const SweepSet &sweepSet() const { return _sweepSet; }
+  const SnifferConfig &config() const { return _config; }
+  const HopStats &hopStats() const { return _hopStats; }
+  const TopTalkers &talkers() const { return _talkers; }
+
+private:
+  void showMetadata(SnifferPacket *snifferPacket);
+  bool bufferCheckMAC(char newmac[]);
+  void bufferRollBack();
+  void bufferAdd(char newmac[]);
+  void bufferReset();
+  bool filterCheckMAC(uint8_t *mac);
+  void filterAdd(uint8_t *mac);
+  void filterReset();
+  void thinSensorPacket(SnifferPacket *snifferPacket);
+  void surgeAlert();
+  bool rulesAccept(SnifferPacket *snifferPacket);
+  void loadRules(const char *source, uint16_t length);
+  void rulesPiece(const uint8_t *payload, uint16_t length);
+  void rulesAck(bool loaded, bool cleared, const RuleError &error);
+  void watchlistAck(bool committed);
+  void endSweep();
+  void hop();
+  void switchChannel(uint8_t channel);
+  void printHopStats();
+  void dataPacket(SnifferDataPacket *dataPacket, uint16_t length);
+  void countTalker(const uint8_t *header, const RxControl &rx, uint32_t frames, uint32_t bytes);
+  void reportTalkers();
+  void endSweepReports();
+  void sampleFrame(SnifferPacket *snifferPacket);
+
+  SnifferHal &_hal;
+  SnifferConfig _config;
+  int _clientCount;
+
+  char (*_macs)[18];
+
+  QuotientFilter _macFilter;
+  uint32_t *_macWindow;
+  int _macWindowHead;
+
+  SensorLink *_link;
+  DigestQueue _digests;
+  uint32_t _digestCounters[DIGEST_COUNTER_COUNT];
+  bool _digestStatsPending;
+
+  SurgeDetector _surge;
+  Watchlist _watchlist;
+  FilterRules _rules;
+  char *_rulesSource;            // FRAME_RULES_DATA pieces so far
+  uint16_t _rulesSourceSize;
+  uint16_t _rulesSourceLength;
+  bool _rulesSourceBroken;       // a piece was lost, or the source doesn't fit
+
+  SweepTracker _sweeps;
+  SweepSet _sweepSet;
+  uint32_t _sweepStartMs;
+
+  HopStats _hopStats;
+  bool _hopWaiting;
+  uint32_t _hopDueMs;
+  uint32_t _lastFrameUs;
+  uint32_t _switchedUs;          // end of the last switch
+  bool _gapOpen;                 // no frame since it
+  uint32_t _deadUs;              // switch to the first frame after it, this dwell
+  uint32_t _dwellFrames;
+
+  FrameSample _samples;
+
+  TopTalkers _talkers;
+  uint8_t *_talkerFrame;         // the last sweep's FRAME_TOP_TALKERS payload
+  uint16_t _talkerFrameLength;
+  bool _talkerFramePending;      // for room on the link
+};
+
+#endif
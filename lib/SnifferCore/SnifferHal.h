@@ -0,0 +1,26 @@
+/**
+* Hardware abstraction used by the sniffer core.
+* main.cpp implements it on top of the ESP8266 SDK; host builds (benchmarks,
+* replay, emulation) provide their own so the same core runs off-target.
+*/
+
+#ifndef SNIFFER_HAL_H
+#define SNIFFER_HAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+class SnifferHal {
+public:
+  virtual ~SnifferHal() {}
+  // One line of text output (Serial.println on the board).
+  virtual void println(const char *line) = 0;
+  virtual uint8_t getChannel() = 0;
+  virtual void setChannel(uint8_t channel) = 0;
+  virtual void spiSetData(const char *data) = 0;
+  virtual uint32_t millis() = 0;
+  // Timing of channel switches; host builds on a millisecond clock can leave it.
+  virtual uint32_t micros() { return millis() * 1000; }
+};
+
+#endif
@@ -0,0 +1,94 @@
+#include "SurgeDetector.h"
+
+#include <math.h>
+#include <string.h>
+
+// Seconds closed per call at most; longer gaps restart the current bin.
+#define SURGE_MAX_CATCHUP_S 120
+
+SurgeDetector::SurgeDetector()
+  : _binStartMs(0), _binCount(0), _seconds(0), _mean(0), _variance(0), _cusum(0),
+    _holdoffUntil(0), _alerts(0) {
+  memset(&_config, 0, sizeof(_config));
+  memset(&_alert, 0, sizeof(_alert));
+}
+
+void SurgeDetector::begin(const SurgeConfig &config, uint32_t nowMs) {
+  _config = config;
+  _binStartMs = nowMs;
+  _binCount = 0;
+  _seconds = 0;
+  _mean = 0;
+  _variance = 0;
+  _cusum = 0;
+  _holdoffUntil = 0;
+  _alerts = 0;
+}
+
+bool SurgeDetector::closeSecond(uint16_t count, uint32_t endMs) {
+  _seconds++;
+  float x = count;
+  if (_seconds <= _config.warmupS) {
+    // Plain running mean and variance while warming up.
+    float delta = x - _mean;
+    _mean += delta / _seconds;
+    _variance += (delta * (x - _mean) - _variance) / _seconds;
+    return false;
+  }
+
+  // Counts are roughly Poisson: never trust a deviation below sqrt(mean), and
+  // below one device a single busy second would look like many deviations.
+  float sd = sqrtf(_variance);
+  float floor = sqrtf(_mean > 1 ? _mean : 1);
+  if (sd < floor) sd = floor;
+  float z = (x - _mean) / sd;
+  _cusum += z - _config.k;
+  if (_cusum < -_config.h / 2) _cusum = -_config.h / 2;
+
+  // Learn only while in control, or right after an alert so that a lasting
+  // new level becomes the baseline instead of alerting every holdoff.
+  if (_cusum < _config.h / 2 || _seconds < _holdoffUntil) {
+    float delta = x - _mean;
+    _mean += _config.alpha * delta;
+    _variance = (1 - _config.alpha) * (_variance + _config.alpha * delta * delta);
+  }
+
+  if (_cusum > _config.h && count >= _config.minRate && _seconds >= _holdoffUntil) {
+    _alert.timeMs = endMs;
+    _alert.rate = count;
+    _alert.baseline = _mean;
+    _alert.cusum = _cusum;
+    _alerts++;
+    _cusum = 0;
+    _holdoffUntil = _seconds + _config.holdoffS;
+    return true;
+  }
+  return false;
+}
+
+bool SurgeDetector::closeSeconds(uint32_t nowMs) {
+  bool alert = false;
+  uint32_t elapsed = (nowMs - _binStartMs) / 1000;
+  if (elapsed > SURGE_MAX_CATCHUP_S) {
+    // Clock jump or long pause: don't replay minutes of empty seconds.
+    _binStartMs = nowMs;
+    _binCount = 0;
+    return false;
+  }
+  while (elapsed-- > 0) {
+    _binStartMs += 1000;
+    alert = closeSecond(_binCount, _binStartMs) || alert;
+    _binCount = 0;
+  }
+  return alert;
+}
+
+bool SurgeDetector::newDevice(uint32_t nowMs) {
+  bool alert = closeSeconds(nowMs);
+  if (_binCount < 0xffff) _binCount++;
+  return alert;
+}
+
+bool SurgeDetector::tick(uint32_t nowMs) {
+  return closeSeconds(nowMs);
+}
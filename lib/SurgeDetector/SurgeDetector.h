@@ -0,0 +1,67 @@
+/**
+* Streaming crowd surge detector over the per-second new-device rate.
+* New devices are counted into one second bins (constant work per frame).
+* Each closed second updates an EWMA baseline of mean and variance and a
+* one-sided CUSUM of the standardized rate; an alert is raised as soon as the
+* CUSUM passes h while the rate is at least minRate. After an alert the
+* CUSUM restarts and further alerts are held off for holdoffS seconds.
+* The baseline is only learned while the process looks in control, so a
+* surge doesn't teach the detector that surges are normal. The CUSUM may go
+* down to -h/2: a quiet spell (eg. a dead channel while hopping) followed by
+* the devices it hid showing up is not a surge.
+*/
+
+#ifndef SURGE_DETECTOR_H
+#define SURGE_DETECTOR_H
+
+#include <stdint.h>
+
+struct SurgeConfig {
+  float alpha;          // EWMA weight of a new second, eg. 0.05
+  float k;              // CUSUM allowance in standard deviations, eg. 0.5
+  float h;              // CUSUM alert threshold in standard deviations, eg. 8
+  uint16_t minRate;     // no alerts below this many new devices per second
+  uint16_t warmupS;     // seconds to learn the baseline before alerting
+  uint16_t holdoffS;    // seconds between alerts
+};
+
+struct SurgeAlert {
+  uint32_t timeMs;      // end of the second that raised the alert
+  uint16_t rate;        // new devices in that second
+  float baseline;       // learned mean rate
+  float cusum;          // statistic at the alert
+};
+
+class SurgeDetector {
+public:
+  SurgeDetector();
+  void begin(const SurgeConfig &config, uint32_t nowMs);
+
+  // A device was seen for the first time. True if closing the previous
+  // seconds raised an alert, see lastAlert().
+  bool newDevice(uint32_t nowMs);
+  // Closes seconds that passed without new devices. Call a few times a second.
+  bool tick(uint32_t nowMs);
+
+  const SurgeAlert &lastAlert() const { return _alert; }
+  uint32_t alerts() const { return _alerts; }
+  float baseline() const { return _mean; }
+  float cusum() const { return _cusum; }
+
+private:
+  bool closeSeconds(uint32_t nowMs);
+  bool closeSecond(uint16_t count, uint32_t endMs);
+
+  SurgeConfig _config;
+  uint32_t _binStartMs;
+  uint16_t _binCount;
+  uint32_t _seconds;
+  float _mean;
+  float _variance;
+  float _cusum;
+  uint32_t _holdoffUntil;
+  uint32_t _alerts;
+  SurgeAlert _alert;
+};
+
+#endif
@@ -0,0 +1,130 @@
+#include "SweepSet.h"
+
+#include <stddef.h>
+#include <string.h>
+
+SweepSet::SweepSet()
+  : _ids(NULL), _capacity(0), _salt(0), _count(0), _closed(0), _exporting(false), _sorted(false),
+    _sweep(0), _block(0), _dropped(0), _sweepDropped(0), _closedDropped(0), _closedUntracked(0), _skipped(0) {
+}
+
+bool SweepSet::begin(Arena &arena, uint16_t capacity, uint32_t salt) {
+  // the block count goes out in a byte.
+  if (capacity > 255 * SWEEP_SET_BLOCK_IDS) capacity = 255 * SWEEP_SET_BLOCK_IDS;
+  _ids = arena.allocateArray<uint64_t>("sweep set", capacity);
+  _capacity = capacity;
+  _salt = salt;
+  _count = _closed = 0;
+  _sweepDropped = 0;
+  _exporting = false;
+  return _ids != NULL;
+}
+
+uint64_t SweepSet::id(const uint8_t *mac, uint32_t salt) {
+  uint64_t h = 0;
+  for (uint8_t i = 0; i < 6; i++) {
+    h = (h << 8) | mac[i];
+  }
+  // splitmix64 finalizer over the salted MAC: the host sees stable IDs, not addresses.
+  h ^= (uint64_t)salt << 48 | (uint64_t)salt << 16;
+  h += 0x9e3779b97f4a7c15ULL;
+  h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+  h ^= h >> 31;
+  return h & EF_ID_MASK;
+}
+
+void SweepSet::add(const uint8_t *mac) {
+  if (_ids == NULL) return;
+  if (_count >= _capacity) {
+    _dropped++;
+    if (_sweepDropped < 0xffff) _sweepDropped++;
+    return;
+  }
+  _ids[_count++] = id(mac, _salt);
+}
+
+void SweepSet::close(uint32_t sweep, uint16_t untracked) {
+  if (_ids == NULL) return;
+  if (_exporting) {
+    _count = _closed;
+    _sweepDropped = 0;
+    _skipped++;
+    return;
+  }
+  _closed = _count;
+  _closedDropped = _sweepDropped;
+  _closedUntracked = untracked;
+  _sweepDropped = 0;
+  _sweep = sweep;
+  _block = 0;
+  _sorted = false;
+  _exporting = true;
+}
+
+static void siftDown(uint64_t *a, uint16_t root, uint16_t n) {
+  for (;;) {
+    uint32_t child = 2UL * root + 1;
+    if (child >= n) return;
+    if (child + 1 < n && a[child + 1] > a[child]) child++;
+    if (a[root] >= a[child]) return;
+    uint64_t tmp = a[root];
+    a[root] = a[child];
+    a[child] = tmp;
+    root = child;
+  }
+}
+
+// Heapsort then drop duplicates (tracker fingerprint collisions), returns the new length.
+static uint16_t sortUnique(uint64_t *a, uint16_t n) {
+  for (uint16_t i = n / 2; i-- > 0;) siftDown(a, i, n);
+  for (uint16_t end = n; end-- > 1;) {
+    uint64_t tmp = a[0];
+    a[0] = a[end];
+    a[end] = tmp;
+    siftDown(a, 0, end);
+  }
+  uint16_t out = 0;
+  for (uint16_t i = 0; i < n; i++) {
+    if (out == 0 || a[i] != a[out - 1]) a[out++] = a[i];
+  }
+  return out;
+}
+
+bool SweepSet::exportNext(SensorLink &link) {
+  if (!_exporting) return false;
+  if (!_sorted) {
+    uint16_t unique = sortUnique(_ids, _closed);
+    if (unique < _closed) {
+      memmove(_ids + unique, _ids + _closed, (_count - _closed) * sizeof(uint64_t));
+      _count -= _closed - unique;
+      _closed = unique;
+    }
+    _sorted = true;
+    return true;
+  }
+
+  uint8_t blocks = (_closed + SWEEP_SET_BLOCK_IDS - 1) / SWEEP_SET_BLOCK_IDS;
+  uint16_t first = (uint16_t)_block * SWEEP_SET_BLOCK_IDS;
+  uint16_t n = _closed - first < SWEEP_SET_BLOCK_IDS ? _closed - first : SWEEP_SET_BLOCK_IDS;
+  size_t length = SWEEP_SET_HEADER + (blocks ? efEncodedLength(_ids + first, n) : 0);
+  if (link.txRoom() < length) return true;
+
+  uint8_t frame[SWEEP_SET_FRAME_MAX];
+  memcpy(frame, &_sweep, 4);
+  memcpy(frame + 4, &_closed, 2);
+  frame[6] = _block;
+  frame[7] = blocks;
+  memcpy(frame + 8, &_closedDropped, 2);
+  memcpy(frame + 10, &_closedUntracked, 2);
+  if (blocks) efEncode(_ids + first, n, frame + SWEEP_SET_HEADER, sizeof(frame) - SWEEP_SET_HEADER);
+  link.send(FRAME_SWEEP_SET, frame, length);
+
+  if (++_block < blocks) return true;
+  // the next sweep's IDs move to the front.
+  memmove(_ids, _ids + _closed, (_count - _closed) * sizeof(uint64_t));
+  _count -= _closed;
+  _closed = 0;
+  _exporting = false;
+  return false;
+}
@@ -0,0 +1,71 @@
+/**
+* Device set of each sweep, exported to the host Elias-Fano coded.
+* Devices are added as salted 48-bit hashes of their MAC on their first
+* frame of the sweep (SweepTracker tells which one that is). Devices the
+* tracker had no room for and IDs past the capacity are missing from the
+* set, and counted in its frames; two devices sharing a tracker
+* fingerprint are one. When the sweep
+* closes its IDs are sorted and sent from loop() as FRAME_SWEEP_SET frames,
+* SWEEP_SET_BLOCK_IDS per frame, while the next sweep's IDs are appended
+* behind them in the same array. Each frame is an independent lib/EliasFano
+* block, so the host can use and skip blocks without decoding the others.
+* Frame: uint32 sweep, uint16 IDs in the sweep, uint8 block, uint8 blocks,
+* uint16 IDs dropped (no room), uint16 frames untracked (of devices the
+* tracker had no room for), block (none for an empty sweep).
+*/
+
+#ifndef SWEEP_SET_H
+#define SWEEP_SET_H
+
+#include <stdint.h>
+#include <Arena.h>
+#include <EliasFano.h>
+#include <SensorLink.h>
+
+#define FRAME_SWEEP_SET       0x05
+#define SWEEP_SET_HEADER      12
+#define SWEEP_SET_BLOCK_IDS   64
+// A block of 64 IDs spread over the whole 48-bit space, 43 bits each.
+#define SWEEP_SET_FRAME_MAX   (SWEEP_SET_HEADER + EF_HEADER_LENGTH + SWEEP_SET_BLOCK_IDS * 44 / 8)
+
+class SweepSet {
+public:
+  SweepSet();
+
+  // capacity IDs for the sweep being exported and the one filling up.
+  bool begin(Arena &arena, uint16_t capacity, uint32_t salt);
+
+  // A device's first frame in the sweep, from the WiFi callback.
+  void add(const uint8_t *mac);
+  // Ends the sweep, untracked frames of it went unseen. Its export starts
+  // on the next exportNext(); if the previous one is still being sent, the
+  // closed sweep is skipped.
+  void close(uint32_t sweep, uint16_t untracked);
+  // From loop(): sends the next frame of a closed sweep if the link has
+  // room. Returns true while there is more to send.
+  bool exportNext(SensorLink &link);
+
+  static uint64_t id(const uint8_t *mac, uint32_t salt);
+
+  uint16_t count() const { return _count - _closed; }
+  uint32_t dropped() const { return _dropped; }
+  uint32_t skipped() const { return _skipped; }
+
+private:
+  uint64_t *_ids;
+  uint16_t _capacity;
+  uint32_t _salt;
+  uint16_t _count;            // IDs in the array, the closed sweep's first
+  uint16_t _closed;           // IDs of the sweep being exported
+  bool _exporting;
+  bool _sorted;
+  uint32_t _sweep;
+  uint8_t _block;             // next block to send
+  uint32_t _dropped;          // IDs that didn't fit
+  uint16_t _sweepDropped;     // of them, in the sweep filling up
+  uint16_t _closedDropped;    // and in the sweep being exported
+  uint16_t _closedUntracked;
+  uint32_t _skipped;          // sweeps closed during an export
+};
+
+#endif
@@ -0,0 +1,113 @@
+#include "SweepTracker.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#define ENTRY_FINGERPRINT(e)  ((e) >> 8)
+#define ENTRY_GENERATION(e)   ((uint8_t)(e))
+
+SweepTracker::SweepTracker()
+  : _table(NULL), _mask(0), _used(0), _generation(1), _cleanCursor(0) {
+  memset(&_current, 0, sizeof(_current));
+  memset(&_last, 0, sizeof(_last));
+}
+
+bool SweepTracker::begin(Arena &arena, uint16_t slots) {
+  uint16_t size = 1;
+  while ((uint32_t)size * 2 <= slots) size *= 2;
+  _table = arena.allocateArray<uint32_t>("sweep tracker", size);
+  _mask = size - 1;
+  _used = 0;
+  _generation = 1;
+  _cleanCursor = 0;
+  memset(&_current, 0, sizeof(_current));
+  memset(&_last, 0, sizeof(_last));
+  return _table != NULL;
+}
+
+uint32_t SweepTracker::fingerprintMAC(const uint8_t *mac) {
+  // 32-bit FNV-1a then a murmur finalizer, 24 bits kept, never 0 (0 is an empty slot).
+  uint32_t h = 2166136261UL;
+  for (uint8_t i = 0; i < 6; i++) h = (h ^ mac[i]) * 16777619UL;
+  h ^= h >> 16;
+  h *= 0x85ebca6bUL;
+  h ^= h >> 13;
+  h &= 0xffffff;
+  return h ? h : 1;
+}
+
+bool SweepTracker::stale(uint32_t entry) const {
+  uint8_t g = ENTRY_GENERATION(entry);
+  return g != _generation && g != (uint8_t)(_generation - 1);
+}
+
+bool SweepTracker::observe(const uint8_t *mac) {
+  uint32_t fp = fingerprintMAC(mac);
+  uint16_t i = fp & _mask;
+  int32_t reuse = -1;
+  for (uint16_t probes = 0; probes <= _mask; probes++, i = (i + 1) & _mask) {
+    uint32_t e = _table[i];
+    if (e == 0) break;
+    if (ENTRY_FINGERPRINT(e) == fp) {
+      uint8_t g = ENTRY_GENERATION(e);
+      if (g == _generation) return false;
+      if (g == (uint8_t)(_generation - 1)) _current.returning++;
+      else _current.newDevices++;
+      _table[i] = (fp << 8) | _generation;
+      return true;
+    }
+    if (reuse < 0 && stale(e)) reuse = i;
+  }
+
+  // Not in the table: a stale slot on the way, or the empty one that ended
+  // the chain, as long as the table keeps some empty slots.
+  if (reuse < 0) {
+    if (_table[i] != 0 || _used >= _mask - (_mask >> 4)) {
+      _current.untracked++;
+      return false;
+    }
+    reuse = i;
+    _used++;
+  }
+  _table[reuse] = (fp << 8) | _generation;
+  _current.newDevices++;
+  return true;
+}
+
+const SweepCounts &SweepTracker::endSweep() {
+  uint16_t lastSeen = _last.newDevices + _last.returning;
+  _current.departed = lastSeen > _current.returning ? lastSeen - _current.returning : 0;
+  _last = _current;
+  memset(&_current, 0, sizeof(_current));
+  _current.sweep = _last.sweep + 1;
+  _generation++;
+  return _last;
+}
+
+// Linear probing delete: pull later entries of the cluster back into the
+// hole unless their home slot lies between the hole and where they are.
+void SweepTracker::removeAt(uint16_t i) {
+  uint16_t j = i;
+  for (;;) {
+    j = (j + 1) & _mask;
+    uint32_t e = _table[j];
+    if (e == 0) break;
+    uint16_t home = ENTRY_FINGERPRINT(e) & _mask;
+    bool stays = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+    if (stays) continue;
+    _table[i] = e;
+    i = j;
+  }
+  _table[i] = 0;
+  _used--;
+}
+
+void SweepTracker::clean(uint16_t maxSlots) {
+  if (_table == NULL) return;
+  for (uint16_t n = 0; n < maxSlots; n++) {
+    uint32_t e = _table[_cleanCursor];
+    // the hole may be refilled by the shift, look at the same slot again.
+    if (e != 0 && stale(e)) removeAt(_cleanCursor);
+    else _cleanCursor = (_cleanCursor + 1) & _mask;
+  }
+}
@@ -0,0 +1,63 @@
+/**
+* New, returning and departed devices per channel sweep.
+* Devices live in an open addressing hash table as a 24-bit MAC fingerprint
+* tagged with the 8-bit sweep generation they were last seen in. Counts are
+* kept as frames arrive: a device first seen this sweep is returning if its
+* tag is the previous generation, new otherwise; departed falls out at the
+* end of the sweep as last sweep's devices minus the returning ones. No
+* table is compared or cleared at the sweep boundary.
+* Entries older than the previous sweep are free for reuse and are removed
+* a few slots at a time from loop() (clean()), with backward shift deletion
+* so the probe chains stay short.
+*/
+
+#ifndef SWEEP_TRACKER_H
+#define SWEEP_TRACKER_H
+
+#include <stdint.h>
+#include <Arena.h>
+
+struct SweepCounts {
+  uint32_t sweep;
+  uint16_t newDevices;
+  uint16_t returning;         // seen in the previous sweep too
+  uint16_t departed;          // seen in the previous sweep, not in this one
+  uint16_t untracked;         // frames of devices that didn't fit the table
+};
+
+class SweepTracker {
+public:
+  SweepTracker();
+
+  // slots is rounded down to a power of two; it should hold two sweeps of devices.
+  bool begin(Arena &arena, uint16_t slots);
+  // The 24-bit fingerprint devices are told apart by, never 0.
+  static uint32_t fingerprintMAC(const uint8_t *mac);
+
+  // Every accepted frame, from the WiFi callback. True on the device's
+  // first frame of the sweep.
+  bool observe(const uint8_t *mac);
+  // Closes the current sweep and returns its counts.
+  const SweepCounts &endSweep();
+  // Removes up to maxSlots worth of stale entries, from loop().
+  void clean(uint16_t maxSlots);
+
+  const SweepCounts &current() const { return _current; }
+  const SweepCounts &last() const { return _last; }
+  uint16_t used() const { return _used; }
+  uint16_t slots() const { return _mask + 1; }
+
+private:
+  bool stale(uint32_t entry) const;
+  void removeAt(uint16_t i);
+
+  uint32_t *_table;
+  uint16_t _mask;
+  uint16_t _used;             // non-empty slots, live or stale
+  uint8_t _generation;
+  uint16_t _cleanCursor;
+  SweepCounts _current;
+  SweepCounts _last;
+};
+
+#endif
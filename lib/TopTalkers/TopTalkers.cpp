@@ -0,0 +1,146 @@
+#include "TopTalkers.h"
+
+#include <stddef.h>
+#include <string.h>
+
+TopTalkers::TopTalkers()
+  : _heap(NULL), _slotOf(NULL), _index(NULL), _mask(0), _capacity(0), _size(0), _totalFrames(0), _totalBytes(0) {
+}
+
+bool TopTalkers::begin(Arena &arena, uint8_t capacity) {
+  if (capacity == 0 || capacity > TOP_TALKERS_MAX) return false;
+  // at most half full, the probe chains stay short.
+  uint16_t slots = 1;
+  while (slots < 2 * capacity) slots *= 2;
+  _heap = arena.allocateArray<Talker>("top talkers", capacity);
+  _slotOf = arena.allocateArray<uint8_t>("top talkers slots", capacity);
+  _index = arena.allocateArray<uint8_t>("top talkers index", slots);
+  if (_heap == NULL || _slotOf == NULL || _index == NULL) return false;
+  _mask = slots - 1;
+  _capacity = capacity;
+  clear();
+  return true;
+}
+
+void TopTalkers::clear() {
+  if (_index) memset(_index, 0, _mask + 1);
+  _size = 0;
+  _totalFrames = 0;
+  _totalBytes = 0;
+}
+
+uint8_t TopTalkers::home(const uint8_t *mac) const {
+  uint32_t h = 2166136261UL;
+  for (uint8_t i = 0; i < 6; i++) h = (h ^ mac[i]) * 16777619UL;
+  return (h ^ (h >> 16)) & _mask;
+}
+
+void TopTalkers::place(uint8_t pos, uint8_t slot) {
+  _slotOf[pos] = slot;
+  _index[slot] = pos + 1;
+}
+
+void TopTalkers::swap(uint8_t a, uint8_t b) {
+  Talker t = _heap[a];
+  _heap[a] = _heap[b];
+  _heap[b] = t;
+  uint8_t slotA = _slotOf[a];
+  place(a, _slotOf[b]);
+  place(b, slotA);
+}
+
+void TopTalkers::siftUp(uint8_t pos) {
+  while (pos > 0) {
+    uint8_t parent = (pos - 1) / 2;
+    if (_heap[parent].bytes <= _heap[pos].bytes) return;
+    swap(pos, parent);
+    pos = parent;
+  }
+}
+
+void TopTalkers::siftDown(uint8_t pos) {
+  for (;;) {
+    uint16_t smallest = pos;
+    uint16_t left = 2 * pos + 1;
+    uint16_t right = left + 1;
+    if (left < _size && _heap[left].bytes < _heap[smallest].bytes) smallest = left;
+    if (right < _size && _heap[right].bytes < _heap[smallest].bytes) smallest = right;
+    if (smallest == pos) return;
+    swap(pos, smallest);
+    pos = smallest;
+  }
+}
+
+// Linear probing delete: pull later entries of the cluster back into the
+// hole unless their home slot lies between the hole and where they are.
+void TopTalkers::unindex(uint8_t i) {
+  uint8_t j = i;
+  for (;;) {
+    j = (j + 1) & _mask;
+    uint8_t e = _index[j];
+    if (e == 0) break;
+    uint8_t h = home(_heap[e - 1].mac);
+    bool stays = i <= j ? (i < h && h <= j) : (i < h || h <= j);
+    if (stays) continue;
+    place(e - 1, i);
+    i = j;
+  }
+  _index[i] = 0;
+}
+
+void TopTalkers::add(const uint8_t *mac, uint8_t channel, int8_t rssi, uint32_t frames, uint32_t bytes) {
+  if (_heap == NULL) return;
+  _totalFrames += frames;
+  _totalBytes += bytes;
+  uint8_t i = home(mac);
+  for (; _index[i]; i = (i + 1) & _mask) {
+    uint8_t pos = _index[i] - 1;
+    Talker &t = _heap[pos];
+    if (memcmp(t.mac, mac, 6) != 0) continue;
+    t.channel = channel;
+    t.rssi = rssi;
+    t.frames += frames;
+    t.bytes += bytes;
+    siftDown(pos);
+    return;
+  }
+
+  uint8_t pos;
+  uint32_t inherited = 0;
+  bool replaced = _size == _capacity;
+  if (!replaced) {
+    pos = _size++;
+  } else {
+    // the smallest counter goes to the newcomer.
+    pos = 0;
+    inherited = _heap[0].bytes;
+    unindex(_slotOf[0]);
+    for (i = home(mac); _index[i]; i = (i + 1) & _mask) {}
+  }
+  Talker &t = _heap[pos];
+  memcpy(t.mac, mac, 6);
+  t.channel = channel;
+  t.rssi = rssi;
+  t.frames = frames;
+  t.bytes = inherited + bytes;
+  t.error = inherited;
+  place(pos, i);
+  if (replaced) siftDown(pos);
+  else siftUp(pos);
+}
+
+uint8_t TopTalkers::top(Talker *out, uint8_t n) const {
+  if (n > _size) n = _size;
+  // a partial selection sort, n is a handful.
+  bool taken[TOP_TALKERS_MAX];
+  memset(taken, 0, _size);
+  for (uint8_t count = 0; count < n; count++) {
+    int16_t best = -1;
+    for (uint8_t i = 0; i < _size; i++) {
+      if (!taken[i] && (best < 0 || _heap[i].bytes > _heap[best].bytes)) best = i;
+    }
+    taken[best] = true;
+    out[count] = _heap[best];
+  }
+  return n;
+}
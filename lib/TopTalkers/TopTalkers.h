@@ -0,0 +1,68 @@
+/**
+* Heaviest data frame transmitters by bytes, in a fixed number of counters
+* (weighted Space-Saving). A min-heap keeps the counters ordered by bytes
+* and an open addressing index maps a MAC to its heap position, so a frame
+* costs one hash lookup and a sift down the heap. A station not in the table
+* takes over the smallest counter and inherits its bytes as overestimate
+* (error); any station with more than total / capacity bytes is sure to be
+* in the table, with its bytes counted at most error too high.
+* Data frames come many times faster than probes: add() runs in the WiFi
+* callback and neither allocates nor divides.
+*/
+
+#ifndef TOP_TALKERS_H
+#define TOP_TALKERS_H
+
+#include <stdint.h>
+#include <Arena.h>
+
+#define TOP_TALKERS_MAX 127
+
+struct Talker {
+  uint8_t mac[6];
+  uint8_t channel;            // last heard on
+  int8_t rssi;                // of the last frame
+  uint32_t frames;            // its own, since it took the counter
+  uint32_t bytes;             // including error
+  uint32_t error;             // bytes inherited from the stations it replaced
+};
+
+static_assert(sizeof(Talker) == 20, "Talker must stay 20 bytes");
+
+class TopTalkers {
+public:
+  TopTalkers();
+
+  // capacity up to TOP_TALKERS_MAX counters.
+  bool begin(Arena &arena, uint8_t capacity);
+
+  void add(const uint8_t *mac, uint8_t channel, int8_t rssi, uint32_t frames, uint32_t bytes);
+  // Copies the n heaviest, heaviest first; returns how many there were.
+  uint8_t top(Talker *out, uint8_t n) const;
+  void clear();
+
+  uint8_t size() const { return _size; }
+  uint8_t capacity() const { return _capacity; }
+  // All data frames added since clear(), also those of stations not kept.
+  uint32_t totalFrames() const { return _totalFrames; }
+  uint32_t totalBytes() const { return _totalBytes; }
+
+private:
+  uint8_t home(const uint8_t *mac) const;
+  void place(uint8_t pos, uint8_t slot);
+  void swap(uint8_t a, uint8_t b);
+  void siftUp(uint8_t pos);
+  void siftDown(uint8_t pos);
+  void unindex(uint8_t slot);
+
+  Talker *_heap;
+  uint8_t *_slotOf;           // index slot of each heap entry
+  uint8_t *_index;            // heap position + 1, 0 empty
+  uint8_t _mask;
+  uint8_t _capacity;
+  uint8_t _size;
+  uint32_t _totalFrames;
+  uint32_t _totalBytes;
+};
+
+#endif
@@ -0,0 +1,124 @@
+#include "Watchlist.h"
+
+#include <stddef.h>
+
+#define KEY_FLAGS 0x03UL
+
+Watchlist::Watchlist()
+  : _active(&_tables[0]), _capacity(0), _loadCount(0), _loading(false), _overflow(false),
+    _committing(false), _heapBuild(0), _heapEnd(0), _generation(0) {
+  _tables[0].keys = _tables[1].keys = NULL;
+  _tables[0].count = _tables[1].count = 0;
+}
+
+bool Watchlist::begin(Arena &arena, uint16_t maxEntries) {
+  _tables[0].keys = arena.allocateArray<uint32_t>("watchlist", maxEntries);
+  _tables[1].keys = arena.allocateArray<uint32_t>("watchlist load", maxEntries);
+  _tables[0].count = _tables[1].count = 0;
+  _active = &_tables[0];
+  _capacity = maxEntries;
+  return _tables[0].keys != NULL && _tables[1].keys != NULL;
+}
+
+uint32_t Watchlist::key(const uint8_t *mac, uint8_t flags) {
+  uint64_t h = 0;
+  for (uint8_t i = 0; i < 6; i++) {
+    h = (h << 8) | mac[i];
+  }
+  // splitmix64 finalizer, as QuotientFilter::fingerprintMAC.
+  h += 0x9e3779b97f4a7c15ULL;
+  h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+  h ^= h >> 31;
+  return ((uint32_t)h & ~KEY_FLAGS) | (flags & KEY_FLAGS);
+}
+
+uint8_t Watchlist::lookup(const uint8_t *mac) const {
+  const Table *t = _active;
+  if (t->count == 0) return 0;
+  uint32_t hash = key(mac, 0);
+  uint16_t lo = 0;
+  uint16_t hi = t->count;
+  while (lo < hi) {
+    uint16_t mid = (lo + hi) / 2;
+    uint32_t k = t->keys[mid] & ~KEY_FLAGS;
+    if (k == hash) return t->keys[mid] & KEY_FLAGS;
+    if (k < hash) lo = mid + 1;
+    else hi = mid;
+  }
+  return 0;
+}
+
+void Watchlist::loadBegin() {
+  _loading = true;
+  _committing = false;
+  _overflow = false;
+  _loadCount = 0;
+}
+
+bool Watchlist::loadAdd(const uint8_t *mac, uint8_t flags) {
+  if (!_loading) return false;
+  if (_loadCount >= _capacity) {
+    _overflow = true;
+    return false;
+  }
+  Table *standby = _active == &_tables[0] ? &_tables[1] : &_tables[0];
+  standby->keys[_loadCount++] = key(mac, flags);
+  return true;
+}
+
+// In place heapsort: no extra memory, and done in steps of a bounded run time in loop().
+static void siftDown(uint32_t *a, uint16_t root, uint16_t n) {
+  for (;;) {
+    uint32_t child = 2UL * root + 1;
+    if (child >= n) return;
+    if (child + 1 < n && a[child + 1] > a[child]) child++;
+    if (a[root] >= a[child]) return;
+    uint32_t tmp = a[root];
+    a[root] = a[child];
+    a[child] = tmp;
+    root = child;
+  }
+}
+
+bool Watchlist::loadCommit(uint16_t expected) {
+  bool ok = _loading && !_overflow && _loadCount == expected;
+  _loading = false;
+  if (!ok) return false;
+  _committing = true;
+  _heapBuild = _loadCount / 2;
+  _heapEnd = _loadCount;
+  return true;
+}
+
+bool Watchlist::commitStep() {
+  if (!_committing) return false;
+  Table *standby = _active == &_tables[0] ? &_tables[1] : &_tables[0];
+  uint32_t *keys = standby->keys;
+  for (uint8_t i = 0; i < WATCHLIST_COMMIT_SIFTS; i++) {
+    if (_heapBuild > 0) {
+      siftDown(keys, --_heapBuild, _loadCount);
+    } else if (_heapEnd > 1) {
+      _heapEnd--;
+      uint32_t tmp = keys[0];
+      keys[0] = keys[_heapEnd];
+      keys[_heapEnd] = tmp;
+      siftDown(keys, 0, _heapEnd);
+    } else {
+      break;
+    }
+  }
+  if (_heapBuild > 0 || _heapEnd > 1) return true;
+
+  // The same MAC listed twice keeps both flags.
+  uint16_t n = 0;
+  for (uint16_t i = 0; i < _loadCount; i++) {
+    if (n > 0 && (keys[n - 1] & ~KEY_FLAGS) == (keys[i] & ~KEY_FLAGS)) keys[n - 1] |= keys[i];
+    else keys[n++] = keys[i];
+  }
+  standby->count = n;
+  _active = standby;
+  _generation++;
+  _committing = false;
+  return false;
+}
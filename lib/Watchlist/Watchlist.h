@@ -0,0 +1,88 @@
+/**
+* Device watchlist: staff devices excluded from counts and devices flagged
+* for reporting.
+* Each MAC is kept as a 32-bit key (30-bit hash, 2 flag bits) in a sorted
+* array, looked up by binary search; 4 bytes per device so a few thousand
+* fit in RAM, at a ~n/2^30 chance of a stranger matching.
+* There are two tables: a new list is loaded and sorted into the standby
+* one while the active one keeps answering, then the active pointer is
+* swapped with a single store. Lookups run in the WiFi callback and loads
+* in loop(), which don't preempt each other, so the old table is no longer
+* read by the time the next load starts writing it.
+* A commit names the records the host sent, a load missing any is
+* rejected; the accepted one is heap sorted a few steps at a time from
+* loop() (commitStep()) and only then swapped in.
+*/
+
+#ifndef WATCHLIST_H
+#define WATCHLIST_H
+
+#include <stdint.h>
+#include <Arena.h>
+
+#define WATCH_EXCLUDE   0x01    // staff device, not counted
+#define WATCH_FLAG      0x02    // report when seen
+
+#define WATCHLIST_COMMIT_SIFTS 16     // heap sift downs per commitStep()
+
+// Load record, as sent by the host and stored in flash.
+struct WatchRecord {
+  uint8_t mac[6];
+  uint8_t flags;
+};
+
+#define WATCH_RECORD_LENGTH 7
+
+static_assert(sizeof(WatchRecord) == WATCH_RECORD_LENGTH, "WatchRecord must stay 7 bytes");
+
+class Watchlist {
+public:
+  Watchlist();
+
+  // Two tables of maxEntries keys from the arena.
+  bool begin(Arena &arena, uint16_t maxEntries);
+
+  // WATCH_* flags of mac, 0 when not listed.
+  uint8_t lookup(const uint8_t *mac) const;
+
+  // Loading goes to the standby table, the active one is untouched until
+  // loadCommit() swaps them. A new loadBegin() discards a partial load.
+  void loadBegin();
+  // False (and the load is marked overflowed) when the table is full.
+  bool loadAdd(const uint8_t *mac, uint8_t flags);
+  // Ends the load and starts sorting it. False if no load was begun, it
+  // overflowed or it doesn't hold the expected records; the active list is
+  // kept then.
+  bool loadCommit(uint16_t expected);
+  // Sorts a committed load some more; after the last step merges
+  // duplicates and activates it. True while there is more to do.
+  bool commitStep();
+  bool loading() const { return _loading; }
+  bool committing() const { return _committing; }
+
+  uint16_t count() const { return _active->count; }
+  uint16_t capacity() const { return _capacity; }
+  // Incremented by every commit.
+  uint32_t generation() const { return _generation; }
+
+  static uint32_t key(const uint8_t *mac, uint8_t flags);
+
+private:
+  struct Table {
+    uint32_t *keys;
+    uint16_t count;
+  };
+
+  Table _tables[2];
+  Table * volatile _active;
+  uint16_t _capacity;
+  uint16_t _loadCount;
+  bool _loading;
+  bool _overflow;
+  bool _committing;
+  uint16_t _heapBuild;        // heap sort: next root to sift down while building
+  uint16_t _heapEnd;          // then the unsorted length
+  uint32_t _generation;
+};
+
+#endif
@@ -0,0 +1,363 @@
+/**
+* Accuracy regression harness for the device counters.
+* A labelled corpus (built-in synthetic scenarios with known devices, or
+* captures with a .labels file) is cut into sweep periods (14 hops), and
+* every estimator's per-period count is compared with the true number of
+* devices present: relative error per period, then per estimator and
+* scenario the bias (mean), mean absolute relative error and variance, next
+* to the estimator's throughput in frames per CPU second.
+* Estimators: the sniffer core counting through its MAC buffer (buffer,
+* buffer_all_macs with local MACs kept), through the quotient filter
+* (quotient_filter) and the sweep tracker (sweep_tracker, new + returning),
+* all on the hopping radio's view; and host side references on the same
+* view: distinct MACs heard (heard_macs) and randomized MACs merged by IE
+* fingerprint (ie_merge).
+* Rows go to stdout as CSV, or JSON lines with -J, so runs before and after
+* a change can be diffed.
+* Usage: accuracy [-n seeds] [-i hop_ms] [-b buffer] [-J] [-w dir]
+*        accuracy [-i hop_ms] [-b buffer] [-J] <capture.pcap>...
+*   -n  seeds per built-in scenario (3)
+*   -w  write the built-in corpus as dir/<scenario>-<seed>.pcap plus .labels
+*  A .labels file (next to the capture, same base name) holds "period_ms,N"
+*  and then one "end_ms,devices" line per period.
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include <Arena.h>
+#include <FrameDigest.h>
+#include <SnifferCore.h>
+#include "../host/capture.h"
+#include "../host/corpus.h"
+#include "../host/host_hal.h"
+#include "../host/replay.h"
+#include "../host/synthetic.h"
+
+#define ACCURACY_ARENA_SIZE (256 * 1024)
+#define SWEEP_HOPS 14
+
+struct Scenario {
+  const char *name;
+  uint32_t durationS;
+  float arrivalsPerS;
+  float dwellS;
+  float probeIntervalS;
+  uint8_t localMacPercent;
+  float macRotateS;
+  uint32_t surgeStartS;
+  uint32_t surgeLengthS;
+  float surgeArrivalsPerS;
+};
+
+// The curated corpus: keep the list stable, add scenarios at the end.
+static const Scenario scenarios[] = {
+  { "quiet",      3600, 0.05f,  600, 60,  0,   0,    0,   0, 0 },
+  { "cafe",       3600, 0.3f,   900, 45, 30,   0,    0,   0, 0 },
+  { "busy",       3600, 2.0f,   300, 30, 30,   0,    0,   0, 0 },
+  { "randomized", 3600, 0.3f,   600, 45, 80, 300,    0,   0, 0 },
+  { "rotating",   3600, 0.3f,   600, 30, 80, 0.001f, 0,   0, 0 },
+  { "surge",      3600, 0.2f,   300, 45, 30,   0, 1800, 600, 3 },
+};
+#define SCENARIOS (sizeof(scenarios) / sizeof(scenarios[0]))
+
+// A corpus entry with its labels.
+struct LabelledEntry {
+  std::string scenario;
+  CorpusEntry corpus;
+  uint32_t periodMs;
+  std::vector<uint32_t> truth;        // devices per period
+};
+
+enum Estimator {
+  EST_BUFFER,
+  EST_BUFFER_ALL_MACS,
+  EST_QUOTIENT_FILTER,
+  EST_SWEEP_TRACKER,
+  EST_HEARD_MACS,
+  EST_IE_MERGE,
+  EST_COUNT
+};
+
+static const char *estimatorNames[EST_COUNT] = {
+  "buffer", "buffer_all_macs", "quotient_filter", "sweep_tracker", "heard_macs", "ie_merge"
+};
+
+struct Options {
+  uint32_t hopIntervalMs;
+  uint16_t bufferSize;
+};
+
+struct Errors {
+  std::vector<double> relative;
+  double truth;
+  double estimate;
+  uint64_t frames;
+  double cpuS;
+};
+
+// What the sensor prints at the end of each sweep.
+struct Reported {
+  std::vector<uint32_t> totals;       // "Total clients"
+  std::vector<uint32_t> sweeps;       // sweep tracker, new + returning
+};
+
+static void onLine(void *ctx, uint32_t nowMs, const char *line) {
+  (void)nowMs;
+  Reported &r = *(Reported *)ctx;
+  uint32_t count;
+  unsigned sweep, fresh, returning;
+  if (parseTotalClients(line, count)) r.totals.push_back(count);
+  if (sscanf(line, "Sweep %u: new %u returning %u", &sweep, &fresh, &returning) == 3) {
+    r.sweeps.push_back(fresh + returning);
+  }
+}
+
+// Per period counts of the sniffer core, as it reports them.
+static std::vector<uint32_t> runCore(Estimator estimator, const Options &options, const LabelledEntry &entry) {
+  SnifferConfig config;
+  replayConfigDefaults(config);
+  config.hopIntervalMs = options.hopIntervalMs;
+  config.bufferSize = options.bufferSize;
+  config.spiSendClientCount = true;
+  config.ignoreLocalMacs = estimator != EST_BUFFER_ALL_MACS;
+  config.dedupQuotientFilter = estimator == EST_QUOTIENT_FILTER;
+  config.surgeDetect = false;
+  if (estimator != EST_SWEEP_TRACKER) config.sweepTrackerSlots = 0;
+
+  std::vector<uint64_t> pool(ACCURACY_ARENA_SIZE / sizeof(uint64_t));
+  Arena arena((uint8_t *)pool.data(), ACCURACY_ARENA_SIZE);
+  HostHal hal(NULL, config.initialChannel);
+  SnifferCore core(hal, config);
+  Replay replay(core, hal, false);
+  Reported reported;
+  hal.onLine(onLine, &reported);
+  if (!core.begin(arena)) return reported.totals;
+  arena.seal();
+  for (size_t i = 0; i < entry.corpus.frames.size(); i++) replay.feed(entry.corpus.frames[i]);
+  replay.advance(entry.periodMs * entry.truth.size());
+  return estimator == EST_SWEEP_TRACKER ? reported.sweeps : reported.totals;
+}
+
+// The channel the hopping sensor is on at ms, as Replay tunes it.
+static uint8_t tunedChannel(uint64_t ms, uint32_t hopMs) {
+  return 1 + (ms / hopMs) % SWEEP_HOPS;
+}
+
+// Host side references over the frames the hopping radio hears.
+static std::vector<uint32_t> runHost(Estimator estimator, const Options &options, const LabelledEntry &entry) {
+  std::vector<uint32_t> counts;
+  std::unordered_set<uint64_t> macs;
+  uint64_t periodEnd = entry.periodMs;
+  for (size_t i = 0; i < entry.corpus.frames.size(); i++) {
+    const CaptureFrame &f = entry.corpus.frames[i];
+    uint64_t ms = f.timeUs / 1000;
+    while (ms >= periodEnd) {
+      counts.push_back(macs.size());
+      macs.clear();
+      periodEnd += entry.periodMs;
+    }
+    if (f.channel != 0 && f.channel != tunedChannel(ms, options.hopIntervalMs)) continue;
+    FrameDigest d;
+    if ((f.packet.data[0] >> 4) != SUBTYPE_PROBE_REQUEST || (f.packet.data[0] & 0x0c) != 0 ||
+        !makeDigest(f.packet.data, f.packet.len < DATA_LENGTH ? f.packet.len : DATA_LENGTH,
+                    f.packet.rx_ctrl.rssi, f.channel, ms, d)) {
+      continue;
+    }
+    uint64_t key = 0;
+    for (int b = 0; b < 6; b++) key = (key << 8) | d.mac[b];
+    // randomized MACs of one IE layout are taken for one device.
+    if (estimator == EST_IE_MERGE && (d.channelFlags & DIGEST_FLAG_LOCAL_MAC)) key = 1ULL << 63 | d.ieFingerprint;
+    macs.insert(key);
+  }
+  while (counts.size() < entry.truth.size()) {
+    counts.push_back(macs.size());
+    macs.clear();
+  }
+  return counts;
+}
+
+static void evaluate(const Options &options, const LabelledEntry &entry, Errors *errors) {
+  for (int e = 0; e < EST_COUNT; e++) {
+    double start = threadCpuS();
+    std::vector<uint32_t> counts = e < EST_HEARD_MACS ? runCore((Estimator)e, options, entry)
+                                                      : runHost((Estimator)e, options, entry);
+    errors[e].cpuS += threadCpuS() - start;
+    errors[e].frames += entry.corpus.frames.size();
+    for (size_t p = 0; p < entry.truth.size() && p < counts.size(); p++) {
+      if (entry.truth[p] == 0) continue;
+      errors[e].truth += entry.truth[p];
+      errors[e].estimate += counts[p];
+      errors[e].relative.push_back(((double)counts[p] - entry.truth[p]) / entry.truth[p]);
+    }
+  }
+}
+
+static void generate(const Scenario &s, uint32_t seed, uint32_t periodMs, LabelledEntry &entry) {
+  CrowdScenario scenario;
+  crowdScenarioDefaults(scenario);
+  scenario.seed = seed;
+  scenario.durationS = s.durationS;
+  scenario.arrivalsPerS = s.arrivalsPerS;
+  scenario.dwellS = s.dwellS;
+  scenario.probeIntervalS = s.probeIntervalS;
+  scenario.localMacPercent = s.localMacPercent;
+  scenario.macRotateS = s.macRotateS;
+  scenario.surgeStartS = s.surgeStartS;
+  scenario.surgeLengthS = s.surgeLengthS;
+  scenario.surgeArrivalsPerS = s.surgeArrivalsPerS;
+
+  char name[64];
+  sprintf(name, "%s-%u", s.name, (unsigned)seed);
+  entry.scenario = s.name;
+  entry.periodMs = periodMs;
+  generateCorpusCrowd(scenario, name, entry.corpus);
+  entry.truth = devicesPerPeriod(entry.corpus, periodMs);
+}
+
+static std::string labelsPath(const std::string &capture) {
+  size_t dot = capture.rfind('.');
+  size_t slash = capture.rfind('/');
+  if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) return capture + ".labels";
+  return capture.substr(0, dot) + ".labels";
+}
+
+static bool writeEntry(const std::string &dir, const LabelledEntry &entry) {
+  std::string base = dir + "/" + entry.corpus.name;
+  CaptureWriter writer;
+  if (!writer.open((base + ".pcap").c_str(), DATA_LENGTH)) {
+    fprintf(stderr, "%s.pcap: can't write\n", base.c_str());
+    return false;
+  }
+  for (size_t i = 0; i < entry.corpus.frames.size(); i++) {
+    const CaptureFrame &f = entry.corpus.frames[i];
+    uint16_t captured = f.packet.len < DATA_LENGTH ? f.packet.len : DATA_LENGTH;
+    writer.write(f.timeUs, f.packet.data, captured, f.packet.len, f.channel, f.packet.rx_ctrl.rssi);
+  }
+  FILE *labels = fopen((base + ".labels").c_str(), "w");
+  if (!writer.close() || !labels) {
+    fprintf(stderr, "%s: can't write\n", base.c_str());
+    if (labels) fclose(labels);
+    return false;
+  }
+  fprintf(labels, "period_ms,%u\n", (unsigned)entry.periodMs);
+  for (size_t p = 0; p < entry.truth.size(); p++) {
+    fprintf(labels, "%u,%u\n", (unsigned)(entry.periodMs * (p + 1)), (unsigned)entry.truth[p]);
+  }
+  return fclose(labels) == 0;
+}
+
+static bool readEntry(const char *path, uint32_t periodMs, LabelledEntry &entry) {
+  std::string labels = labelsPath(path);
+  FILE *f = fopen(labels.c_str(), "r");
+  unsigned period = 0;
+  if (!f || fscanf(f, "period_ms,%u", &period) != 1) {
+    fprintf(stderr, "%s: no labels\n", labels.c_str());
+    if (f) fclose(f);
+    return false;
+  }
+  unsigned endMs, devices;
+  while (fscanf(f, "%u,%u", &endMs, &devices) == 2) entry.truth.push_back(devices);
+  fclose(f);
+  if (period != periodMs) {
+    fprintf(stderr, "%s: labelled per %u ms, sweeps take %u ms (-i %u)\n", labels.c_str(), period,
+      (unsigned)periodMs, (unsigned)(period / SWEEP_HOPS));
+    return false;
+  }
+  if (!loadCorpusCapture(path, entry.corpus)) return false;
+  entry.scenario = path;
+  entry.periodMs = periodMs;
+  return true;
+}
+
+static void report(const std::string &scenario, Errors *errors, bool json) {
+  for (int e = 0; e < EST_COUNT; e++) {
+    const Errors &r = errors[e];
+    size_t n = r.relative.size();
+    double bias = 0, absolute = 0, variance = 0;
+    for (size_t i = 0; i < n; i++) {
+      bias += r.relative[i];
+      absolute += fabs(r.relative[i]);
+    }
+    if (n) {
+      bias /= n;
+      absolute /= n;
+    }
+    for (size_t i = 0; i < n; i++) variance += (r.relative[i] - bias) * (r.relative[i] - bias);
+    if (n > 1) variance /= n - 1;
+    double rate = r.cpuS > 0 ? r.frames / r.cpuS : 0;
+    if (json) {
+      printf("{\"estimator\":\"%s\",\"scenario\":\"%s\",\"samples\":%u,\"truth_mean\":%.2f,"
+             "\"estimate_mean\":%.2f,\"bias\":%.4f,\"mare\":%.4f,\"variance\":%.5f,\"frames_per_s\":%.0f}\n",
+        estimatorNames[e], scenario.c_str(), (unsigned)n, n ? r.truth / n : 0.0, n ? r.estimate / n : 0.0,
+        bias, absolute, variance, rate);
+    } else {
+      printf("%s,%s,%u,%.2f,%.2f,%.4f,%.4f,%.5f,%.0f\n", estimatorNames[e], scenario.c_str(), (unsigned)n,
+        n ? r.truth / n : 0.0, n ? r.estimate / n : 0.0, bias, absolute, variance, rate);
+    }
+  }
+}
+
+static void usage() {
+  fprintf(stderr,
+    "usage: accuracy [-n seeds] [-i hop_ms] [-b buffer] [-J] [-w dir]\n"
+    "       accuracy [-i hop_ms] [-b buffer] [-J] <capture.pcap>...\n");
+}
+
+int main(int argc, char **argv) {
+  Options options;
+  options.hopIntervalMs = 30000;
+  options.bufferSize = 100;
+  unsigned seeds = 3;
+  bool json = false;
+  const char *writeDir = NULL;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:i:b:Jw:h")) != -1) {
+    switch (opt) {
+      case 'n': seeds = atoi(optarg); break;
+      case 'i': options.hopIntervalMs = atoi(optarg); break;
+      case 'b': options.bufferSize = atoi(optarg); break;
+      case 'J': json = true; break;
+      case 'w': writeDir = optarg; break;
+      default: usage(); return 2;
+    }
+  }
+  if (options.hopIntervalMs == 0 || (writeDir && optind < argc)) {
+    usage();
+    return 2;
+  }
+  uint32_t periodMs = SWEEP_HOPS * options.hopIntervalMs;
+
+  const char *header = "estimator,scenario,samples,truth_mean,estimate_mean,bias,mare,variance,frames_per_s\n";
+  if (optind < argc) {
+    for (int i = optind; i < argc; i++) {
+      LabelledEntry entry;
+      if (!readEntry(argv[i], periodMs, entry)) return 1;
+      if (!json && i == optind) printf("%s", header);
+      Errors errors[EST_COUNT] = {};
+      evaluate(options, entry, errors);
+      report(entry.scenario, errors, json);
+    }
+    return 0;
+  }
+  if (!json) printf("%s", header);
+  for (size_t s = 0; s < SCENARIOS; s++) {
+    Errors errors[EST_COUNT] = {};
+    for (unsigned seed = 1; seed <= seeds; seed++) {
+      LabelledEntry entry;
+      generate(scenarios[s], seed, periodMs, entry);
+      if (writeDir && !writeEntry(writeDir, entry)) return 1;
+      evaluate(options, entry, errors);
+    }
+    report(scenarios[s].name, errors, json);
+    fflush(stdout);
+  }
+  return 0;
+}
@@ -0,0 +1,305 @@
+#include "arrow_writer.h"
+
+#include <errno.h>
+
+// Message.fbs and Schema.fbs values.
+#define ARROW_METADATA_V5        4
+#define ARROW_HEADER_SCHEMA      1
+#define ARROW_HEADER_RECORD_BATCH 3
+#define ARROW_TYPE_INT           2
+#define ARROW_TYPE_TIMESTAMP     10
+#define ARROW_UNIT_MILLISECOND   1
+
+static const uint8_t magic[8] = { 'A', 'R', 'R', 'O', 'W', '1', 0, 0 };
+static const uint8_t zeros[8] = { 0 };
+
+static size_t padded(size_t length) {
+  return (length + 7) & ~(size_t)7;
+}
+
+FlatBuilder::FlatBuilder() : _buf(1024), _size(0), _maxAlign(1), _tableStart(0), _slotCount(0) {
+}
+
+void FlatBuilder::clear() {
+  _size = 0;
+  _maxAlign = 1;
+}
+
+void FlatBuilder::grow(size_t length) {
+  if (_size + length <= _buf.size()) return;
+  size_t capacity = _buf.size();
+  while (capacity < _size + length) capacity *= 2;
+  std::vector<uint8_t> buf(capacity);
+  memcpy(&buf[capacity - _size], _buf.data() + _buf.size() - _size, _size);
+  _buf.swap(buf);
+}
+
+// Pads so that the next extra bytes end on a multiple of alignment.
+void FlatBuilder::align(size_t alignment, size_t extra) {
+  if (alignment > _maxAlign) _maxAlign = alignment;
+  size_t pad = (alignment - (_size + extra) % alignment) % alignment;
+  grow(pad);
+  _size += pad;
+  memset(_buf.data() + _buf.size() - _size, 0, pad);
+}
+
+void FlatBuilder::bytes(const void *data, size_t length) {
+  if (length == 0) return;
+  grow(length);
+  _size += length;
+  memcpy(_buf.data() + _buf.size() - _size, data, length);
+}
+
+// An offset field points forward, at an object built before it.
+void FlatBuilder::offset(uint32_t target) {
+  align(4);
+  uint32_t relative = _size + 4 - target;
+  bytes(&relative, 4);
+}
+
+uint32_t FlatBuilder::string(const char *text) {
+  size_t length = strlen(text);
+  align(4, length + 1);
+  bytes(zeros, 1);
+  bytes(text, length);
+  scalar<uint32_t>(length);
+  return _size;
+}
+
+uint32_t FlatBuilder::offsets(const uint32_t *targets, size_t count) {
+  align(4, count * 4);
+  for (size_t i = count; i-- > 0;) offset(targets[i]);
+  scalar<uint32_t>(count);
+  return _size;
+}
+
+uint32_t FlatBuilder::structs(const void *data, size_t size, size_t count) {
+  align(8, size * count);
+  bytes(data, size * count);
+  scalar<uint32_t>(count);
+  return _size;
+}
+
+void FlatBuilder::startTable() {
+  _tableStart = _size;
+  _slotCount = 0;
+  memset(_slots, 0, sizeof(_slots));
+}
+
+void FlatBuilder::mark(uint8_t slot) {
+  _slots[slot] = _size;
+  if (slot >= _slotCount) _slotCount = slot + 1;
+}
+
+void FlatBuilder::offsetField(uint8_t slot, uint32_t target) {
+  offset(target);
+  mark(slot);
+}
+
+// The table's first word is the distance back to its vtable, written
+// right before it: vtable size, table size, offset of each field.
+uint32_t FlatBuilder::endTable() {
+  scalar<int32_t>(0);
+  uint32_t table = _size;
+  uint16_t vtable[2 + sizeof(_slots) / sizeof(_slots[0])];
+  vtable[0] = (2 + _slotCount) * 2;
+  vtable[1] = table - _tableStart;
+  for (uint8_t i = 0; i < _slotCount; i++) vtable[2 + i] = _slots[i] ? table - _slots[i] : 0;
+  bytes(vtable, vtable[0]);
+  int32_t back = _size - table;
+  memcpy(_buf.data() + _buf.size() - table, &back, 4);
+  return table;
+}
+
+void FlatBuilder::finish(uint32_t root) {
+  align(_maxAlign > 4 ? _maxAlign : 4, 4);
+  offset(root);
+}
+
+ArrowWriter::ArrowWriter(const ArrowField *fields, uint8_t count, uint32_t batchRows)
+  : _batchRows(batchRows), _rows(0), _out(NULL), _fileLayout(false), _position(0), _rowsWritten(0), _batches(0),
+    _error(NULL) {
+  if (count > ARROW_COLUMNS_MAX) count = ARROW_COLUMNS_MAX;
+  size_t words = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    words += padded(batchRows * fields[i].bytes) / 8;
+    if (fields[i].nullable) words += padded((batchRows + 7) / 8) / 8;
+  }
+  _storage.assign(words, 0);
+  uint8_t *at = (uint8_t *)_storage.data();
+  for (uint8_t i = 0; i < count; i++) {
+    Column c = { fields[i], at, NULL };
+    at += padded(batchRows * fields[i].bytes);
+    if (fields[i].nullable) {
+      c.validity = at;
+      at += padded((batchRows + 7) / 8);
+    }
+    _columns.push_back(c);
+  }
+}
+
+ArrowWriter::~ArrowWriter() {
+  if (_out && _out != stdout) fclose(_out);
+}
+
+bool ArrowWriter::write(const void *data, size_t length) {
+  if (_error) return false;
+  if (length && fwrite(data, 1, length, _out) != length) {
+    _error = strerror(errno);
+    return false;
+  }
+  _position += length;
+  return true;
+}
+
+uint32_t ArrowWriter::schema(FlatBuilder &b) {
+  uint32_t fields[ARROW_COLUMNS_MAX];
+  uint32_t noChildren = b.offsets(NULL, 0);
+  size_t count = _columns.size();
+  for (size_t i = 0; i < count; i++) {
+    const ArrowField &f = _columns[i].field;
+    uint32_t name = b.string(f.name);
+    uint32_t type;
+    uint8_t typeType;
+    if (f.type == ARROW_TIMESTAMP_MS) {
+      uint32_t timezone = b.string("UTC");
+      b.startTable();
+      b.offsetField(1, timezone);
+      b.field<int16_t>(0, ARROW_UNIT_MILLISECOND);
+      type = b.endTable();
+      typeType = ARROW_TYPE_TIMESTAMP;
+    } else {
+      b.startTable();
+      b.field<int32_t>(0, f.bytes * 8);
+      b.field<uint8_t>(1, f.isSigned);
+      type = b.endTable();
+      typeType = ARROW_TYPE_INT;
+    }
+    b.startTable();
+    b.offsetField(0, name);
+    b.offsetField(3, type);
+    b.offsetField(5, noChildren);
+    b.field<uint8_t>(1, f.nullable);
+    b.field<uint8_t>(2, typeType);
+    fields[i] = b.endTable();
+  }
+  uint32_t list = b.offsets(fields, count);
+  b.startTable();
+  b.offsetField(1, list);
+  b.field<int16_t>(0, 0);     // little endian
+  return b.endTable();
+}
+
+// The builder holds the header; the message goes out as continuation
+// marker, metadata length, metadata padded to 8.
+bool ArrowWriter::message(uint8_t headerType, uint32_t header, int64_t bodyLength, int32_t &metadataLength) {
+  FlatBuilder &b = _builder;
+  b.startTable();
+  b.field<int64_t>(3, bodyLength);
+  b.offsetField(2, header);
+  b.field<int16_t>(0, ARROW_METADATA_V5);
+  b.field<uint8_t>(1, headerType);
+  b.finish(b.endTable());
+  int32_t prefix[2] = { -1, (int32_t)padded(b.size()) };
+  metadataLength = 8 + prefix[1];
+  return write(prefix, 8) && write(b.data(), b.size()) && write(zeros, prefix[1] - b.size());
+}
+
+bool ArrowWriter::open(const char *path, bool fileLayout) {
+  _out = strcmp(path, "-") == 0 ? stdout : fopen(path, "wb");
+  _error = _out ? NULL : strerror(errno);
+  if (!_out) return false;
+  _fileLayout = fileLayout;
+  _position = 0;
+  _blocks.clear();
+  if (fileLayout && !write(magic, sizeof(magic))) return false;
+  _builder.clear();
+  int32_t metadataLength;
+  return message(ARROW_HEADER_SCHEMA, schema(_builder), 0, metadataLength);
+}
+
+// Body: per column the validity bitmap (nullable ones) and the values,
+// each padded to 8. The rows are gone either way, the next batch starts
+// empty.
+bool ArrowWriter::flush() {
+  if (_rows == 0) return _out && !_error;
+  int64_t nodes[2 * ARROW_COLUMNS_MAX];
+  int64_t buffers[4 * ARROW_COLUMNS_MAX];
+  size_t count = _columns.size();
+  int64_t bodyLength = 0;
+  for (size_t i = 0; i < count; i++) {
+    const Column &c = _columns[i];
+    size_t validityLength = c.validity ? (_rows + 7) / 8 : 0;
+    uint32_t valid = _rows;
+    if (c.validity) {
+      valid = 0;
+      for (size_t k = 0; k < validityLength; k++) valid += __builtin_popcount(c.validity[k]);
+    }
+    nodes[2 * i] = _rows;
+    nodes[2 * i + 1] = _rows - valid;
+    buffers[4 * i] = bodyLength;
+    buffers[4 * i + 1] = validityLength;
+    bodyLength += padded(validityLength);
+    buffers[4 * i + 2] = bodyLength;
+    buffers[4 * i + 3] = _rows * c.field.bytes;
+    bodyLength += padded(_rows * c.field.bytes);
+  }
+  FlatBuilder &b = _builder;
+  b.clear();
+  uint32_t nodeVector = b.structs(nodes, 16, count);
+  uint32_t bufferVector = b.structs(buffers, 16, 2 * count);
+  b.startTable();
+  b.field<int64_t>(0, _rows);
+  b.offsetField(1, nodeVector);
+  b.offsetField(2, bufferVector);
+  uint32_t batch = b.endTable();
+  Block block = { (int64_t)_position, 0, 0, bodyLength };
+  bool ok = _out && message(ARROW_HEADER_RECORD_BATCH, batch, bodyLength, block.metadataLength);
+  for (size_t i = 0; i < count; i++) {
+    Column &c = _columns[i];
+    size_t validityLength = c.validity ? (_rows + 7) / 8 : 0;
+    size_t dataLength = _rows * c.field.bytes;
+    ok = ok && write(c.validity, validityLength) && write(zeros, padded(validityLength) - validityLength) &&
+         write(c.data, dataLength) && write(zeros, padded(dataLength) - dataLength);
+    if (c.validity) memset(c.validity, 0, validityLength);
+  }
+  if (ok && fflush(_out) != 0) {
+    _error = strerror(errno);
+    ok = false;
+  }
+  if (ok) {
+    if (_fileLayout) _blocks.push_back(block);
+    _rowsWritten += _rows;
+    _batches++;
+  }
+  _rows = 0;
+  return ok;
+}
+
+bool ArrowWriter::close() {
+  if (!_out) return false;
+  static const int32_t end[2] = { -1, 0 };
+  bool ok = flush() && write(end, sizeof(end));
+  if (ok && _fileLayout) {
+    FlatBuilder &b = _builder;
+    b.clear();
+    uint32_t s = schema(b);
+    uint32_t dictionaries = b.structs(NULL, sizeof(Block), 0);
+    uint32_t batches = b.structs(_blocks.data(), sizeof(Block), _blocks.size());
+    b.startTable();
+    b.offsetField(1, s);
+    b.offsetField(2, dictionaries);
+    b.offsetField(3, batches);
+    b.field<int16_t>(0, ARROW_METADATA_V5);
+    b.finish(b.endTable());
+    int32_t length = b.size();
+    ok = write(b.data(), b.size()) && write(&length, 4) && write(magic, 6);
+  }
+  if (_out == stdout) {
+    if (fflush(_out) != 0 && !_error) _error = strerror(errno);
+  } else if (fclose(_out) != 0 && !_error) {
+    _error = strerror(errno);
+  }
+  _out = NULL;
+  return ok && !_error;
+}
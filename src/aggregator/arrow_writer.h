@@ -0,0 +1,146 @@
+/**
+* Apache Arrow IPC output of fixed width columns, for columnar tools
+* (pyarrow, DuckDB, Polars) to read without parsing text.
+* Rows are written column by column into buffers sized for a whole batch
+* when the writer is made; a full batch (or flush()) goes out as one
+* record batch message whose body is those buffers as they are, so a row
+* costs a few stores and no allocation.
+* Two layouts: the IPC stream (schema, batches, end marker) for pipes and
+* files read as they grow, and the IPC file (the stream between "ARROW1"
+* magics, with a footer indexing the batches) written on close(), which
+* tools can open at random.
+* The metadata is built with a small FlatBuffers builder of its own, for
+* the few tables of Schema.fbs, Message.fbs and File.fbs used here;
+* metadata version V5, little endian.
+*/
+
+#ifndef ARROW_WRITER_H
+#define ARROW_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#define ARROW_COLUMNS_MAX 16
+
+enum ArrowType {
+  ARROW_INT,
+  ARROW_TIMESTAMP_MS        // int64 milliseconds since the Unix epoch, UTC
+};
+
+struct ArrowField {
+  const char *name;
+  ArrowType type;
+  uint8_t bytes;            // 1, 2, 4 or 8; 8 for timestamps
+  bool isSigned;
+  bool nullable;
+};
+
+// Builds a FlatBuffer back to front, children before the tables that
+// point at them, as the FlatBuffers library does. Offsets are counted
+// from the end of the buffer.
+class FlatBuilder {
+public:
+  FlatBuilder();
+
+  void clear();
+  void align(size_t alignment, size_t extra = 0);
+  void bytes(const void *data, size_t length);
+  template<typename T> void scalar(T value) {
+    align(sizeof(T));
+    bytes(&value, sizeof(T));
+  }
+
+  uint32_t string(const char *text);
+  uint32_t offsets(const uint32_t *targets, size_t count);
+  // Structs of size bytes aligned to 8, as their bytes.
+  uint32_t structs(const void *data, size_t size, size_t count);
+
+  void startTable();
+  template<typename T> void field(uint8_t slot, T value) {
+    scalar(value);
+    mark(slot);
+  }
+  void offsetField(uint8_t slot, uint32_t target);
+  uint32_t endTable();
+
+  void finish(uint32_t root);
+  const uint8_t *data() const { return &_buf[_buf.size() - _size]; }
+  size_t size() const { return _size; }
+
+private:
+  void grow(size_t length);
+  void offset(uint32_t target);
+  void mark(uint8_t slot);
+
+  std::vector<uint8_t> _buf;  // the data is the last _size bytes
+  size_t _size;
+  size_t _maxAlign;
+  size_t _tableStart;
+  uint32_t _slots[8];         // offsets of the fields of the open table
+  uint8_t _slotCount;
+};
+
+class ArrowWriter {
+public:
+  // batchRows: rows buffered per record batch; up to ARROW_COLUMNS_MAX fields.
+  ArrowWriter(const ArrowField *fields, uint8_t count, uint32_t batchRows);
+  ~ArrowWriter();
+
+  // "-" is stdout. Writes the schema (and the file magic).
+  bool open(const char *path, bool fileLayout);
+  // Writes the rows left, the end marker and the footer; closes the file.
+  bool close();
+  bool isOpen() const { return _out != NULL; }
+
+  // T's size must be the column's. A column not put in a row is null if
+  // it is nullable, else keeps what the row there had in an earlier batch.
+  template<typename T> void put(uint8_t column, T value) {
+    Column &c = _columns[column];
+    memcpy(c.data + _rows * sizeof(T), &value, sizeof(T));
+    if (c.validity) c.validity[_rows >> 3] |= 1 << (_rows & 7);
+  }
+  bool endRow() { return ++_rows < _batchRows || flush(); }
+  // Writes the rows so far as a record batch, if there are any, through
+  // to the file or pipe.
+  bool flush();
+
+  uint32_t rows() const { return _rows; }
+  uint64_t rowsWritten() const { return _rowsWritten; }
+  uint64_t batches() const { return _batches; }
+  const char *error() const { return _error; }
+
+private:
+  struct Column {
+    ArrowField field;
+    uint8_t *data;
+    uint8_t *validity;        // NULL when the column is not nullable
+  };
+  struct Block {
+    int64_t offset;
+    int32_t metadataLength;
+    int32_t padding;
+    int64_t bodyLength;
+  };
+
+  uint32_t schema(FlatBuilder &b);
+  bool message(uint8_t headerType, uint32_t header, int64_t bodyLength, int32_t &metadataLength);
+  bool write(const void *data, size_t length);
+
+  std::vector<Column> _columns;
+  std::vector<uint64_t> _storage;   // column buffers, 8 byte aligned
+  uint32_t _batchRows;
+  uint32_t _rows;
+  FILE *_out;
+  bool _fileLayout;
+  uint64_t _position;
+  std::vector<Block> _blocks;
+  FlatBuilder _builder;
+  uint64_t _rowsWritten;
+  uint64_t _batches;
+  const char *_error;
+};
+
+#endif
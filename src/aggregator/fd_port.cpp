@@ -0,0 +1,117 @@
+#include "fd_port.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+static speed_t baudConstant(uint32_t baud) {
+  switch (baud) {
+    case 9600: return B9600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+    case 460800: return B460800;
+    case 921600: return B921600;
+#ifdef B2000000
+    case 2000000: return B2000000;
+#endif
+#ifdef B3000000
+    case 3000000: return B3000000;
+#endif
+  }
+  return 0;
+}
+
+bool setSerialBaud(int fd, uint32_t baud) {
+  struct termios tio;
+  speed_t speed = baudConstant(baud);
+  if (speed == 0 || tcgetattr(fd, &tio) != 0) return false;
+  cfsetispeed(&tio, speed);
+  cfsetospeed(&tio, speed);
+  return tcsetattr(fd, TCSADRAIN, &tio) == 0;
+}
+
+int openSerial(const char *path, uint32_t baud, bool rtscts) {
+  int fd = open(path, O_RDWR | O_NOCTTY);
+  if (fd < 0) return -1;
+  struct termios tio;
+  if (tcgetattr(fd, &tio) == 0) {
+    cfmakeraw(&tio);
+    if (rtscts) tio.c_cflag |= CRTSCTS;
+    else tio.c_cflag &= ~CRTSCTS;
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    tcsetattr(fd, TCSANOW, &tio);
+    setSerialBaud(fd, baud);
+  }
+  return fd;
+}
+
+FdPort::FdPort(int readFd, int writeFd, bool tty)
+  : _readFd(readFd), _writeFd(writeFd), _tty(tty), _eof(false), _readWaitMs(1), _bufLength(0), _bufPos(0),
+    _injectEvery(0), _written(0), _injected(0) {
+}
+
+size_t FdPort::write(const uint8_t *data, size_t len) {
+  if (_writeFd < 0) return len;
+  uint8_t copy[512];
+  size_t done = 0;
+  while (done < len) {
+    size_t chunk = len - done < sizeof(copy) ? len - done : sizeof(copy);
+    memcpy(copy, data + done, chunk);
+    if (_injectEvery) {
+      for (size_t i = 0; i < chunk; i++) {
+        if ((_written + i) % _injectEvery == _injectEvery / 2) {
+          copy[i] ^= 0x10;
+          _injected++;
+        }
+      }
+    }
+    ssize_t n = ::write(_writeFd, copy, chunk);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN) break;
+      _eof = true;
+      break;
+    }
+    _written += n;
+    done += n;
+  }
+  return done;
+}
+
+int FdPort::read() {
+  if (_bufPos == _bufLength) {
+    if (_eof) return -1;
+    // Wait a little for data so callers can poll in a loop without spinning.
+    struct pollfd pfd = { _readFd, POLLIN, 0 };
+    if (::poll(&pfd, 1, _readWaitMs) <= 0) return -1;
+    ssize_t n = ::read(_readFd, _buf, sizeof(_buf));
+    if (n <= 0) {
+      if (n == 0 || (errno != EAGAIN && errno != EINTR)) _eof = true;
+      return -1;
+    }
+    _bufLength = n;
+    _bufPos = 0;
+  }
+  return _buf[_bufPos++];
+}
+
+bool FdPort::txIdle() {
+  if (_tty && _writeFd >= 0) tcdrain(_writeFd);
+  return true;
+}
+
+void FdPort::setBaud(uint32_t baud) {
+  if (_tty && _writeFd >= 0) setSerialBaud(_writeFd, baud);
+}
+
+uint32_t FdPort::millis() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
@@ -0,0 +1,48 @@
+/**
+* LinkPort on a POSIX file descriptor: serial device, pty, pipe or stdin.
+*/
+
+#ifndef FD_PORT_H
+#define FD_PORT_H
+
+#include <stdint.h>
+#include <SensorLink.h>
+
+// Opens a serial device raw at baud, with RTS/CTS when rtscts is set.
+int openSerial(const char *path, uint32_t baud, bool rtscts);
+bool setSerialBaud(int fd, uint32_t baud);
+
+class FdPort : public LinkPort {
+public:
+  // writeFd -1 discards writes (eg. reading a capture from stdin).
+  FdPort(int readFd, int writeFd, bool tty);
+
+  size_t write(const uint8_t *data, size_t len) override;
+  int read() override;
+  bool txIdle() override;
+  void setBaud(uint32_t baud) override;
+  uint32_t millis() override;
+
+  bool eof() const { return _eof; }
+  int readFd() const { return _readFd; }
+  // Flips a bit in every everyBytes-th byte written, 0 turns it off.
+  void injectErrors(uint32_t everyBytes) { _injectEvery = everyBytes; }
+  uint32_t injected() const { return _injected; }
+  // How long read() waits for data before reporting none (default 1 ms).
+  void setReadWait(int ms) { _readWaitMs = ms; }
+
+private:
+  int _readFd;
+  int _writeFd;
+  bool _tty;
+  bool _eof;
+  int _readWaitMs;
+  uint8_t _buf[4096];
+  size_t _bufLength;
+  size_t _bufPos;
+  uint32_t _injectEvery;
+  uint64_t _written;
+  uint32_t _injected;
+};
+
+#endif
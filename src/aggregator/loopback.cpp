@@ -0,0 +1,178 @@
+#include "loopback.h"
+
+#include <atomic>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <thread>
+#include <unistd.h>
+
+#include <SnifferCore.h>
+#include "fd_port.h"
+
+#define LOOPBACK_FRAMES 4000
+#define LOOPBACK_PAYLOAD 512
+#define LOOPBACK_INJECT_EVERY 20011   // bytes between bit errors, prime so it walks over frame offsets
+#define LOOPBACK_BAUD 3000000
+#define LOOPBACK_DONE 0x0f            // last frame of the stream, carries the sensor LinkStats
+
+struct LoopbackSensor {
+  int fd;
+  std::atomic<bool> stop;
+  LinkStats stats;
+  uint32_t injected;
+};
+
+// Frame number n followed by a pattern derived from it.
+static void fillPayload(uint8_t *p, uint32_t n) {
+  memcpy(p, &n, 4);
+  for (int i = 4; i < LOOPBACK_PAYLOAD; i++) {
+    p[i] = (uint8_t)(n * 31 + i);
+  }
+}
+
+static void sensorThread(LoopbackSensor *sensor) {
+  static uint8_t pool[16384];
+  Arena arena(pool, sizeof(pool));
+  FdPort port(sensor->fd, sensor->fd, true);
+  port.setReadWait(0);  // a sensor never waits for input
+  SensorLink link(port);
+  link.begin(arena, 8192, 256, LINK_DEFAULT_BAUD, LOOPBACK_BAUD);
+
+  // Answer the negotiation, then stream once the new rate is confirmed.
+  while (link.baud() != LOOPBACK_BAUD || link.stats().rxFrames < 2) {
+    link.poll(1000);
+    if (sensor->stop) return;
+  }
+  port.injectErrors(LOOPBACK_INJECT_EVERY);
+  uint8_t payload[LOOPBACK_PAYLOAD];
+  for (uint32_t n = 0; n < LOOPBACK_FRAMES && !sensor->stop; ) {
+    if (link.txRoom() >= LOOPBACK_PAYLOAD) {
+      fillPayload(payload, n);
+      link.send(FRAME_DIGESTS, payload, LOOPBACK_PAYLOAD);
+      n++;
+    }
+    link.poll(1000);
+  }
+  while (link.poll(1000)) {
+  }
+  port.injectErrors(0);
+  sensor->injected = port.injected();
+  sensor->stats = link.stats();
+  // txFrames of the copy sent counts the done frame itself.
+  sensor->stats.txFrames++;
+  link.send(LOOPBACK_DONE, (const uint8_t *)&sensor->stats, sizeof(LinkStats));
+  while (link.poll(1000)) {
+  }
+  while (!sensor->stop) {
+    link.poll(1000);
+  }
+}
+
+struct LoopbackHost {
+  uint32_t frames;
+  uint32_t corrupt;     // delivered with a wrong payload: CRC missed an error
+  bool done;
+  LinkStats sensorStats;
+};
+
+static void hostFrame(void *ctx, uint8_t type, const uint8_t *payload, uint16_t length) {
+  LoopbackHost *host = (LoopbackHost *)ctx;
+  if (type == LOOPBACK_DONE && length == sizeof(LinkStats)) {
+    memcpy(&host->sensorStats, payload, sizeof(LinkStats));
+    host->done = true;
+    return;
+  }
+  if (type != FRAME_DIGESTS || length != LOOPBACK_PAYLOAD) {
+    host->corrupt++;
+    return;
+  }
+  uint32_t n;
+  memcpy(&n, payload, 4);
+  uint8_t expected[LOOPBACK_PAYLOAD];
+  fillPayload(expected, n);
+  bool match = n < LOOPBACK_FRAMES && memcmp(expected, payload, LOOPBACK_PAYLOAD) == 0;
+  if (match) host->frames++;
+  else host->corrupt++;
+}
+
+static void printStats(const char *side, const LinkStats &s) {
+  printf("%s: baud %u tx %u frames %u bytes %u dropped, rx %u frames %u bytes, "
+         "%u crc errors %u lost %u resync bytes %u oversize\n",
+    side, (unsigned)s.baud, (unsigned)s.txFrames, (unsigned)s.txBytes, (unsigned)s.txDropped,
+    (unsigned)s.rxFrames, (unsigned)s.rxBytes, (unsigned)s.rxCrcErrors, (unsigned)s.rxLost,
+    (unsigned)s.rxResyncBytes, (unsigned)s.rxOversize);
+}
+
+int runLoopback() {
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+    perror("posix_openpt");
+    return 1;
+  }
+  int slave = openSerial(ptsname(master), LINK_DEFAULT_BAUD, false);
+  if (slave < 0) {
+    perror("pty slave");
+    return 1;
+  }
+
+  LoopbackSensor sensor;
+  sensor.fd = slave;
+  sensor.stop = false;
+  std::thread thread(sensorThread, &sensor);
+
+  static uint8_t pool[16384];
+  Arena arena(pool, sizeof(pool));
+  FdPort port(master, master, false);
+  SensorLink link(port);
+  link.begin(arena, 1024, 1024, LINK_DEFAULT_BAUD, LOOPBACK_BAUD);
+  LoopbackHost host;
+  memset(&host, 0, sizeof(host));
+  link.onFrame(hostFrame, &host);
+
+  int status = 0;
+  bool negotiated = link.negotiateBaud(LOOPBACK_BAUD, 1000);
+  printf("negotiated %u baud: %s\n", (unsigned)LOOPBACK_BAUD, negotiated ? "ok" : "FAILED");
+  if (!negotiated) status = 1;
+
+  uint32_t start = port.millis();
+  while (negotiated && !host.done && port.millis() - start < 30000) {
+    link.poll(10000);
+  }
+  uint32_t elapsed = port.millis() - start;
+  sensor.stop = true;
+  thread.join();
+
+  const LinkStats &hs = link.stats();
+  printStats("sensor", host.sensorStats);
+  printStats("host  ", hs);
+  printf("%u bit errors injected, %u frames delivered intact, %u corrupt, %u kB/s\n",
+    (unsigned)sensor.injected, (unsigned)host.frames, (unsigned)host.corrupt,
+    (unsigned)(elapsed ? (uint64_t)hs.rxBytes / elapsed : 0));
+
+  if (!host.done) {
+    printf("FAIL: stream did not complete\n");
+    status = 1;
+  } else {
+    // Every frame the sensor sent was either received or counted as lost.
+    if (hs.rxFrames + hs.rxLost != host.sensorStats.txFrames) {
+      printf("FAIL: %u received + %u lost != %u sent\n",
+        (unsigned)hs.rxFrames, (unsigned)hs.rxLost, (unsigned)host.sensorStats.txFrames);
+      status = 1;
+    }
+    if (host.corrupt != 0) {
+      printf("FAIL: corrupt frames passed the CRC\n");
+      status = 1;
+    }
+    if (sensor.injected > 0 && hs.rxLost == 0) {
+      printf("FAIL: injected errors were not detected\n");
+      status = 1;
+    }
+  }
+  close(master);
+  close(slave);
+  printf("loopback %s\n", status == 0 ? "passed" : "FAILED");
+  return status;
+}
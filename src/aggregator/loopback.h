@@ -0,0 +1,15 @@
+/**
+* Link self test over a pseudo-terminal pair: a sensor side SensorLink runs in
+* a thread on the pty slave, the host side on the master. The host negotiates
+* the baud rate, then the sensor streams frames with bit errors injected on
+* the wire. Checks that every frame is either delivered intact or counted as
+* lost, and reports throughput and error counters of both ends.
+*/
+
+#ifndef LOOPBACK_H
+#define LOOPBACK_H
+
+// Returns the process exit status: 0 when all checks pass.
+int runLoopback();
+
+#endif
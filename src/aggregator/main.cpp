@@ -0,0 +1,1181 @@
+/**
+* Host side aggregator for thin-sensor mode.
+* Reads the sensors' SensorLink streams (serial devices, or stdin with "-"),
+* decodes digest batches and prints one CSV line per digest on stdout:
+*   time_ms,mac,rssi,channel,flags,seq,ie_fingerprint[,sensor,epoch_ms]
+* flags: 1 locally administered MAC, 2 truncated IEs, 4 watchlist flagged.
+* With -T the host exchanges FRAME_TIME_SYNC with every sensor, fits each
+* one's offset and drift (clock_sync.h) and adds the sensor number and the
+* digest time on the host clock (Unix ms) to each line. -W then counts
+* distinct devices per window of event time over all sensors (per sensor
+* and merged, event_windows.h); a window is reported on stderr once every
+* sensor is past its end by the lateness allowed with -G.
+* Sensor counters (accepted, emitted, dropped and filtered frames, channel
+* switch time and frame gaps around hops as avg/max), link counters of both
+* ends and throughput go to stderr.
+* Each sweep's heaviest data frame transmitters (lib/TopTalkers) go to
+* stderr too.
+* With -P the frames each sensor samples per sweep (lib/FrameSample) are
+* appended to <prefix><sensor>.pcap, stamped with host time once the clock
+* is aligned.
+* Sensor health records (lib/Health: heap, last reset, loop and callback
+* rates, stack use) go to stderr as they arrive.
+* Sweep device sets (lib/SweepSet) are checked against the previous sweep in
+* their compressed form; devices also in it and in either go to stderr.
+* With -V they are also recorded in a returning-visitor index (per device day
+* bitmaps in a memory-mapped file, see visitor_index.h) under today's UTC date.
+* With -C the aggregator's state (per sensor counts, the last sweep sets,
+* the open event windows) is checkpointed to a memory-mapped file every
+* -I ms (1000) and at exit, and restored from it on start (checkpoint.h):
+* a restart, even after a crash, carries on with the open windows instead
+* of losing them, less what arrived since the last checkpoint.
+* With -M the same figures are served for Prometheus as OpenMetrics on
+* http://[addr:]port/metrics (metrics_server.h): digests per sensor and
+* channel, the sensor counters, hop and link statistics, health, sweep and
+* window device counts, and histograms of the digest delay (arrival less
+* event time, with -T) and of the time sync round trips.
+* With -A the digests are also written as Apache Arrow record batches
+* (arrow_writer.h) of time (event time with -T, else arrival; Unix ms),
+* sensor, device (the salted 48-bit ID of lib/SweepSet, as the sweep sets
+* and the visitor index have it), channel, rssi and flags; -E writes the
+* window summaries, one row per sensor and one for all (sensor null).
+* The output is an IPC stream, flushed every second for a pipe reading
+* it ("-" is stdout, instead of the CSV), or with -R files in the IPC file
+* layout, <path>-YYYYMMDDTHHMMSSZ.arrow, rolled over every roll_s seconds.
+* Usage: aggregator [-b baud] [-n max_baud] [-r] [-w watchlist] [-F rules] [-V index [-D days]]
+*                   [-T sync_ms [-W window_s] [-G lateness_ms]] [-C checkpoint [-I interval_ms]]
+*                   [-P sample_prefix] [-M [addr:]port] [-A sightings] [-E windows] [-R roll_s] [-S salt]
+*                   <device|->...
+*   -b  baud rate the sensor boots with (SERIAL_BAUD)
+*   -n  negotiate the fastest rate up to max_baud the link sustains
+*   -r  RTS/CTS hardware flow control
+*   -w  load a watchlist (staff exclusion, flagged devices) into the sensor
+*   -F  load filter rules (a file in the lib/FilterRules language) into the sensor
+*   -V  record sweep sets in a visitor index, created with -D days of history (384)
+*   -T  align the sensor clocks, a sync round trip every sync_ms; needed for several devices
+*   -W  event time windows of window_s seconds, -G lateness (2000 ms)
+*   -C  checkpoint state to a file and restart from it, every -I interval_ms
+*   -P  append sampled frames to sample_prefix<sensor>.pcap
+*   -M  serve metrics on port, of the loopback interface unless addr is given
+*   -A  write digests as Arrow to a file or pipe, -E window summaries (needs -W)
+*   -R  roll the -A and -E output over to new files every roll_s seconds
+*   -S  salt of the device IDs, the sensors' SWEEP_SET_SALT (0x5eed5a17)
+*        aggregator -B watchlist > data/watchlist.bin
+*   writes the watchlist as flash records for the sensor's file system.
+*        aggregator -L
+*   runs the link self test over a pseudo-terminal pair.
+*        aggregator -V index -q YYYY-MM-DD [-k weeks]
+*   prints the day's visitors and the share of them seen in each of the
+*   previous weeks (4) and anywhere in the index window before the day.
+*/
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <FrameDigest.h>
+#include <FrameSample.h>
+#include <Health.h>
+#include <SensorLink.h>
+#include <SnifferCore.h>
+#include <SweepSet.h>
+#include "arrow_writer.h"
+#include "fd_port.h"
+#include "loopback.h"
+#include "metrics.h"
+#include "metrics_server.h"
+#include "visitor_index.h"
+#include "../host/checkpoint.h"
+#include "../host/clock_sync.h"
+#include "../host/event_windows.h"
+#include "../host/id_set.h"
+#include "../host/text_file.h"
+#include "../host/watchlist_file.h"
+
+static const char *counterNames[DIGEST_COUNTER_COUNT] = {
+  "accepted", "emitted", "dropped_queue_full", "filtered_not_probe", "filtered_local_mac", "filtered_short",
+  "filtered_watch_exclude", "filtered_rules"
+};
+
+static const char *resetReasons[] = {
+  "power on", "hardware watchdog", "exception", "software watchdog", "restart", "deep sleep wake", "external"
+};
+
+static const uint32_t negotiationRates[] = { 3000000, 2000000, 921600, 460800, 230400 };
+
+// The sensor's LINK_RX_MAX_PAYLOAD.
+#define SENSOR_RX_MAX_PAYLOAD 256
+#define WATCHLIST_RECORDS_PER_FRAME (SENSOR_RX_MAX_PAYLOAD / WATCH_RECORD_LENGTH)
+#define RULES_PIECE_LENGTH (SENSOR_RX_MAX_PAYLOAD - 4)
+#define ACK_TIMEOUT_MS 2000
+#define SYNC_ROUNDS 8                 // round trips at startup, before any digest is stamped
+#define SYNC_TIMEOUT_MS 500
+#define WINDOW_IDLE_MS 15000          // a sensor without digests this long stops holding windows open
+#define STATE_FORMAT 1                // of the checkpointed state
+#define METRIC_VALUES 65536           // registry slots, about 100 a sensor
+#define DEVICE_SALT 0x5eed5a17        // the sensors' SWEEP_SET_SALT
+#define ARROW_SIGHTING_ROWS 65536     // rows per record batch, at most
+#define ARROW_WINDOW_ROWS 1024
+#define ARROW_FLUSH_MS 1000           // of a stream's partial batch
+
+enum { SIGHTING_TIME, SIGHTING_SENSOR, SIGHTING_DEVICE, SIGHTING_CHANNEL, SIGHTING_RSSI, SIGHTING_FLAGS };
+
+static const ArrowField sightingFields[] = {
+  { "time", ARROW_TIMESTAMP_MS, 8, true, false },
+  { "sensor", ARROW_INT, 1, false, false },
+  { "device", ARROW_INT, 8, false, false },
+  { "channel", ARROW_INT, 1, false, false },
+  { "rssi", ARROW_INT, 1, true, false },
+  { "flags", ARROW_INT, 1, false, false }
+};
+
+enum { WINDOW_START, WINDOW_LENGTH, WINDOW_SENSOR, WINDOW_DEVICES, WINDOW_DIGESTS };
+
+static const ArrowField windowFields[] = {
+  { "start", ARROW_TIMESTAMP_MS, 8, true, false },
+  { "length_ms", ARROW_INT, 4, false, false },
+  { "sensor", ARROW_INT, 1, false, true },
+  { "devices", ARROW_INT, 4, false, false },
+  { "digests", ARROW_INT, 8, false, true }
+};
+
+// FRAME_SWEEP_SET blocks of the sweep coming in, and the last whole one.
+struct SweepSets {
+  uint32_t sweep;
+  uint8_t received;
+  bool broken;
+  IdSet building;
+  bool havePrevious;
+  uint32_t previousSweep;
+  IdSet previous;
+};
+
+// Metric families, registered before the sensors are opened.
+struct MetricFamilies {
+  int digests;
+  int digestDelay;
+  int sensorFrames;
+  int hops;
+  int switchTime;
+  int hopGaps;
+  int hopLost;
+  int linkBytes;
+  int linkErrors;
+  int heap;
+  int loops;
+  int callbacks;
+  int uptime;
+  int syncRtt;
+  int drift;
+  int sweepDevices;
+  int windowDevices;
+  int lateDigests;
+  int dataFrames;
+  int dataBytes;
+};
+
+struct LinkMetrics {
+  MetricId txBytes, rxBytes, txDropped, rxCrcErrors, rxLost;
+};
+
+// A sensor's series; per channel ones on the first digest of the channel.
+struct SensorMetrics {
+  MetricId channelDigests[16];
+  uint16_t channels;          // bit per channel registered
+  MetricId digestDelay;
+  MetricId frames[DIGEST_COUNTER_COUNT];
+  MetricId hops, switchTime, hopGaps, hopLost;
+  LinkMetrics host, sensor;
+  MetricId freeHeap, minFreeHeap, maxFreeBlock, loops, callbacks, uptime;
+  MetricId syncRtt, drift;
+  MetricId sweepDevices;
+  MetricId dataFrames, dataBytes;
+};
+
+// -A and -E output: one IPC stream, or files rolled over every rollMs.
+struct ArrowOutput {
+  ArrowWriter *writer;
+  const char *path;
+  uint32_t rollMs;
+  uint64_t rollEndMs;
+  uint64_t flushMs;
+};
+
+struct Aggregator;
+
+struct Sensor {
+  Aggregator *agg;
+  unsigned index;
+  SensorLink *link;
+  FdPort *port;
+  unsigned long digests;
+  uint32_t startMs;
+  bool watchlistAcked;
+  bool watchlistCommitted;
+  uint16_t watchlistCount;
+  bool rulesAcked;
+  bool rulesLoaded;
+  uint16_t rulesDetail;       // worst case steps, or the error position
+  char rulesError[48];
+  SweepSets sweepSets;
+  ClockSync clock;
+  uint32_t syncSeq;
+  bool syncAcked;
+  uint64_t lastSyncUs;
+  FILE *samples;              // -P capture, opened on the first sample
+  SensorMetrics m;
+};
+
+struct Aggregator {
+  VisitorIndex *visitors;
+  bool sync;
+  uint64_t epochOffsetUs;       // Unix time minus the monotonic clock
+  EventWindows *windows;
+  const char *samplePrefix;
+  MetricRegistry *registry;
+  MetricShard *metrics;         // this thread's
+  MetricFamilies families;
+  std::vector<MetricId> windowDevices;  // per sensor, then of all
+  MetricId lateDigests;
+  bool csv;                     // digests on stdout
+  ArrowOutput *sightings;
+  ArrowOutput *windowRows;
+  uint32_t salt;
+};
+
+static volatile sig_atomic_t stopping = 0;
+
+static void onSignal(int sig) {
+  (void)sig;
+  stopping = 1;
+}
+
+static uint64_t monotonicUs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void printLinkStats(const char *side, const LinkStats &s) {
+  fprintf(stderr, "%s link: baud %u tx %u frames %u bytes %u dropped, rx %u frames %u bytes "
+                  "%u crc_errors %u lost %u resync_bytes %u oversize\n",
+    side, (unsigned)s.baud, (unsigned)s.txFrames, (unsigned)s.txBytes, (unsigned)s.txDropped,
+    (unsigned)s.rxFrames, (unsigned)s.rxBytes, (unsigned)s.rxCrcErrors, (unsigned)s.rxLost,
+    (unsigned)s.rxResyncBytes, (unsigned)s.rxOversize);
+}
+
+static std::string labels(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+static std::string labels(const char *format, ...) {
+  char text[128];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(text, sizeof(text), format, args);
+  va_end(args);
+  return text;
+}
+
+static void registerMetrics(Aggregator &agg) {
+  MetricRegistry &r = *agg.registry;
+  MetricFamilies &f = agg.families;
+  static const double delayBounds[] = { 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30 };
+  static const double rttBounds[] = { 0.001, 0.002, 0.005, 0.01, 0.02, 0.05, 0.1, 0.25 };
+  f.digests = r.family("fcc_digests", METRIC_COUNTER, "Digests received, by sensor and channel.");
+  f.digestDelay = r.family("fcc_digest_delay_seconds", METRIC_HISTOGRAM,
+    "Host arrival less event time of digests, on the synced clock.",
+    std::vector<double>(delayBounds, delayBounds + sizeof(delayBounds) / sizeof(delayBounds[0])));
+  f.sensorFrames = r.family("fcc_sensor_frames", METRIC_COUNTER, "Sensor frame counters, by outcome.");
+  f.hops = r.family("fcc_sensor_channel_hops", METRIC_COUNTER, "Channel switches of the sensor.");
+  f.switchTime = r.family("fcc_sensor_channel_switch_microseconds", METRIC_COUNTER,
+    "Time spent in channel switches.");
+  f.hopGaps = r.family("fcc_sensor_hop_gap_milliseconds", METRIC_COUNTER,
+    "Time without frames around channel switches.");
+  f.hopLost = r.family("fcc_sensor_hop_lost_frames", METRIC_GAUGE,
+    "Frames estimated lost to channel switches since boot.");
+  f.linkBytes = r.family("fcc_link_bytes", METRIC_COUNTER, "Link bytes, by end and direction.");
+  f.linkErrors = r.family("fcc_link_errors", METRIC_COUNTER, "Link frames dropped or lost, by end and kind.");
+  f.heap = r.family("fcc_sensor_heap_bytes", METRIC_GAUGE, "Sensor heap: free, lowest free, largest block.");
+  f.loops = r.family("fcc_sensor_loops_per_second", METRIC_GAUGE, "Sensor main loop rate.");
+  f.callbacks = r.family("fcc_sensor_callbacks_per_second", METRIC_GAUGE, "Sensor promiscuous callback rate.");
+  f.uptime = r.family("fcc_sensor_uptime_seconds", METRIC_GAUGE, "Sensor time since boot.");
+  f.syncRtt = r.family("fcc_sync_rtt_seconds", METRIC_HISTOGRAM, "Time sync round trips.",
+    std::vector<double>(rttBounds, rttBounds + sizeof(rttBounds) / sizeof(rttBounds[0])));
+  f.drift = r.family("fcc_clock_drift_ppm", METRIC_GAUGE, "Sensor clock rate error, + when it runs fast.");
+  f.sweepDevices = r.family("fcc_sweep_devices", METRIC_GAUGE, "Devices in the sensor's last whole sweep.");
+  f.windowDevices = r.family("fcc_window_devices", METRIC_GAUGE, "Distinct devices in the last closed window.");
+  f.lateDigests = r.family("fcc_late_digests", METRIC_COUNTER, "Digests too late for their window.");
+  f.dataFrames = r.family("fcc_data_frames", METRIC_COUNTER, "Data frames counted for top talkers.");
+  f.dataBytes = r.family("fcc_data_bytes", METRIC_COUNTER, "Bytes of data frames counted for top talkers.");
+  agg.lateDigests = r.series(f.lateDigests, "");
+}
+
+static void registerLinkMetrics(MetricRegistry &r, const MetricFamilies &f, LinkMetrics &m, unsigned sensor,
+                                const char *end) {
+  m.txBytes = r.series(f.linkBytes, labels("sensor=\"%u\",end=\"%s\",direction=\"tx\"", sensor, end));
+  m.rxBytes = r.series(f.linkBytes, labels("sensor=\"%u\",end=\"%s\",direction=\"rx\"", sensor, end));
+  m.txDropped = r.series(f.linkErrors, labels("sensor=\"%u\",end=\"%s\",kind=\"tx_dropped\"", sensor, end));
+  m.rxCrcErrors = r.series(f.linkErrors, labels("sensor=\"%u\",end=\"%s\",kind=\"crc\"", sensor, end));
+  m.rxLost = r.series(f.linkErrors, labels("sensor=\"%u\",end=\"%s\",kind=\"lost\"", sensor, end));
+}
+
+static void registerSensorMetrics(Sensor &sensor) {
+  MetricRegistry &r = *sensor.agg->registry;
+  const MetricFamilies &f = sensor.agg->families;
+  SensorMetrics &m = sensor.m;
+  std::string id = labels("sensor=\"%u\"", sensor.index);
+  m.channels = 0;
+  m.digestDelay = r.series(f.digestDelay, id);
+  for (int i = 0; i < DIGEST_COUNTER_COUNT; i++) {
+    m.frames[i] = r.series(f.sensorFrames, labels("sensor=\"%u\",outcome=\"%s\"", sensor.index, counterNames[i]));
+  }
+  m.hops = r.series(f.hops, id);
+  m.switchTime = r.series(f.switchTime, id);
+  m.hopGaps = r.series(f.hopGaps, id);
+  m.hopLost = r.series(f.hopLost, id);
+  registerLinkMetrics(r, f, m.host, sensor.index, "host");
+  registerLinkMetrics(r, f, m.sensor, sensor.index, "sensor");
+  m.freeHeap = r.series(f.heap, labels("sensor=\"%u\",kind=\"free\"", sensor.index));
+  m.minFreeHeap = r.series(f.heap, labels("sensor=\"%u\",kind=\"min_free\"", sensor.index));
+  m.maxFreeBlock = r.series(f.heap, labels("sensor=\"%u\",kind=\"max_block\"", sensor.index));
+  m.loops = r.series(f.loops, id);
+  m.callbacks = r.series(f.callbacks, id);
+  m.uptime = r.series(f.uptime, id);
+  m.syncRtt = r.series(f.syncRtt, id);
+  m.drift = r.series(f.drift, id);
+  m.sweepDevices = r.series(f.sweepDevices, id);
+  m.dataFrames = r.series(f.dataFrames, id);
+  m.dataBytes = r.series(f.dataBytes, id);
+}
+
+static void linkMetrics(MetricShard &metrics, const LinkMetrics &m, const LinkStats &s) {
+  metrics.set(m.txBytes, s.txBytes);
+  metrics.set(m.rxBytes, s.rxBytes);
+  metrics.set(m.txDropped, s.txDropped);
+  metrics.set(m.rxCrcErrors, s.rxCrcErrors);
+  metrics.set(m.rxLost, s.rxLost);
+}
+
+static bool arrowOpen(ArrowOutput &out, uint64_t nowMs) {
+  char path[512];
+  if (out.rollMs) {
+    // named for when it opens, a restart doesn't overwrite the file of the period.
+    time_t now = nowMs / 1000;
+    struct tm t;
+    gmtime_r(&now, &t);
+    snprintf(path, sizeof(path), "%s-%04d%02d%02dT%02d%02d%02dZ.arrow", out.path, t.tm_year + 1900, t.tm_mon + 1,
+      t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec);
+    out.rollEndMs = nowMs - nowMs % out.rollMs + out.rollMs;
+  } else {
+    snprintf(path, sizeof(path), "%s", out.path);
+  }
+  out.flushMs = nowMs;
+  if (out.writer->open(path, out.rollMs != 0)) return true;
+  fprintf(stderr, "%s: %s\n", path, out.writer->error());
+  return false;
+}
+
+static void arrowClose(ArrowOutput &out) {
+  if (out.writer->isOpen() && !out.writer->close()) fprintf(stderr, "%s: %s\n", out.path, out.writer->error());
+}
+
+// After a row: a failed write (the pipe reader gone) ends the output.
+static void arrowRow(ArrowOutput &out) {
+  if (out.writer->endRow()) return;
+  fprintf(stderr, "%s: %s, output stopped\n", out.path, out.writer->error());
+  out.writer->close();
+}
+
+// From the main loop: rolls files over, pushes a stream's rows out.
+static void arrowTick(ArrowOutput &out, uint64_t nowMs) {
+  if (!out.writer->isOpen()) return;
+  if (out.rollMs && nowMs >= out.rollEndMs) {
+    arrowClose(out);
+    arrowOpen(out, nowMs);
+  } else if (!out.rollMs && nowMs - out.flushMs >= ARROW_FLUSH_MS) {
+    out.flushMs = nowMs;
+    if (!out.writer->flush()) {
+      fprintf(stderr, "%s: %s, output stopped\n", out.path, out.writer->error());
+      out.writer->close();
+    }
+  }
+}
+
+static void windowRow(ArrowOutput &out, const WindowSummary &w, int sensor, uint32_t devices) {
+  ArrowWriter &writer = *out.writer;
+  if (!writer.isOpen()) return;
+  writer.put<int64_t>(WINDOW_START, w.startMs);
+  writer.put<uint32_t>(WINDOW_LENGTH, w.lengthMs);
+  if (sensor >= 0) writer.put<uint8_t>(WINDOW_SENSOR, sensor);
+  writer.put<uint32_t>(WINDOW_DEVICES, devices);
+  if (sensor < 0) writer.put<uint64_t>(WINDOW_DIGESTS, w.records);
+  arrowRow(out);
+}
+
+static void printWindow(Aggregator &agg, const WindowSummary &w) {
+  time_t start = w.startMs / 1000;
+  struct tm t;
+  gmtime_r(&start, &t);
+  fflush(stdout);
+  fprintf(stderr, "window %04d-%02d-%02dT%02d:%02d:%02d.%03uZ %u s: %u devices,", t.tm_year + 1900, t.tm_mon + 1,
+    t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec, (unsigned)(w.startMs % 1000), w.lengthMs / 1000, w.devices);
+  for (size_t i = 0; i < w.perSensor.size(); i++) fprintf(stderr, " sensor%u %u", (unsigned)i, w.perSensor[i]);
+  fprintf(stderr, ", %llu digests\n", (unsigned long long)w.records);
+  for (size_t i = 0; i < w.perSensor.size() && i + 1 < agg.windowDevices.size(); i++) {
+    agg.metrics->gauge(agg.windowDevices[i], w.perSensor[i]);
+  }
+  agg.metrics->gauge(agg.windowDevices.back(), w.devices);
+  agg.metrics->set(agg.lateDigests, agg.windows->late());
+  if (agg.windowRows) {
+    for (size_t i = 0; i < w.perSensor.size(); i++) windowRow(*agg.windowRows, w, i, w.perSensor[i]);
+    windowRow(*agg.windowRows, w, -1, w.devices);
+  }
+}
+
+static MetricId channelDigests(Sensor &sensor, uint8_t channel) {
+  SensorMetrics &m = sensor.m;
+  if (!(m.channels & 1 << channel)) {
+    m.channelDigests[channel] = sensor.agg->registry->series(sensor.agg->families.digests,
+      labels("sensor=\"%u\",channel=\"%u\"", sensor.index, channel));
+    m.channels |= 1 << channel;
+  }
+  return m.channelDigests[channel];
+}
+
+static void printDigests(Sensor &sensor, const uint8_t *payload, uint16_t length) {
+  Aggregator &agg = *sensor.agg;
+  uint64_t nowMs = (monotonicUs() + agg.epochOffsetUs) / 1000;
+  for (uint16_t off = 0; off + sizeof(FrameDigest) <= length; off += sizeof(FrameDigest)) {
+    FrameDigest d;
+    memcpy(&d, payload + off, sizeof(d));
+    // digests that beat the first sync answer, or without -T, are placed at their arrival.
+    bool synced = agg.sync && sensor.clock.ready();
+    uint64_t eventMs = synced ? (sensor.clock.toHostUs(d.timestampMs) + agg.epochOffsetUs) / 1000 : nowMs;
+    if (agg.csv) {
+      printf("%u,%02x:%02x:%02x:%02x:%02x:%02x,%d,%u,%u,%u,%04x",
+        (unsigned)d.timestampMs, d.mac[0], d.mac[1], d.mac[2], d.mac[3], d.mac[4], d.mac[5],
+        d.rssi, d.channelFlags & 0x0f, d.channelFlags >> 4, d.seq >> 4, d.ieFingerprint);
+      if (agg.sync) printf(",%u,%llu", sensor.index, (unsigned long long)eventMs);
+      printf("\n");
+    }
+    if (agg.windows) agg.windows->add(sensor.index, eventMs, d.mac, nowMs);
+    if (synced) {
+      agg.metrics->observe(sensor.m.digestDelay, agg.registry->bounds(agg.families.digestDelay),
+        nowMs > eventMs ? (nowMs - eventMs) / 1000.0 : 0);
+    }
+    if (agg.sightings && agg.sightings->writer->isOpen()) {
+      ArrowWriter &writer = *agg.sightings->writer;
+      writer.put<int64_t>(SIGHTING_TIME, eventMs);
+      writer.put<uint8_t>(SIGHTING_SENSOR, sensor.index);
+      writer.put<uint64_t>(SIGHTING_DEVICE, SweepSet::id(d.mac, agg.salt));
+      writer.put<uint8_t>(SIGHTING_CHANNEL, d.channelFlags & 0x0f);
+      writer.put<int8_t>(SIGHTING_RSSI, d.rssi);
+      writer.put<uint8_t>(SIGHTING_FLAGS, d.channelFlags >> 4);
+      arrowRow(*agg.sightings);
+    }
+    sensor.digests++;
+    agg.metrics->add(channelDigests(sensor, d.channelFlags & 0x0f));
+  }
+  WindowSummary w;
+  while (agg.windows && agg.windows->next(w, nowMs)) printWindow(agg, w);
+}
+
+static void printCounters(Sensor &sensor, const uint8_t *payload, uint16_t length) {
+  if (length < 4 + 4 * DIGEST_COUNTER_COUNT) return;
+  MetricShard &metrics = *sensor.agg->metrics;
+  uint32_t values[1 + DIGEST_COUNTER_COUNT];
+  memcpy(values, payload, sizeof(values));
+  for (int i = 0; i < DIGEST_COUNTER_COUNT; i++) metrics.set(sensor.m.frames[i], values[1 + i]);
+  fflush(stdout);
+  fprintf(stderr, "sensor%u t=%u", sensor.index, (unsigned)values[0]);
+  for (int i = 0; i < DIGEST_COUNTER_COUNT; i++) {
+    fprintf(stderr, " %s=%u", counterNames[i], (unsigned)values[1 + i]);
+  }
+  if (length >= 4 + 4 * DIGEST_COUNTER_COUNT + sizeof(HopStats)) {
+    HopStats h;
+    memcpy(&h, payload + 4 + 4 * DIGEST_COUNTER_COUNT, sizeof(h));
+    metrics.set(sensor.m.hops, h.hops);
+    metrics.set(sensor.m.switchTime, h.switchUsTotal);
+    metrics.set(sensor.m.hopGaps, h.gapMsTotal);
+    metrics.gauge(sensor.m.hopLost, h.lostMilliFrames / 1000.0);
+    fprintf(stderr, " hops=%u switch_us=%u/%u gap_ms=%u/%u lost=%.1f", (unsigned)h.hops,
+      (unsigned)(h.hops ? h.switchUsTotal / h.hops : 0), (unsigned)h.switchUsMax,
+      (unsigned)(h.gaps ? h.gapMsTotal / h.gaps : 0), (unsigned)h.gapMsMax, h.lostMilliFrames / 1000.0);
+    if (h.deferred) fprintf(stderr, " deferred=%u forced=%u saved=%u", (unsigned)h.deferred, (unsigned)h.forced,
+      (unsigned)h.framesSaved);
+  }
+  uint32_t elapsed = sensor.port->millis() - sensor.startMs;
+  fprintf(stderr, " | host digests=%lu rx=%u B/s", sensor.digests,
+    (unsigned)(elapsed ? (uint64_t)sensor.link->stats().rxBytes * 1000 / elapsed : 0));
+  if (sensor.agg->sync && sensor.clock.ready()) {
+    fprintf(stderr, " clock drift=%.1fppm rtt=%.1fms", sensor.clock.driftPpm(), sensor.clock.minRttUs() / 1000.0);
+  }
+  if (sensor.agg->windows) fprintf(stderr, " late=%llu", (unsigned long long)sensor.agg->windows->late());
+  fprintf(stderr, "\n");
+  printLinkStats("host", sensor.link->stats());
+  linkMetrics(metrics, sensor.m.host, sensor.link->stats());
+}
+
+static void printHealth(Sensor &sensor, const uint8_t *payload, uint16_t length) {
+  if (length < sizeof(HealthRecord)) return;
+  HealthRecord r;
+  memcpy(&r, payload, sizeof(r));
+  fflush(stdout);
+  fprintf(stderr, "sensor%u health t=%u heap=%u min=%u block=%u frag=%u%% reset=", sensor.index, (unsigned)r.uptimeMs,
+    (unsigned)r.freeHeap, (unsigned)r.minFreeHeap, (unsigned)r.maxFreeBlock, r.heapFragmentation);
+  if (r.resetReason < sizeof(resetReasons) / sizeof(resetReasons[0])) {
+    fprintf(stderr, "%s", resetReasons[r.resetReason]);
+  } else {
+    fprintf(stderr, "%u", r.resetReason);
+  }
+  if (r.resetReason == 2 || r.resetReason == 3) {
+    fprintf(stderr, " (exccause %u epc1 0x%08x)", (unsigned)r.resetExcCause, (unsigned)r.resetEpc1);
+  }
+  fprintf(stderr, " loops=%u/s callbacks=%u/s", (unsigned)r.loopsPerS, (unsigned)r.callbacksPerS);
+  if (r.expectedPerS) fprintf(stderr, " (expected %u on channel %u)", (unsigned)r.expectedPerS, r.channel);
+  fprintf(stderr, " callback stack=%u B loop stack free=%u B\n", r.callbackStack, r.loopStackFree);
+  MetricShard &metrics = *sensor.agg->metrics;
+  metrics.gauge(sensor.m.freeHeap, r.freeHeap);
+  metrics.gauge(sensor.m.minFreeHeap, r.minFreeHeap);
+  metrics.gauge(sensor.m.maxFreeBlock, r.maxFreeBlock);
+  metrics.gauge(sensor.m.loops, r.loopsPerS);
+  metrics.gauge(sensor.m.callbacks, r.callbacksPerS);
+  metrics.gauge(sensor.m.uptime, r.uptimeMs / 1000.0);
+}
+
+static void printTalkers(Sensor &sensor, const uint8_t *payload, uint16_t length) {
+  if (length < 12) return;
+  uint32_t head[3];
+  memcpy(head, payload, sizeof(head));
+  fflush(stdout);
+  fprintf(stderr, "sensor%u t=%u data frames=%u bytes=%u\n", sensor.index, (unsigned)head[0], (unsigned)head[1],
+    (unsigned)head[2]);
+  sensor.agg->metrics->add(sensor.m.dataFrames, head[1]);
+  sensor.agg->metrics->add(sensor.m.dataBytes, head[2]);
+  for (uint16_t at = 12; at + sizeof(Talker) <= length; at += sizeof(Talker)) {
+    Talker t;
+    memcpy(&t, payload + at, sizeof(t));
+    fprintf(stderr, "sensor%u talker %02x:%02x:%02x:%02x:%02x:%02x frames=%u bytes=%u error=%u channel=%u rssi=%d\n",
+      sensor.index, t.mac[0], t.mac[1], t.mac[2], t.mac[3], t.mac[4], t.mac[5], (unsigned)t.frames, (unsigned)t.bytes,
+      (unsigned)t.error, t.channel, t.rssi);
+  }
+}
+
+static void frameSample(Sensor &sensor, const uint8_t *payload, uint16_t length) {
+  Aggregator &agg = *sensor.agg;
+  if (length < FRAME_SAMPLE_HEADER) return;
+  uint32_t sweep, seen;
+  memcpy(&sweep, payload, 4);
+  memcpy(&seen, payload + 4, 4);
+  uint8_t index = payload[8];
+  uint8_t count = payload[9];
+  if (index == 0) {
+    fflush(stdout);
+    fprintf(stderr, "sensor%u sweep %u: %u of %u frames sampled\n", sensor.index, (unsigned)sweep, count, (unsigned)seen);
+  }
+  if (!agg.samplePrefix || count == 0 || length < FRAME_SAMPLE_HEADER + sizeof(PcapRecordHeader)) return;
+  if (!sensor.samples) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s%u.pcap", agg.samplePrefix, sensor.index);
+    sensor.samples = fopen(path, "ab");
+    if (!sensor.samples) {
+      fprintf(stderr, "%s: %s\n", path, strerror(errno));
+      agg.samplePrefix = NULL;
+      return;
+    }
+    if (ftell(sensor.samples) == 0) {
+      PcapFileHeader header;
+      pcapFileHeader(header, RADIOTAP_SENSOR_LENGTH + FRAME_SAMPLE_CAPTURE, LINKTYPE_IEEE802_11_RADIOTAP);
+      fwrite(&header, sizeof(header), 1, sensor.samples);
+    }
+  }
+  PcapRecordHeader record;
+  memcpy(&record, payload + FRAME_SAMPLE_HEADER, sizeof(record));
+  if (agg.sync && sensor.clock.ready()) {
+    uint64_t us = sensor.clock.toHostUs(record.tsSec * 1000 + record.tsUsec / 1000) + agg.epochOffsetUs;
+    record.tsSec = us / 1000000;
+    record.tsUsec = us % 1000000;
+  }
+  uint16_t at = FRAME_SAMPLE_HEADER + sizeof(record);
+  fwrite(&record, sizeof(record), 1, sensor.samples);
+  fwrite(payload + at, 1, length - at, sensor.samples);
+  if (index + 1 == count) fflush(sensor.samples);
+}
+
+static void sweepSet(Sensor &sensor, const uint8_t *payload, uint16_t length) {
+  if (length < SWEEP_SET_HEADER) return;
+  Aggregator &agg = *sensor.agg;
+  SweepSets &s = sensor.sweepSets;
+  uint32_t sweep;
+  uint16_t ids;
+  memcpy(&sweep, payload, 4);
+  memcpy(&ids, payload + 4, 2);
+  uint8_t block = payload[6];
+  uint8_t blocks = payload[7];
+  uint16_t dropped, untracked;
+  memcpy(&dropped, payload + 8, 2);
+  memcpy(&untracked, payload + 10, 2);
+  if (block == 0) {
+    s.sweep = sweep;
+    s.received = 0;
+    s.broken = false;
+    s.building.clear();
+  }
+  if (s.broken || sweep != s.sweep) return;
+  // a lost frame leaves the set incomplete, wait for the next sweep.
+  if (block != s.received ||
+      (blocks && !s.building.addBlock(payload + SWEEP_SET_HEADER, length - SWEEP_SET_HEADER))) {
+    s.broken = true;
+    fflush(stdout);
+    fprintf(stderr, "sensor%u sweep %u: set incomplete, block %u of %u lost\n", sensor.index, (unsigned)sweep, s.received, blocks);
+    return;
+  }
+  if (blocks && ++s.received < blocks) return;
+
+  fflush(stdout);
+  fprintf(stderr, "sensor%u sweep %u: %u devices in %u bytes", sensor.index, (unsigned)sweep, (unsigned)s.building.size(),
+    (unsigned)s.building.bytes());
+  if (s.building.size() != ids) fprintf(stderr, " (sensor sent %u)", ids);
+  if (dropped || untracked) fprintf(stderr, " (%u dropped, %u frames untracked)", dropped, untracked);
+  agg.metrics->gauge(sensor.m.sweepDevices, s.building.size());
+  if (s.havePrevious && s.previousSweep + 1 == sweep) {
+    fprintf(stderr, ", %u also in sweep %u, %u in either", (unsigned)intersectionSize(s.building, s.previous),
+      (unsigned)s.previousSweep, (unsigned)unionSize(s.building, s.previous));
+  }
+  fprintf(stderr, "\n");
+  if (agg.visitors) {
+    uint32_t today = time(NULL) / 86400;
+    if (!agg.visitors->add(today, s.building) || !agg.visitors->sync()) {
+      fprintf(stderr, "visitor index: %s\n", agg.visitors->error());
+    }
+  }
+  std::swap(s.previous, s.building);
+  s.previousSweep = sweep;
+  s.havePrevious = true;
+  s.broken = true;    // done until the next block 0
+}
+
+// Sync answers echo the request: uint32 sequence, uint64 host send time.
+static void syncAck(Sensor &sensor, const uint8_t *payload, uint16_t length) {
+  if (length < 16) return;
+  uint32_t sensorMs, seq;
+  uint64_t sentUs;
+  memcpy(&sensorMs, payload, 4);
+  memcpy(&seq, payload + 4, 4);
+  memcpy(&sentUs, payload + 8, 8);
+  if (seq != sensor.syncSeq) return;
+  Aggregator &agg = *sensor.agg;
+  uint64_t receivedUs = monotonicUs();
+  sensor.clock.addSample(sentUs, receivedUs, sensorMs);
+  sensor.syncAcked = true;
+  agg.metrics->observe(sensor.m.syncRtt, agg.registry->bounds(agg.families.syncRtt), (receivedUs - sentUs) / 1e6);
+  agg.metrics->gauge(sensor.m.drift, sensor.clock.driftPpm());
+}
+
+static void onFrame(void *ctx, uint8_t type, const uint8_t *payload, uint16_t length) {
+  Sensor &agg = *(Sensor *)ctx;
+  switch (type) {
+    case FRAME_DIGESTS:
+      printDigests(agg, payload, length);
+      break;
+    case FRAME_DIGEST_STATS:
+      printCounters(agg, payload, length);
+      break;
+    case FRAME_SWEEP_SET:
+      sweepSet(agg, payload, length);
+      break;
+    case FRAME_TIME_SYNC_ACK:
+      syncAck(agg, payload, length);
+      break;
+    case FRAME_HEALTH:
+      printHealth(agg, payload, length);
+      break;
+    case FRAME_TOP_TALKERS:
+      printTalkers(agg, payload, length);
+      break;
+    case FRAME_SAMPLE:
+      frameSample(agg, payload, length);
+      break;
+    case FRAME_WATCHLIST_ACK:
+      if (length >= 7) {
+        agg.watchlistAcked = true;
+        agg.watchlistCommitted = payload[6] != 0;
+        memcpy(&agg.watchlistCount, payload + 4, 2);
+      }
+      break;
+    case FRAME_RULES_ACK:
+      if (length >= 7) {
+        agg.rulesAcked = true;
+        agg.rulesLoaded = payload[4] != 0;
+        memcpy(&agg.rulesDetail, payload + 5, 2);
+        uint16_t n = (size_t)(length - 7) < sizeof(agg.rulesError) - 1 ? length - 7 : sizeof(agg.rulesError) - 1;
+        memcpy(agg.rulesError, payload + 7, n);
+        agg.rulesError[n] = 0;
+      }
+      break;
+    case LINK_STATS:
+      if (length >= sizeof(LinkStats)) {
+        LinkStats s;
+        memcpy(&s, payload, sizeof(s));
+        char side[16];
+        sprintf(side, "sensor%u", agg.index);
+        printLinkStats(side, s);
+        linkMetrics(*agg.agg->metrics, agg.m.sensor, s);
+      }
+      break;
+  }
+}
+
+static void sendWhenRoom(SensorLink &link, uint8_t type, const uint8_t *payload, uint16_t length) {
+  while (link.txRoom() < length) link.poll(1000);
+  link.send(type, payload, length);
+}
+
+static void waitFor(Sensor &agg, const bool &acked) {
+  uint32_t start = agg.port->millis();
+  while (!acked && agg.port->millis() - start < ACK_TIMEOUT_MS) agg.link->poll(1000);
+}
+
+static bool loadWatchlist(Sensor &agg, const std::vector<WatchRecord> &records) {
+  SensorLink &link = *agg.link;
+  sendWhenRoom(link, FRAME_WATCHLIST_BEGIN, NULL, 0);
+  for (size_t i = 0; i < records.size(); i += WATCHLIST_RECORDS_PER_FRAME) {
+    size_t n = records.size() - i < WATCHLIST_RECORDS_PER_FRAME ? records.size() - i : WATCHLIST_RECORDS_PER_FRAME;
+    sendWhenRoom(link, FRAME_WATCHLIST_DATA, (const uint8_t *)&records[i], n * WATCH_RECORD_LENGTH);
+  }
+  // the sensor rejects the list unless it got every record.
+  uint16_t sent = records.size();
+  agg.watchlistAcked = false;
+  sendWhenRoom(link, FRAME_WATCHLIST_COMMIT, (const uint8_t *)&sent, sizeof(sent));
+  waitFor(agg, agg.watchlistAcked);
+
+  size_t expected = watchlistDistinct(records);
+  if (!agg.watchlistAcked) {
+    fprintf(stderr, "watchlist: no answer from the sensor\n");
+    return false;
+  }
+  if (!agg.watchlistCommitted || agg.watchlistCount != expected) {
+    // rejected: too long for WATCHLIST_SIZE, or records lost on the way.
+    fprintf(stderr, "watchlist: %s, sensor has %u of %u MACs\n",
+      agg.watchlistCommitted ? "incomplete" : "rejected", agg.watchlistCount, (unsigned)expected);
+    return false;
+  }
+  fprintf(stderr, "watchlist: %u MACs loaded\n", agg.watchlistCount);
+  return true;
+}
+
+// Rules longer than a frame go in FRAME_RULES_DATA pieces, the sensor
+// loads them when the last one arrives.
+static bool loadRules(Sensor &agg, const std::string &rules) {
+  if (rules.size() > 0xffff) {
+    fprintf(stderr, "rules: %u bytes, too long\n", (unsigned)rules.size());
+    return false;
+  }
+  agg.rulesAcked = false;
+  if (rules.size() <= SENSOR_RX_MAX_PAYLOAD) {
+    sendWhenRoom(*agg.link, FRAME_RULES, (const uint8_t *)rules.data(), rules.size());
+  } else {
+    uint8_t piece[SENSOR_RX_MAX_PAYLOAD];
+    uint16_t total = rules.size();
+    for (size_t offset = 0; offset < total; offset += RULES_PIECE_LENGTH) {
+      uint16_t at = offset;
+      uint16_t n = total - offset < RULES_PIECE_LENGTH ? total - offset : RULES_PIECE_LENGTH;
+      memcpy(piece, &at, 2);
+      memcpy(piece + 2, &total, 2);
+      memcpy(piece + 4, rules.data() + offset, n);
+      sendWhenRoom(*agg.link, FRAME_RULES_DATA, piece, 4 + n);
+    }
+  }
+  waitFor(agg, agg.rulesAcked);
+  if (!agg.rulesAcked) {
+    fprintf(stderr, "rules: no answer from the sensor\n");
+    return false;
+  }
+  if (!agg.rulesLoaded) {
+    fprintf(stderr, "rules: error at %u: %s\n", agg.rulesDetail, agg.rulesError);
+    return false;
+  }
+  fprintf(stderr, "rules: loaded, %u instructions worst case\n", agg.rulesDetail);
+  return true;
+}
+
+static void sendSync(Sensor &sensor) {
+  uint8_t request[16];
+  uint64_t now = monotonicUs();
+  sensor.syncSeq++;
+  sensor.syncAcked = false;
+  sensor.lastSyncUs = now;
+  memcpy(request, &sensor.syncSeq, 4);
+  memcpy(request + 4, &now, 8);
+  memset(request + 12, 0, 4);
+  sensor.link->send(FRAME_TIME_SYNC, request, sizeof(request));
+}
+
+// A few round trips before streaming starts, so the first digests are placed well.
+static bool syncClock(Sensor &sensor) {
+  for (int i = 0; i < SYNC_ROUNDS; i++) {
+    sendSync(sensor);
+    uint32_t start = sensor.port->millis();
+    while (!sensor.syncAcked && sensor.port->millis() - start < SYNC_TIMEOUT_MS) sensor.link->poll(1000);
+  }
+  if (!sensor.clock.ready()) {
+    fprintf(stderr, "sensor%u: no answer to time sync\n", sensor.index);
+    return false;
+  }
+  fprintf(stderr, "sensor%u: clock synced, rtt %.1f ms\n", sensor.index, sensor.clock.minRttUs() / 1000.0);
+  return true;
+}
+
+static int queryVisitors(const char *path, const char *dayText, uint32_t weeks) {
+  uint32_t day;
+  if (!parseDay(dayText, day)) {
+    fprintf(stderr, "%s: not a YYYY-MM-DD date\n", dayText);
+    return 1;
+  }
+  VisitorIndex index;
+  if (access(path, F_OK) != 0) {
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    return 1;
+  }
+  if (!index.openReadOnly(path)) {
+    fprintf(stderr, "%s: %s\n", path, index.error());
+    return 1;
+  }
+  // a range per week back, then the whole window before the day.
+  std::vector<DayRange> ranges;
+  for (uint32_t k = 1; k <= weeks && 7 * k <= day; k++) {
+    DayRange r = { day - 7 * k, day - 7 * k + 6 };
+    ranges.push_back(r);
+  }
+  DayRange before = { index.firstDay(), day ? day - 1 : 0 };
+  ranges.push_back(before);
+  std::vector<uint64_t> returning(ranges.size());
+  uint64_t visitors;
+  if (!index.cohort(day, ranges.data(), ranges.size(), visitors, returning.data())) {
+    fprintf(stderr, "%s is outside the index window %s..%s\n", dayText, formatDay(index.firstDay()).c_str(),
+      formatDay(index.lastDay()).c_str());
+    return 1;
+  }
+  printf("%s: %llu visitors, index of %llu devices over %s..%s\n", dayText, (unsigned long long)visitors,
+    (unsigned long long)index.devices(), formatDay(index.firstDay()).c_str(), formatDay(index.lastDay()).c_str());
+  for (size_t i = 0; i < ranges.size(); i++) {
+    if (day == 0 || ranges[i].from > ranges[i].to) continue;
+    printf("  %s %s..%s: %llu returning, %.1f%%\n", i + 1 < ranges.size() ? "week" : "any ",
+      formatDay(ranges[i].from).c_str(), formatDay(ranges[i].to).c_str(), (unsigned long long)returning[i],
+      visitors ? 100.0 * returning[i] / visitors : 0.0);
+  }
+  return 0;
+}
+
+// Opens a device or stdin and brings up its link.
+static Sensor *openSensor(Aggregator &agg, unsigned index, const char *path, uint32_t baud, bool rtscts) {
+  bool tty = strcmp(path, "-") != 0;
+  int fd = tty ? openSerial(path, baud, rtscts) : 0;
+  if (fd < 0) {
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    return NULL;
+  }
+  uint64_t *pool = new uint64_t[16384 / sizeof(uint64_t)];
+  Arena *arena = new Arena((uint8_t *)pool, 16384);
+  FdPort *port = new FdPort(fd, tty ? fd : -1, tty);
+  SensorLink *link = new SensorLink(*port);
+  link->begin(*arena, 1024, 4096, baud, baud);
+  Sensor *sensor = new Sensor();
+  sensor->agg = &agg;
+  sensor->index = index;
+  sensor->link = link;
+  sensor->port = port;
+  sensor->startMs = port->millis();
+  link->onFrame(onFrame, sensor);
+  registerSensorMetrics(*sensor);
+  return sensor;
+}
+
+// Moves the link to the highest rate both ends agree on.
+static void negotiateBaud(Sensor &sensor, uint32_t baud, uint32_t maxBaud) {
+  for (unsigned i = 0; i < sizeof(negotiationRates) / sizeof(negotiationRates[0]); i++) {
+    if (negotiationRates[i] > maxBaud || negotiationRates[i] <= baud) continue;
+    if (sensor.link->negotiateBaud(negotiationRates[i], 1000)) break;
+  }
+  fprintf(stderr, "sensor%u: link at %u baud\n", sensor.index, (unsigned)sensor.link->baud());
+}
+
+static void saveState(const Aggregator &agg, const std::vector<Sensor *> &sensors, std::vector<uint8_t> &state) {
+  state.clear();
+  StateWriter out(state);
+  out.u32(STATE_FORMAT);
+  out.u32(sensors.size());
+  for (size_t i = 0; i < sensors.size(); i++) {
+    const Sensor &sensor = *sensors[i];
+    const SweepSets &s = sensor.sweepSets;
+    out.u64(sensor.digests);
+    out.u8(s.havePrevious);
+    out.u32(s.previousSweep);
+    out.bytes(s.previous.data().data(), s.previous.data().size());
+  }
+  out.u8(agg.windows != NULL);
+  if (agg.windows) agg.windows->save(out);
+}
+
+// All or nothing: a snapshot of another setup leaves the state as it is.
+static bool restoreState(Aggregator &agg, std::vector<Sensor *> &sensors, const std::vector<uint8_t> &state) {
+  StateReader in(state.data(), state.size());
+  if (in.u32() != STATE_FORMAT || in.u32() != sensors.size()) return false;
+  std::vector<unsigned long> digests(sensors.size());
+  std::vector<SweepSets> sets(sensors.size(), SweepSets());
+  for (size_t i = 0; i < sensors.size(); i++) {
+    digests[i] = in.u64();
+    sets[i].havePrevious = in.u8() != 0;
+    sets[i].previousSweep = in.u32();
+    size_t length;
+    const uint8_t *data = in.bytes(length);
+    if (!in.ok() || !sets[i].previous.assign(data, length)) return false;
+  }
+  bool windows = in.u8() != 0;
+  if (windows != (agg.windows != NULL)) return false;
+  EventWindows restored = windows ? *agg.windows : EventWindows(0, 0, 0, 0);
+  if (windows && !restored.restore(in)) return false;
+  if (!in.done()) return false;
+  for (size_t i = 0; i < sensors.size(); i++) {
+    sensors[i]->digests += digests[i];
+    SweepSets &s = sensors[i]->sweepSets;
+    if (s.havePrevious) continue;
+    s.havePrevious = sets[i].havePrevious;
+    s.previousSweep = sets[i].previousSweep;
+    s.previous = sets[i].previous;
+  }
+  if (windows) *agg.windows = restored;
+  return true;
+}
+
+int main(int argc, char **argv) {
+  uint32_t baud = LINK_DEFAULT_BAUD;
+  uint32_t maxBaud = 0;
+  bool rtscts = false;
+  const char *watchlistPath = NULL;
+  std::vector<WatchRecord> watchlist;
+  const char *rulesPath = NULL;
+  std::string rules;
+  const char *visitorsPath = NULL;
+  uint32_t visitorDays = VISITOR_INDEX_DAYS;
+  const char *queryDay = NULL;
+  uint32_t queryWeeks = 4;
+  uint32_t syncMs = 0;
+  uint32_t windowS = 0;
+  uint32_t latenessMs = 2000;
+  const char *checkpointPath = NULL;
+  uint32_t checkpointMs = 1000;
+  const char *samplePrefix = NULL;
+  const char *metricsListen = NULL;
+  const char *sightingsPath = NULL;
+  const char *windowsPath = NULL;
+  uint32_t rollS = 0;
+  uint32_t salt = DEVICE_SALT;
+  int opt;
+  while ((opt = getopt(argc, argv, "b:n:rw:F:V:D:q:k:T:W:G:C:I:P:M:A:E:R:S:B:L")) != -1) {
+    switch (opt) {
+      case 'b': baud = atol(optarg); break;
+      case 'n': maxBaud = atol(optarg); break;
+      case 'r': rtscts = true; break;
+      case 'w': watchlistPath = optarg; break;
+      case 'F': rulesPath = optarg; break;
+      case 'V': visitorsPath = optarg; break;
+      case 'D': visitorDays = atol(optarg); break;
+      case 'q': queryDay = optarg; break;
+      case 'k': queryWeeks = atol(optarg); break;
+      case 'T': syncMs = atol(optarg); break;
+      case 'W': windowS = atol(optarg); break;
+      case 'G': latenessMs = atol(optarg); break;
+      case 'C': checkpointPath = optarg; break;
+      case 'I': checkpointMs = atol(optarg); break;
+      case 'P': samplePrefix = optarg; break;
+      case 'M': metricsListen = optarg; break;
+      case 'A': sightingsPath = optarg; break;
+      case 'E': windowsPath = optarg; break;
+      case 'R': rollS = atol(optarg); break;
+      case 'S': salt = strtoul(optarg, NULL, 0); break;
+      case 'B':
+        if (!readWatchlist(optarg, watchlist)) return 1;
+        fwrite(watchlist.data(), WATCH_RECORD_LENGTH, watchlist.size(), stdout);
+        return 0;
+      case 'L': return runLoopback();
+      default: optind = argc; break;
+    }
+  }
+  if (queryDay && visitorsPath) return queryVisitors(visitorsPath, queryDay, queryWeeks);
+  if (optind >= argc) {
+    fprintf(stderr, "usage: %s [-b baud] [-n max_baud] [-r] [-w watchlist] [-F rules] [-V index [-D days]]\n"
+                    "         [-T sync_ms [-W window_s] [-G lateness_ms]] [-C checkpoint [-I interval_ms]]\n"
+                    "         [-P sample_prefix] [-M [addr:]port] [-A sightings] [-E windows] [-R roll_s] [-S salt]\n"
+                    "         <device|->...\n"
+                    "       %s -B watchlist\n       %s -L\n       %s -V index -q YYYY-MM-DD [-k weeks]\n",
+      argv[0], argv[0], argv[0], argv[0]);
+    return 2;
+  }
+
+  int devices = argc - optind;
+  bool tty = true;
+  for (int i = optind; i < argc; i++) tty = tty && strcmp(argv[i], "-") != 0;
+  if ((watchlistPath || rulesPath || syncMs) && !tty) {
+    fprintf(stderr, "-w, -F and -T need devices\n");
+    return 1;
+  }
+  if ((devices > 1 || windowS) && !syncMs) {
+    fprintf(stderr, "several devices and -W need -T, records are placed on a common clock\n");
+    return 1;
+  }
+  if (windowsPath && !windowS) {
+    fprintf(stderr, "-E needs -W\n");
+    return 1;
+  }
+  bool arrowStdout = (sightingsPath && strcmp(sightingsPath, "-") == 0) || (windowsPath && strcmp(windowsPath, "-") == 0);
+  if (arrowStdout && (rollS || (sightingsPath && windowsPath))) {
+    fprintf(stderr, "-A - and -E - take stdout, one of them and without -R\n");
+    return 1;
+  }
+  if (watchlistPath && !readWatchlist(watchlistPath, watchlist)) return 1;
+  if (rulesPath && !readTextFile(rulesPath, rules)) return 1;
+  VisitorIndex visitors;
+  if (visitorsPath && !visitors.open(visitorsPath, visitorDays)) {
+    fprintf(stderr, "%s: %s\n", visitorsPath, visitors.error());
+    return 1;
+  }
+  EventWindows windows(windowS * 1000, latenessMs, WINDOW_IDLE_MS, devices);
+
+  Aggregator agg;
+  agg.visitors = visitorsPath ? &visitors : NULL;
+  agg.sync = syncMs != 0;
+  agg.windows = windowS ? &windows : NULL;
+  agg.samplePrefix = samplePrefix;
+  agg.csv = !arrowStdout;
+  agg.salt = salt;
+  ArrowWriter sightingWriter(sightingFields, sizeof(sightingFields) / sizeof(sightingFields[0]),
+    sightingsPath ? ARROW_SIGHTING_ROWS : 0);
+  ArrowWriter windowWriter(windowFields, sizeof(windowFields) / sizeof(windowFields[0]), windowsPath ? ARROW_WINDOW_ROWS : 0);
+  ArrowOutput sightings = { &sightingWriter, sightingsPath, rollS * 1000, 0, 0 };
+  ArrowOutput windowRows = { &windowWriter, windowsPath, rollS * 1000, 0, 0 };
+  agg.sightings = sightingsPath ? &sightings : NULL;
+  agg.windowRows = windowsPath ? &windowRows : NULL;
+  MetricRegistry registry(METRIC_VALUES);
+  agg.registry = &registry;
+  agg.metrics = registry.addShard();
+  registerMetrics(agg);
+  struct timespec realtime;
+  clock_gettime(CLOCK_REALTIME, &realtime);
+  agg.epochOffsetUs = (uint64_t)realtime.tv_sec * 1000000 + realtime.tv_nsec / 1000 - monotonicUs();
+  setvbuf(stdout, NULL, _IOFBF, 1 << 16);
+  if (sightingsPath || windowsPath) {
+    // a pipe closed by its reader fails the writes instead.
+    signal(SIGPIPE, SIG_IGN);
+    uint64_t nowMs = (monotonicUs() + agg.epochOffsetUs) / 1000;
+    if (sightingsPath && !arrowOpen(sightings, nowMs)) return 1;
+    if (windowsPath && !arrowOpen(windowRows, nowMs)) return 1;
+  }
+
+  std::vector<Sensor *> sensors;
+  for (int i = 0; i < devices; i++) {
+    Sensor *sensor = openSensor(agg, i, argv[optind + i], baud, rtscts);
+    if (!sensor) return 1;
+    sensors.push_back(sensor);
+    agg.windowDevices.push_back(registry.series(agg.families.windowDevices, labels("sensor=\"%u\"", i)));
+  }
+  agg.windowDevices.push_back(registry.series(agg.families.windowDevices, "sensor=\"all\""));
+  MetricsServer metricsServer(registry);
+  if (metricsListen && !metricsServer.start(metricsListen)) {
+    fprintf(stderr, "-M %s: %s\n", metricsListen, metricsServer.error());
+    return 1;
+  }
+
+  // Restored before the first digest is read.
+  Checkpoint checkpoint;
+  std::vector<uint8_t> state;
+  if (checkpointPath) {
+    if (!checkpoint.open(checkpointPath)) {
+      fprintf(stderr, "%s: %s\n", checkpointPath, checkpoint.error());
+      return 1;
+    }
+    uint64_t startUs = monotonicUs();
+    if (!checkpoint.load(state)) {
+      fprintf(stderr, "checkpoint: none yet, starting afresh\n");
+    } else if (!restoreState(agg, sensors, state)) {
+      fprintf(stderr, "checkpoint: of another setup, starting afresh\n");
+    } else {
+      fprintf(stderr, "checkpoint: generation %llu restored, %u bytes in %.1f ms\n",
+        (unsigned long long)checkpoint.generation(), (unsigned)state.size(), (monotonicUs() - startUs) / 1000.0);
+    }
+  }
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+
+  for (int i = 0; i < devices; i++) {
+    Sensor *sensor = sensors[i];
+    // a text mode sensor sends its sweep sets, samples and health once the host has spoken.
+    sensor->link->send(LINK_PING, NULL, 0);
+    if (tty && maxBaud > baud) negotiateBaud(*sensor, baud, maxBaud);
+    if (watchlistPath && !loadWatchlist(*sensor, watchlist)) return 1;
+    if (rulesPath && !loadRules(*sensor, rules)) return 1;
+    if (syncMs && !syncClock(*sensor)) return 1;
+  }
+
+  // One sensor blocks in its own reads; several are polled together.
+  std::vector<struct pollfd> fds(devices);
+  for (int i = 0; i < devices; i++) {
+    fds[i].fd = devices > 1 ? sensors[i]->port->readFd() : -1;
+    fds[i].events = POLLIN;
+    if (devices > 1) sensors[i]->port->setReadWait(0);
+  }
+  uint64_t checkpointUs = monotonicUs();
+  while (!stopping) {
+    bool open = false;
+    for (int i = 0; i < devices; i++) open = open || !sensors[i]->port->eof();
+    if (!open) break;
+    if (devices > 1) ::poll(fds.data(), fds.size(), 10);
+    for (int i = 0; i < devices; i++) {
+      Sensor &sensor = *sensors[i];
+      if (sensor.port->eof()) continue;
+      if (syncMs && monotonicUs() - sensor.lastSyncUs >= (uint64_t)syncMs * 1000) sendSync(sensor);
+      sensor.link->poll(devices > 1 ? 1000 : 100000);
+    }
+    WindowSummary w;
+    uint64_t nowMs = (monotonicUs() + agg.epochOffsetUs) / 1000;
+    while (agg.windows && agg.windows->next(w, nowMs)) printWindow(agg, w);
+    if (agg.sightings) arrowTick(sightings, nowMs);
+    if (agg.windowRows) arrowTick(windowRows, nowMs);
+    if (checkpointPath && monotonicUs() - checkpointUs >= (uint64_t)checkpointMs * 1000) {
+      // the output up to the state goes out first.
+      fflush(stdout);
+      saveState(agg, sensors, state);
+      if (!checkpoint.save(state)) fprintf(stderr, "%s: %s\n", checkpointPath, checkpoint.error());
+      checkpointUs = monotonicUs();
+    }
+  }
+  // open windows stay in the checkpoint for the next run.
+  fflush(stdout);
+  if (checkpointPath) {
+    saveState(agg, sensors, state);
+    if (!checkpoint.save(state)) fprintf(stderr, "%s: %s\n", checkpointPath, checkpoint.error());
+  } else {
+    WindowSummary w;
+    while (agg.windows && agg.windows->flush(w)) printWindow(agg, w);
+  }
+  for (int i = 0; i < devices; i++) {
+    fprintf(stderr, "sensor%u: host digests=%lu\n", (unsigned)i, sensors[i]->digests);
+    printLinkStats("host", sensors[i]->link->stats());
+  }
+  if (agg.windows && windows.late()) fprintf(stderr, "%llu digests too late for their window\n",
+                                             (unsigned long long)windows.late());
+  if (agg.sightings) arrowClose(sightings);
+  if (agg.windowRows) arrowClose(windowRows);
+  metricsServer.stop();
+  if (registry.dropped()) fprintf(stderr, "metrics: %llu series over the registry size\n",
+                                  (unsigned long long)registry.dropped());
+  return 0;
+}
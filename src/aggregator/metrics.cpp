@@ -0,0 +1,127 @@
+#include "metrics.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+static uint64_t doubleBits(double value) {
+  uint64_t bits;
+  memcpy(&bits, &value, 8);
+  return bits;
+}
+
+static double bitsDouble(uint64_t bits) {
+  double value;
+  memcpy(&value, &bits, 8);
+  return value;
+}
+
+MetricShard::MetricShard(size_t values) : _values(new std::atomic<uint64_t>[values]) {
+  for (size_t i = 0; i < values; i++) _values[i].store(0, std::memory_order_relaxed);
+}
+
+void MetricShard::gauge(MetricId id, double value) {
+  if (id >= 0) _values[id].store(doubleBits(value), std::memory_order_relaxed);
+}
+
+// Buckets are kept per bound, not cumulative; the last is +Inf, then the sum.
+void MetricShard::observe(MetricId id, const std::vector<double> &bounds, double value) {
+  if (id < 0) return;
+  size_t bucket = 0;
+  while (bucket < bounds.size() && value > bounds[bucket]) bucket++;
+  add(id + bucket);
+  std::atomic<uint64_t> &sum = _values[id + bounds.size() + 1];
+  sum.store(doubleBits(bitsDouble(sum.load(std::memory_order_relaxed)) + value), std::memory_order_relaxed);
+}
+
+MetricRegistry::MetricRegistry(size_t values) : _capacity(values), _used(0), _dropped(0) {
+}
+
+int MetricRegistry::family(const char *name, MetricType type, const char *help, const std::vector<double> &bounds) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  Family f;
+  f.name = name;
+  f.type = type;
+  f.help = help;
+  f.bounds = bounds;
+  _families.push_back(f);
+  return _families.size() - 1;
+}
+
+MetricId MetricRegistry::series(int family, const std::string &labels) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  for (size_t i = 0; i < _series.size(); i++) {
+    if (_series[i].family == family && _series[i].labels == labels) return _series[i].id;
+  }
+  size_t width = _families[family].type == METRIC_HISTOGRAM ? _families[family].bounds.size() + 2 : 1;
+  if (_used + width > _capacity) {
+    _dropped++;
+    return -1;
+  }
+  Series s = { family, labels, (MetricId)_used };
+  _used += width;
+  _series.push_back(s);
+  return s.id;
+}
+
+MetricShard *MetricRegistry::addShard() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  _shards.push_back(std::unique_ptr<MetricShard>(new MetricShard(_capacity)));
+  return _shards.back().get();
+}
+
+static void appendf(std::string &out, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+static void appendf(std::string &out, const char *format, ...) {
+  char line[512];
+  va_list args;
+  va_start(args, format);
+  int n = vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  if (n > 0) out.append(line, (size_t)n < sizeof(line) ? n : sizeof(line) - 1);
+}
+
+static const char *typeNames[] = { "counter", "gauge", "histogram" };
+
+void MetricRegistry::render(std::string &out) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  out.clear();
+  for (size_t f = 0; f < _families.size(); f++) {
+    const Family &family = _families[f];
+    appendf(out, "# TYPE %s %s\n# HELP %s %s\n", family.name.c_str(), typeNames[family.type], family.name.c_str(),
+      family.help.c_str());
+    for (size_t i = 0; i < _series.size(); i++) {
+      const Series &s = _series[i];
+      if (s.family != (int)f) continue;
+      const char *name = family.name.c_str();
+      const char *labels = s.labels.c_str();
+      const char *comma = s.labels.empty() ? "" : ",";
+      std::string braces = s.labels.empty() ? "" : "{" + s.labels + "}";
+      if (family.type == METRIC_COUNTER) {
+        uint64_t total = 0;
+        for (size_t k = 0; k < _shards.size(); k++) total += _shards[k]->value(s.id);
+        appendf(out, "%s_total%s %llu\n", name, braces.c_str(), (unsigned long long)total);
+      } else if (family.type == METRIC_GAUGE) {
+        double total = 0;
+        for (size_t k = 0; k < _shards.size(); k++) total += bitsDouble(_shards[k]->value(s.id));
+        appendf(out, "%s%s %.9g\n", name, braces.c_str(), total);
+      } else {
+        uint64_t cumulative = 0;
+        double sum = 0;
+        for (size_t b = 0; b <= family.bounds.size(); b++) {
+          for (size_t k = 0; k < _shards.size(); k++) cumulative += _shards[k]->value(s.id + b);
+          if (b < family.bounds.size()) {
+            appendf(out, "%s_bucket{%s%sle=\"%g\"} %llu\n", name, labels, comma, family.bounds[b],
+              (unsigned long long)cumulative);
+          } else {
+            appendf(out, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", name, labels, comma, (unsigned long long)cumulative);
+          }
+        }
+        for (size_t k = 0; k < _shards.size(); k++) sum += bitsDouble(_shards[k]->value(s.id + family.bounds.size() + 1));
+        appendf(out, "%s_count%s %llu\n%s_sum%s %.9g\n", name, braces.c_str(), (unsigned long long)cumulative, name,
+          braces.c_str(), sum);
+      }
+    }
+  }
+  out += "# EOF\n";
+}
@@ -0,0 +1,100 @@
+/**
+* Metric registry for the OpenMetrics endpoint (metrics_server.h).
+* Each ingesting thread owns a shard: a fixed array of values it alone
+* writes, with relaxed atomic loads and stores, so an update is a plain
+* memory write with no lock and no read-modify-write. A scrape sums every
+* shard's value per series.
+* Families are registered before the ingesting threads start, series up
+* front or on first use (a sensor, a channel) under a mutex; ingestion
+* keeps the returned MetricIds.
+* Counters and histogram buckets are integers, gauges and histogram sums
+* doubles kept as their bits; a gauge should be set by one shard only.
+*/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+enum MetricType {
+  METRIC_COUNTER,
+  METRIC_GAUGE,
+  METRIC_HISTOGRAM
+};
+
+// Offset of a series' values in the shards; -1 when the registry is full,
+// updates of it are ignored.
+typedef int32_t MetricId;
+
+class MetricShard {
+public:
+  explicit MetricShard(size_t values);
+
+  void add(MetricId id, uint64_t n = 1) {
+    if (id < 0) return;
+    std::atomic<uint64_t> &v = _values[id];
+    v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+  // A counter kept elsewhere (a sensor's), relayed as is.
+  void set(MetricId id, uint64_t value) {
+    if (id >= 0) _values[id].store(value, std::memory_order_relaxed);
+  }
+  void gauge(MetricId id, double value);
+  // bounds: the histogram's family bounds, MetricRegistry::bounds().
+  void observe(MetricId id, const std::vector<double> &bounds, double value);
+
+  uint64_t value(size_t offset) const { return _values[offset].load(std::memory_order_relaxed); }
+
+private:
+  std::unique_ptr<std::atomic<uint64_t>[]> _values;
+};
+
+class MetricRegistry {
+public:
+  // values: counters, gauges and histogram slots (buckets + 2) of all series.
+  explicit MetricRegistry(size_t values);
+
+  // name without the _total suffix of counters; bounds of histograms, ascending.
+  int family(const char *name, MetricType type, const char *help,
+             const std::vector<double> &bounds = std::vector<double>());
+  // labels as the text between the braces, eg. sensor="0",channel="6".
+  MetricId series(int family, const std::string &labels);
+  const std::vector<double> &bounds(int family) const { return _families[family].bounds; }
+
+  // One per ingesting thread, owned by the registry.
+  MetricShard *addShard();
+
+  // The OpenMetrics text exposition of all series, shards summed.
+  void render(std::string &out);
+  uint64_t dropped() const { return _dropped; }
+
+private:
+  struct Family {
+    std::string name;
+    MetricType type;
+    std::string help;
+    std::vector<double> bounds;
+  };
+  struct Series {
+    int family;
+    std::string labels;
+    MetricId id;
+  };
+
+  std::mutex _mutex;
+  size_t _capacity;
+  size_t _used;
+  std::deque<Family> _families;
+  std::vector<Series> _series;
+  std::vector<std::unique_ptr<MetricShard> > _shards;
+  uint64_t _dropped;          // series that didn't fit
+};
+
+#endif
@@ -0,0 +1,117 @@
+#include "metrics_server.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define METRICS_REQUEST_MAX   4096
+#define METRICS_IO_TIMEOUT_MS 2000
+#define METRICS_CONTENT_TYPE  "application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+MetricsServer::MetricsServer(MetricRegistry &registry)
+  : _registry(registry), _listenFd(-1), _stopping(false), _scrapes(0), _error(NULL) {
+}
+
+MetricsServer::~MetricsServer() {
+  stop();
+}
+
+bool MetricsServer::start(const char *listen) {
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  const char *colon = strrchr(listen, ':');
+  if (colon) {
+    std::string host(listen, colon - listen);
+    if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) {
+      _error = "not an IPv4 address";
+      return false;
+    }
+    listen = colon + 1;
+  }
+  int port = atoi(listen);
+  if (port <= 0 || port > 65535) {
+    _error = "not a port";
+    return false;
+  }
+  addr.sin_port = htons(port);
+
+  _listenFd = socket(AF_INET, SOCK_STREAM, 0);
+  int on = 1;
+  if (_listenFd < 0 || setsockopt(_listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) != 0 ||
+      bind(_listenFd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || ::listen(_listenFd, 8) != 0) {
+    _error = "can't listen";
+    if (_listenFd >= 0) close(_listenFd);
+    _listenFd = -1;
+    return false;
+  }
+  _thread = std::thread(&MetricsServer::run, this);
+  return true;
+}
+
+void MetricsServer::stop() {
+  if (!_thread.joinable()) return;
+  _stopping = true;
+  _thread.join();
+  close(_listenFd);
+  _listenFd = -1;
+}
+
+// Polls so stop() needs no signal to end the thread.
+void MetricsServer::run() {
+  while (!_stopping) {
+    struct pollfd p = { _listenFd, POLLIN, 0 };
+    if (poll(&p, 1, 200) <= 0) continue;
+    int fd = accept(_listenFd, NULL, NULL);
+    if (fd < 0) continue;
+    serve(fd);
+    close(fd);
+  }
+}
+
+static bool sendAll(int fd, const char *data, size_t len) {
+  while (len > 0) {
+    struct pollfd p = { fd, POLLOUT, 0 };
+    if (poll(&p, 1, METRICS_IO_TIMEOUT_MS) <= 0) return false;
+    ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+    if (n <= 0) return false;
+    data += n;
+    len -= n;
+  }
+  return true;
+}
+
+void MetricsServer::serve(int fd) {
+  char request[METRICS_REQUEST_MAX + 1];
+  size_t length = 0;
+  // the request line and headers; a body, if any, is ignored.
+  while (length < METRICS_REQUEST_MAX) {
+    struct pollfd p = { fd, POLLIN, 0 };
+    if (poll(&p, 1, METRICS_IO_TIMEOUT_MS) <= 0) return;
+    ssize_t n = recv(fd, request + length, METRICS_REQUEST_MAX - length, 0);
+    if (n <= 0) return;
+    length += n;
+    request[length] = 0;
+    if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n")) break;
+  }
+
+  char header[256];
+  bool metrics = strncmp(request, "GET /metrics ", 13) == 0 || strncmp(request, "GET /metrics?", 13) == 0;
+  if (!metrics) {
+    const char *notFound = "HTTP/1.1 404 Not Found\r\nContent-Type: text/plain\r\nContent-Length: 10\r\n"
+                           "Connection: close\r\n\r\nnot found\n";
+    sendAll(fd, notFound, strlen(notFound));
+    return;
+  }
+  _registry.render(_body);
+  _scrapes++;
+  int n = snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nContent-Length: %u\r\n"
+                   "Connection: close\r\n\r\n", METRICS_CONTENT_TYPE, (unsigned)_body.size());
+  if (sendAll(fd, header, n)) sendAll(fd, _body.data(), _body.size());
+}
@@ -0,0 +1,40 @@
+/**
+* Serves a MetricRegistry over HTTP for Prometheus: GET /metrics answers
+* the OpenMetrics text, anything else 404. One connection at a time on
+* its own thread, rendered from the registry on each scrape; the threads
+* ingesting data never wait on it.
+*/
+
+#ifndef METRICS_SERVER_H
+#define METRICS_SERVER_H
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include "metrics.h"
+
+class MetricsServer {
+public:
+  explicit MetricsServer(MetricRegistry &registry);
+  ~MetricsServer();
+
+  // "port" listens on the loopback interface, "address:port" on that one.
+  bool start(const char *listen);
+  void stop();
+  const char *error() const { return _error; }
+  uint64_t scrapes() const { return _scrapes; }
+
+private:
+  void run();
+  void serve(int fd);
+
+  MetricRegistry &_registry;
+  int _listenFd;
+  std::thread _thread;
+  std::atomic<bool> _stopping;
+  std::atomic<uint64_t> _scrapes;
+  const char *_error;
+  std::string _body;
+};
+
+#endif
@@ -0,0 +1,335 @@
+#include "visitor_index.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#define VISITOR_INDEX_MAGIC   "FCCVIDX1"
+#define VISITOR_INDEX_MIN     1024
+
+struct VisitorIndexHeader {
+  char magic[8];
+  uint32_t days;              // bitmap bits per device
+  uint32_t lastDay;           // newest day of the window
+  uint64_t slots;             // a power of two
+  uint64_t used;
+  uint32_t clean;             // 0 while open for writing
+  uint32_t reserved[7];
+};
+
+static_assert(sizeof(VisitorIndexHeader) == 64, "VisitorIndexHeader must stay 64 bytes");
+
+VisitorIndex::VisitorIndex()
+  : _fd(-1), _base(NULL), _length(0), _header(NULL), _words(0), _readOnly(false), _error(NULL) {
+}
+
+VisitorIndex::~VisitorIndex() {
+  close();
+}
+
+uint64_t *VisitorIndex::entry(uint64_t slot) const {
+  return (uint64_t *)(_base + sizeof(VisitorIndexHeader)) + slot * (1 + _words);
+}
+
+bool VisitorIndex::map(int fd, bool writable) {
+  if (writable && flock(fd, LOCK_EX | LOCK_NB) != 0) {
+    _error = "index is open for writing elsewhere";
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(VisitorIndexHeader)) {
+    _error = "not a visitor index";
+    return false;
+  }
+  void *base = mmap(NULL, st.st_size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+  if (base == MAP_FAILED) {
+    _error = "can't map the index";
+    return false;
+  }
+  const VisitorIndexHeader *header = (const VisitorIndexHeader *)base;
+  uint32_t words = header->days / 64;
+  if (memcmp(header->magic, VISITOR_INDEX_MAGIC, 8) != 0 || header->days == 0 || header->days % 64 ||
+      (header->slots & (header->slots - 1)) ||
+      (size_t)st.st_size != sizeof(VisitorIndexHeader) + header->slots * (1 + words) * 8) {
+    munmap(base, st.st_size);
+    _error = "not a visitor index";
+    return false;
+  }
+  _fd = fd;
+  _base = (uint8_t *)base;
+  _length = st.st_size;
+  _header = (VisitorIndexHeader *)base;
+  _words = words;
+  _readOnly = !writable;
+  return true;
+}
+
+void VisitorIndex::unmap() {
+  if (_base) munmap(_base, _length);
+  if (_fd >= 0) ::close(_fd);
+  _base = NULL;
+  _header = NULL;
+  _fd = -1;
+}
+
+bool VisitorIndex::create(const std::string &path, uint32_t days, uint64_t slots, uint32_t lastDay) {
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    _error = "can't create the index";
+    return false;
+  }
+  VisitorIndexHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, VISITOR_INDEX_MAGIC, 8);
+  header.days = days;
+  header.lastDay = lastDay;
+  header.slots = slots;
+  // entries stay a sparse hole of zeros until written.
+  if (write(fd, &header, sizeof(header)) != sizeof(header) ||
+      ftruncate(fd, sizeof(header) + slots * (1 + days / 64) * 8) != 0) {
+    ::close(fd);
+    _error = "can't write the index";
+    return false;
+  }
+  if (!map(fd, true)) {
+    ::close(fd);
+    return false;
+  }
+  return true;
+}
+
+bool VisitorIndex::open(const char *path, uint32_t days) {
+  _path = path;
+  int fd = ::open(path, O_RDWR);
+  if (fd < 0) {
+    if (!create(_path, (days + 63) / 64 * 64, VISITOR_INDEX_MIN, 0)) return false;
+  } else if (!map(fd, true)) {
+    ::close(fd);
+    return false;
+  }
+  if (!_header->clean) {
+    // not closed properly: updates since the last sync are lost, recount.
+    uint64_t used = 0;
+    for (uint64_t i = 0; i < _header->slots; i++) used += entry(i)[0] != 0;
+    _header->used = used;
+  }
+  _header->clean = 0;
+  return true;
+}
+
+// The header is left as it is: a writer may have it open, and the device
+// count of an index not closed properly stays the one last written.
+bool VisitorIndex::openReadOnly(const char *path) {
+  _path = path;
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0) {
+    _error = "can't open the index";
+    return false;
+  }
+  if (!map(fd, false)) {
+    ::close(fd);
+    return false;
+  }
+  return true;
+}
+
+bool VisitorIndex::sync() {
+  if (_base == NULL || _readOnly) return false;
+  return msync(_base, _length, MS_SYNC) == 0;
+}
+
+bool VisitorIndex::close() {
+  if (_base == NULL) return true;
+  if (_readOnly) {
+    unmap();
+    return true;
+  }
+  _header->clean = 1;
+  bool ok = sync();
+  unmap();
+  return ok;
+}
+
+uint64_t VisitorIndex::devices() const { return _header ? _header->used : 0; }
+uint32_t VisitorIndex::days() const { return _header ? _header->days : 0; }
+uint32_t VisitorIndex::lastDay() const { return _header ? _header->lastDay : 0; }
+
+uint32_t VisitorIndex::firstDay() const {
+  if (_header == NULL) return 0;
+  return _header->lastDay >= _header->days ? _header->lastDay - _header->days + 1 : 0;
+}
+
+// Sets the day bit of id, false if the table is full.
+bool VisitorIndex::insert(uint64_t id, uint32_t day) {
+  uint64_t key = id + 1;
+  uint64_t mask = _header->slots - 1;
+  uint64_t slot = (id ^ (id >> 23)) & mask;
+  for (uint64_t probes = 0; probes <= mask; probes++, slot = (slot + 1) & mask) {
+    uint64_t *e = entry(slot);
+    if (e[0] != key) {
+      if (e[0] != 0) continue;
+      e[0] = key;
+      _header->used++;
+    }
+    uint32_t bit = day % _header->days;
+    e[1 + bit / 64] |= 1ULL << (bit % 64);
+    return true;
+  }
+  return false;
+}
+
+// Copies the entries still inside the window ending at lastDay into a new
+// table of slots entries, then swaps the files.
+bool VisitorIndex::rebuild(uint64_t slots, uint32_t lastDay) {
+  VisitorIndex next;
+  std::string tmp = _path + ".tmp";
+  if (!next.create(tmp, _header->days, slots, lastDay)) {
+    _error = next._error;
+    return false;
+  }
+  next._path = tmp;
+  next._header->clean = 0;
+
+  // ring bits of the days that leave the window are dropped.
+  uint32_t days = _header->days;
+  std::vector<uint64_t> keep(_words, 0);
+  uint32_t oldLast = _header->lastDay;
+  for (uint32_t d = lastDay >= days - 1 ? lastDay - days + 1 : 0; d <= lastDay && d <= oldLast; d++) {
+    if (oldLast - d < days) keep[(d % days) / 64] |= 1ULL << ((d % days) % 64);
+  }
+
+  for (uint64_t i = 0; i < _header->slots; i++) {
+    const uint64_t *e = entry(i);
+    if (e[0] == 0) continue;
+    bool any = false;
+    for (uint32_t w = 0; w < _words; w++) any |= (e[1 + w] & keep[w]) != 0;
+    if (!any) continue;
+    uint64_t id = e[0] - 1;
+    uint64_t mask = slots - 1;
+    uint64_t slot = (id ^ (id >> 23)) & mask;
+    while (next.entry(slot)[0] != 0) slot = (slot + 1) & mask;
+    uint64_t *n = next.entry(slot);
+    n[0] = e[0];
+    for (uint32_t w = 0; w < _words; w++) n[1 + w] = e[1 + w] & keep[w];
+    next._header->used++;
+  }
+
+  if (!next.sync() || rename(tmp.c_str(), _path.c_str()) != 0) {
+    _error = "can't replace the index";
+    return false;
+  }
+  unmap();
+  _fd = next._fd;
+  _base = next._base;
+  _length = next._length;
+  _header = next._header;
+  next._fd = -1;
+  next._base = NULL;
+  next._header = NULL;
+  return true;
+}
+
+bool VisitorIndex::add(uint32_t day, const IdSet &ids) {
+  if (_header == NULL) return false;
+  if (_readOnly) {
+    _error = "index is open read only";
+    return false;
+  }
+  if (_header->used > 0 && day + _header->days <= _header->lastDay) {
+    _error = "day is older than the window";
+    return false;
+  }
+  uint64_t slots = _header->slots;
+  while ((_header->used + ids.size()) * 4 > slots * 3) slots *= 2;
+  if (day > _header->lastDay && _header->used > 0) {
+    if (!rebuild(slots, day)) return false;
+  } else if (slots != _header->slots) {
+    if (!rebuild(slots, _header->lastDay)) return false;
+  }
+  if (day > _header->lastDay) _header->lastDay = day;
+
+  IdSet::Cursor c(ids);
+  uint64_t id;
+  while (c.next(id)) {
+    if (!insert(id, day)) {
+      _error = "index full";
+      return false;
+    }
+  }
+  return true;
+}
+
+bool VisitorIndex::cohort(uint32_t day, const DayRange *ranges, size_t count, uint64_t &visitors,
+                          uint64_t *returning) const {
+  visitors = 0;
+  memset(returning, 0, count * sizeof(uint64_t));
+  if (_header == NULL || day > _header->lastDay || day < firstDay()) return false;
+
+  // a bit mask per range; ranges are clipped to the window.
+  uint32_t days = _header->days;
+  std::vector<uint64_t> masks(count * _words, 0);
+  uint64_t *mask = masks.data();
+  for (size_t r = 0; r < count; r++) {
+    uint32_t from = ranges[r].from > firstDay() ? ranges[r].from : firstDay();
+    for (uint32_t d = from; d <= ranges[r].to && d <= _header->lastDay; d++) {
+      mask[r * _words + (d % days) / 64] |= 1ULL << ((d % days) % 64);
+    }
+  }
+
+  uint32_t dayWord = (day % days) / 64;
+  uint64_t dayBit = 1ULL << ((day % days) % 64);
+  for (uint64_t i = 0; i < _header->slots; i++) {
+    const uint64_t *e = entry(i);
+    if (e[0] == 0 || !(e[1 + dayWord] & dayBit)) continue;
+    visitors++;
+    for (size_t r = 0; r < count; r++) {
+      const uint64_t *m = mask + r * _words;
+      for (uint32_t w = 0; w < _words; w++) {
+        if (e[1 + w] & m[w]) {
+          returning[r]++;
+          break;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+// Civil date conversions (proleptic Gregorian), after H. Hinnant's days_from_civil.
+bool parseDay(const char *text, uint32_t &day) {
+  int y, m, d;
+  char end;
+  if (sscanf(text, "%d-%d-%d%c", &y, &m, &d, &end) != 3 || y < 1970 || m < 1 || m > 12 || d < 1) {
+    return false;
+  }
+  static const int monthDays[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+  bool leap = (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+  if (d > monthDays[m - 1] + (m == 2 && leap)) return false;
+  y -= m <= 2;
+  int era = y / 400;
+  unsigned yoe = y - era * 400;
+  unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  day = era * 146097 + doe - 719468;
+  return true;
+}
+
+std::string formatDay(uint32_t day) {
+  uint32_t z = day + 719468;
+  uint32_t era = z / 146097;
+  uint32_t doe = z - era * 146097;
+  uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  uint32_t mp = (5 * doy + 2) / 153;
+  uint32_t d = doy - (153 * mp + 2) / 5 + 1;
+  uint32_t m = mp < 10 ? mp + 3 : mp - 9;
+  uint32_t y = yoe + era * 400 + (m <= 2);
+  char text[32];
+  snprintf(text, sizeof(text), "%04u-%02u-%02u", y, m, d);
+  return text;
+}
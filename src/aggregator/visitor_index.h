@@ -0,0 +1,81 @@
+/**
+* Returning-visitor index: salted device IDs (the sweep sets' 48-bit IDs)
+* with a bitmap of the days each was seen, in a memory-mapped file.
+* The file is an open addressing hash table, keyed by the ID (already a
+* hash), with fixed size entries: uint64 ID + 1 (0 is an empty slot) and a
+* ring of `days` bits, bit day % days. Only pages touched by an update or
+* query are read, so the index may be far larger than RAM.
+* A day outside the window makes the window move: the table is rebuilt
+* into a new file without the expired days and devices and renamed over
+* the old one. The same rebuild doubles the table when it gets 3/4 full.
+* Updates are idempotent bit sets; a crash between sync()s loses at most
+* the updates since, and the device count is recounted on the next open.
+* One writer at a time holds an flock() on the file; queries map it read
+* only and never write, so they can run beside the writer.
+* Days are UTC days since 1970-01-01.
+*/
+
+#ifndef VISITOR_INDEX_H
+#define VISITOR_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include "../host/id_set.h"
+
+#define VISITOR_INDEX_DAYS 384      // default window, a multiple of 64
+
+struct DayRange {
+  uint32_t from;
+  uint32_t to;                      // inclusive
+};
+
+class VisitorIndex {
+public:
+  VisitorIndex();
+  ~VisitorIndex();
+
+  // Opens the index, creating it with a window of `days` (rounded up to 64) if missing.
+  bool open(const char *path, uint32_t days);
+  // Opens an existing index for queries only.
+  bool openReadOnly(const char *path);
+  bool close();
+  const char *error() const { return _error; }
+
+  // Marks the set's devices seen on day.
+  bool add(uint32_t day, const IdSet &ids);
+  // Flushes the mapping to the file.
+  bool sync();
+
+  // Devices seen on day, and per range how many of them were also seen in it.
+  bool cohort(uint32_t day, const DayRange *ranges, size_t count, uint64_t &visitors,
+              uint64_t *returning) const;
+
+  uint64_t devices() const;
+  uint32_t days() const;
+  uint32_t firstDay() const;
+  uint32_t lastDay() const;
+
+private:
+  bool map(int fd, bool writable);
+  void unmap();
+  bool create(const std::string &path, uint32_t days, uint64_t slots, uint32_t lastDay);
+  bool rebuild(uint64_t slots, uint32_t lastDay);
+  bool insert(uint64_t id, uint32_t day);
+  uint64_t *entry(uint64_t slot) const;
+
+  std::string _path;
+  int _fd;
+  uint8_t *_base;
+  size_t _length;
+  struct VisitorIndexHeader *_header;
+  uint32_t _words;            // bitmap words per entry
+  bool _readOnly;
+  const char *_error;
+};
+
+// "YYYY-MM-DD" to days since 1970-01-01 and back.
+bool parseDay(const char *text, uint32_t &day);
+std::string formatDay(uint32_t day);
+
+#endif
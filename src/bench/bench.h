@@ -0,0 +1,81 @@
+/**
+* Micro benchmarks for the sniffer data structures.
+* The same sources build for the board (env:nodemcuv2_bench, results on serial)
+* and for the host (env:native_bench, results on stdout).
+*/
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef ARDUINO
+  #include <Arduino.h>
+  #define benchPrintf(...) Serial.printf(__VA_ARGS__)
+#else
+  #include <time.h>
+  #define benchPrintf(...) printf(__VA_ARGS__)
+#endif
+
+// CPU cycle counter: CCOUNT on the ESP8266, TSC on x86 hosts, nanoseconds elsewhere.
+static inline uint64_t benchCycles() {
+#if defined(ARDUINO)
+  return ESP.getCycleCount();
+#elif defined(__x86_64__) || defined(__i386__)
+  uint32_t lo, hi;
+  __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+  return ((uint64_t)hi << 32) | lo;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+// Small deterministic PRNG (xorshift32) so host and device runs see the same MACs.
+static inline uint32_t benchRandom(uint32_t *state) {
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return *state = x;
+}
+
+static inline void benchRandomMAC(uint32_t *state, uint8_t *mac) {
+  uint32_t a = benchRandom(state);
+  uint32_t b = benchRandom(state);
+  mac[0] = (a & 0xfc);  // globally administered unicast
+  mac[1] = a >> 8;
+  mac[2] = a >> 16;
+  mac[3] = b;
+  mac[4] = b >> 8;
+  mac[5] = b >> 16;
+}
+
+// Measured regions. On Linux hosts the region also collects hardware counters
+// (cycles, instructions, L1d/LLC misses, branch misses) via perf_event_open;
+// counters that can't be opened (no PMU, perf_event_paranoid, containers) are
+// reported as n/a and the region falls back to benchCycles().
+// benchRegionEnd() prints the counters divided by ops, labeled per unit.
+void benchCountersBegin();
+void benchRegionBegin(const char *name);
+void benchRegionEnd(uint32_t ops, const char *unit);
+// Cycles/op of the last finished region.
+uint64_t benchRegionCyclesPerOp();
+
+// Heap guard (host glibc builds): counts malloc/calloc/realloc/free calls made
+// while armed. Elsewhere it is not available and always reports 0.
+bool heapGuardAvailable();
+void heapGuardArm();
+uint32_t heapGuardDisarm();
+
+// Failed checks make the native program exit non-zero.
+void benchFail(const char *reason);
+
+// Benchmarks. Each prints its own result lines.
+void benchQuotientFilter();
+void benchSnifferCore();
+void benchScheduler();
+
+#endif
@@ -0,0 +1,140 @@
+#include "bench.h"
+
+#include <string.h>
+
+#if defined(__linux__) && !defined(ARDUINO)
+  #define BENCH_PERF_EVENTS 1
+  #include <linux/perf_event.h>
+  #include <sys/ioctl.h>
+  #include <sys/syscall.h>
+  #include <unistd.h>
+#else
+  #define BENCH_PERF_EVENTS 0
+#endif
+
+enum {
+  COUNTER_CYCLES,
+  COUNTER_INSTRUCTIONS,
+  COUNTER_L1D_MISSES,
+  COUNTER_LLC_MISSES,
+  COUNTER_BRANCH_MISSES,
+  COUNTER_COUNT
+};
+
+static const char *counterNames[COUNTER_COUNT] = {
+  "cycles", "instr", "L1d-miss", "LLC-miss", "br-miss"
+};
+
+static const char *regionName = "";
+static uint64_t regionStart;
+static uint64_t regionValues[COUNTER_COUNT];
+static bool regionValid[COUNTER_COUNT];
+static uint64_t lastCyclesPerOp;
+
+#if BENCH_PERF_EVENTS
+
+static int counterFds[COUNTER_COUNT] = { -1, -1, -1, -1, -1 };
+static bool countersOpened = false;
+
+static int openCounter(uint32_t type, uint64_t config) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static uint64_t cacheConfig(uint64_t cache) {
+  return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+
+void benchCountersBegin() {
+  if (countersOpened) return;
+  countersOpened = true;
+  counterFds[COUNTER_CYCLES] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+  counterFds[COUNTER_INSTRUCTIONS] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+  counterFds[COUNTER_L1D_MISSES] = openCounter(PERF_TYPE_HW_CACHE, cacheConfig(PERF_COUNT_HW_CACHE_L1D));
+  counterFds[COUNTER_LLC_MISSES] = openCounter(PERF_TYPE_HW_CACHE, cacheConfig(PERF_COUNT_HW_CACHE_LL));
+  counterFds[COUNTER_BRANCH_MISSES] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+
+  benchPrintf("perf counters:");
+  for (int i = 0; i < COUNTER_COUNT; i++) {
+    benchPrintf(" %s=%s", counterNames[i], counterFds[i] >= 0 ? "ok" : "n/a");
+  }
+  benchPrintf("\n");
+}
+
+void benchRegionBegin(const char *name) {
+  benchCountersBegin();
+  regionName = name;
+  for (int i = 0; i < COUNTER_COUNT; i++) {
+    if (counterFds[i] < 0) continue;
+    ioctl(counterFds[i], PERF_EVENT_IOC_RESET, 0);
+    ioctl(counterFds[i], PERF_EVENT_IOC_ENABLE, 0);
+  }
+  regionStart = benchCycles();
+}
+
+static void stopCounters() {
+  uint64_t elapsed = benchCycles() - regionStart;
+  for (int i = 0; i < COUNTER_COUNT; i++) {
+    regionValid[i] = false;
+    if (counterFds[i] < 0) continue;
+    ioctl(counterFds[i], PERF_EVENT_IOC_DISABLE, 0);
+    uint64_t data[3];
+    if (read(counterFds[i], data, sizeof(data)) != sizeof(data) || data[2] == 0) continue;
+    // Scale up when the kernel multiplexed the counter.
+    regionValues[i] = data[1] == data[2] ? data[0] : (uint64_t)((double)data[0] * data[1] / data[2]);
+    regionValid[i] = true;
+  }
+  if (!regionValid[COUNTER_CYCLES]) {
+    regionValues[COUNTER_CYCLES] = elapsed;
+    regionValid[COUNTER_CYCLES] = true;
+  }
+}
+
+#else
+
+void benchCountersBegin() {
+}
+
+void benchRegionBegin(const char *name) {
+  regionName = name;
+  regionStart = benchCycles();
+}
+
+static void stopCounters() {
+  regionValues[COUNTER_CYCLES] = benchCycles() - regionStart;
+  regionValid[COUNTER_CYCLES] = true;
+  for (int i = 1; i < COUNTER_COUNT; i++) {
+    regionValid[i] = false;
+  }
+}
+
+#endif
+
+void benchRegionEnd(uint32_t ops, const char *unit) {
+  stopCounters();
+  if (ops == 0) ops = 1;
+  benchPrintf("  %s:", regionName);
+  for (int i = 0; i < COUNTER_COUNT; i++) {
+    if (!regionValid[i]) {
+      if (BENCH_PERF_EVENTS) benchPrintf(" %s n/a", counterNames[i]);
+      continue;
+    }
+    // Two decimals in fixed point, the board's printf has no float support.
+    uint64_t centi = regionValues[i] * 100 / ops;
+    benchPrintf(" %s %u.%02u", counterNames[i], (unsigned)(centi / 100), (unsigned)(centi % 100));
+  }
+  benchPrintf(" per %s\n", unit);
+  lastCyclesPerOp = regionValues[COUNTER_CYCLES] / ops;
+}
+
+uint64_t benchRegionCyclesPerOp() {
+  return lastCyclesPerOp;
+}
@@ -0,0 +1,37 @@
+#include "bench.h"
+
+static int benchFailures = 0;
+
+void benchFail(const char *reason) {
+  benchPrintf("FAIL: %s\n", reason);
+  benchFailures++;
+}
+
+static void runBenchmarks() {
+  benchPrintf("== sniffer benchmarks ==\n");
+  benchCountersBegin();
+  benchQuotientFilter();
+  benchSnifferCore();
+  benchScheduler();
+  benchPrintf("== done, %d failed ==\n", benchFailures);
+}
+
+#ifdef ARDUINO
+
+void setup() {
+  Serial.begin(115200);
+  delay(100);
+  runBenchmarks();
+}
+
+void loop() {
+}
+
+#else
+
+int main() {
+  runBenchmarks();
+  return benchFailures ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,120 @@
+#include "bench.h"
+
+#include <string.h>
+#include <QuotientFilter.h>
+
+#define QF_BENCH_QUERIES 10000
+#define LEGACY_BUFFER_SIZE 100
+
+struct QFGeometry {
+  uint8_t qbits;
+  uint8_t rbits;
+};
+
+static const QFGeometry geometries[] = {
+  { 10, 5 },
+  { 10, 8 },
+  { 12, 8 },
+  { 12, 13 },
+#ifndef ARDUINO
+  // Larger than L1/L2 on the host, to see where lookups start missing cache.
+  { 16, 8 },
+  { 20, 8 },
+#endif
+};
+
+#ifdef ARDUINO
+  #define QF_BENCH_MAX_SLOTS (1UL << 12)
+#else
+  #define QF_BENCH_MAX_SLOTS (1UL << 20)
+#endif
+
+static uint8_t table[(QF_BENCH_MAX_SLOTS * (13 + 3) + 7) / 8];
+
+static void benchGeometry(const QFGeometry &g) {
+  QuotientFilter filter;
+  filter.begin(g.qbits, g.rbits, table);
+  uint32_t entries = filter.slots() * 3 / 4;
+  uint8_t mac[6];
+
+  benchPrintf("qf q=%u r=%u: %u entries in %u bytes (%u.%02u B/entry)\n",
+    g.qbits, g.rbits, (unsigned)entries, (unsigned)filter.tableBytes(),
+    (unsigned)(filter.tableBytes() / entries), (unsigned)(filter.tableBytes() * 100 / entries % 100));
+
+  uint32_t seed = 0x12345678;
+  benchRegionBegin("insert");
+  for (uint32_t i = 0; i < entries; i++) {
+    benchRandomMAC(&seed, mac);
+    filter.insert(mac);
+  }
+  benchRegionEnd(entries, "insert");
+
+  // Query the inserted MACs again: all of them must hit.
+  seed = 0x12345678;
+  uint32_t hits = 0;
+  benchRegionBegin("lookup hit");
+  for (uint32_t i = 0; i < entries; i++) {
+    benchRandomMAC(&seed, mac);
+    hits += filter.contains(mac);
+  }
+  benchRegionEnd(entries, "lookup");
+
+  // Query MACs never inserted: every hit is a false positive.
+  uint32_t fresh = 0x9abcdef1;
+  uint32_t falsePositives = 0;
+  benchRegionBegin("lookup miss");
+  for (uint32_t i = 0; i < QF_BENCH_QUERIES; i++) {
+    benchRandomMAC(&fresh, mac);
+    falsePositives += filter.contains(mac);
+  }
+  benchRegionEnd(QF_BENCH_QUERIES, "lookup");
+
+  seed = 0x12345678;
+  benchRegionBegin("remove");
+  for (uint32_t i = 0; i < entries / 2; i++) {
+    benchRandomMAC(&seed, mac);
+    filter.remove(mac);
+  }
+  benchRegionEnd(entries / 2, "remove");
+
+  benchPrintf("  %u/%u hits, fp rate %u/%u (expected ~%u)\n",
+    (unsigned)hits, (unsigned)entries,
+    (unsigned)falsePositives, QF_BENCH_QUERIES, (unsigned)(QF_BENCH_QUERIES * 3 / 4 >> g.rbits));
+}
+
+// The exact table used by main.cpp: MAC strings compared with strcmp.
+static char legacyMacs[LEGACY_BUFFER_SIZE][18];
+
+static void benchLegacyBuffer() {
+  uint32_t seed = 0x12345678;
+  uint8_t mac[6];
+  for (int i = 0; i < LEGACY_BUFFER_SIZE; i++) {
+    benchRandomMAC(&seed, mac);
+    sprintf(legacyMacs[i], "%02x:%02x:%02x:%02x:%02x:%02x", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+  }
+  benchPrintf("legacy buffer: %u entries in %u bytes\n", LEGACY_BUFFER_SIZE, (unsigned)sizeof(legacyMacs));
+
+  char addr[18];
+  uint32_t fresh = 0x9abcdef1;
+  uint32_t found = 0;
+  benchRegionBegin("lookup miss (incl. sprintf)");
+  for (uint32_t i = 0; i < QF_BENCH_QUERIES; i++) {
+    benchRandomMAC(&fresh, mac);
+    sprintf(addr, "%02x:%02x:%02x:%02x:%02x:%02x", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    for (int j = 0; j < LEGACY_BUFFER_SIZE; j++) {
+      if (strcmp(addr, legacyMacs[j]) == 0) {
+        found++;
+        break;
+      }
+    }
+  }
+  benchRegionEnd(QF_BENCH_QUERIES, "lookup");
+  benchPrintf("  %u found\n", (unsigned)found);
+}
+
+void benchQuotientFilter() {
+  for (unsigned i = 0; i < sizeof(geometries) / sizeof(geometries[0]); i++) {
+    benchGeometry(geometries[i]);
+  }
+  benchLegacyBuffer();
+}
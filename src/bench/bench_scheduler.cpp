@@ -0,0 +1,131 @@
+#include "bench.h"
+
+#include <string.h>
+#include <CoopScheduler.h>
+
+// Virtual microsecond clock: tasks advance it to simulate the work they do.
+static uint32_t virtualNow;
+
+static uint32_t virtualClock() {
+  return virtualNow;
+}
+
+// A resumable task: a queue of items costing itemUs each, drained in chunks.
+struct DrainTask {
+  uint32_t items;
+  uint32_t itemUs;
+};
+
+static bool drainRun(void *ctx, uint32_t budgetUs) {
+  DrainTask *d = (DrainTask *)ctx;
+  uint32_t start = virtualNow;
+  while (d->items > 0 && virtualNow - start + d->itemUs <= budgetUs) {
+    virtualNow += d->itemUs;
+    d->items--;
+  }
+  return d->items > 0;
+}
+
+// Takes a fixed time, whatever its budget.
+static bool fixedRun(void *ctx, uint32_t budgetUs) {
+  (void)budgetUs;
+  virtualNow += *(uint32_t *)ctx;
+  return false;
+}
+
+static bool idleRun(void *ctx, uint32_t budgetUs) {
+  (void)ctx;
+  (void)budgetUs;
+  return false;
+}
+
+static uint8_t arenaPool[1024] __attribute__((aligned(8)));
+
+struct ScheduleResult {
+  CoopTask tasks[3];
+  uint32_t maxSliceUs;
+  uint32_t drainLeft;
+  uint32_t drainDoneAt;
+};
+
+// Fixed scenario: 1000 items to drain, a periodic expiry task and a task that
+// overruns its budget. The SDK takes 1 ms between loop() calls.
+static void runSchedule(ScheduleResult &result) {
+  virtualNow = 0;
+  Arena arena(arenaPool, sizeof(arenaPool));
+  CoopScheduler scheduler(virtualClock);
+  scheduler.begin(arena, 4);
+
+  DrainTask drain = { 1000, 30 };
+  uint32_t expiryUs = 80;
+  uint32_t hogUs = 300;
+  int8_t drainId = scheduler.addTask("drain", drainRun, &drain, 0, 200, 0);
+  scheduler.addTask("expiry", fixedRun, &expiryUs, 1, 100, 10000);
+  scheduler.addTask("hog", fixedRun, &hogUs, 2, 100, 5000);
+  scheduler.wake(drainId);
+
+  result.maxSliceUs = 0;
+  result.drainDoneAt = 0;
+  for (int i = 0; i < 2000; i++) {
+    uint32_t used = scheduler.runOnce(500);
+    if (used > result.maxSliceUs) result.maxSliceUs = used;
+    if (drain.items == 0 && result.drainDoneAt == 0) result.drainDoneAt = virtualNow;
+    virtualNow += 1000;
+  }
+  result.drainLeft = drain.items;
+  for (uint8_t i = 0; i < 3; i++) {
+    result.tasks[i] = scheduler.task(i);
+  }
+}
+
+static bool sameResult(const ScheduleResult &a, const ScheduleResult &b) {
+  if (a.maxSliceUs != b.maxSliceUs || a.drainLeft != b.drainLeft || a.drainDoneAt != b.drainDoneAt) return false;
+  for (uint8_t i = 0; i < 3; i++) {
+    const CoopTask &x = a.tasks[i];
+    const CoopTask &y = b.tasks[i];
+    if (x.runs != y.runs || x.usedUs != y.usedUs || x.maxUs != y.maxUs || x.overruns != y.overruns) return false;
+  }
+  return true;
+}
+
+static void benchDispatch() {
+  virtualNow = 0;
+  Arena arena(arenaPool, sizeof(arenaPool));
+  CoopScheduler scheduler(virtualClock);
+  scheduler.begin(arena, 8);
+  for (uint8_t i = 0; i < 8; i++) {
+    scheduler.addTask("idle", idleRun, NULL, i, 100, 0);
+  }
+  const uint32_t rounds = 10000;
+  benchRegionBegin("runOnce, 8 pending tasks");
+  for (uint32_t i = 0; i < rounds; i++) {
+    for (uint8_t t = 0; t < 8; t++) {
+      scheduler.wake(t);
+    }
+    scheduler.runOnce(500);
+  }
+  benchRegionEnd(rounds * 8, "dispatch");
+}
+
+void benchScheduler() {
+  ScheduleResult first, second;
+  runSchedule(first);
+  runSchedule(second);
+
+  benchPrintf("scheduler: drain done at %u us, longest slice %u us\n",
+    (unsigned)first.drainDoneAt, (unsigned)first.maxSliceUs);
+  for (uint8_t i = 0; i < 3; i++) {
+    const CoopTask &t = first.tasks[i];
+    benchPrintf("  %-8s runs %u used %u us max %u us overruns %u\n",
+      t.name, (unsigned)t.runs, (unsigned)t.usedUs, (unsigned)t.maxUs, (unsigned)t.overruns);
+  }
+
+  if (!sameResult(first, second)) benchFail("scheduler run is not deterministic");
+  if (first.drainLeft != 0) benchFail("resumable task did not finish");
+  if (first.tasks[0].overruns != 0 || first.tasks[1].overruns != 0) benchFail("well behaved task overran");
+  if (first.tasks[2].overruns != first.tasks[2].runs) benchFail("overruns not counted");
+  // A slice can only be exceeded by the task that overran it.
+  if (first.maxSliceUs > 500 + 300) benchFail("slice exceeded");
+
+  benchDispatch();
+}
@@ -0,0 +1,201 @@
+#include "bench.h"
+
+#include <string.h>
+#include <SnifferCore.h>
+
+#define CORE_BENCH_FRAMES 20000
+#define CORE_BENCH_DEVICES 300
+#define CORE_BENCH_HOP_EVERY 1000
+
+// Swallows the output, counting lines so the work isn't optimized away.
+class BenchHal : public SnifferHal {
+public:
+  BenchHal() : lines(0), channel(1), now(0) {}
+  void println(const char *line) override { lines += line[0] != 0; }
+  uint8_t getChannel() override { return channel; }
+  void setChannel(uint8_t ch) override { channel = ch; }
+  void spiSetData(const char *data) override { (void)data; }
+  uint32_t millis() override { return now; }
+  uint32_t lines;
+  uint8_t channel;
+  uint32_t now;
+};
+
+// A link port taking everything, as if the UART was infinitely fast.
+class BenchPort : public LinkPort {
+public:
+  BenchPort() : bytes(0) {}
+  size_t write(const uint8_t *data, size_t len) override { (void)data; bytes += len; return len; }
+  int read() override { return -1; }
+  bool txIdle() override { return true; }
+  void setBaud(uint32_t baud) override { (void)baud; }
+  uint32_t millis() override { return 0; }
+  uint32_t bytes;
+};
+
+static uint8_t arenaPool[21504] __attribute__((aligned(8)));
+static SnifferPacket frames[64];
+
+// Rules of a demanding site, 28 of the default 32 instructions.
+static const char benchRules[] =
+  "drop rssi < -88\n"
+  "drop not type mgmt,data\n"
+  "drop oui 00:00:5e,00:50:56,08:00:27,52:54:00\n"
+  "accept probe channel 1,6,11 rssi >= -75 global\n"
+  "accept probe local rssi >= -65 len >= 40\n"
+  "accept type data subtype 0,8 rssi >= -60 channel 1,6,11\n"
+  "drop subtype beacon,proberesp,action\n"
+  "accept probe not oui 00:1a:11 len >= 24\n"
+  "default drop\n";
+
+// Probe requests from a fixed device population, with some local MACs and
+// non-probe management frames mixed in.
+static void makeFrame(uint32_t *seed, SnifferPacket *p) {
+  memset(p, 0, sizeof(*p));
+  uint32_t r = benchRandom(seed);
+  uint32_t device = r % CORE_BENCH_DEVICES;
+  p->data[0] = (r >> 16) % 10 == 0 ? 0x80 : (SUBTYPE_PROBE_REQUEST << 4);  // 1 in 10 is a beacon
+  uint8_t *mac = p->data + 10;
+  mac[0] = (r >> 24) % 20 == 0 ? 0x02 : 0x00;  // 1 in 20 is locally administered
+  mac[1] = 0x1a;
+  mac[2] = 0x2b;
+  mac[3] = device >> 16;
+  mac[4] = device >> 8;
+  mac[5] = device;
+  p->rx_ctrl.rssi = -40 - (int)(r % 50);
+  p->rx_ctrl.channel = 1;
+  p->len = 64;
+}
+
+static void benchConfig(const char *name, const SnifferConfig &config) {
+  Arena arena(arenaPool, sizeof(arenaPool));
+  BenchHal hal;
+  BenchPort port;
+  SensorLink link(port);
+  SnifferCore core(hal, config);
+  core.setLink(&link);
+  if (!core.begin(arena) || !link.begin(arena, 2048, 64, 115200, 115200)) {
+    benchFail("sniffer core doesn't fit the bench arena");
+    return;
+  }
+  arena.seal();
+  benchPrintf("sniffer core, %s: arena %u bytes\n", name, (unsigned)arena.used());
+
+  uint32_t seed = 0xdecafbad;
+  for (unsigned i = 0; i < sizeof(frames) / sizeof(frames[0]); i++) {
+    makeFrame(&seed, &frames[i]);
+  }
+
+  // A full watchlist of strangers, every frame pays for the whole search.
+  core.handleFrame(FRAME_WATCHLIST_BEGIN, NULL, 0);
+  for (uint16_t i = 0; i < config.watchlistSize; i++) {
+    WatchRecord r;
+    benchRandomMAC(&seed, r.mac);
+    r.flags = WATCH_EXCLUDE;
+    core.handleFrame(FRAME_WATCHLIST_DATA, (const uint8_t *)&r, sizeof(r));
+  }
+  core.handleFrame(FRAME_WATCHLIST_COMMIT, (const uint8_t *)&config.watchlistSize, sizeof(config.watchlistSize));
+  while (core.commitWatchlist(1000)) {}
+
+  // The hot path must not allocate: the receive callback runs for weeks on a
+  // 40 KB heap. Channel hops are included since they run from the SDK timer.
+  heapGuardArm();
+  benchRegionBegin("handlePacket");
+  for (uint32_t i = 0; i < CORE_BENCH_FRAMES; i++) {
+    SnifferPacket *p = &frames[i % (sizeof(frames) / sizeof(frames[0]))];
+    // Vary the device so new MACs keep arriving.
+    p->data[13] = i >> 8;
+    core.handlePacket((uint8_t *)p, sizeof(*p));
+    if (i % CORE_BENCH_HOP_EVERY == CORE_BENCH_HOP_EVERY - 1) core.channelHop();
+    // loop() gets to run every few frames, one millisecond apart.
+    if (i % 16 == 15) {
+      hal.now++;
+      core.tick();
+      if (config.thinSensor) core.drainDigests(500);
+      else core.exportSweepSet();
+      link.poll(500);
+    }
+  }
+  benchRegionEnd(CORE_BENCH_FRAMES, "frame");
+  uint32_t allocations = heapGuardDisarm();
+
+  benchPrintf("  %u output lines, %d clients, heap calls %u%s\n",
+    (unsigned)hal.lines, core.clientCount(), (unsigned)allocations,
+    heapGuardAvailable() ? "" : " (heap guard n/a)");
+  if (allocations != 0) benchFail("sniffer hot path touched the heap");
+  if (config.thinSensor) {
+    benchPrintf("  digests accepted %u emitted %u dropped %u, %u bytes out\n",
+      (unsigned)core.digestCounter(DIGEST_ACCEPTED), (unsigned)core.digestCounter(DIGEST_EMITTED),
+      (unsigned)core.digestCounter(DIGEST_DROP_QUEUE_FULL), (unsigned)port.bytes);
+  }
+}
+
+// The rule program alone: cycles per frame against its worst case length.
+static void benchRuleEval() {
+  Arena arena(arenaPool, sizeof(arenaPool));
+  FilterRules rules;
+  RuleError error;
+  if (!rules.begin(arena, 32, 16) || !rules.load(benchRules, sizeof(benchRules) - 1, error)) {
+    benchFail("bench rules don't compile");
+    return;
+  }
+  RuleFrame ruleFrames[sizeof(frames) / sizeof(frames[0])];
+  for (unsigned i = 0; i < sizeof(frames) / sizeof(frames[0]); i++) {
+    ruleFrame(frames[i].data, frames[i].len, frames[i].len, frames[i].rx_ctrl.rssi,
+              frames[i].rx_ctrl.channel, ruleFrames[i]);
+  }
+  uint32_t accepted = 0;
+  benchRegionBegin("rules accept");
+  for (uint32_t i = 0; i < CORE_BENCH_FRAMES; i++) {
+    accepted += rules.accept(ruleFrames[i % (sizeof(ruleFrames) / sizeof(ruleFrames[0]))]);
+  }
+  benchRegionEnd(CORE_BENCH_FRAMES, "frame");
+  benchPrintf("  %u instructions worst case, %u of %u frames accepted\n",
+    rules.worstCaseSteps(), (unsigned)accepted, (unsigned)CORE_BENCH_FRAMES);
+}
+
+void benchSnifferCore() {
+  SnifferConfig config;
+  memset(&config, 0, sizeof(config));
+  config.ignoreLocalMacs = true;
+  config.initialChannel = 1;
+  config.hopIntervalMs = 30000;
+  config.bufferSize = 100;
+  config.spiSendClientCount = true;
+  config.qfQuotientBits = 10;
+  config.qfRemainderBits = 8;
+  config.qfWindowSize = 768;
+  config.surgeDetect = true;
+  config.surge.alpha = 0.02f;
+  config.surge.k = 0.5f;
+  config.surge.h = 8;
+  config.surge.minRate = 3;
+  config.surge.warmupS = 120;
+  config.surge.holdoffS = 60;
+  config.watchlistSize = 512;
+  config.rules = "";
+  config.rulesMaxInsns = 32;
+  config.rulesMaxOuis = 16;
+  config.rulesMaxSource = 512;
+  config.sweepTrackerSlots = 1024;
+  config.sweepSetSize = 256;
+  config.sweepSetSalt = 0x5eed5a17;
+  config.talkerSlots = 32;
+  config.talkerReport = 5;
+  config.sampleFrames = 8;
+  benchConfig("macs buffer", config);
+
+  config.dedupQuotientFilter = true;
+  benchConfig("quotient filter", config);
+
+  config.dedupQuotientFilter = false;
+  config.thinSensor = true;
+  config.digestQueueSize = 256;
+  config.digestBatchSize = 32;
+  config.digestBatchMaxMs = 50;
+  benchConfig("thin sensor", config);
+
+  config.rules = benchRules;
+  benchConfig("thin sensor, rules", config);
+  benchRuleEval();
+}
@@ -0,0 +1,78 @@
+#include "bench.h"
+
+// Heap guard for host builds on glibc: the malloc family is interposed and
+// every call made while the guard is armed is counted. glibc keeps the real
+// allocator reachable as __libc_malloc and friends.
+
+#if defined(__GLIBC__) && !defined(ARDUINO)
+
+#include <stddef.h>
+
+extern "C" {
+  void *__libc_malloc(size_t size);
+  void *__libc_calloc(size_t count, size_t size);
+  void *__libc_realloc(void *ptr, size_t size);
+  void *__libc_memalign(size_t align, size_t size);
+  void __libc_free(void *ptr);
+}
+
+static volatile bool heapGuardArmed = false;
+static volatile uint32_t heapGuardCalls = 0;
+
+static inline void heapGuardCheck() {
+  if (heapGuardArmed) heapGuardCalls++;
+}
+
+extern "C" void *malloc(size_t size) {
+  heapGuardCheck();
+  return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size) {
+  heapGuardCheck();
+  return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size) {
+  heapGuardCheck();
+  return __libc_realloc(ptr, size);
+}
+
+extern "C" void *memalign(size_t align, size_t size) {
+  heapGuardCheck();
+  return __libc_memalign(align, size);
+}
+
+extern "C" void free(void *ptr) {
+  heapGuardCheck();
+  __libc_free(ptr);
+}
+
+bool heapGuardAvailable() {
+  return true;
+}
+
+void heapGuardArm() {
+  heapGuardCalls = 0;
+  heapGuardArmed = true;
+}
+
+uint32_t heapGuardDisarm() {
+  heapGuardArmed = false;
+  return heapGuardCalls;
+}
+
+#else
+
+bool heapGuardAvailable() {
+  return false;
+}
+
+void heapGuardArm() {
+}
+
+uint32_t heapGuardDisarm() {
+  return 0;
+}
+
+#endif
@@ -0,0 +1,141 @@
+/**
+* Sensor fleet emulator: N virtual sensors, each the real sniffer core in its
+* own thread with its own traffic, each on a pseudo-terminal that behaves
+* like the board's serial port. Point aggregators (or anything reading a
+* sensor) at the printed terminals to load test them without hardware.
+* Traffic is a synthetic crowd, seeded per sensor, or a capture every sensor
+* replays; -X runs the virtual clocks faster than real time.
+* Fleet totals (frames, output, drops) go to stderr every few seconds.
+* Usage: emulator [-n sensors] [-o dir] [-X speed] [-l] [sensor options]
+*                 [scenario options] [capture.pcap]
+*   -n  virtual sensors (4)
+*   -o  also link the terminals as dir/sensor00, dir/sensor01, ...
+*   -X  virtual seconds per second (1)
+*   -l  start the traffic over when it ends, run until interrupted
+*  sensor: -t thin-sensor mode, -s static, -c channel, -i hop_ms,
+*          -q quotient filter, -L keep local MACs, -a hear all channels
+*  scenario: -x seed, -d duration_s, -r arrivals/s, -D dwell_s, -p probe_interval_s
+*/
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <memory>
+#include <vector>
+
+#include "../host/replay.h"
+#include "virtual_sensor.h"
+
+#define FLEET_STATS_INTERVAL_S 10
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void onSignal(int sig) {
+  (void)sig;
+  interrupted = 1;
+}
+
+static void usage() {
+  fprintf(stderr,
+    "usage: emulator [-n sensors] [-o dir] [-X speed] [-l] [sensor options] [scenario options] [capture.pcap]\n"
+    "  sensor: -t thin sensor, -s static, -c channel, -i hop_ms, -q quotient filter,\n"
+    "          -L keep local MACs, -a hear all channels\n"
+    "  scenario: -x seed, -d duration_s, -r arrivals/s, -D dwell_s, -p probe_interval_s\n");
+}
+
+static void printFleet(const std::vector<std::unique_ptr<VirtualSensor> > &sensors, unsigned elapsedS,
+                       uint64_t &lastFrames, unsigned &lastS) {
+  uint64_t frames = 0, lines = 0, bytes = 0, linesDropped = 0, framesDropped = 0;
+  unsigned running = 0;
+  for (size_t i = 0; i < sensors.size(); i++) {
+    const VirtualSensorStats &s = sensors[i]->stats();
+    frames += s.frames;
+    lines += s.lines;
+    bytes += s.bytesOut;
+    linesDropped += s.linesDropped;
+    framesDropped += s.framesDropped;
+    running += sensors[i]->running();
+  }
+  fprintf(stderr, "fleet %u s: %u/%u running, %llu frames (%llu/s), %llu lines, %llu kB out, "
+                  "dropped %llu lines %llu link frames\n",
+    elapsedS, running, (unsigned)sensors.size(), (unsigned long long)frames,
+    (unsigned long long)(elapsedS > lastS ? (frames - lastFrames) / (elapsedS - lastS) : 0), (unsigned long long)lines,
+    (unsigned long long)(bytes / 1024), (unsigned long long)linesDropped, (unsigned long long)framesDropped);
+  lastFrames = frames;
+  lastS = elapsedS;
+}
+
+int main(int argc, char **argv) {
+  FleetOptions options;
+  replayConfigDefaults(options.config);
+  options.allChannels = false;
+  options.capture = NULL;
+  crowdScenarioDefaults(options.scenario);
+  options.scenario.surgeLengthS = 0;
+  options.loop = false;
+  options.speed = 1;
+  unsigned count = 4;
+  const char *linkDir = NULL;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:o:X:ltsc:i:qLax:d:r:D:p:h")) != -1) {
+    switch (opt) {
+      case 'n': count = atoi(optarg); break;
+      case 'o': linkDir = optarg; break;
+      case 'X': options.speed = atof(optarg); break;
+      case 'l': options.loop = true; break;
+      case 't': options.config.thinSensor = true; break;
+      case 's': options.config.staticMode = true; break;
+      case 'c': options.config.initialChannel = atoi(optarg); break;
+      case 'i': options.config.hopIntervalMs = atoi(optarg); break;
+      case 'q': options.config.dedupQuotientFilter = true; break;
+      case 'L': options.config.ignoreLocalMacs = false; break;
+      case 'a': options.allChannels = true; break;
+      case 'x': options.scenario.seed = atoi(optarg); break;
+      case 'd': options.scenario.durationS = atoi(optarg); break;
+      case 'r': options.scenario.arrivalsPerS = atof(optarg); break;
+      case 'D': options.scenario.dwellS = atof(optarg); break;
+      case 'p': options.scenario.probeIntervalS = atof(optarg); break;
+      default: usage(); return 2;
+    }
+  }
+  if (optind + 1 < argc || count == 0 || options.speed <= 0) {
+    usage();
+    return 2;
+  }
+  if (optind < argc) options.capture = argv[optind];
+
+  std::vector<std::unique_ptr<VirtualSensor> > sensors;
+  for (unsigned i = 0; i < count; i++) {
+    sensors.push_back(std::unique_ptr<VirtualSensor>(new VirtualSensor(i, options)));
+    if (!sensors.back()->open()) return 1;
+    printf("sensor %u: %s\n", i, sensors.back()->path().c_str());
+    if (linkDir) {
+      char name[256];
+      snprintf(name, sizeof(name), "%s/sensor%02u", linkDir, i);
+      unlink(name);
+      if (symlink(sensors.back()->path().c_str(), name) != 0) perror(name);
+    }
+  }
+  fflush(stdout);
+
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+  for (size_t i = 0; i < sensors.size(); i++) sensors[i]->start();
+
+  uint64_t lastFrames = 0;
+  unsigned elapsedS = 0, lastS = 0;
+  for (;;) {
+    bool running = false;
+    for (size_t i = 0; i < sensors.size(); i++) running |= sensors[i]->running();
+    if (!running || interrupted) break;
+    sleep(1);
+    if (++elapsedS % FLEET_STATS_INTERVAL_S == 0) printFleet(sensors, elapsedS, lastFrames, lastS);
+  }
+  for (size_t i = 0; i < sensors.size(); i++) sensors[i]->stop();
+  for (size_t i = 0; i < sensors.size(); i++) sensors[i]->join();
+  printFleet(sensors, elapsedS, lastFrames, lastS);
+  return 0;
+}
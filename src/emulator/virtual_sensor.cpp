@@ -0,0 +1,206 @@
+#include "virtual_sensor.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <memory>
+
+#include "../host/capture.h"
+#include "../host/host_hal.h"
+#include "../host/replay.h"
+
+#define SERVICE_BUDGET_US 500
+#define IDLE_SLEEP_US 1000
+
+static uint64_t monotonicUs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+class PtyPort : public LinkPort {
+public:
+  explicit PtyPort(VirtualSensor &sensor) : _sensor(sensor) {}
+  size_t write(const uint8_t *data, size_t len) override { return _sensor.write(data, len); }
+  int read() override { return _sensor.read(); }
+  bool txIdle() override { return true; }
+  void setBaud(uint32_t baud) override { (void)baud; }
+  uint32_t millis() override { return monotonicUs() / 1000; }
+
+private:
+  VirtualSensor &_sensor;
+};
+
+// Frames of a synthetic crowd or a capture, on one timeline when looping.
+class TrafficSource {
+public:
+  TrafficSource(const FleetOptions &options, uint16_t id)
+    : _options(options), _scenario(options.scenario), _offsetUs(0), _lastUs(0) {
+    _scenario.seed += id;
+  }
+
+  bool open() {
+    if (_options.capture == NULL) {
+      _crowd.reset(new CrowdGenerator(_scenario));
+      return true;
+    }
+    _reader.reset(new CaptureReader());
+    if (_reader->open(_options.capture)) return true;
+    fprintf(stderr, "%s: %s\n", _options.capture, _reader->error());
+    return false;
+  }
+
+  bool next(CaptureFrame &frame) {
+    for (int attempt = 0; attempt < 2; attempt++) {
+      bool have = _crowd ? _crowd->next(frame) : _reader->next(frame);
+      if (have) {
+        frame.timeUs += _offsetUs;
+        _lastUs = frame.timeUs;
+        return true;
+      }
+      if (!_options.loop || !open()) return false;
+      _offsetUs = _lastUs + 1000;
+      _scenario.seed += 0x10000;
+    }
+    return false;
+  }
+
+private:
+  const FleetOptions &_options;
+  CrowdScenario _scenario;
+  std::unique_ptr<CrowdGenerator> _crowd;
+  std::unique_ptr<CaptureReader> _reader;
+  uint64_t _offsetUs;
+  uint64_t _lastUs;
+};
+
+VirtualSensor::VirtualSensor(uint16_t id, const FleetOptions &options)
+  : _id(id), _options(options), _master(-1), _slave(-1), _pool(VIRTUAL_SENSOR_ARENA / 8),
+    _stop(false), _running(false) {
+  _stats.frames = _stats.lines = _stats.bytesOut = _stats.linesDropped = _stats.framesDropped = 0;
+}
+
+VirtualSensor::~VirtualSensor() {
+  stop();
+  join();
+  if (_slave >= 0) close(_slave);
+  if (_master >= 0) close(_master);
+}
+
+bool VirtualSensor::open() {
+  _master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (_master < 0 || grantpt(_master) != 0 || unlockpt(_master) != 0) {
+    perror("posix_openpt");
+    return false;
+  }
+  _path = ptsname(_master);
+  _slave = ::open(_path.c_str(), O_RDWR | O_NOCTTY);
+  struct termios tio;
+  if (_slave < 0 || tcgetattr(_slave, &tio) != 0) {
+    perror(_path.c_str());
+    return false;
+  }
+  // no echo or line editing: the host sees exactly the sensor's bytes.
+  cfmakeraw(&tio);
+  tcsetattr(_slave, TCSANOW, &tio);
+  return true;
+}
+
+size_t VirtualSensor::write(const uint8_t *data, size_t len) {
+  ssize_t n = ::write(_master, data, len);
+  if (n < 0) n = 0;
+  _stats.bytesOut += n;
+  return n;
+}
+
+void VirtualSensor::writeLine(const char *line) {
+  // as Serial.println(), the terminal is raw.
+  std::string text(line);
+  text += "\r\n";
+  if (write((const uint8_t *)text.data(), text.size()) < text.size()) _stats.linesDropped++;
+}
+
+int VirtualSensor::read() {
+  uint8_t c;
+  return ::read(_master, &c, 1) == 1 ? c : -1;
+}
+
+void VirtualSensor::start() {
+  _running = true;
+  _thread = std::thread(&VirtualSensor::run, this);
+}
+
+void VirtualSensor::join() {
+  if (_thread.joinable()) _thread.join();
+}
+
+static void printLine(void *ctx, uint32_t nowMs, const char *line) {
+  (void)nowMs;
+  ((VirtualSensor *)ctx)->writeLine(line);
+}
+
+static void linkFrame(void *ctx, uint8_t type, const uint8_t *payload, uint16_t length) {
+  ((SnifferCore *)ctx)->handleFrame(type, payload, length);
+}
+
+void VirtualSensor::run() {
+  TrafficSource traffic(_options, _id);
+  Arena arena((uint8_t *)_pool.data(), _pool.size() * 8);
+  HostHal hal(NULL, _options.config.initialChannel);
+  SnifferCore core(hal, _options.config);
+  PtyPort port(*this);
+  SensorLink link(port);
+  Replay replay(core, hal, _options.allChannels);
+  hal.onLine(printLine, this);
+  core.setLink(&link);
+  link.onFrame(linkFrame, &core);
+  if (!traffic.open() || !core.begin(arena) ||
+      !link.begin(arena, 2048, 256, LINK_DEFAULT_BAUD, VIRTUAL_SENSOR_MAX_BAUD)) {
+    fprintf(stderr, "sensor %u: doesn't start\n", _id);
+    _running = false;
+    return;
+  }
+  arena.seal();
+
+  uint64_t startUs = monotonicUs();
+  uint32_t nextStatsMs = VIRTUAL_SENSOR_DIGEST_STATS_MS;
+  CaptureFrame frame;
+  while (!_stop && traffic.next(frame)) {
+    uint64_t dueUs = startUs + (uint64_t)(frame.timeUs / _options.speed);
+    uint32_t frameMs = frame.timeUs / 1000;
+    // loop() work until the frame is due.
+    for (;;) {
+      uint64_t now = monotonicUs();
+      uint32_t virtualMs = (now - startUs) * _options.speed / 1000;
+      replay.advance(virtualMs < frameMs ? virtualMs : frameMs);
+      if (_options.config.thinSensor) {
+        core.drainDigests(SERVICE_BUDGET_US);
+        if ((int32_t)(hal.nowMs - nextStatsMs) >= 0) {
+          core.requestDigestStats();
+          link.send(LINK_STATS, (const uint8_t *)&link.stats(), sizeof(LinkStats));
+          nextStatsMs += VIRTUAL_SENSOR_DIGEST_STATS_MS;
+        }
+      } else if (link.opened()) {
+        core.exportSweepSet();
+      }
+      if (_options.config.thinSensor || link.opened()) core.exportSamples();
+      core.commitWatchlist(SERVICE_BUDGET_US);
+      link.poll(SERVICE_BUDGET_US);
+      if (now >= dueUs || _stop) break;
+      uint64_t wait = dueUs - now;
+      usleep(wait < IDLE_SLEEP_US ? wait : IDLE_SLEEP_US);
+    }
+    replay.feed(frame);
+    _stats.frames++;
+    _stats.lines = hal.lines;
+    _stats.framesDropped = link.stats().txDropped;
+  }
+  // what is still queued goes out, for a moment.
+  for (int i = 0; i < 100 && link.poll(SERVICE_BUDGET_US); i++) usleep(IDLE_SLEEP_US);
+  _running = false;
+}
@@ -0,0 +1,79 @@
+/**
+* One emulated sensor: the real SnifferCore on a HostHal, fed by a synthetic
+* crowd or a capture in (scaled) real time from its own thread, speaking the
+* firmware's output on a pseudo-terminal. Text lines are written as
+* Serial.println() would, SensorLink frames go through the same terminal,
+* and frames from the host (watchlists, rules, baud negotiation) are read
+* back from it. Output nobody reads is dropped once the terminal buffer is
+* full, the sensor never blocks.
+*/
+
+#ifndef VIRTUAL_SENSOR_H
+#define VIRTUAL_SENSOR_H
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include <SnifferCore.h>
+#include "../host/synthetic.h"
+
+#define VIRTUAL_SENSOR_ARENA 65536
+#define VIRTUAL_SENSOR_DIGEST_STATS_MS 5000   // the firmware's DIGEST_STATS_INTERVAL_MS
+#define VIRTUAL_SENSOR_MAX_BAUD 3000000        // the firmware's LINK_MAX_BAUD
+
+struct FleetOptions {
+  SnifferConfig config;
+  bool allChannels;
+  const char *capture;        // NULL --> synthetic crowd
+  CrowdScenario scenario;     // seeded per sensor
+  bool loop;                  // start over at the end of the traffic
+  double speed;               // virtual seconds per wall clock second
+};
+
+struct VirtualSensorStats {
+  std::atomic<uint64_t> frames;
+  std::atomic<uint64_t> lines;
+  std::atomic<uint64_t> bytesOut;
+  std::atomic<uint64_t> linesDropped;     // terminal buffer full
+  std::atomic<uint64_t> framesDropped;    // SensorLink transmit buffer full
+};
+
+class VirtualSensor {
+public:
+  VirtualSensor(uint16_t id, const FleetOptions &options);
+  ~VirtualSensor();
+
+  // Opens the pseudo-terminal, false with a message on stderr.
+  bool open();
+  // The terminal device to point an aggregator at.
+  const std::string &path() const { return _path; }
+
+  void start();
+  void stop() { _stop = true; }
+  void join();
+  bool running() const { return _running; }
+  const VirtualSensorStats &stats() const { return _stats; }
+
+  // Terminal I/O of the sensor thread.
+  size_t write(const uint8_t *data, size_t len);
+  int read();
+  void writeLine(const char *line);
+
+private:
+  void run();
+
+  uint16_t _id;
+  const FleetOptions &_options;
+  int _master;
+  int _slave;                 // kept open so the terminal stays raw and alive
+  std::string _path;
+  std::vector<uint64_t> _pool;
+  std::thread _thread;
+  std::atomic<bool> _stop;
+  std::atomic<bool> _running;
+  VirtualSensorStats _stats;
+};
+
+#endif
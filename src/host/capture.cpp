@@ -0,0 +1,149 @@
+#include "capture.h"
+
+#include <string.h>
+#include <PcapFormat.h>
+
+static uint32_t swap32(uint32_t v) {
+  return (v >> 24) | ((v >> 8) & 0xff00) | ((v << 8) & 0xff0000) | (v << 24);
+}
+
+void captureFrame(CaptureFrame &frame, uint64_t timeUs, const uint8_t *data, uint32_t len,
+                  uint8_t channel, int8_t rssi) {
+  memset(&frame, 0, sizeof(frame));
+  frame.timeUs = timeUs;
+  frame.channel = channel;
+  RxControl &rx = frame.packet.rx_ctrl;
+  rx.rssi = rssi;
+  rx.sig_mode = 1;
+  rx.legacy_length = len & 0xfff;
+  rx.channel = channel & 0x0f;
+  memcpy(frame.packet.data, data, len < DATA_LENGTH ? len : DATA_LENGTH);
+  frame.packet.cnt = 1;
+  frame.packet.len = len;
+}
+
+CaptureReader::CaptureReader()
+  : _file(NULL), _error(NULL), _swapped(false), _nanoseconds(false), _linkType(0),
+    _haveStart(false), _startUs(0), _records(0), _skipped(0) {
+}
+
+CaptureReader::~CaptureReader() {
+  if (_file) fclose(_file);
+}
+
+bool CaptureReader::open(const char *path) {
+  _file = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+  if (_file == NULL) {
+    _error = "can't open";
+    return false;
+  }
+  PcapFileHeader header;
+  if (fread(&header, sizeof(header), 1, _file) != 1) {
+    _error = "short file header";
+    return false;
+  }
+  uint32_t magic = header.magic;
+  _swapped = magic == swap32(PCAP_MAGIC) || magic == swap32(PCAP_MAGIC_NANOSECONDS);
+  if (_swapped) magic = swap32(magic);
+  if (magic != PCAP_MAGIC && magic != PCAP_MAGIC_NANOSECONDS) {
+    _error = "not a pcap file";
+    return false;
+  }
+  _nanoseconds = magic == PCAP_MAGIC_NANOSECONDS;
+  _linkType = _swapped ? swap32(header.linkType) : header.linkType;
+  if (_linkType != LINKTYPE_IEEE802_11 && _linkType != LINKTYPE_IEEE802_11_RADIOTAP) {
+    _error = "link type is not 802.11";
+    return false;
+  }
+  return true;
+}
+
+bool CaptureReader::next(CaptureFrame &frame) {
+  for (;;) {
+    PcapRecordHeader rec;
+    if (fread(&rec, sizeof(rec), 1, _file) != 1) return false;
+    if (_swapped) {
+      rec.tsSec = swap32(rec.tsSec);
+      rec.tsUsec = swap32(rec.tsUsec);
+      rec.inclLen = swap32(rec.inclLen);
+      rec.origLen = swap32(rec.origLen);
+    }
+    if (rec.inclLen > sizeof(_buf)) {
+      _error = "record longer than 64 kB";
+      return false;
+    }
+    if (fread(_buf, 1, rec.inclLen, _file) != rec.inclLen) {
+      _error = "truncated record";
+      return false;
+    }
+    _records++;
+
+    uint64_t timeUs = (uint64_t)rec.tsSec * 1000000 + (_nanoseconds ? rec.tsUsec / 1000 : rec.tsUsec);
+    if (!_haveStart) {
+      _haveStart = true;
+      _startUs = timeUs;
+    }
+
+    const uint8_t *data = _buf;
+    uint32_t len = rec.inclLen;
+    uint32_t origLen = rec.origLen;
+    uint8_t channel = 0;
+    int8_t rssi = 0;
+    if (_linkType == LINKTYPE_IEEE802_11_RADIOTAP) {
+      RadiotapInfo info;
+      // a header longer than the frame on air: the record is corrupt.
+      if (!radiotapParse(data, len, info) || origLen < info.length) {
+        _skipped++;
+        continue;
+      }
+      data += info.length;
+      len -= info.length;
+      origLen -= info.length;
+      if (info.hasFcs && len == origLen && len >= 4) len -= 4;
+      if (info.hasFcs && origLen >= 4) origLen -= 4;
+      if (info.hasChannel) channel = info.channel;
+      if (info.hasSignal) rssi = info.signal;
+    }
+    captureFrame(frame, timeUs < _startUs ? 0 : timeUs - _startUs, data, len, channel, rssi);
+    frame.packet.len = origLen;
+    return true;
+  }
+}
+
+CaptureWriter::CaptureWriter() : _file(NULL), _snapLen(0) {
+}
+
+CaptureWriter::~CaptureWriter() {
+  close();
+}
+
+bool CaptureWriter::open(const char *path, uint32_t snapLen) {
+  _file = strcmp(path, "-") == 0 ? stdout : fopen(path, "wb");
+  if (_file == NULL) return false;
+  _snapLen = snapLen;
+  PcapFileHeader header;
+  pcapFileHeader(header, snapLen + RADIOTAP_SENSOR_LENGTH, LINKTYPE_IEEE802_11_RADIOTAP);
+  return fwrite(&header, sizeof(header), 1, _file) == 1;
+}
+
+bool CaptureWriter::write(uint64_t timeUs, const uint8_t *data, uint32_t len, uint32_t origLen,
+                          uint8_t channel, int8_t rssi) {
+  if (len > _snapLen) len = _snapLen;
+  uint8_t radiotap[RADIOTAP_SENSOR_LENGTH];
+  uint16_t rtLength = radiotapBuild(radiotap, channel, rssi);
+  PcapRecordHeader rec;
+  rec.tsSec = timeUs / 1000000;
+  rec.tsUsec = timeUs % 1000000;
+  rec.inclLen = rtLength + len;
+  rec.origLen = rtLength + origLen;
+  return fwrite(&rec, sizeof(rec), 1, _file) == 1 &&
+         fwrite(radiotap, 1, rtLength, _file) == rtLength &&
+         fwrite(data, 1, len, _file) == len;
+}
+
+bool CaptureWriter::close() {
+  if (_file == NULL) return true;
+  bool ok = _file == stdout ? fflush(_file) == 0 : fclose(_file) == 0;
+  _file = NULL;
+  return ok;
+}
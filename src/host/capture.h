@@ -0,0 +1,66 @@
+/**
+* pcap captures as seen by the sensor: records become SnifferPackets with
+* the channel and RSSI from the radiotap header. Plain 802.11 captures
+* (no radiotap) are read with channel 0 and RSSI 0.
+*/
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <SnifferCore.h>
+
+struct CaptureFrame {
+  uint64_t timeUs;          // from the start of the capture
+  uint8_t channel;          // 0 when the capture doesn't say
+  SnifferPacket packet;
+};
+
+// Fills a SnifferPacket the way the SDK does from an 802.11 frame.
+void captureFrame(CaptureFrame &frame, uint64_t timeUs, const uint8_t *data, uint32_t len,
+                  uint8_t channel, int8_t rssi);
+
+class CaptureReader {
+public:
+  CaptureReader();
+  ~CaptureReader();
+
+  bool open(const char *path);
+  // False at the end of the file or on a damaged record, see error().
+  bool next(CaptureFrame &frame);
+  const char *error() const { return _error; }
+  uint32_t linkType() const { return _linkType; }
+  uint32_t records() const { return _records; }
+  uint32_t skipped() const { return _skipped; }
+
+private:
+  FILE *_file;
+  const char *_error;
+  bool _swapped;
+  bool _nanoseconds;
+  uint32_t _linkType;
+  bool _haveStart;
+  uint64_t _startUs;
+  uint32_t _records;
+  uint32_t _skipped;
+  uint8_t _buf[65536];
+};
+
+class CaptureWriter {
+public:
+  CaptureWriter();
+  ~CaptureWriter();
+
+  // Radiotap 802.11 capture, snapLen bytes of each frame at most.
+  bool open(const char *path, uint32_t snapLen);
+  bool write(uint64_t timeUs, const uint8_t *data, uint32_t len, uint32_t origLen,
+             uint8_t channel, int8_t rssi);
+  bool close();
+
+private:
+  FILE *_file;
+  uint32_t _snapLen;
+};
+
+#endif
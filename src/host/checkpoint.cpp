@@ -0,0 +1,192 @@
+#include "checkpoint.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define CHECKPOINT_MAGIC      "FCCCKPT1"
+#define CHECKPOINT_SLOTS_AT   4096          // slots start page aligned
+#define CHECKPOINT_MIN_SLOT   65536
+
+struct CheckpointSlot {
+  uint64_t generation;        // 0: never written
+  uint64_t length;
+  uint64_t hash;              // of the slot's first length bytes
+};
+
+struct CheckpointHeader {
+  char magic[8];
+  uint64_t slotBytes;         // a multiple of CHECKPOINT_SLOTS_AT
+  CheckpointSlot slots[2];
+};
+
+// FNV-1a, enough to tell a torn slot from a whole one.
+static uint64_t stateHash(const uint8_t *data, size_t length) {
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < length; i++) h = (h ^ data[i]) * 0x100000001b3ULL;
+  return h;
+}
+
+// msync wants whole pages.
+static bool syncRange(uint8_t *base, size_t offset, size_t length) {
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t start = offset / page * page;
+  return msync(base + start, offset + length - start, MS_SYNC) == 0;
+}
+
+Checkpoint::Checkpoint() : _fd(-1), _base(NULL), _length(0), _header(NULL), _error(NULL) {
+}
+
+Checkpoint::~Checkpoint() {
+  close();
+}
+
+uint8_t *Checkpoint::slot(int i) const {
+  return _base + CHECKPOINT_SLOTS_AT + i * _header->slotBytes;
+}
+
+bool Checkpoint::map(int fd) {
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < CHECKPOINT_SLOTS_AT) {
+    _error = "not a checkpoint";
+    return false;
+  }
+  void *base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (base == MAP_FAILED) {
+    _error = "can't map the checkpoint";
+    return false;
+  }
+  const CheckpointHeader *header = (const CheckpointHeader *)base;
+  if (memcmp(header->magic, CHECKPOINT_MAGIC, 8) != 0 || header->slotBytes % CHECKPOINT_SLOTS_AT ||
+      (size_t)st.st_size != CHECKPOINT_SLOTS_AT + 2 * header->slotBytes) {
+    munmap(base, st.st_size);
+    _error = "not a checkpoint";
+    return false;
+  }
+  _fd = fd;
+  _base = (uint8_t *)base;
+  _length = st.st_size;
+  _header = (CheckpointHeader *)base;
+  return true;
+}
+
+void Checkpoint::unmap() {
+  if (_base) munmap(_base, _length);
+  if (_fd >= 0) ::close(_fd);
+  _base = NULL;
+  _header = NULL;
+  _fd = -1;
+}
+
+void Checkpoint::close() {
+  unmap();
+}
+
+bool Checkpoint::create(const std::string &path, size_t slotBytes) {
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    _error = "can't create the checkpoint";
+    return false;
+  }
+  CheckpointHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, CHECKPOINT_MAGIC, 8);
+  header.slotBytes = slotBytes;
+  if (write(fd, &header, sizeof(header)) != sizeof(header) ||
+      ftruncate(fd, CHECKPOINT_SLOTS_AT + 2 * slotBytes) != 0) {
+    ::close(fd);
+    _error = "can't write the checkpoint";
+    return false;
+  }
+  if (!map(fd)) {
+    ::close(fd);
+    return false;
+  }
+  return true;
+}
+
+bool Checkpoint::open(const char *path) {
+  _path = path;
+  int fd = ::open(path, O_RDWR);
+  if (fd < 0) return create(_path, CHECKPOINT_MIN_SLOT);
+  if (!map(fd)) {
+    ::close(fd);
+    return false;
+  }
+  return true;
+}
+
+// The whole slot with the highest generation, -1 if none.
+int Checkpoint::latest() const {
+  int best = -1;
+  for (int i = 0; i < 2; i++) {
+    const CheckpointSlot &s = _header->slots[i];
+    if (s.generation == 0 || s.length > _header->slotBytes || stateHash(slot(i), s.length) != s.hash) continue;
+    if (best < 0 || s.generation > _header->slots[best].generation) best = i;
+  }
+  return best;
+}
+
+uint64_t Checkpoint::generation() const {
+  if (_header == NULL) return 0;
+  int i = latest();
+  return i < 0 ? 0 : _header->slots[i].generation;
+}
+
+bool Checkpoint::load(std::vector<uint8_t> &state) const {
+  if (_header == NULL) return false;
+  int i = latest();
+  if (i < 0) return false;
+  state.assign(slot(i), slot(i) + _header->slots[i].length);
+  return true;
+}
+
+bool Checkpoint::save(const std::vector<uint8_t> &state) {
+  if (_header == NULL) return false;
+  int latest = this->latest();
+  uint64_t generation = latest < 0 ? 1 : _header->slots[latest].generation + 1;
+  if (state.size() > _header->slotBytes) {
+    size_t slotBytes = _header->slotBytes;
+    while (slotBytes < state.size()) slotBytes *= 2;
+    Checkpoint next;
+    std::string tmp = _path + ".tmp";
+    if (!next.create(tmp, slotBytes)) {
+      _error = next._error;
+      return false;
+    }
+    next._path = _path;
+    memcpy(next.slot(0), state.data(), state.size());
+    CheckpointSlot s = { generation, state.size(), stateHash(state.data(), state.size()) };
+    next._header->slots[0] = s;
+    if (msync(next._base, next._length, MS_SYNC) != 0 || rename(tmp.c_str(), _path.c_str()) != 0) {
+      _error = "can't replace the checkpoint";
+      return false;
+    }
+    unmap();
+    _fd = next._fd;
+    _base = next._base;
+    _length = next._length;
+    _header = next._header;
+    next._fd = -1;
+    next._base = NULL;
+    return true;
+  }
+
+  // the older slot, or one that never held a whole snapshot.
+  int i = latest < 0 ? 0 : 1 - latest;
+  memcpy(slot(i), state.data(), state.size());
+  if (!syncRange(_base, slot(i) - _base, state.size())) {
+    _error = "can't write the checkpoint";
+    return false;
+  }
+  CheckpointSlot s = { generation, state.size(), stateHash(state.data(), state.size()) };
+  _header->slots[i] = s;
+  if (!syncRange(_base, 0, sizeof(CheckpointHeader))) {
+    _error = "can't write the checkpoint";
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,108 @@
+/**
+* Crash-consistent state snapshots in a memory-mapped file, so a restarted
+* host tool picks up where it stopped instead of rebuilding from the
+* sensors' history.
+* The file holds two slots. A save writes the slot not holding the latest
+* snapshot, flushes it, and only then publishes it in the header with a
+* higher generation and a hash of its contents; a crash at any point
+* leaves the previous snapshot whole, and a torn slot fails its hash.
+* A snapshot outgrowing the slots is saved into a new file with doubled
+* slots, renamed over the old one.
+* StateWriter / StateReader build and parse the snapshot, native byte
+* order: the file stays on the host that wrote it.
+*/
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class Checkpoint {
+public:
+  Checkpoint();
+  ~Checkpoint();
+
+  // Opens the file, creating it empty if missing.
+  bool open(const char *path);
+  void close();
+  const char *error() const { return _error; }
+
+  // The latest whole snapshot, false if there is none.
+  bool load(std::vector<uint8_t> &state) const;
+  bool save(const std::vector<uint8_t> &state);
+
+  uint64_t generation() const;
+
+private:
+  bool map(int fd);
+  void unmap();
+  bool create(const std::string &path, size_t slotBytes);
+  int latest() const;
+  uint8_t *slot(int i) const;
+
+  std::string _path;
+  int _fd;
+  uint8_t *_base;
+  size_t _length;
+  struct CheckpointHeader *_header;
+  const char *_error;
+};
+
+class StateWriter {
+public:
+  explicit StateWriter(std::vector<uint8_t> &out) : _out(out) {}
+  void u8(uint8_t v) { put(&v, 1); }
+  void u32(uint32_t v) { put(&v, 4); }
+  void u64(uint64_t v) { put(&v, 8); }
+  // Length prefixed.
+  void bytes(const uint8_t *data, size_t length) { u64(length); put(data, length); }
+  void put(const void *data, size_t length) {
+    _out.insert(_out.end(), (const uint8_t *)data, (const uint8_t *)data + length);
+  }
+
+private:
+  std::vector<uint8_t> &_out;
+};
+
+// Reads past the end fail and keep failing; check ok() once at the end.
+class StateReader {
+public:
+  StateReader(const uint8_t *data, size_t length) : _data(data), _length(length), _pos(0), _ok(true) {}
+  uint8_t u8() { uint8_t v = 0; get(&v, 1); return v; }
+  uint32_t u32() { uint32_t v = 0; get(&v, 4); return v; }
+  uint64_t u64() { uint64_t v = 0; get(&v, 8); return v; }
+  // A length prefixed run, NULL if it doesn't fit.
+  const uint8_t *bytes(size_t &length) {
+    uint64_t n = u64();
+    if (!_ok || n > _length - _pos) {
+      _ok = false;
+      length = 0;
+      return NULL;
+    }
+    length = n;
+    _pos += n;
+    return _data + _pos - n;
+  }
+  bool ok() const { return _ok; }
+  bool done() const { return _ok && _pos == _length; }
+
+private:
+  void get(void *v, size_t n) {
+    if (!_ok || n > _length - _pos) {
+      _ok = false;
+      return;
+    }
+    for (size_t i = 0; i < n; i++) ((uint8_t *)v)[i] = _data[_pos + i];
+    _pos += n;
+  }
+
+  const uint8_t *_data;
+  size_t _length;
+  size_t _pos;
+  bool _ok;
+};
+
+#endif
@@ -0,0 +1,61 @@
+#include "clock_sync.h"
+
+// Samples within this much of the fastest round trip go into the fit; the
+// sensor's millis() resolution alone makes a millisecond.
+#define CLOCK_SYNC_RTT_SLACK_US 2000
+
+ClockSync::ClockSync() : _minRttUs(0), _slope(1000), _sensorMean(0), _hostMean(0) {
+}
+
+int64_t ClockSync::unwrap(uint32_t sensorMs) const {
+  if (_samples.empty()) return sensorMs;
+  int64_t last = _samples.back().sensorMs;
+  return last + (int32_t)(sensorMs - (uint32_t)last);
+}
+
+void ClockSync::addSample(uint64_t sentUs, uint64_t receivedUs, uint32_t sensorMs) {
+  Sample s;
+  s.rttUs = receivedUs - sentUs;
+  s.hostUs = sentUs + s.rttUs / 2;
+  s.sensorMs = unwrap(sensorMs);
+  _samples.push_back(s);
+  if (_samples.size() > CLOCK_SYNC_SAMPLES) _samples.pop_front();
+  _minRttUs = _samples.front().rttUs;
+  for (size_t i = 1; i < _samples.size(); i++) {
+    if (_samples[i].rttUs < _minRttUs) _minRttUs = _samples[i].rttUs;
+  }
+  fit();
+}
+
+void ClockSync::fit() {
+  // centered sums keep the doubles exact enough over months of microseconds.
+  const Sample &ref = _samples.back();
+  double n = 0, sx = 0, sy = 0;
+  for (size_t i = 0; i < _samples.size(); i++) {
+    const Sample &s = _samples[i];
+    if (s.rttUs > _minRttUs + CLOCK_SYNC_RTT_SLACK_US) continue;
+    // millis() truncates: the true time is half a millisecond later on average.
+    sx += (s.sensorMs - ref.sensorMs) + 0.5;
+    sy += (double)(int64_t)(s.hostUs - ref.hostUs);
+    n++;
+  }
+  double mx = sx / n, my = sy / n;
+  double sxx = 0, sxy = 0;
+  for (size_t i = 0; i < _samples.size(); i++) {
+    const Sample &s = _samples[i];
+    if (s.rttUs > _minRttUs + CLOCK_SYNC_RTT_SLACK_US) continue;
+    double dx = (s.sensorMs - ref.sensorMs) + 0.5 - mx;
+    double dy = (double)(int64_t)(s.hostUs - ref.hostUs) - my;
+    sxx += dx * dx;
+    sxy += dx * dy;
+  }
+  // drift needs a few seconds of baseline, until then the clocks run alike.
+  _slope = sxx > 1e6 ? sxy / sxx : 1000;
+  _sensorMean = ref.sensorMs + mx;
+  _hostMean = ref.hostUs + my;
+}
+
+uint64_t ClockSync::toHostUs(uint32_t sensorMs) const {
+  double x = unwrap(sensorMs) + 0.5 - _sensorMean;
+  return (uint64_t)(_hostMean + x * _slope);
+}
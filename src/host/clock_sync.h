@@ -0,0 +1,54 @@
+/**
+* A sensor's millis() on the host clock, from FRAME_TIME_SYNC round trips.
+* Each round trip gives the sensor time at the host midpoint of the request,
+* off by at most half the round trip. The model is a least squares line
+* through the recent samples whose round trip is close to the fastest
+* seen, so queueing delays don't pull it; its slope is the crystal drift.
+* millis() wraps every 49.7 days, sensor times are unwrapped around the
+* latest sample.
+*/
+
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <deque>
+
+#define CLOCK_SYNC_SAMPLES 64
+
+class ClockSync {
+public:
+  ClockSync();
+
+  // A request sent at sentUs and answered at receivedUs (host clock),
+  // sensorMs the sensor's millis() in between.
+  void addSample(uint64_t sentUs, uint64_t receivedUs, uint32_t sensorMs);
+
+  bool ready() const { return !_samples.empty(); }
+  // Host time of a sensor millis() value.
+  uint64_t toHostUs(uint32_t sensorMs) const;
+
+  size_t samples() const { return _samples.size(); }
+  uint32_t minRttUs() const { return _minRttUs; }
+  // Sensor clock rate error, parts per million, + when it runs fast.
+  double driftPpm() const { return (1000.0 / _slope - 1) * 1e6; }
+
+private:
+  struct Sample {
+    uint64_t hostUs;        // midpoint of the round trip
+    int64_t sensorMs;       // unwrapped
+    uint32_t rttUs;
+  };
+
+  int64_t unwrap(uint32_t sensorMs) const;
+  void fit();
+
+  std::deque<Sample> _samples;
+  uint32_t _minRttUs;
+  double _slope;            // host us per sensor ms
+  double _sensorMean;
+  double _hostMean;
+};
+
+#endif
@@ -0,0 +1,75 @@
+#include "corpus.h"
+
+#include <stdio.h>
+#include <time.h>
+#include <unordered_set>
+
+#include <SnifferCore.h>
+
+bool loadCorpusCapture(const char *path, CorpusEntry &entry) {
+  CaptureReader reader;
+  if (!reader.open(path)) {
+    fprintf(stderr, "%s: %s\n", path, reader.error());
+    return false;
+  }
+  entry.name = path;
+  CaptureFrame frame;
+  while (reader.next(frame)) {
+    const uint8_t *d = frame.packet.data;
+    bool probe = (d[0] & 0x0c) == 0 && (d[0] >> 4) == SUBTYPE_PROBE_REQUEST;
+    uint64_t mac = 0;
+    for (int i = 0; i < 6; i++) mac = (mac << 8) | d[10 + i];
+    entry.frames.push_back(frame);
+    entry.devices.push_back(probe ? mac : CORPUS_NO_DEVICE);
+  }
+  if (reader.error()) fprintf(stderr, "%s: %s after %u records\n", path, reader.error(), reader.records());
+  entry.endMs = entry.frames.empty() ? 0 : entry.frames.back().timeUs / 1000;
+  return true;
+}
+
+void generateCorpusCrowd(const CrowdScenario &scenario, const char *name, CorpusEntry &entry) {
+  entry.name = name;
+  CrowdGenerator crowd(scenario);
+  CaptureFrame frame;
+  while (crowd.next(frame)) {
+    entry.frames.push_back(frame);
+    entry.devices.push_back(crowd.device() < 0 ? CORPUS_NO_DEVICE : (uint64_t)crowd.device());
+  }
+  entry.endMs = scenario.durationS * 1000;
+}
+
+std::vector<uint32_t> devicesPerPeriod(const CorpusEntry &entry, uint32_t periodMs) {
+  std::vector<uint32_t> counts;
+  std::unordered_set<uint64_t> seen;
+  uint64_t periodEnd = periodMs;
+  for (size_t i = 0; i < entry.frames.size(); i++) {
+    uint64_t ms = entry.frames[i].timeUs / 1000;
+    while (ms >= periodEnd) {
+      counts.push_back(seen.size());
+      seen.clear();
+      periodEnd += periodMs;
+    }
+    if (entry.devices[i] != CORPUS_NO_DEVICE) seen.insert(entry.devices[i]);
+  }
+  if (periodEnd <= entry.endMs) counts.push_back(seen.size());
+  return counts;
+}
+
+bool parseTotalClients(const char *line, uint32_t &count) {
+  int n;
+  if (sscanf(line, "Total clients:%d", &n) != 1) return false;
+  count = n;
+  return true;
+}
+
+void collectTotalClients(void *ctx, uint32_t nowMs, const char *line) {
+  (void)nowMs;
+  uint32_t count;
+  if (parseTotalClients(line, count)) ((std::vector<uint32_t> *)ctx)->push_back(count);
+}
+
+double threadCpuS() {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,44 @@
+/**
+* Evaluation corpus of the host tools (accuracy, whatif): a capture or
+* synthetic crowd held in memory with the device behind each probe
+* request, the true device count per period, and the sensor side of a run:
+* its "Total clients" lines and the thread's CPU time.
+*/
+
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "capture.h"
+#include "synthetic.h"
+
+#define CORPUS_NO_DEVICE UINT64_MAX
+
+struct CorpusEntry {
+  std::string name;
+  std::vector<CaptureFrame> frames;
+  std::vector<uint64_t> devices;      // per frame, CORPUS_NO_DEVICE when not a probe request
+  uint32_t endMs;
+};
+
+// A capture, each probe request's device its source MAC (a randomizing
+// phone counts once per MAC). False with a message on stderr if it can't be read.
+bool loadCorpusCapture(const char *path, CorpusEntry &entry);
+// A synthetic crowd, the generator's own devices.
+void generateCorpusCrowd(const CrowdScenario &scenario, const char *name, CorpusEntry &entry);
+
+// Devices sending probe requests in each period of periodMs, whole periods only.
+std::vector<uint32_t> devicesPerPeriod(const CorpusEntry &entry, uint32_t periodMs);
+
+// The count of a "Total clients:" line of the sniffer core.
+bool parseTotalClients(const char *line, uint32_t &count);
+// HostLineFn collecting the counts into a std::vector<uint32_t> ctx.
+void collectTotalClients(void *ctx, uint32_t nowMs, const char *line);
+
+// CPU time of the calling thread, seconds.
+double threadCpuS();
+
+#endif
@@ -0,0 +1,126 @@
+#include "event_windows.h"
+
+#include "checkpoint.h"
+
+EventWindows::EventWindows(uint32_t windowMs, uint32_t latenessMs, uint32_t idleMs, size_t sensors)
+  : _windowMs(windowMs), _latenessMs(latenessMs), _idleMs(idleMs), _sources(sensors),
+    _closedUpToMs(0), _late(0) {
+  for (size_t i = 0; i < sensors; i++) {
+    _sources[i].maxEventMs = 0;
+    _sources[i].lastRecordMs = 0;
+    _sources[i].seen = false;
+  }
+}
+
+bool EventWindows::add(size_t sensor, uint64_t eventMs, const uint8_t *mac, uint64_t nowMs) {
+  Source &s = _sources[sensor];
+  if (!s.seen || eventMs > s.maxEventMs) s.maxEventMs = eventMs;
+  s.lastRecordMs = nowMs;
+  s.seen = true;
+
+  uint64_t start = eventMs - eventMs % _windowMs;
+  if (start < _closedUpToMs) {
+    _late++;
+    return false;
+  }
+  uint64_t key = 0;
+  for (int i = 0; i < 6; i++) key = (key << 8) | mac[i];
+  Window &w = _windows[start];
+  if (w.perSensor.empty()) {
+    w.perSensor.resize(_sources.size());
+    w.records = 0;
+  }
+  w.merged.insert(key);
+  w.perSensor[sensor].insert(key);
+  w.records++;
+  return true;
+}
+
+uint64_t EventWindows::watermark(uint64_t nowMs) const {
+  uint64_t mark = UINT64_MAX;
+  for (size_t i = 0; i < _sources.size(); i++) {
+    const Source &s = _sources[i];
+    if (!s.seen || nowMs - s.lastRecordMs >= _idleMs) continue;
+    if (s.maxEventMs < mark) mark = s.maxEventMs;
+  }
+  // every sensor idle: nothing newer than the idle time is coming.
+  if (mark == UINT64_MAX) mark = nowMs > _idleMs ? nowMs - _idleMs : 0;
+  return mark > _latenessMs ? mark - _latenessMs : 0;
+}
+
+void EventWindows::close(std::map<uint64_t, Window>::iterator it, WindowSummary &summary) {
+  summary.startMs = it->first;
+  summary.lengthMs = _windowMs;
+  summary.devices = it->second.merged.size();
+  summary.records = it->second.records;
+  summary.perSensor.resize(_sources.size());
+  for (size_t i = 0; i < _sources.size(); i++) summary.perSensor[i] = it->second.perSensor[i].size();
+  if (it->first + _windowMs > _closedUpToMs) _closedUpToMs = it->first + _windowMs;
+  _windows.erase(it);
+}
+
+bool EventWindows::next(WindowSummary &summary, uint64_t nowMs) {
+  if (_windows.empty()) return false;
+  std::map<uint64_t, Window>::iterator it = _windows.begin();
+  if (it->first + _windowMs > watermark(nowMs)) return false;
+  close(it, summary);
+  return true;
+}
+
+bool EventWindows::flush(WindowSummary &summary) {
+  if (_windows.empty()) return false;
+  close(_windows.begin(), summary);
+  return true;
+}
+
+static void saveSet(StateWriter &out, const std::unordered_set<uint64_t> &set) {
+  out.u64(set.size());
+  for (std::unordered_set<uint64_t>::const_iterator it = set.begin(); it != set.end(); ++it) out.u64(*it);
+}
+
+static bool restoreSet(StateReader &in, std::unordered_set<uint64_t> &set) {
+  uint64_t n = in.u64();
+  set.clear();
+  for (uint64_t i = 0; i < n && in.ok(); i++) set.insert(in.u64());
+  return in.ok();
+}
+
+void EventWindows::save(StateWriter &out) const {
+  out.u32(_windowMs);
+  out.u32(_sources.size());
+  for (size_t i = 0; i < _sources.size(); i++) {
+    out.u64(_sources[i].maxEventMs);
+    out.u64(_sources[i].lastRecordMs);
+    out.u8(_sources[i].seen);
+  }
+  out.u64(_closedUpToMs);
+  out.u64(_late);
+  out.u64(_windows.size());
+  for (std::map<uint64_t, Window>::const_iterator it = _windows.begin(); it != _windows.end(); ++it) {
+    out.u64(it->first);
+    out.u64(it->second.records);
+    saveSet(out, it->second.merged);
+    for (size_t i = 0; i < _sources.size(); i++) saveSet(out, it->second.perSensor[i]);
+  }
+}
+
+bool EventWindows::restore(StateReader &in) {
+  if (in.u32() != _windowMs || in.u32() != _sources.size()) return false;
+  for (size_t i = 0; i < _sources.size(); i++) {
+    _sources[i].maxEventMs = in.u64();
+    _sources[i].lastRecordMs = in.u64();
+    _sources[i].seen = in.u8() != 0;
+  }
+  _closedUpToMs = in.u64();
+  _late = in.u64();
+  uint64_t windows = in.u64();
+  _windows.clear();
+  for (uint64_t n = 0; n < windows && in.ok(); n++) {
+    Window &w = _windows[in.u64()];
+    w.records = in.u64();
+    w.perSensor.resize(_sources.size());
+    restoreSet(in, w.merged);
+    for (size_t i = 0; i < _sources.size(); i++) restoreSet(in, w.perSensor[i]);
+  }
+  return in.ok();
+}
@@ -0,0 +1,74 @@
+/**
+* Event time windows over several sensors: records are placed by their
+* time on the common (host) clock, not by when they arrive, and counted as
+* distinct devices per tumbling window, per sensor and merged.
+* A window closes when the watermark passes its end: the lowest of the
+* sensors' latest record times, less the allowed lateness. A batch that
+* arrives late but within the lateness still lands in its own window;
+* records of already closed windows are counted as late and dropped.
+* Sensors without records for idleMs (host clock) don't hold the watermark
+* back, so a quiet or unplugged sensor doesn't stall the others.
+*/
+
+#ifndef EVENT_WINDOWS_H
+#define EVENT_WINDOWS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
+#include <unordered_set>
+#include <vector>
+
+class StateReader;
+class StateWriter;
+
+struct WindowSummary {
+  uint64_t startMs;
+  uint32_t lengthMs;
+  uint32_t devices;                 // distinct over all sensors
+  std::vector<uint32_t> perSensor;  // distinct per sensor
+  uint64_t records;
+};
+
+class EventWindows {
+public:
+  EventWindows(uint32_t windowMs, uint32_t latenessMs, uint32_t idleMs, size_t sensors);
+
+  // A device seen at eventMs; nowMs is the host clock. False if it was too late.
+  bool add(size_t sensor, uint64_t eventMs, const uint8_t *mac, uint64_t nowMs);
+  // The oldest window the watermark has passed, false if none.
+  bool next(WindowSummary &summary, uint64_t nowMs);
+  // At the end: closes every window.
+  bool flush(WindowSummary &summary);
+
+  uint64_t watermark(uint64_t nowMs) const;
+  // The open windows and the sensors' progress, for a checkpoint. Restoring
+  // fails on a snapshot of other windows or another sensor count.
+  void save(StateWriter &out) const;
+  bool restore(StateReader &in);
+  uint64_t late() const { return _late; }
+
+private:
+  struct Window {
+    std::unordered_set<uint64_t> merged;
+    std::vector<std::unordered_set<uint64_t> > perSensor;
+    uint64_t records;
+  };
+  struct Source {
+    uint64_t maxEventMs;
+    uint64_t lastRecordMs;          // host clock
+    bool seen;
+  };
+
+  void close(std::map<uint64_t, Window>::iterator it, WindowSummary &summary);
+
+  uint32_t _windowMs;
+  uint32_t _latenessMs;
+  uint32_t _idleMs;
+  std::vector<Source> _sources;
+  std::map<uint64_t, Window> _windows;
+  uint64_t _closedUpToMs;           // windows starting below this are closed
+  uint64_t _late;
+};
+
+#endif
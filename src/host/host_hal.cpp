@@ -0,0 +1,12 @@
+#include "host_hal.h"
+
+HostHal::HostHal(FILE *out, uint8_t channel)
+  : nowMs(0), channel(channel), lines(0), channelSwitches(0), spiWrites(0),
+    _out(out), _lineFn(NULL), _lineCtx(NULL) {
+}
+
+void HostHal::println(const char *line) {
+  lines++;
+  if (_out) fprintf(_out, "%u.%03u %s\n", (unsigned)(nowMs / 1000), (unsigned)(nowMs % 1000), line);
+  if (_lineFn) _lineFn(_lineCtx, nowMs, line);
+}
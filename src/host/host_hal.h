@@ -0,0 +1,40 @@
+/**
+* SnifferHal for host programs: a virtual clock and channel, output lines go
+* to a FILE (or nowhere) and can be watched through a callback.
+*/
+
+#ifndef HOST_HAL_H
+#define HOST_HAL_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <SnifferHal.h>
+
+typedef void (*HostLineFn)(void *ctx, uint32_t nowMs, const char *line);
+
+class HostHal : public SnifferHal {
+public:
+  // out NULL discards the lines.
+  HostHal(FILE *out, uint8_t channel);
+
+  void println(const char *line) override;
+  uint8_t getChannel() override { return channel; }
+  void setChannel(uint8_t ch) override { channel = ch; channelSwitches++; }
+  void spiSetData(const char *data) override { (void)data; spiWrites++; }
+  uint32_t millis() override { return nowMs; }
+
+  void onLine(HostLineFn fn, void *ctx) { _lineFn = fn; _lineCtx = ctx; }
+
+  uint32_t nowMs;
+  uint8_t channel;
+  uint32_t lines;
+  uint32_t channelSwitches;
+  uint32_t spiWrites;
+
+private:
+  FILE *_out;
+  HostLineFn _lineFn;
+  void *_lineCtx;
+};
+
+#endif
@@ -0,0 +1,162 @@
+#include "id_set.h"
+
+#include <algorithm>
+#include <SweepSet.h>
+
+IdSet::IdSet() : _last(0), _size(0) {
+}
+
+void IdSet::clear() {
+  _data.clear();
+  _offsets.clear();
+  _bases.clear();
+  _last = 0;
+  _size = 0;
+}
+
+bool IdSet::addBlock(const uint8_t *block, size_t length) {
+  EfReader reader;
+  if (!reader.begin(block, length) || reader.blockLength() != length) return false;
+  if (reader.count() == 0) return true;
+  // the IDs must go on rising from the last one in the set, blocks may not overlap.
+  uint64_t first = reader.base();
+  uint64_t id, last = 0;
+  for (uint16_t i = 0; reader.next(id); i++) {
+    if ((i == 0 && !_bases.empty() && id <= _last) || (i > 0 && id <= last)) return false;
+    last = id;
+  }
+  _offsets.push_back(_data.size());
+  _bases.push_back(first);
+  _last = last;
+  _data.insert(_data.end(), block, block + reader.blockLength());
+  _size += reader.count();
+  return true;
+}
+
+bool IdSet::assign(const uint8_t *data, size_t length) {
+  clear();
+  EfReader reader;
+  for (size_t off = 0; off < length; off += reader.blockLength()) {
+    if (!reader.begin(data + off, length - off) || !addBlock(data + off, reader.blockLength())) {
+      clear();
+      return false;
+    }
+  }
+  return true;
+}
+
+void IdSet::encode(const std::vector<uint64_t> &ids) {
+  clear();
+  uint8_t block[EF_HEADER_LENGTH + SWEEP_SET_BLOCK_IDS * 8];
+  for (size_t i = 0; i < ids.size(); i += SWEEP_SET_BLOCK_IDS) {
+    uint16_t n = std::min<size_t>(ids.size() - i, SWEEP_SET_BLOCK_IDS);
+    size_t length = efEncode(&ids[i], n, block, sizeof(block));
+    addBlock(block, length);
+  }
+}
+
+std::vector<uint64_t> IdSet::decode() const {
+  std::vector<uint64_t> ids;
+  ids.reserve(_size);
+  Cursor c(*this);
+  uint64_t id;
+  while (c.next(id)) ids.push_back(id);
+  return ids;
+}
+
+IdSet::Cursor::Cursor(const IdSet &set) : _set(set), _block(0) {
+  openBlock(0);
+}
+
+bool IdSet::Cursor::openBlock(size_t block) {
+  _block = block;
+  if (block >= _set._offsets.size()) return false;
+  size_t offset = _set._offsets[block];
+  return _reader.begin(&_set._data[offset], _set._data.size() - offset);
+}
+
+bool IdSet::Cursor::next(uint64_t &id) {
+  while (_block < _set._offsets.size()) {
+    if (_reader.next(id)) return true;
+    openBlock(_block + 1);
+  }
+  return false;
+}
+
+bool IdSet::Cursor::nextGEQ(uint64_t target, uint64_t &id) {
+  // the last block starting at or before target, if it's past the current one.
+  const std::vector<uint64_t> &bases = _set._bases;
+  size_t block = std::upper_bound(bases.begin(), bases.end(), target) - bases.begin();
+  if (block > _block + 1) openBlock(block - 1);
+  while (_block < bases.size()) {
+    if (_reader.nextGEQ(target, id)) return true;
+    openBlock(_block + 1);
+  }
+  return false;
+}
+
+// Leapfrog: the side behind skips to the other's ID until they meet.
+template <typename Match>
+static void leapfrog(const IdSet &a, const IdSet &b, Match match) {
+  const IdSet &small = a.size() <= b.size() ? a : b;
+  const IdSet &large = a.size() <= b.size() ? b : a;
+  IdSet::Cursor s(small), l(large);
+  uint64_t x, y;
+  bool hx = s.next(x);
+  bool hy = hx && l.nextGEQ(x, y);
+  while (hx && hy) {
+    if (x == y) {
+      match(x);
+      hx = s.next(x);
+      hy = hx && l.nextGEQ(x, y);
+    } else if (x < y) {
+      hx = s.nextGEQ(y, x);
+    } else {
+      hy = l.nextGEQ(x, y);
+    }
+  }
+}
+
+// Merge of both cursors, each ID once.
+template <typename Visit>
+static void merge(const IdSet &a, const IdSet &b, Visit visit) {
+  IdSet::Cursor ca(a), cb(b);
+  uint64_t x, y;
+  bool hx = ca.next(x), hy = cb.next(y);
+  while (hx || hy) {
+    if (hx && (!hy || x < y)) {
+      visit(x);
+      hx = ca.next(x);
+    } else if (hy && (!hx || y < x)) {
+      visit(y);
+      hy = cb.next(y);
+    } else {
+      visit(x);
+      hx = ca.next(x);
+      hy = cb.next(y);
+    }
+  }
+}
+
+size_t intersectionSize(const IdSet &a, const IdSet &b) {
+  size_t n = 0;
+  leapfrog(a, b, [&n](uint64_t) { n++; });
+  return n;
+}
+
+size_t unionSize(const IdSet &a, const IdSet &b) {
+  return a.size() + b.size() - intersectionSize(a, b);
+}
+
+void intersect(const IdSet &a, const IdSet &b, IdSet &out) {
+  std::vector<uint64_t> ids;
+  leapfrog(a, b, [&ids](uint64_t id) { ids.push_back(id); });
+  out.encode(ids);
+}
+
+void unite(const IdSet &a, const IdSet &b, IdSet &out) {
+  std::vector<uint64_t> ids;
+  ids.reserve(a.size() + b.size());
+  merge(a, b, [&ids](uint64_t id) { ids.push_back(id); });
+  out.encode(ids);
+}
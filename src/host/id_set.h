@@ -0,0 +1,64 @@
+/**
+* Device ID sets in the sensor's compressed form: a run of lib/EliasFano
+* blocks in ID order, as FRAME_SWEEP_SET delivers them. Cursors walk the
+* blocks and skip ahead (block bases first, then inside a block), so
+* intersections cost about the smaller set's length and nothing is
+* decoded into a plain array on the way.
+*/
+
+#ifndef ID_SET_H
+#define ID_SET_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include <EliasFano.h>
+
+class IdSet {
+public:
+  IdSet();
+
+  void clear();
+  // Appends a block; its IDs must follow the ones already in the set.
+  bool addBlock(const uint8_t *block, size_t length);
+  // Sorted distinct IDs, SWEEP_SET_BLOCK_IDS per block.
+  void encode(const std::vector<uint64_t> &ids);
+
+  // The blocks back to back, as stored (eg. in a checkpoint), and back.
+  const std::vector<uint8_t> &data() const { return _data; }
+  bool assign(const uint8_t *data, size_t length);
+
+  size_t size() const { return _size; }
+  size_t bytes() const { return _data.size(); }
+  std::vector<uint64_t> decode() const;
+
+  class Cursor {
+  public:
+    explicit Cursor(const IdSet &set);
+    bool next(uint64_t &id);
+    // First ID >= target from the current position on.
+    bool nextGEQ(uint64_t target, uint64_t &id);
+
+  private:
+    bool openBlock(size_t block);
+
+    const IdSet &_set;
+    size_t _block;
+    EfReader _reader;
+  };
+
+private:
+  std::vector<uint8_t> _data;
+  std::vector<size_t> _offsets;     // of each block in _data
+  std::vector<uint64_t> _bases;     // first ID of each block
+  uint64_t _last;                   // of the last block
+  size_t _size;
+};
+
+size_t intersectionSize(const IdSet &a, const IdSet &b);
+size_t unionSize(const IdSet &a, const IdSet &b);
+// Both as a new compressed set.
+void intersect(const IdSet &a, const IdSet &b, IdSet &out);
+void unite(const IdSet &a, const IdSet &b, IdSet &out);
+
+#endif
@@ -0,0 +1,89 @@
+#include "link_decoder.h"
+
+#include <string.h>
+
+void DigestColumns::append(const FrameDigest &d) {
+  timeMs.push_back(d.timestampMs);
+  mac.insert(mac.end(), d.mac, d.mac + 6);
+  rssi.push_back(d.rssi);
+  channel.push_back(d.channelFlags & 0x0f);
+  flags.push_back(d.channelFlags >> 4);
+  seq.push_back(d.seq >> 4);
+  ieFingerprint.push_back(d.ieFingerprint);
+}
+
+void DigestColumns::clear() {
+  timeMs.clear();
+  mac.clear();
+  rssi.clear();
+  channel.clear();
+  flags.clear();
+  seq.clear();
+  ieFingerprint.clear();
+}
+
+void DigestColumns::swap(DigestColumns &other) {
+  timeMs.swap(other.timeMs);
+  mac.swap(other.mac);
+  rssi.swap(other.rssi);
+  channel.swap(other.channel);
+  flags.swap(other.flags);
+  seq.swap(other.seq);
+  ieFingerprint.swap(other.ieFingerprint);
+}
+
+LinkDecoder::LinkDecoder()
+  : _arena((uint8_t *)_pool, sizeof(_pool)), _link(*this), _data(NULL), _length(0), _at(0), _haveCounters(false),
+    _haveSensorStats(false), _rulesAcked(false), _rulesLoaded(false), _rulesDetail(0) {
+  memset(_counters, 0, sizeof(_counters));
+  _rulesError[0] = 0;
+  memset(&_hopStats, 0, sizeof(_hopStats));
+  memset(&_sensorStats, 0, sizeof(_sensorStats));
+  _link.begin(_arena, 64, LINK_DECODER_MAX_PAYLOAD, LINK_DEFAULT_BAUD, LINK_DEFAULT_BAUD);
+  _link.onFrame(onFrame, this);
+}
+
+void LinkDecoder::feed(const uint8_t *data, size_t length) {
+  _data = data;
+  _length = length;
+  _at = 0;
+  while (_at < _length) _link.poll(1000000);
+  _data = NULL;
+  _length = 0;
+}
+
+void LinkDecoder::onFrame(void *ctx, uint8_t type, const uint8_t *payload, uint16_t length) {
+  LinkDecoder &d = *(LinkDecoder *)ctx;
+  switch (type) {
+    case FRAME_DIGESTS:
+      for (uint16_t off = 0; off + sizeof(FrameDigest) <= length; off += sizeof(FrameDigest)) {
+        FrameDigest digest;
+        memcpy(&digest, payload + off, sizeof(digest));
+        d._digests.append(digest);
+      }
+      break;
+    case FRAME_DIGEST_STATS:
+      if (length < 4 + sizeof(d._counters)) break;
+      memcpy(d._counters, payload + 4, sizeof(d._counters));
+      d._haveCounters = true;
+      if (length >= 4 + sizeof(d._counters) + sizeof(HopStats)) {
+        memcpy(&d._hopStats, payload + 4 + sizeof(d._counters), sizeof(HopStats));
+      }
+      break;
+    case LINK_STATS:
+      if (length < sizeof(LinkStats)) break;
+      memcpy(&d._sensorStats, payload, sizeof(LinkStats));
+      d._haveSensorStats = true;
+      break;
+    case FRAME_RULES_ACK:
+      if (length < 7) break;
+      d._rulesAcked = true;
+      d._rulesLoaded = payload[4] != 0;
+      memcpy(&d._rulesDetail, payload + 5, 2);
+      length -= 7;
+      if (length > sizeof(d._rulesError) - 1) length = sizeof(d._rulesError) - 1;
+      memcpy(d._rulesError, payload + 7, length);
+      d._rulesError[length] = 0;
+      break;
+  }
+}
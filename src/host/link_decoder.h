@@ -0,0 +1,100 @@
+/**
+* Decodes a sensor's SensorLink byte stream in memory: bytes are fed as
+* they come (from a serial read, a recorded stream, or a SnifferCore in
+* the same process through a LinkDecoderPort) and the digests of whole
+* FRAME_DIGESTS frames are appended column by column, one array per
+* FrameDigest field, ready for columnar tools to use in place. The last
+* FRAME_DIGEST_STATS, LINK_STATS and FRAME_RULES_ACK are kept too.
+*/
+
+#ifndef LINK_DECODER_H
+#define LINK_DECODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include <Arena.h>
+#include <FrameDigest.h>
+#include <SensorLink.h>
+#include <SnifferCore.h>
+
+#define LINK_DECODER_MAX_PAYLOAD 4096   // the longest frame taken, as the aggregator's
+
+struct DigestColumns {
+  std::vector<uint32_t> timeMs;         // sensor millis()
+  std::vector<uint8_t> mac;             // 6 bytes a digest
+  std::vector<int8_t> rssi;
+  std::vector<uint8_t> channel;
+  std::vector<uint8_t> flags;           // DIGEST_FLAG_* >> 4, as the aggregator prints them
+  std::vector<uint16_t> seq;            // sequence number, no fragment
+  std::vector<uint16_t> ieFingerprint;
+
+  size_t size() const { return timeMs.size(); }
+  void append(const FrameDigest &d);
+  void clear();
+  void swap(DigestColumns &other);
+};
+
+class LinkDecoder : public LinkPort {
+public:
+  LinkDecoder();
+
+  // Decodes the whole frames in data; a frame cut short is completed by
+  // the next feed.
+  void feed(const uint8_t *data, size_t length);
+
+  DigestColumns &digests() { return _digests; }
+  bool haveCounters() const { return _haveCounters; }
+  uint32_t counter(DigestCounter c) const { return _counters[c]; }
+  const HopStats &hopStats() const { return _hopStats; }
+  bool haveSensorStats() const { return _haveSensorStats; }
+  const LinkStats &sensorStats() const { return _sensorStats; }
+  const LinkStats &stats() const { return _link.stats(); }
+  bool rulesAcked() const { return _rulesAcked; }
+  bool rulesLoaded() const { return _rulesLoaded; }
+  uint16_t rulesDetail() const { return _rulesDetail; }   // worst case steps, or the error position
+  const char *rulesError() const { return _rulesError; }
+
+  // LinkPort: what the decoder's link reads; nothing is sent back.
+  size_t write(const uint8_t *data, size_t len) override { (void)data; return len; }
+  int read() override { return _at < _length ? _data[_at++] : -1; }
+  bool txIdle() override { return true; }
+  void setBaud(uint32_t baud) override { (void)baud; }
+  uint32_t millis() override { return 0; }
+
+private:
+  static void onFrame(void *ctx, uint8_t type, const uint8_t *payload, uint16_t length);
+
+  uint64_t _pool[(LINK_DECODER_MAX_PAYLOAD + 512) / 8];
+  Arena _arena;
+  SensorLink _link;
+  const uint8_t *_data;
+  size_t _length;
+  size_t _at;
+  DigestColumns _digests;
+  bool _haveCounters;
+  uint32_t _counters[DIGEST_COUNTER_COUNT];
+  HopStats _hopStats;
+  bool _haveSensorStats;
+  LinkStats _sensorStats;
+  bool _rulesAcked;
+  bool _rulesLoaded;
+  uint16_t _rulesDetail;
+  char _rulesError[48];
+};
+
+// A SnifferCore's link port writing straight into a decoder.
+class LinkDecoderPort : public LinkPort {
+public:
+  explicit LinkDecoderPort(LinkDecoder &decoder) : _decoder(decoder) {}
+  size_t write(const uint8_t *data, size_t len) override { _decoder.feed(data, len); return len; }
+  int read() override { return -1; }
+  bool txIdle() override { return true; }
+  void setBaud(uint32_t baud) override { (void)baud; }
+  uint32_t millis() override { return 0; }
+
+private:
+  LinkDecoder &_decoder;
+};
+
+#endif
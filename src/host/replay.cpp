@@ -0,0 +1,91 @@
+#include "replay.h"
+
+#include <string.h>
+
+void replayConfigDefaults(SnifferConfig &config) {
+  memset(&config, 0, sizeof(config));
+  config.ignoreLocalMacs = true;
+  config.staticMode = false;
+  config.initialChannel = 1;
+  config.hopIntervalMs = 30000;
+  config.bufferSize = 100;
+  config.qfQuotientBits = 10;
+  config.qfRemainderBits = 8;
+  config.qfWindowSize = 768;
+  config.digestQueueSize = 256;
+  config.digestBatchSize = 32;
+  config.digestBatchMaxMs = 50;
+  config.surgeDetect = true;
+  config.surge.alpha = 0.02f;
+  config.surge.k = 0.5f;
+  config.surge.h = 8;
+  config.surge.minRate = 3;
+  config.surge.warmupS = 120;
+  config.surge.holdoffS = 60;
+  config.watchlistSize = 512;
+  config.rules = "";
+  config.rulesMaxInsns = 32;
+  config.rulesMaxOuis = 16;
+  config.rulesMaxSource = 512;
+  config.sweepTrackerSlots = 1024;
+  config.sweepSetSize = 256;
+  config.sweepSetSalt = 0x5eed5a17;
+  config.hopDeferMaxMs = 200;
+  config.talkerSlots = 32;
+  config.talkerReport = 5;
+  config.sampleFrames = 8;
+}
+
+Replay::Replay(SnifferCore &core, HostHal &hal, bool allChannels)
+  : _core(core), _hal(hal), _allChannels(allChannels), _hopWaiting(false), _hopRetryMs(0), _alertsSeen(0) {
+  memset(&_stats, 0, sizeof(_stats));
+  _nextHopMs = hal.nowMs + core.config().hopIntervalMs;
+  _nextTickMs = hal.nowMs + REPLAY_TICK_MS;
+}
+
+void Replay::checkAlerts() {
+  while (_alertsSeen < _core.surge().alerts()) {
+    _alerts.push_back(_core.surge().lastAlert().timeMs);
+    _alertsSeen++;
+  }
+}
+
+void Replay::advance(uint32_t nowMs) {
+  for (;;) {
+    bool hopping = !_core.config().staticMode;
+    uint32_t hopMs = _hopWaiting ? _hopRetryMs : _nextHopMs;
+    uint32_t next = _nextTickMs;
+    if (hopping && hopMs < next) next = hopMs;
+    if ((int32_t)(next - nowMs) > 0) break;
+    _hal.nowMs = next;
+    if (hopping && next == hopMs) {
+      // the hop timer keeps its period, a waiting hop is retried in between.
+      _hopWaiting = !_core.channelHop();
+      if (_hopWaiting) {
+        _hopRetryMs = next + HOP_RETRY_MS;
+      } else {
+        _stats.hops++;
+      }
+      if (next == _nextHopMs) _nextHopMs += _core.config().hopIntervalMs;
+    } else {
+      _core.tick();
+      _nextTickMs += REPLAY_TICK_MS;
+    }
+    checkAlerts();
+  }
+  _hal.nowMs = nowMs;
+}
+
+void Replay::feed(const CaptureFrame &frame) {
+  advance((uint32_t)(frame.timeUs / 1000));
+  _stats.frames++;
+  // Captures without channel information are heard on any channel.
+  if (!_allChannels && frame.channel != 0 && frame.channel != _hal.channel) {
+    _stats.offChannel++;
+    return;
+  }
+  _stats.delivered++;
+  SnifferPacket packet = frame.packet;
+  _core.handlePacket((uint8_t *)&packet, sizeof(packet));
+  checkAlerts();
+}
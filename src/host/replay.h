@@ -0,0 +1,57 @@
+/**
+* Runs captured frames through SnifferCore on a virtual clock, with the
+* channel hop timer and loop() work interleaved as on the board. When
+* hopping, only frames on the channel the sensor is tuned to are delivered,
+* the way a single radio would hear them.
+*/
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdint.h>
+#include <vector>
+#include <SnifferCore.h>
+#include "capture.h"
+#include "host_hal.h"
+
+#define REPLAY_TICK_MS 250      // SnifferCore::tick() period, as the firmware's task
+
+// Defaults of src/main.cpp.
+void replayConfigDefaults(SnifferConfig &config);
+
+struct ReplayStats {
+  uint64_t frames;
+  uint64_t delivered;
+  uint64_t offChannel;        // dropped, the sensor was on another channel
+  uint32_t hops;
+};
+
+class Replay {
+public:
+  // allChannels delivers every frame regardless of the tuned channel.
+  Replay(SnifferCore &core, HostHal &hal, bool allChannels);
+
+  void feed(const CaptureFrame &frame);
+  // Runs timers up to nowMs without frames.
+  void advance(uint32_t nowMs);
+
+  const ReplayStats &stats() const { return _stats; }
+  // Virtual times of the surge alerts raised so far.
+  const std::vector<uint32_t> &alerts() const { return _alerts; }
+
+private:
+  SnifferCore &_core;
+  HostHal &_hal;
+  bool _allChannels;
+  uint32_t _nextHopMs;
+  bool _hopWaiting;           // for a quiet gap, tried again at _hopRetryMs
+  uint32_t _hopRetryMs;
+  uint32_t _nextTickMs;
+  ReplayStats _stats;
+  std::vector<uint32_t> _alerts;
+  uint32_t _alertsSeen;
+
+  void checkAlerts();
+};
+
+#endif
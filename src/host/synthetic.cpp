@@ -0,0 +1,168 @@
+#include "synthetic.h"
+
+#include <math.h>
+#include <string.h>
+
+#define BURST_CHANNELS       13
+#define BURST_CHANNEL_US     12000    // phones dwell ~10-20 ms per channel while scanning
+#define BEACON_INTERVAL_US   102400
+
+// Probe request bodies of a few device models, the IE fingerprint tells them apart.
+static const uint8_t modelIes[][40] = {
+  { 0, 0, 1, 8, 0x02, 0x04, 0x0b, 0x16, 0x0c, 0x12, 0x18, 0x24, 50, 4, 0x30, 0x48, 0x60, 0x6c,
+    45, 4, 0x2d, 0x01, 0x1b, 0xff, 127, 8, 0x04, 0, 0x0a, 0x02, 0, 0x40, 0, 0x40 },
+  { 0, 0, 1, 4, 0x02, 0x04, 0x0b, 0x16, 50, 8, 0x0c, 0x12, 0x18, 0x24, 0x30, 0x48, 0x60, 0x6c,
+    45, 4, 0xef, 0x01, 0x17, 0xff, 221, 7, 0x00, 0x50, 0xf2, 0x08, 0x00, 0x2c, 0x00 },
+  { 0, 0, 1, 8, 0x82, 0x84, 0x8b, 0x96, 0x0c, 0x12, 0x18, 0x24, 50, 4, 0x30, 0x48, 0x60, 0x6c,
+    45, 4, 0x6f, 0x00, 0x17, 0xff, 127, 4, 0x00, 0x00, 0x08, 0x84 },
+  { 0, 0, 1, 8, 0x02, 0x04, 0x0b, 0x16, 0x0c, 0x12, 0x18, 0x24, 50, 4, 0x30, 0x48, 0x60, 0x6c,
+    221, 9, 0x00, 0x10, 0x18, 0x02, 0x00, 0x00, 0x1c, 0x00, 0x00 },
+};
+static const uint8_t modelIesLength[] = { 34, 33, 30, 29 };
+#define MODELS (sizeof(modelIesLength) / sizeof(modelIesLength[0]))
+
+void crowdScenarioDefaults(CrowdScenario &scenario) {
+  scenario.seed = 1;
+  scenario.durationS = 3600;
+  scenario.arrivalsPerS = 0.2f;
+  scenario.surgeStartS = 0;
+  scenario.surgeLengthS = 0;
+  scenario.surgeArrivalsPerS = 2;
+  scenario.dwellS = 300;
+  scenario.probeIntervalS = 60;
+  scenario.localMacPercent = 0;
+  scenario.accessPoints = 3;
+  scenario.macRotateS = 0;
+}
+
+CrowdGenerator::CrowdGenerator(const CrowdScenario &scenario)
+  : _scenario(scenario), _rng(scenario.seed * 0x9e3779b97f4a7c15ULL + 1),
+    _endUs((uint64_t)scenario.durationS * 1000000), _nextArrivalUs(0), _lastDevice(-1) {
+  for (uint8_t i = 0; i < scenario.accessPoints; i++) {
+    _apChannels.push_back(1 + (uint8_t)(uniform() * BURST_CHANNELS));
+    Event e = { (uint64_t)(uniform() * BEACON_INTERVAL_US), -1 - (int32_t)i, _apChannels[i] };
+    _events.push(e);
+  }
+  scheduleArrival();
+}
+
+double CrowdGenerator::uniform() {
+  // xorshift64*, top 53 bits
+  _rng ^= _rng >> 12;
+  _rng ^= _rng << 25;
+  _rng ^= _rng >> 27;
+  return ((_rng * 0x2545f4914f6cdd1dULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+double CrowdGenerator::exponential(double mean) {
+  return -mean * log(1.0 - uniform());
+}
+
+// Piecewise constant rate: draw with the rate in force now and restart at the
+// next rate change if the draw crosses it (the process is memoryless).
+void CrowdGenerator::scheduleArrival() {
+  uint64_t t = _nextArrivalUs;
+  uint64_t surgeStart = (uint64_t)_scenario.surgeStartS * 1000000;
+  uint64_t surgeEnd = surgeStart + (uint64_t)_scenario.surgeLengthS * 1000000;
+  for (;;) {
+    bool surge = _scenario.surgeLengthS > 0 && t >= surgeStart && t < surgeEnd;
+    double rate = _scenario.arrivalsPerS + (surge ? _scenario.surgeArrivalsPerS : 0);
+    uint64_t change = surge ? surgeEnd : (t < surgeStart && _scenario.surgeLengthS > 0 ? surgeStart : _endUs);
+    uint64_t next = rate > 0 ? t + (uint64_t)(exponential(1e6 / rate)) : change;
+    if (next < change || change >= _endUs) {
+      _nextArrivalUs = next;
+      return;
+    }
+    t = change;
+  }
+}
+
+void CrowdGenerator::arrive(uint64_t timeUs) {
+  Device d;
+  for (int i = 0; i < 6; i++) d.mac[i] = (uint8_t)(uniform() * 256);
+  d.mac[0] &= 0xfc;
+  if (uniform() * 100 < _scenario.localMacPercent) d.mac[0] |= 0x02;
+  d.seq = (uint16_t)(uniform() * 4096);
+  d.model = (uint8_t)(uniform() * MODELS);
+  d.rssi = -40 - (int8_t)(uniform() * 50);
+  d.departUs = timeUs + (uint64_t)exponential(_scenario.dwellS * 1e6);
+  d.rotateUs = timeUs + (uint64_t)(_scenario.macRotateS * 1e6);
+  _devices.push_back(d);
+  int32_t id = _devices.size() - 1;
+  for (uint8_t ch = 1; ch <= BURST_CHANNELS; ch++) {
+    Event e = { timeUs + (ch - 1) * BURST_CHANNEL_US, id, ch };
+    _events.push(e);
+  }
+}
+
+void CrowdGenerator::probeFrame(CaptureFrame &frame, const Event &e) {
+  Device &d = _devices[e.device];
+  if ((d.mac[0] & 0x02) && _scenario.macRotateS > 0 && e.channel == 1 && e.timeUs >= d.rotateUs) {
+    for (int i = 1; i < 6; i++) d.mac[i] = (uint8_t)(uniform() * 256);
+    d.rotateUs = e.timeUs + (uint64_t)(_scenario.macRotateS * 1e6);
+  }
+  uint8_t buf[24 + 40];
+  memset(buf, 0, 24);
+  buf[0] = 0x40;                      // management, probe request
+  memset(buf + 4, 0xff, 6);           // broadcast
+  memcpy(buf + 10, d.mac, 6);
+  memset(buf + 16, 0xff, 6);
+  buf[22] = d.seq << 4;
+  buf[23] = d.seq >> 4;
+  d.seq = (d.seq + 1) & 0x0fff;
+  memcpy(buf + 24, modelIes[d.model], modelIesLength[d.model]);
+  uint16_t len = 24 + modelIesLength[d.model];
+  int8_t rssi = d.rssi + (int8_t)(uniform() * 7) - 3;
+  captureFrame(frame, e.timeUs, buf, len, e.channel, rssi);
+}
+
+void CrowdGenerator::beaconFrame(CaptureFrame &frame, const Event &e) {
+  int32_t ap = -1 - e.device;
+  uint8_t buf[24 + 12 + 10];
+  memset(buf, 0, sizeof(buf));
+  buf[0] = 0x80;                      // management, beacon
+  memset(buf + 4, 0xff, 6);
+  buf[10] = 0x02;
+  buf[15] = ap;
+  memcpy(buf + 16, buf + 10, 6);
+  buf[24 + 8] = 0x64;                 // interval 100 TU
+  buf[24 + 12] = 0;                   // SSID "crowd"
+  buf[24 + 13] = 5;
+  memcpy(buf + 24 + 14, "crowd", 5);
+  captureFrame(frame, e.timeUs, buf, 24 + 12 + 7, e.channel, -60);
+}
+
+bool CrowdGenerator::next(CaptureFrame &frame) {
+  for (;;) {
+    uint64_t nextEvent = _events.empty() ? _endUs : _events.top().timeUs;
+    if (_nextArrivalUs <= nextEvent && _nextArrivalUs < _endUs) {
+      arrive(_nextArrivalUs);
+      scheduleArrival();
+      continue;
+    }
+    if (_events.empty() || nextEvent >= _endUs) return false;
+
+    Event e = _events.top();
+    _events.pop();
+    _lastDevice = e.device;
+    if (e.device < 0) {
+      beaconFrame(frame, e);
+      e.timeUs += BEACON_INTERVAL_US;
+      _events.push(e);
+      return true;
+    }
+
+    probeFrame(frame, e);
+    if (e.channel == BURST_CHANNELS) {
+      // burst done, the next one if the device is still around.
+      uint64_t t = e.timeUs + (uint64_t)exponential(_scenario.probeIntervalS * 1e6);
+      if (t < _devices[e.device].departUs) {
+        for (uint8_t ch = 1; ch <= BURST_CHANNELS; ch++) {
+          Event b = { t + (ch - 1) * BURST_CHANNEL_US, e.device, ch };
+          _events.push(b);
+        }
+      }
+    }
+    return true;
+  }
+}
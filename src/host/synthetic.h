@@ -0,0 +1,78 @@
+/**
+* Synthetic crowd traffic: devices arrive as a Poisson process, stay for an
+* exponential dwell time and send probe request bursts across channels
+* 1-13 while present. A surge raises the arrival rate for a while, so the
+* ground truth of every scenario is known. A few access points add beacons
+* the sensor has to filter out. Devices with a randomized (local) MAC can
+* draw a new one every macRotateS, at the start of a burst, so the MACs
+* heard overstate the devices present. Same seed, same frames.
+*/
+
+#ifndef SYNTHETIC_H
+#define SYNTHETIC_H
+
+#include <stdint.h>
+#include <queue>
+#include <vector>
+#include "capture.h"
+
+struct CrowdScenario {
+  uint32_t seed;
+  uint32_t durationS;
+  float arrivalsPerS;         // new devices per second outside the surge
+  uint32_t surgeStartS;       // surge window, surgeLengthS 0 --> no surge
+  uint32_t surgeLengthS;
+  float surgeArrivalsPerS;    // extra arrivals per second during the surge
+  float dwellS;               // mean time a device stays
+  float probeIntervalS;       // mean time between probe bursts of a device
+  uint8_t localMacPercent;    // devices using a randomized (local) MAC
+  uint8_t accessPoints;       // beaconing APs on random channels
+  float macRotateS;           // local MACs change this often, 0 never
+};
+
+void crowdScenarioDefaults(CrowdScenario &scenario);
+
+class CrowdGenerator {
+public:
+  explicit CrowdGenerator(const CrowdScenario &scenario);
+
+  // Frames in time order, false after durationS.
+  bool next(CaptureFrame &frame);
+  // Device of the last frame, -1 for a beacon.
+  int32_t device() const { return _lastDevice; }
+  uint32_t devices() const { return _devices.size(); }
+
+private:
+  struct Device {
+    uint8_t mac[6];
+    uint16_t seq;
+    uint8_t model;
+    int8_t rssi;
+    uint64_t departUs;
+    uint64_t rotateUs;      // next MAC change
+  };
+  struct Event {
+    uint64_t timeUs;
+    int32_t device;         // -1 - ap for beacons
+    uint8_t channel;
+    bool operator<(const Event &o) const { return timeUs > o.timeUs; }
+  };
+
+  double uniform();
+  double exponential(double mean);
+  void scheduleArrival();
+  void arrive(uint64_t timeUs);
+  void probeFrame(CaptureFrame &frame, const Event &e);
+  void beaconFrame(CaptureFrame &frame, const Event &e);
+
+  CrowdScenario _scenario;
+  uint64_t _rng;
+  uint64_t _endUs;
+  uint64_t _nextArrivalUs;
+  std::vector<Device> _devices;
+  std::vector<uint8_t> _apChannels;
+  std::priority_queue<Event> _events;
+  int32_t _lastDevice;
+};
+
+#endif
@@ -0,0 +1,19 @@
+#include "text_file.h"
+
+#include <stdio.h>
+
+bool readTextFile(const char *path, std::string &text) {
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    perror(path);
+    return false;
+  }
+  char buf[1024];
+  size_t n;
+  text.clear();
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) text.append(buf, n);
+  bool ok = !ferror(f);
+  if (!ok) perror(path);
+  fclose(f);
+  return ok;
+}
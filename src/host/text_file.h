@@ -0,0 +1,13 @@
+/**
+* Whole small text files (filter rules) into a string.
+*/
+
+#ifndef TEXT_FILE_H
+#define TEXT_FILE_H
+
+#include <string>
+
+// False with a message on stderr if the file can't be read.
+bool readTextFile(const char *path, std::string &text);
+
+#endif
@@ -0,0 +1,60 @@
+#include "watchlist_file.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+static bool parseFlags(char *text, uint8_t &flags) {
+  flags = 0;
+  for (char *word = strtok(text, ", \t\r\n"); word; word = strtok(NULL, ", \t\r\n")) {
+    if (strcmp(word, "exclude") == 0) flags |= WATCH_EXCLUDE;
+    else if (strcmp(word, "flag") == 0) flags |= WATCH_FLAG;
+    else return false;
+  }
+  if (flags == 0) flags = WATCH_EXCLUDE;
+  return true;
+}
+
+bool readWatchlist(const char *path, std::vector<WatchRecord> &records) {
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    perror(path);
+    return false;
+  }
+  char line[256];
+  unsigned lineNumber = 0;
+  bool ok = true;
+  while (ok && fgets(line, sizeof(line), f)) {
+    lineNumber++;
+    char *hash = strchr(line, '#');
+    if (hash) *hash = 0;
+    if (line[strspn(line, " \t\r\n")] == 0) continue;
+    unsigned m[6];
+    int used = 0;
+    WatchRecord r;
+    if (sscanf(line, " %2x:%2x:%2x:%2x:%2x:%2x%n", &m[0], &m[1], &m[2], &m[3], &m[4], &m[5], &used) != 6 ||
+        !parseFlags(line + used, r.flags)) {
+      fprintf(stderr, "%s:%u: expected \"aa:bb:cc:dd:ee:ff [exclude|flag]\"\n", path, lineNumber);
+      ok = false;
+      break;
+    }
+    for (int i = 0; i < 6; i++) r.mac[i] = m[i];
+    records.push_back(r);
+  }
+  fclose(f);
+  return ok;
+}
+
+static bool macLess(const WatchRecord &a, const WatchRecord &b) {
+  return memcmp(a.mac, b.mac, 6) < 0;
+}
+
+static bool macEqual(const WatchRecord &a, const WatchRecord &b) {
+  return memcmp(a.mac, b.mac, 6) == 0;
+}
+
+size_t watchlistDistinct(const std::vector<WatchRecord> &records) {
+  std::vector<WatchRecord> sorted(records);
+  std::sort(sorted.begin(), sorted.end(), macLess);
+  return std::unique(sorted.begin(), sorted.end(), macEqual) - sorted.begin();
+}
@@ -0,0 +1,17 @@
+/**
+* Watchlist text files: one MAC per line, optionally followed by "exclude"
+* (staff, the default), "flag" or both, comma separated. '#' starts a comment.
+*/
+
+#ifndef WATCHLIST_FILE_H
+#define WATCHLIST_FILE_H
+
+#include <vector>
+#include <Watchlist.h>
+
+// False with a message on stderr if the file can't be read or has a bad line.
+bool readWatchlist(const char *path, std::vector<WatchRecord> &records);
+// Distinct MACs, what the sensor reports after loading.
+size_t watchlistDistinct(const std::vector<WatchRecord> &records);
+
+#endif
@@ -4,6 +4,44 @@
 * Maintains a buffer for seen MAC-addresses and has the possibility to filter out local MACs.
 * In "static mode" (STATIC_MODE true) buffer acts as a rollbuffer of defined size (BUFFER_SIZE).
 * When channel hopping is used (STATIC_MODE false) buffer is resetted after every sweep 1-14 channels.
+* With DEDUP_QUOTIENT_FILTER the MAC strings are replaced by a quotient filter of MAC fingerprints
+* (~2 bytes per entry instead of 18) so a much larger window fits in RAM, at a small false positive rate.
+* In thin-sensor mode (THIN_SENSOR_MODE true) there is no dedup: each accepted probe becomes a
+* 16 byte digest (MAC, RSSI, channel, sequence number, IE fingerprint, timestamp) and digests are
+* streamed to the host in binary batches, with drop counters.
+* Binary frames use a framed link (lib/SensorLink) with sequence numbers and CRC. The host can
+* negotiate the baud rate up to LINK_MAX_BAUD, with optional RTS/CTS (UART_HW_FLOW_CONTROL).
+* All runtime buffers are carved from a static arena (ARENA_SIZE) at boot and the memory map is
+* printed; nothing is allocated from the heap afterwards.
+* With SURGE_DETECT a CUSUM change-point detector watches the per-second rate of new devices and
+* prints "Surge alert: ..." as soon as it rises above the learned baseline, instead of waiting for
+* the client count at the end of a sweep.
+* A watchlist (WATCHLIST_SIZE MACs) excludes staff devices from counts and flags devices of
+* interest. It is loaded from flash at boot (WATCHLIST_FILE) and can be replaced at runtime over
+* the link or SPI; a new list is built aside and swapped in, capture never pauses.
+* FILTER_RULES replaces the built-in probe request / local MAC checks with runtime rules (frame
+* types, RSSI windows, OUIs, channels, see lib/FilterRules) compiled to bytecode; the host can
+* send new rules over the link without reflashing.
+* With SWEEP_TRACKER_SLOTS each sweep reports new, returning (seen the sweep before) and departed
+* devices, counted as frames arrive from generation tagged entries, independent of the dedup buffer.
+* SWEEP_SET_SIZE also sends the host each sweep's device set as salted 48-bit IDs, Elias-Fano coded
+* in link frames (lib/SweepSet), about 6 bytes a device instead of an 18 byte MAC string.
+* Every HEALTH_INTERVAL_MS a health record (free and lowest heap, largest free block, reset
+* reason, loop() and WiFi callback rates, stack use, see lib/Health) goes out as a link frame,
+* printed as a "Health:" line in text mode.
+* Every channel switch is timed, with the gap in received frames around it (printed per sweep, and
+* sent with the digest stats in thin-sensor mode); HOP_QUIET_GAP_MS holds a hop back until the
+* channel has been quiet that long, so it doesn't cut a probe burst short.
+* TOP_TALKER_SLOTS counts data frames and bytes per transmitting station in a bounded heavy hitters
+* table (lib/TopTalkers) and reports the TOP_TALKERS_REPORT heaviest every sweep, to tell idle
+* phones from busy ones.
+* FRAME_SAMPLE_SIZE accepted frames per sweep are reservoir sampled (lib/FrameSample) and sent
+* at the sweep's end as pcap records, to audit the counts against real frames.
+* In text mode binary link frames are held back until the host has opened the link (sent it a
+* frame), so a serial console only ever sees text.
+* Work outside the WiFi callbacks runs from loop() in a cooperative scheduler: tasks get a
+* microsecond budget per call and loop() returns after LOOP_SLICE_US so the SDK is never starved.
+* The sniffer logic itself lives in lib/SnifferCore, this file binds it to the ESP8266 SDK.
 * SPI functions are not tested.
 * Based on https://github.com/kalanda
 * Author: jajupoik
@@ -11,6 +49,12 @@
 
 #include <Arduino.h>
 #include <SPISlave.h>
+#include <LittleFS.h>
+#include <Arena.h>
+#include <CoopScheduler.h>
+#include <Health.h>
+#include <SensorLink.h>
+#include <SnifferCore.h>
 
 extern "C" {
   #include <user_interface.h>
@@ -19,174 +63,366 @@ extern "C" {
 // Configurable definitions:
 #define IGNORE_LOCAL_MACS true            // true --> locally administred MAC-addresses are ignored.
 #define CHANNEL_HOP_INTERVAL_MS   30000   // timer for channel hopping.
+#define HOP_QUIET_GAP_MS 0                // hop only after this long without frames, 0 --> hop on time.
+#define HOP_DEFER_MAX_MS 200              // longest a hop waits for the quiet gap.
 #define STATIC_MODE false                 // if set true channel hopping is disabled --> static scannig mode
 #define INITIAL_WIFI_CHANNEL 1            // channel to be used in static- and starting channel for dynamic mode
 #define BUFFER_SIZE 100                    // MAC entry buffer size
 #define SPI_SEND_ADDRESSES false          // Send MAC-addresses with SPI when they are first seen.
 #define SPI_SEND_CLIENT_COUNT false        // Send client count in dynamic mode after 1-14 channels are scanned.
+#define DEDUP_QUOTIENT_FILTER false       // true --> dedup with a quotient filter instead of the MAC string buffer.
+#define QF_QUOTIENT_BITS 10               // quotient filter has 2^QF_QUOTIENT_BITS slots.
+#define QF_REMAINDER_BITS 8               // false positive rate is about load / 2^QF_REMAINDER_BITS.
+#define QF_WINDOW_SIZE 768                // MACs kept in the quotient filter window (max 15/16 of the slots).
+#define THIN_SENSOR_MODE false            // true --> stream binary frame digests instead of deduped MAC lines.
+#define DIGEST_QUEUE_SIZE 256             // digests buffered between the WiFi callback and loop().
+#define DIGEST_BATCH_SIZE 32              // digests per binary frame.
+#define DIGEST_BATCH_MAX_MS 50            // partial batches are sent when the oldest digest is this old.
+#define DIGEST_STATS_INTERVAL_MS 5000     // how often thin-sensor mode sends its counters.
+#define SURGE_DETECT true                 // alert when the rate of new devices surges.
+#define SURGE_EWMA_ALPHA 0.02             // weight of a new second in the baseline rate.
+#define SURGE_CUSUM_K 0.5                 // CUSUM allowance, standard deviations.
+#define SURGE_CUSUM_H 8.0                 // CUSUM alert threshold, standard deviations.
+#define SURGE_MIN_RATE 3                  // no alerts below this many new devices per second.
+#define SURGE_WARMUP_S 120                // seconds to learn the baseline before alerting.
+#define SURGE_HOLDOFF_S 60                // seconds between alerts.
+#define WATCHLIST_SIZE 512                // MACs in the watchlist (staff exclusion, flagged devices), 0 --> none.
+#define WATCHLIST_FILE "/watchlist.bin"   // WatchRecords loaded from flash at boot when the file exists.
+#define WATCHLIST_SPI false               // true --> also take watchlist frames as SPI slave packets.
+#define FILTER_RULES ""                   // receive filter rules at boot, eg. "drop rssi < -85; accept probe".
+#define FILTER_RULES_MAX_INSNS 32         // compiled rule size, one per condition and rule, 0 --> no rules.
+#define FILTER_RULES_MAX_OUIS 16          // OUIs the rules may list.
+#define FILTER_RULES_MAX_SOURCE 512       // longest rules source the host may send in pieces.
+#define SWEEP_TRACKER_SLOTS 1024          // devices tracked over two sweeps for new/returning/departed, 0 --> off.
+#define SWEEP_SET_SIZE 256                // device IDs per sweep sent to the host (needs the tracker), 0 --> off.
+#define SWEEP_SET_SALT 0x5eed5a17         // salt of the sent IDs, per deployment.
+#define SERIAL_BAUD 115200                // output link speed at boot.
+#define LINK_MAX_BAUD 3000000             // highest baud rate the host may negotiate.
+#define LINK_TX_BUFFER_SIZE 2048          // binary frames queued for the UART.
+#define LINK_RX_MAX_PAYLOAD 256           // largest frame accepted from the host.
+#define UART_HW_FLOW_CONTROL false        // true --> RTS/CTS on GPIO15/GPIO13, wired to the host.
+#define ARENA_SIZE 21504                  // bytes reserved at boot for all runtime buffers.
+#define SCHEDULER_MAX_TASKS 8             // cooperative tasks run from loop().
+#define LOOP_SLICE_US 2000                // time one loop() call may spend in tasks.
+#define TASK_STATS_INTERVAL_MS 60000      // print per task time used and overruns, 0 --> never.
+#define TOP_TALKER_SLOTS 32               // data frame transmitters counted per sweep, 0 --> off.
+#define TOP_TALKERS_REPORT 5              // heaviest of them reported per sweep.
+#define FRAME_SAMPLE_SIZE 8               // accepted frames sampled per sweep and sent over the link, 0 --> off.
+#define HEALTH_INTERVAL_MS 10000          // send a health record (FRAME_HEALTH), 0 --> never.
+#define SYS_STACK_TOP 0x40000000UL        // the SDK's system stack, WiFi callbacks run on it, grows down.
+
+#if TOP_TALKER_SLOTS > TOP_TALKERS_MAX || TOP_TALKERS_REPORT > TOP_TALKER_SLOTS
+  #error "TOP_TALKER_SLOTS must be at most TOP_TALKERS_MAX and hold TOP_TALKERS_REPORT"
+#endif
+
+#if HOP_QUIET_GAP_MS && HOP_DEFER_MAX_MS >= CHANNEL_HOP_INTERVAL_MS
+  #error "HOP_DEFER_MAX_MS must be shorter than CHANNEL_HOP_INTERVAL_MS"
+#endif
+
+#if DEDUP_QUOTIENT_FILTER && QF_WINDOW_SIZE > (1UL << QF_QUOTIENT_BITS) * 15 / 16
+  #error "QF_WINDOW_SIZE does not fit in the quotient filter"
+#endif
+
+class Esp8266Hal : public SnifferHal {
+public:
+  void println(const char *line) override { Serial.println(line); }
+  uint8_t getChannel() override { return wifi_get_channel(); }
+  void setChannel(uint8_t channel) override { wifi_set_channel(channel); }
+  void spiSetData(const char *data) override { SPISlave.setData(data); }
+  uint32_t millis() override { return ::millis(); }
+  uint32_t micros() override { return ::micros(); }
+};
 
-#define DATA_LENGTH           112
-
-#define TYPE_MANAGEMENT       0x00
-#define TYPE_CONTROL          0x01
-#define TYPE_DATA             0x02
-#define SUBTYPE_PROBE_REQUEST 0x04
-
-// Sniffer packet data structure
-struct RxControl {
- signed rssi:8; // signal intensity of packet
- unsigned rate:4;
- unsigned is_group:1;
- unsigned:1;
- unsigned sig_mode:2; // 0:is 11n packet; 1:is not 11n packet;
- unsigned legacy_length:12; // if not 11n packet, shows length of packet.
- unsigned damatch0:1;
- unsigned damatch1:1;
- unsigned bssidmatch0:1;
- unsigned bssidmatch1:1;
- unsigned MCS:7; // if is 11n packet, shows the modulation and code used (range from 0 to 76)
- unsigned CWB:1; // if is 11n packet, shows if is HT40 packet or not
- unsigned HT_length:16;// if is 11n packet, shows length of packet.
- unsigned Smoothing:1;
- unsigned Not_Sounding:1;
- unsigned:1;
- unsigned Aggregation:1;
- unsigned STBC:2;
- unsigned FEC_CODING:1; // if is 11n packet, shows if is LDPC packet or not.
- unsigned SGI:1;
- unsigned rxend_state:8;
- unsigned ampdu_cnt:8;
- unsigned channel:4; //which channel this packet in.
- unsigned:12;
+class SerialPort : public LinkPort {
+public:
+  size_t write(const uint8_t *data, size_t len) override {
+    // text mode prints block anyway; writing frames whole keeps them apart from text lines.
+    if (!THIN_SENSOR_MODE) return Serial.write(data, len);
+    size_t room = Serial.availableForWrite();
+    return Serial.write(data, len < room ? len : room);
+  }
+  int read() override { return Serial.read(); }
+  bool txIdle() override { Serial.flush(); return true; }
+  void setBaud(uint32_t baud) override { Serial.updateBaudRate(baud); }
+  uint32_t millis() override { return ::millis(); }
 };
 
-// Sniffer packet structure
-struct SnifferPacket{
-    struct RxControl rx_ctrl;
-    uint8_t data[DATA_LENGTH];
-    uint16_t cnt;
-    uint16_t len;
+static const SnifferConfig snifferConfig = {
+  IGNORE_LOCAL_MACS,
+  STATIC_MODE,
+  INITIAL_WIFI_CHANNEL,
+  CHANNEL_HOP_INTERVAL_MS,
+  BUFFER_SIZE,
+  SPI_SEND_ADDRESSES,
+  SPI_SEND_CLIENT_COUNT,
+  DEDUP_QUOTIENT_FILTER,
+  QF_QUOTIENT_BITS,
+  QF_REMAINDER_BITS,
+  QF_WINDOW_SIZE,
+  THIN_SENSOR_MODE,
+  DIGEST_QUEUE_SIZE,
+  DIGEST_BATCH_SIZE,
+  DIGEST_BATCH_MAX_MS,
+  SURGE_DETECT,
+  { SURGE_EWMA_ALPHA, SURGE_CUSUM_K, SURGE_CUSUM_H, SURGE_MIN_RATE, SURGE_WARMUP_S, SURGE_HOLDOFF_S },
+  WATCHLIST_SIZE,
+  FILTER_RULES,
+  FILTER_RULES_MAX_INSNS,
+  FILTER_RULES_MAX_OUIS,
+  FILTER_RULES_MAX_SOURCE,
+  SWEEP_TRACKER_SLOTS,
+  SWEEP_SET_SIZE,
+  SWEEP_SET_SALT,
+  HOP_QUIET_GAP_MS,
+  HOP_DEFER_MAX_MS,
+  TOP_TALKER_SLOTS,
+  TOP_TALKERS_REPORT,
+  FRAME_SAMPLE_SIZE,
 };
 
-char macs[BUFFER_SIZE][18];
-int clientCount = 0;
+static uint8_t arenaPool[ARENA_SIZE] __attribute__((aligned(8)));
+static Arena arena(arenaPool, sizeof(arenaPool));
+static Esp8266Hal hal;
+static SnifferCore sniffer(hal, snifferConfig);
+static SerialPort serialPort;
+static SensorLink link(serialPort);
 
-static void getMAC(char *addr, uint8_t* data, uint16_t offset) {
-  sprintf(addr, "%02x:%02x:%02x:%02x:%02x:%02x", data[offset+0], data[offset+1], data[offset+2], data[offset+3], data[offset+4], data[offset+5]);
+static uint32_t schedulerClock() {
+  return micros();
 }
 
-static boolean isLocalMAC(uint8_t* data) {
-  uint8_t local = (data[10] & 0b00000010) >> 1;
-  if (local) return true;
-  return false;
-}
+static CoopScheduler scheduler(schedulerClock);
+static HealthMonitor health;
 
-static void printDataSpan(uint16_t start, uint16_t size, uint8_t* data) {
-  for(uint16_t i = start; i < DATA_LENGTH && i < start+size; i++) {
-    Serial.write(data[i]);
+static void printMemoryMap() {
+  char line[64];
+  Serial.println("Memory map:");
+  for (uint8_t i = 0; i < arena.entryCount(); i++) {
+    const ArenaEntry &e = arena.entry(i);
+    sprintf(line, "  %-16s @%5u %6u bytes", e.owner, e.offset, e.size);
+    Serial.println(line);
   }
+  sprintf(line, "  arena %u/%u bytes used, %u failed", (unsigned)arena.used(), (unsigned)arena.size(), arena.failures());
+  Serial.println(line);
+  sprintf(line, "  heap free %u bytes", ESP.getFreeHeap());
+  Serial.println(line);
 }
 
-// MAC buffer functions. These administer the local buffer so that each addresses
-// is taken into account only once.
-static boolean bufferCheckMAC(char newmac[]){
-  for (int i=0;i<=clientCount;i++) {
-    if (strcmp(newmac, macs[i]) == 0) {
-      return true;
-    }
+static uint8_t taskStatsNext = 0;
+
+/**
+ * Task printing scheduler statistics, one task per call to keep within budget.
+ */
+static bool printTaskStats(void *ctx, uint32_t budgetUs) {
+  (void) budgetUs;
+  uint8_t *next = (uint8_t *) ctx;
+  if (*next == 0) {
+    char line[48];
+    sprintf(line, "Task stats, %u loops:", scheduler.iterations());
+    Serial.println(line);
   }
+  const CoopTask &t = scheduler.task(*next);
+  char line[96];
+  sprintf(line, "  %s: runs %u used %u us max %u us overruns %u",
+    t.name, t.runs, t.usedUs, t.maxUs, t.overruns);
+  Serial.println(line);
+  if (++*next < scheduler.taskCount()) return true;
+  *next = 0;
+  scheduler.resetStats();
   return false;
 }
 
-static void bufferRollBack() {
-  if (clientCount >= BUFFER_SIZE) {
-    Serial.println("Buffer rollback.");
-    for (int i=1; i<clientCount; i++) {
-      strcpy(macs[i-1], macs[i]);
-    }
-    clientCount--;
-  }
+/**
+ * In text mode binary frames go out only once the host has opened the link,
+ * a serial console never sees them.
+ */
+static bool binaryOutput() {
+  return THIN_SENSOR_MODE || link.opened();
 }
 
-static void bufferAdd(char newmac[]) {
-  bufferRollBack();
-  strcpy(macs[clientCount++],newmac);
+/**
+ * Thin-sensor output tasks.
+ */
+static bool drainDigests(void *ctx, uint32_t budgetUs) {
+  (void) ctx;
+  return sniffer.drainDigests(budgetUs);
 }
 
-static void bufferReset() {
-  Serial.println("Resetting buffer.");
-  for (int i=0; i<clientCount; i++) {
-    strcpy(macs[i], "");
-  }
-  clientCount = 0;
+static bool digestStats(void *ctx, uint32_t budgetUs) {
+  (void) ctx;
+  (void) budgetUs;
+  sniffer.requestDigestStats();
+  link.send(LINK_STATS, (const uint8_t *) &link.stats(), sizeof(LinkStats));
+  return false;
 }
 
-static void showMetadata(SnifferPacket *snifferPacket) {
+/**
+ * Closes surge detector seconds that passed without new devices, cleans the
+ * sweep tracker.
+ */
+static bool snifferTick(void *ctx, uint32_t budgetUs) {
+  (void) ctx;
+  (void) budgetUs;
+  sniffer.tick();
+  return false;
+}
 
-  unsigned int frameControl = ((unsigned int)snifferPacket->data[1] << 8) + snifferPacket->data[0];
+/**
+ * Streams the last sweep's sampled frames, a frame per call.
+ */
+static bool frameSample(void *ctx, uint32_t budgetUs) {
+  (void) ctx;
+  (void) budgetUs;
+  if (!binaryOutput()) return false;
+  return sniffer.exportSamples();
+}
+
+/**
+ * Streams the last sweep's device set, a frame per call.
+ */
+static bool sweepSet(void *ctx, uint32_t budgetUs) {
+  (void) ctx;
+  (void) budgetUs;
+  if (!binaryOutput()) return false;
+  return sniffer.exportSweepSet();
+}
 
-  uint8_t version      = (frameControl & 0b0000000000000011) >> 0;
-  uint8_t frameType    = (frameControl & 0b0000000000001100) >> 2;
-  uint8_t frameSubType = (frameControl & 0b0000000011110000) >> 4;
-  uint8_t toDS         = (frameControl & 0b0000000100000000) >> 8;
-  uint8_t fromDS       = (frameControl & 0b0000001000000000) >> 9;
+/**
+ * Samples the heap once a second, sends the health record every HEALTH_INTERVAL_MS,
+ * or prints it in text mode until the host opens the link.
+ */
+static uint32_t healthNextMs = HEALTH_INTERVAL_MS;
+
+static bool healthReport(void *ctx, uint32_t budgetUs) {
+  (void) ctx;
+  (void) budgetUs;
+  uint32_t now = millis();
+  if ((int32_t)(now - healthNextMs) < 0) {
+    health.sampleHeap(ESP.getFreeHeap());
+    return false;
+  }
+  healthNextMs = now + HEALTH_INTERVAL_MS;
+  HealthRecord r;
+  health.report(now, ESP.getFreeHeap(), r);
+  r.maxFreeBlock = ESP.getMaxFreeBlockSize();
+  r.heapFragmentation = ESP.getHeapFragmentation();
+  const rst_info *reset = ESP.getResetInfoPtr();
+  r.resetReason = reset->reason;
+  r.resetExcCause = reset->exccause;
+  r.resetEpc1 = reset->epc1;
+  uint32_t sp = health.lowestCallbackSp();
+  r.callbackStack = sp < SYS_STACK_TOP ? SYS_STACK_TOP - sp : 0;
+  r.loopStackFree = ESP.getFreeContStack();
+  if (binaryOutput()) {
+    link.send(FRAME_HEALTH, (const uint8_t *) &r, sizeof(r));
+    return false;
+  }
+  char line[192];
+  sprintf(line, "Health: heap %u min %u block %u frag %u%% loops %u/s callbacks %u/s stack %u free %u reset %u",
+    r.freeHeap, r.minFreeHeap, r.maxFreeBlock, r.heapFragmentation, r.loopsPerS, r.callbacksPerS,
+    r.callbackStack, r.loopStackFree, r.resetReason);
+  Serial.println(line);
+  return false;
+}
+
+/**
+ * Moves link frames to and from the UART.
+ */
+static bool pollLink(void *ctx, uint32_t budgetUs) {
+  (void) ctx;
+  return link.poll(budgetUs);
+}
 
-  // Only look for probe request packetsBUFFER_SIZE
-  if (frameType != TYPE_MANAGEMENT ||
-      frameSubType != SUBTYPE_PROBE_REQUEST)
-        return;
+/**
+ * Frames from the host go to the sniffer core.
+ */
+static void linkFrame(void *ctx, uint8_t type, const uint8_t *payload, uint16_t length) {
+  (void) ctx;
+  sniffer.handleFrame(type, payload, length);
+}
 
-  if (isLocalMAC(snifferPacket->data) && IGNORE_LOCAL_MACS) return;
+/**
+ * SPI slave packets: type, payload length, up to 30 bytes of payload.
+ * The interrupt only copies the packet, the status register reads 1 until
+ * the task has handled it and the master may send the next one.
+ */
+static uint8_t spiPacket[32];
+static volatile bool spiPacketPending = false;
+
+static void ICACHE_RAM_ATTR spiData(uint8_t *data, size_t len) {
+  if (spiPacketPending) return;
+  memcpy(spiPacket, data, len < sizeof(spiPacket) ? len : sizeof(spiPacket));
+  spiPacketPending = true;
+  SPISlave.setStatus(1);
+}
 
-  char addr[] = "00:00:00:00:00:00";
-  getMAC(addr, snifferPacket->data, 10);
-  RxControl rxControl = snifferPacket->rx_ctrl;
+/**
+ * Sorts a watchlist the host committed and switches to it.
+ */
+static bool commitWatchlist(void *ctx, uint32_t budgetUs) {
+  (void) ctx;
+  return sniffer.commitWatchlist(budgetUs);
+}
 
-  if (!bufferCheckMAC(addr)) {
-    bufferAdd(addr);
+static bool spiFrames(void *ctx, uint32_t budgetUs) {
+  (void) ctx;
+  (void) budgetUs;
+  if (!spiPacketPending) return false;
+  sniffer.handleFrame(spiPacket[0], spiPacket + 2, spiPacket[1] <= 30 ? spiPacket[1] : 30);
+  spiPacketPending = false;
+  SPISlave.setStatus(0);
+  return false;
+}
 
-    char msg [50];
-    sprintf(msg, "MAC: %s RSSI: %d Ch: %d cnt: %d", addr, rxControl.rssi, rxControl.channel, clientCount);
-    Serial.println(msg);
-    if (SPI_SEND_ADDRESSES) SPISlave.setData(addr);
+/**
+ * Loads the watchlist kept in flash, if there is one.
+ */
+static void loadWatchlistFile() {
+  if (!WATCHLIST_SIZE || !LittleFS.begin()) return;
+  File f = LittleFS.open(WATCHLIST_FILE, "r");
+  if (f) {
+    WatchRecord r;
+    uint16_t records = 0;
+    sniffer.watchlist().loadBegin();
+    while (f.read((uint8_t *) &r, sizeof(r)) == sizeof(r)) {
+      sniffer.watchlist().loadAdd(r.mac, r.flags);
+      records++;
+    }
+    f.close();
+    // nothing else runs yet, the whole sort is done here.
+    bool loaded = sniffer.watchlist().loadCommit(records);
+    while (sniffer.watchlist().commitStep()) {}
+    if (!THIN_SENSOR_MODE) {
+      char line[64];
+      sprintf(line, "Watchlist %s: %u MACs from flash", loaded ? "loaded" : "rejected", sniffer.watchlist().count());
+      Serial.println(line);
+    }
   }
+  // the file system buffers go back to the heap.
+  LittleFS.end();
 }
 
 /**
  * Callback for promiscuous mode
  */
 static void ICACHE_FLASH_ATTR sniffer_callback(uint8_t *buffer, uint16_t length) {
-  struct SnifferPacket *snifferPacket = (struct SnifferPacket*) buffer;
-  showMetadata(snifferPacket);
+  if (HEALTH_INTERVAL_MS) health.onCallback((uint32_t)(uintptr_t) __builtin_frame_address(0));
+  sniffer.handlePacket(buffer, length);
 }
 
 static os_timer_t channelHop_timer;
+static os_timer_t hopRetry_timer;
 
 /**
- * Callback for channel hoping
+ * Callback for channel hoping, and for retrying a hop waiting for a quiet gap.
  */
 void channelHop()
 {
-  // hoping channels 1-14
-  uint8 new_channel = wifi_get_channel() + 1;
-  if (new_channel > 14) {
-    new_channel = 1;
-    Serial.print("Total clients:");
-    Serial.println(clientCount);
-
-    if(SPI_SEND_CLIENT_COUNT) {
-      char msg [5];
-      sprintf(msg, "%d",clientCount);
-      SPISlave.setData(msg);
-      bufferReset();
-    }
+  if (!sniffer.channelHop()) {
+    os_timer_arm(&hopRetry_timer, HOP_RETRY_MS, 0);
+    return;
   }
-
-  wifi_set_channel(new_channel);
-
-  Serial.print("Channel: ");
-  Serial.println(wifi_get_channel());
-
+  health.onChannel(wifi_get_channel());
 }
 
 #define DISABLE 0
@@ -194,8 +430,31 @@ void channelHop()
 
 void setup() {
   // set the WiFi chip to "promiscuous" mode aka monitor mode
-  Serial.begin(115200);
+  Serial.begin(SERIAL_BAUD);
   delay(10);
+#if UART_HW_FLOW_CONTROL
+  // UART0 CTS on GPIO13 and RTS on GPIO15, RTS raised when 64 bytes wait in the RX FIFO.
+  pinMode(13, FUNCTION_4);
+  pinMode(15, FUNCTION_4);
+  U0C0 |= (1 << UCTXHFE);
+  U0C1 |= (1 << UCRXHFE) | (64 << UCRXHFT);
+#endif
+
+  // every subsystem takes its fixed budget here, nothing is allocated later.
+  boolean ready = sniffer.begin(arena);
+  ready = scheduler.begin(arena, SCHEDULER_MAX_TASKS) && ready;
+  ready = link.begin(arena, LINK_TX_BUFFER_SIZE, LINK_RX_MAX_PAYLOAD, SERIAL_BAUD, LINK_MAX_BAUD) && ready;
+  sniffer.setLink(&link);
+  link.onFrame(linkFrame, NULL);
+  arena.seal();
+  printMemoryMap();
+  if (!ready) {
+    Serial.println("Arena too small for the configured buffers, increase ARENA_SIZE.");
+    return;
+  }
+
+  loadWatchlistFile();
+
   wifi_set_opmode(STATION_MODE);
   wifi_set_channel(INITIAL_WIFI_CHANNEL);
   wifi_promiscuous_enable(DISABLE);
@@ -209,9 +468,47 @@ void setup() {
     os_timer_disarm(&channelHop_timer);
     os_timer_setfn(&channelHop_timer, (os_timer_func_t *) channelHop, NULL);
     os_timer_arm(&channelHop_timer, CHANNEL_HOP_INTERVAL_MS, 1);
+    os_timer_disarm(&hopRetry_timer);
+    os_timer_setfn(&hopRetry_timer, (os_timer_func_t *) channelHop, NULL);
+  }
+
+  scheduler.addTask("link", pollLink, NULL, 0, 500, 1000);
+  if (WATCHLIST_SIZE) {
+    scheduler.addTask("watchlist", commitWatchlist, NULL, 0, 500, 1000);
+  }
+  if (THIN_SENSOR_MODE) {
+    scheduler.addTask("digests", drainDigests, NULL, 0, 500, 1000);
+    scheduler.addTask("digest stats", digestStats, NULL, 1, 100, DIGEST_STATS_INTERVAL_MS * 1000UL);
+  }
+  if (WATCHLIST_SPI) {
+    SPISlave.onData(spiData);
+    SPISlave.begin();
+    scheduler.addTask("spi", spiFrames, NULL, 0, 500, 1000);
+  }
+  if (((SURGE_DETECT || SWEEP_TRACKER_SLOTS) && !THIN_SENSOR_MODE) ||
+      (STATIC_MODE && (TOP_TALKER_SLOTS || FRAME_SAMPLE_SIZE))) {
+    scheduler.addTask("tick", snifferTick, NULL, 1, 200, 250000UL);
+  }
+  if (SWEEP_TRACKER_SLOTS && SWEEP_SET_SIZE && !THIN_SENSOR_MODE) {
+    scheduler.addTask("sweep set", sweepSet, NULL, 1, 1000, 10000UL);
+  }
+  if (FRAME_SAMPLE_SIZE) {
+    scheduler.addTask("frame sample", frameSample, NULL, 1, 300, 10000UL);
+  }
+
+  if (HEALTH_INTERVAL_MS) {
+    health.begin(millis(), INITIAL_WIFI_CHANNEL);
+    scheduler.addTask("health", healthReport, NULL, 1, 300, 1000000UL);
+  }
+
+  // text output would corrupt the binary stream of thin-sensor mode.
+  if (TASK_STATS_INTERVAL_MS && !THIN_SENSOR_MODE) {
+    scheduler.addTask("stats", printTaskStats, &taskStatsNext, 255, 1000, TASK_STATS_INTERVAL_MS * 1000UL);
   }
 }
 
 void loop() {
-//  delay(10);
+  // returning from loop() lets the SDK run WiFi and feed the watchdog.
+  health.onLoop();
+  scheduler.runOnce(LOOP_SLICE_US);
 }
@@ -0,0 +1,339 @@
+#include "device_tables.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <Arena.h>
+#include <QuotientFilter.h>
+#include <SnifferCore.h>
+#include <SweepTracker.h>
+#include "../host/host_hal.h"
+#include "../host/replay.h"
+
+#define TABLE_ARENA_SIZE (64 * 1024)
+
+#define OP_BIT(op) (1 << (op))
+
+const char *const opNames[OP_COUNT] = { "insert", "lookup", "evict", "reset", "expire", "clean" };
+
+static uint64_t macKey(const uint8_t *mac) {
+  uint64_t key = 0;
+  for (int i = 0; i < 6; i++) key = (key << 8) | mac[i];
+  return key;
+}
+
+// The fewest quotient bits for entries, as the sniffer core sizes its window.
+static uint8_t quotientBits(uint32_t entries) {
+  uint8_t q = 1;
+  while ((1UL << q) * 15 / 16 < entries) q++;
+  return q;
+}
+
+// The sniffer core's dedup, fed probe requests as the WiFi callback would:
+// a device is new when the core prints its "MAC:" line. The sweep's end
+// (spiSendClientCount) resets it.
+class CoreTable : public DeviceTable {
+public:
+  explicit CoreTable(bool quotientFilter)
+    : _quotientFilter(quotientFilter), _pool(TABLE_ARENA_SIZE / 8), _hal(NULL, 1), _core(NULL), _redzone(NULL),
+      _printed(false) {
+    memset(&_packet, 0, sizeof(_packet));
+    _packet.data[0] = SUBTYPE_PROBE_REQUEST << 4;
+    _packet.rx_ctrl.rssi = -60;
+    _packet.rx_ctrl.channel = 1;
+    _packet.len = 64;
+  }
+  ~CoreTable() { delete _core; }
+
+  bool begin(const TableParams &params) override {
+    SnifferConfig config;
+    replayConfigDefaults(config);
+    config.bufferSize = params.capacity;
+    config.dedupQuotientFilter = _quotientFilter;
+    config.qfQuotientBits = quotientBits(params.capacity);
+    config.qfRemainderBits = params.remainderBits;
+    config.qfWindowSize = params.capacity;
+    config.spiSendClientCount = true;
+    config.surgeDetect = false;
+    config.watchlistSize = 0;
+    config.rulesMaxInsns = 0;
+    config.sweepTrackerSlots = 0;
+    config.sweepSetSize = 0;
+    _capacity = params.capacity;
+    _qbits = config.qfQuotientBits;
+    _rbits = config.qfRemainderBits;
+    _core = new SnifferCore(_hal, config);
+    _hal.onLine(onLine, this);
+    Arena arena((uint8_t *)_pool.data(), TABLE_ARENA_SIZE);
+    if (!_core->begin(arena)) return false;
+    // The MAC buffer is the core's last allocation: the slot after it gets
+    // the MAC looked up, so a read past the buffer's end finds the device.
+    if (!_quotientFilter) _redzone = arena.allocateArray<char[18]>("redzone", 1);
+    return _quotientFilter || _redzone != NULL;
+  }
+
+  uint32_t capacity() const override { return _capacity; }
+
+  uint64_t key(const uint8_t *mac) const override {
+    return _quotientFilter ? QuotientFilter::fingerprintMAC(mac, _qbits, _rbits) : macKey(mac);
+  }
+
+  void prepare(const Op &op, const uint8_t *mac) override {
+    if (op.kind != OP_INSERT) return;
+    memcpy(_packet.data + 10, mac, 6);
+    if (_redzone) {
+      sprintf(*_redzone, "%02x:%02x:%02x:%02x:%02x:%02x", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    }
+    _printed = false;
+  }
+
+  Outcome apply(const Op &op, const uint8_t *mac) override {
+    (void)mac;
+    Outcome o = { 0, 0, 0, 0 };
+    if (op.kind == OP_INSERT) {
+      _core->handlePacket((uint8_t *)&_packet, sizeof(_packet));
+      o.result = _printed ? INSERT_NEW : INSERT_KNOWN;
+    } else if (op.kind == OP_RESET) {
+      _hal.channel = 14;
+      _core->channelHop();
+    }
+    o.size = _core->clientCount();
+    return o;
+  }
+
+private:
+  static void onLine(void *ctx, uint32_t nowMs, const char *line) {
+    (void)nowMs;
+    if (strncmp(line, "MAC: ", 5) == 0) ((CoreTable *)ctx)->_printed = true;
+  }
+
+  bool _quotientFilter;
+  std::vector<uint64_t> _pool;
+  HostHal _hal;
+  SnifferCore *_core;
+  char (*_redzone)[18];
+  SnifferPacket _packet;
+  bool _printed;
+  uint32_t _capacity;
+  uint8_t _qbits;
+  uint8_t _rbits;
+};
+
+class BufferTable : public CoreTable {
+public:
+  BufferTable() : CoreTable(false) {}
+};
+
+class FilterWindowTable : public CoreTable {
+public:
+  FilterWindowTable() : CoreTable(true) {}
+};
+
+class QuotientFilterTable : public DeviceTable {
+public:
+  bool begin(const TableParams &params) override {
+    uint8_t qbits = quotientBits(params.capacity);
+    _storage.assign(QuotientFilter::storageBytes(qbits, params.remainderBits), 0);
+    return _filter.begin(qbits, params.remainderBits, _storage.data());
+  }
+
+  uint32_t capacity() const override { return _filter.capacity(); }
+  uint64_t key(const uint8_t *mac) const override { return _filter.fingerprintMAC(mac); }
+
+  Outcome apply(const Op &op, const uint8_t *mac) override {
+    Outcome o = { 0, 0, 0, 0 };
+    uint32_t before = _filter.count();
+    switch (op.kind) {
+      case OP_INSERT:
+        if (!_filter.insert(mac)) o.result = INSERT_DROPPED;
+        else o.result = _filter.count() > before ? INSERT_NEW : INSERT_KNOWN;
+        break;
+      case OP_LOOKUP: o.result = _filter.contains(mac); break;
+      case OP_EVICT: o.result = _filter.remove(mac); break;
+      case OP_RESET: _filter.clear(); break;
+    }
+    o.size = _filter.count();
+    return o;
+  }
+
+private:
+  std::vector<uint8_t> _storage;
+  QuotientFilter _filter;
+};
+
+// Its contract takes clean() to go round the table within 254 sweeps, or
+// generations wrap; the generated runs clean far more often.
+class SweepTrackerTable : public DeviceTable {
+public:
+  SweepTrackerTable() : _pool(TABLE_ARENA_SIZE / 8) {}
+
+  bool begin(const TableParams &params) override {
+    Arena arena((uint8_t *)_pool.data(), TABLE_ARENA_SIZE);
+    return _tracker.begin(arena, params.capacity);
+  }
+
+  uint32_t capacity() const override { return _tracker.slots(); }
+  uint64_t key(const uint8_t *mac) const override { return SweepTracker::fingerprintMAC(mac); }
+
+  Outcome apply(const Op &op, const uint8_t *mac) override {
+    Outcome o = { 0, 0, 0, 0 };
+    if (op.kind == OP_INSERT) {
+      uint16_t untracked = _tracker.current().untracked;
+      if (_tracker.observe(mac)) o.result = INSERT_NEW;
+      else o.result = _tracker.current().untracked != untracked ? INSERT_DROPPED : INSERT_KNOWN;
+    } else if (op.kind == OP_EXPIRE) {
+      const SweepCounts &last = _tracker.endSweep();
+      o.result = last.newDevices;
+      o.returning = last.returning;
+      o.departed = last.departed;
+    } else if (op.kind == OP_CLEAN) {
+      _tracker.clean(op.arg);
+    }
+    o.size = _tracker.current().newDevices + _tracker.current().returning;
+    return o;
+  }
+
+private:
+  std::vector<uint64_t> _pool;
+  SweepTracker _tracker;
+};
+
+// The last capacity distinct devices, the oldest evicted for a new one.
+class WindowModel : public TableModel {
+public:
+  void begin(uint32_t capacity) override {
+    _capacity = capacity;
+    _order.clear();
+    _held.clear();
+  }
+
+  Outcome apply(const Op &op, uint64_t key, const Outcome &table) override {
+    (void)table;
+    Outcome o = { 0, 0, 0, 0 };
+    if (op.kind == OP_INSERT) {
+      if (_held.count(key)) {
+        o.result = INSERT_KNOWN;
+      } else {
+        if (_order.size() >= _capacity) {
+          _held.erase(_order.front());
+          _order.pop_front();
+        }
+        _order.push_back(key);
+        _held.insert(key);
+        o.result = INSERT_NEW;
+      }
+    } else if (op.kind == OP_RESET) {
+      _order.clear();
+      _held.clear();
+    }
+    o.size = _order.size();
+    return o;
+  }
+
+private:
+  uint32_t _capacity;
+  std::deque<uint64_t> _order;
+  std::unordered_set<uint64_t> _held;
+};
+
+// A set of up to capacity devices; inserts past it are refused.
+class SetModel : public TableModel {
+public:
+  void begin(uint32_t capacity) override {
+    _capacity = capacity;
+    _held.clear();
+  }
+
+  Outcome apply(const Op &op, uint64_t key, const Outcome &table) override {
+    (void)table;
+    Outcome o = { 0, 0, 0, 0 };
+    switch (op.kind) {
+      case OP_INSERT:
+        if (_held.count(key)) o.result = INSERT_KNOWN;
+        else if (_held.size() >= _capacity) o.result = INSERT_DROPPED;
+        else {
+          _held.insert(key);
+          o.result = INSERT_NEW;
+        }
+        break;
+      case OP_LOOKUP: o.result = _held.count(key); break;
+      case OP_EVICT: o.result = _held.erase(key); break;
+      case OP_RESET: _held.clear(); break;
+    }
+    o.size = _held.size();
+    return o;
+  }
+
+private:
+  uint32_t _capacity;
+  std::unordered_set<uint64_t> _held;
+};
+
+// The sweep each device was last seen in. A full table may drop a device
+// not seen this sweep or the one before; those it holds whatever happens.
+class SweepModel : public TableModel {
+public:
+  void begin(uint32_t capacity) override {
+    (void)capacity;
+    _lastSeen.clear();
+    _sweep = 1;
+    _new = _returning = _previous = 0;
+  }
+
+  Outcome apply(const Op &op, uint64_t key, const Outcome &table) override {
+    Outcome o = { 0, 0, 0, 0 };
+    if (op.kind == OP_INSERT) {
+      std::unordered_map<uint64_t, uint32_t>::iterator it = _lastSeen.find(key);
+      bool seen = it != _lastSeen.end();
+      bool returning = seen && it->second + 1 == _sweep;
+      if (seen && it->second == _sweep) {
+        o.result = INSERT_KNOWN;
+      } else if (table.result == INSERT_DROPPED && !returning) {
+        o.result = INSERT_DROPPED;
+      } else {
+        if (returning) _returning++;
+        else _new++;
+        _lastSeen[key] = _sweep;
+        o.result = INSERT_NEW;
+      }
+    } else if (op.kind == OP_EXPIRE) {
+      o.result = _new;
+      o.returning = _returning;
+      o.departed = _previous - _returning;
+      _previous = _new + _returning;
+      _new = _returning = 0;
+      _sweep++;
+    }
+    o.size = _new + _returning;
+    return o;
+  }
+
+private:
+  std::unordered_map<uint64_t, uint32_t> _lastSeen;
+  uint32_t _sweep;
+  int32_t _new;
+  int32_t _returning;
+  int32_t _previous;          // devices of the sweep before
+};
+
+template <typename T> static DeviceTable *makeTable() { return new T(); }
+template <typename T> static TableModel *makeModel() { return new T(); }
+
+const TableKind tableKinds[] = {
+  { "buffer", "sniffer core, MAC string buffer (BUFFER_SIZE)",
+    OP_BIT(OP_INSERT) | OP_BIT(OP_RESET), false, makeTable<BufferTable>, makeModel<WindowModel> },
+  { "filter_window", "sniffer core, quotient filter window (DEDUP_QUOTIENT_FILTER)",
+    OP_BIT(OP_INSERT) | OP_BIT(OP_RESET), true, makeTable<FilterWindowTable>, makeModel<WindowModel> },
+  { "quotient_filter", "lib/QuotientFilter",
+    OP_BIT(OP_INSERT) | OP_BIT(OP_LOOKUP) | OP_BIT(OP_EVICT) | OP_BIT(OP_RESET), true,
+    makeTable<QuotientFilterTable>, makeModel<SetModel> },
+  { "sweep_tracker", "lib/SweepTracker, new/returning/departed per sweep",
+    OP_BIT(OP_INSERT) | OP_BIT(OP_EXPIRE) | OP_BIT(OP_CLEAN), false,
+    makeTable<SweepTrackerTable>, makeModel<SweepModel> },
+};
+
+const size_t tableKindCount = sizeof(tableKinds) / sizeof(tableKinds[0]);
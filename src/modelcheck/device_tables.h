@@ -0,0 +1,86 @@
+/**
+* The device tables the model checker runs, and their reference models.
+* A table answers ops on devices (MACs) the way the sniffer uses it; its
+* model is the plainest code with the same contract, a std:: container
+* keyed the way the table is: by the MAC, or by the fingerprint the table
+* keeps, so two devices sharing a fingerprint are one device to both and a
+* collision is the contract, not a divergence.
+* Where a contract leaves a choice (a full table may drop a device it
+* doesn't hold) the model is shown the table's answer and checks it is
+* one the contract allows.
+*/
+
+#ifndef DEVICE_TABLES_H
+#define DEVICE_TABLES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum TableOp {
+  OP_INSERT,                // a frame of the device; answers INSERT_*
+  OP_LOOKUP,                // 1 if the device is held
+  OP_EVICT,                 // removes the device; 1 if it was held
+  OP_RESET,                 // empties the table
+  OP_EXPIRE,                // closes the sweep; answers its counts
+  OP_CLEAN,                 // expiry work on arg slots
+  OP_COUNT
+};
+
+extern const char *const opNames[OP_COUNT];
+
+#define INSERT_NEW     0
+#define INSERT_KNOWN   1
+#define INSERT_DROPPED 2    // no room for it
+
+struct Op {
+  uint8_t kind;
+  uint32_t arg;             // the device for insert, lookup and evict
+};
+
+struct TableParams {
+  uint16_t capacity;        // devices the table is made for
+  uint8_t remainderBits;    // fingerprint bits over the quotient, quotient filters
+};
+
+// A table's answer to one op, compared field by field with the model's.
+struct Outcome {
+  int32_t result;
+  int32_t size;             // devices held after the op (of the sweep, sweep tracker)
+  int32_t returning;        // expire
+  int32_t departed;         // expire
+};
+
+class DeviceTable {
+public:
+  virtual ~DeviceTable() {}
+  virtual bool begin(const TableParams &params) = 0;
+  // The devices the table is sure to hold.
+  virtual uint32_t capacity() const = 0;
+  // What the table tells devices apart by.
+  virtual uint64_t key(const uint8_t *mac) const = 0;
+  // Untimed set up for the next apply().
+  virtual void prepare(const Op &op, const uint8_t *mac) { (void)op; (void)mac; }
+  virtual Outcome apply(const Op &op, const uint8_t *mac) = 0;
+};
+
+class TableModel {
+public:
+  virtual ~TableModel() {}
+  virtual void begin(uint32_t capacity) = 0;
+  // What the table should have answered, given what it did answer.
+  virtual Outcome apply(const Op &op, uint64_t key, const Outcome &table) = 0;
+};
+
+struct TableKind {
+  const char *name;
+  const char *description;
+  uint8_t ops;              // 1 << OP_* supported
+  bool remainderBits;       // takes TableParams::remainderBits
+  DeviceTable *(*makeTable)();
+  TableModel *(*makeModel)();
+};
+
+extern const TableKind tableKinds[];
+extern const size_t tableKindCount;
+
+#endif
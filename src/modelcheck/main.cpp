@@ -0,0 +1,330 @@
+/**
+* Differential model checker for the device tables.
+* Every table (modelcheck -h lists them) runs random sequences of ops:
+* insert, lookup, evict, reset, expire (a sweep closes) and clean, next to
+* a reference model of its contract (device_tables.h), and every answer is
+* compared with the model's, the table's size after the op included.
+* A divergence is shrunk to a minimal reproducer, the smallest capacity
+* and then as few ops as still diverge, printed op by op with the run's
+* seed to replay it. The table's time per op (not the model's) is measured
+* on the way, per op: mean and 99th percentile.
+* A new table implementation goes into device_tables.cpp with its model,
+* or an existing one for the same contract.
+* Usage: modelcheck [-t table] [-n runs] [-o ops] [-c capacity] [-s seed]
+*   -n  runs per table (200), each with its own capacity, devices and ops
+*   -o  ops per run (2000)
+*   -c  largest capacity drawn (256); most runs draw 16 or less, where a
+*       full, single entry or empty table comes up often
+*   -s  seed of the first run (1), the next runs count up from it
+*  Exits 1 when a table diverged.
+*/
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#include "device_tables.h"
+
+#define SHRINK_ROUNDS 4
+
+struct Options {
+  uint32_t runs;
+  uint32_t ops;
+  uint16_t maxCapacity;
+  uint64_t seed;
+};
+
+struct Run {
+  TableParams params;
+  std::vector<Op> ops;
+};
+
+struct Divergence {
+  long at;                  // op index, -1 when table and model agree
+  Outcome table;
+  Outcome model;
+};
+
+struct Costs {
+  std::vector<uint32_t> ns[OP_COUNT];
+};
+
+// Relative weights of the ops, of those the table takes.
+static const uint8_t opWeights[OP_COUNT] = { 60, 15, 10, 1, 4, 10 };
+
+static uint64_t splitmix(uint64_t &state) {
+  uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+// Device n's MAC is the same in every run, so reproducers name real MACs.
+static void deviceMAC(uint32_t device, uint8_t *mac) {
+  uint64_t state = device;
+  uint64_t h = splitmix(state);
+  for (int i = 0; i < 6; i++) mac[i] = h >> (8 * i);
+  mac[0] &= 0xfc;           // globally administered unicast
+}
+
+static uint64_t nowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// What reading the clock twice costs, taken off every op.
+static uint64_t timerNs() {
+  uint64_t least = ~0ULL;
+  for (int i = 0; i < 1000; i++) {
+    uint64_t start = nowNs();
+    uint64_t ns = nowNs() - start;
+    if (ns < least) least = ns;
+  }
+  return least;
+}
+
+static void generate(const TableKind &kind, uint64_t seed, const Options &options, Run &run) {
+  uint64_t state = seed;
+  uint32_t r = splitmix(state);
+  uint16_t spread = (r & 3) == 0 ? options.maxCapacity : std::min<uint16_t>(16, options.maxCapacity);
+  run.params.capacity = 1 + (r >> 2) % spread;
+  run.params.remainderBits = 1 + (r >> 20) % 8;
+  // devices drawn from one to four times what the table holds, plus one.
+  uint32_t devices = run.params.capacity * (1 + (r >> 24) % 4) + 1;
+  uint32_t total = 0;
+  for (int k = 0; k < OP_COUNT; k++) {
+    if (kind.ops & (1 << k)) total += opWeights[k];
+  }
+  run.ops.resize(options.ops);
+  for (uint32_t i = 0; i < options.ops; i++) {
+    uint64_t x = splitmix(state);
+    uint32_t pick = (uint32_t)x % total;
+    uint8_t k = 0;
+    for (;; k++) {
+      if (!(kind.ops & (1 << k))) continue;
+      if (pick < opWeights[k]) break;
+      pick -= opWeights[k];
+    }
+    run.ops[i].kind = k;
+    run.ops[i].arg = k == OP_CLEAN ? 1 + (x >> 32) % 64 : (x >> 32) % devices;
+  }
+}
+
+static bool same(const Outcome &a, const Outcome &b) {
+  return a.result == b.result && a.size == b.size && a.returning == b.returning && a.departed == b.departed;
+}
+
+// Runs ops on a fresh table and model. costs collects the table's time per
+// op, trace its answers up to the divergence.
+static Divergence check(const TableKind &kind, const TableParams &params, const std::vector<Op> &ops, Costs *costs,
+                        std::vector<Outcome> *trace) {
+  static uint64_t timer = timerNs();
+  Divergence d;
+  d.at = -1;
+  DeviceTable *table = kind.makeTable();
+  TableModel *model = kind.makeModel();
+  if (!table->begin(params)) {
+    fprintf(stderr, "%s: can't make a table of capacity %u\n", kind.name, params.capacity);
+    exit(2);
+  }
+  model->begin(table->capacity());
+  uint8_t mac[6];
+  for (size_t i = 0; i < ops.size(); i++) {
+    const Op &op = ops[i];
+    deviceMAC(op.arg, mac);
+    table->prepare(op, mac);
+    uint64_t start = costs ? nowNs() : 0;
+    Outcome answer = table->apply(op, mac);
+    if (costs) {
+      uint64_t ns = nowNs() - start;
+      costs->ns[op.kind].push_back(ns > timer ? ns - timer : 0);
+    }
+    Outcome expected = model->apply(op, table->key(mac), answer);
+    if (trace) trace->push_back(answer);
+    if (!same(answer, expected)) {
+      d.at = i;
+      d.table = answer;
+      d.model = expected;
+      break;
+    }
+  }
+  delete model;
+  delete table;
+  return d;
+}
+
+// Smallest capacity that still diverges, then chunks of ops taken out,
+// halving the chunk when none can go; the ops after a divergence never
+// matter. Repeated while that makes progress.
+static void shrink(const TableKind &kind, Run &run, long at) {
+  run.ops.resize(at + 1);
+  for (int round = 0; round < SHRINK_ROUNDS; round++) {
+    size_t before = run.ops.size();
+    uint16_t capacity = run.params.capacity;
+    for (uint16_t c = 1; c < run.params.capacity; c++) {
+      TableParams params = run.params;
+      params.capacity = c;
+      Divergence d = check(kind, params, run.ops, NULL, NULL);
+      if (d.at >= 0) {
+        run.params = params;
+        run.ops.resize(d.at + 1);
+        break;
+      }
+    }
+    for (size_t chunk = std::max<size_t>(run.ops.size() / 2, 1);;) {
+      bool removed = false;
+      for (size_t from = 0; from + chunk <= run.ops.size();) {
+        std::vector<Op> trial(run.ops.begin(), run.ops.begin() + from);
+        trial.insert(trial.end(), run.ops.begin() + from + chunk, run.ops.end());
+        Divergence d = check(kind, run.params, trial, NULL, NULL);
+        if (d.at >= 0) {
+          trial.resize(d.at + 1);
+          run.ops.swap(trial);
+          removed = true;
+        } else {
+          from += chunk;
+        }
+      }
+      if (removed) continue;
+      if (chunk == 1) break;
+      chunk /= 2;
+    }
+    if (run.ops.size() == before && run.params.capacity == capacity) break;
+  }
+}
+
+static void formatOutcome(uint8_t kind, const Outcome &o, char *out, size_t size) {
+  static const char *const inserts[] = { "new", "known", "dropped" };
+  switch (kind) {
+    case OP_INSERT:
+      snprintf(out, size, "%s, size %d", o.result >= 0 && o.result <= 2 ? inserts[o.result] : "?", o.size);
+      break;
+    case OP_LOOKUP: snprintf(out, size, "%s, size %d", o.result ? "hit" : "miss", o.size); break;
+    case OP_EVICT: snprintf(out, size, "%s, size %d", o.result ? "removed" : "absent", o.size); break;
+    case OP_EXPIRE:
+      snprintf(out, size, "new %d returning %d departed %d, size %d", o.result, o.returning, o.departed, o.size);
+      break;
+    default: snprintf(out, size, "size %d", o.size); break;
+  }
+}
+
+static void printOp(const Op &op, char *out, size_t size) {
+  if (op.kind == OP_INSERT || op.kind == OP_LOOKUP || op.kind == OP_EVICT) {
+    uint8_t mac[6];
+    deviceMAC(op.arg, mac);
+    snprintf(out, size, "%s d%u (%02x:%02x:%02x:%02x:%02x:%02x)", opNames[op.kind], (unsigned)op.arg,
+      mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+  } else if (op.kind == OP_CLEAN) {
+    snprintf(out, size, "clean %u slots", (unsigned)op.arg);
+  } else {
+    snprintf(out, size, "%s", opNames[op.kind]);
+  }
+}
+
+static void report(const TableKind &kind, uint64_t seed, const Options &options, Run &run, const Divergence &d) {
+  printf("%s: DIVERGED at op %ld of run seed %llu (capacity %u, %u ops)\n", kind.name, d.at + 1,
+    (unsigned long long)seed, run.params.capacity, (unsigned)run.ops.size());
+  printf("  rerun: modelcheck -t %s -s %llu -n 1 -o %u -c %u\n", kind.name, (unsigned long long)seed,
+    (unsigned)options.ops, options.maxCapacity);
+  shrink(kind, run, d.at);
+  std::vector<Outcome> trace;
+  Divergence last = check(kind, run.params, run.ops, NULL, &trace);
+  printf("  minimal reproducer: capacity %u", run.params.capacity);
+  if (kind.remainderBits) printf(", %u remainder bits", run.params.remainderBits);
+  printf(", %u ops\n", (unsigned)run.ops.size());
+  char opText[64], tableText[64], modelText[64];
+  for (size_t i = 0; i < trace.size(); i++) {
+    printOp(run.ops[i], opText, sizeof(opText));
+    formatOutcome(run.ops[i].kind, trace[i], tableText, sizeof(tableText));
+    if ((long)i == last.at) {
+      formatOutcome(run.ops[i].kind, last.model, modelText, sizeof(modelText));
+      printf("  %5u  %-34s %s    <- model: %s\n", (unsigned)i + 1, opText, tableText, modelText);
+    } else {
+      printf("  %5u  %-34s %s\n", (unsigned)i + 1, opText, tableText);
+    }
+  }
+}
+
+static void printCosts(Costs &costs) {
+  for (int k = 0; k < OP_COUNT; k++) {
+    std::vector<uint32_t> &ns = costs.ns[k];
+    if (ns.empty()) continue;
+    uint64_t total = 0;
+    for (size_t i = 0; i < ns.size(); i++) total += ns[i];
+    size_t p99 = ns.size() * 99 / 100;
+    std::nth_element(ns.begin(), ns.begin() + p99, ns.end());
+    printf("  %-7s %9u ops %8.1f ns/op  p99 %6u ns\n", opNames[k], (unsigned)ns.size(), (double)total / ns.size(),
+      ns[p99]);
+  }
+}
+
+// True when the table diverged.
+static bool checkTable(const TableKind &kind, const Options &options) {
+  Costs costs;
+  uint64_t ops = 0;
+  for (uint32_t r = 0; r < options.runs; r++) {
+    uint64_t seed = options.seed + r;
+    Run run;
+    generate(kind, seed, options, run);
+    Divergence d = check(kind, run.params, run.ops, &costs, NULL);
+    if (d.at >= 0) {
+      report(kind, seed, options, run, d);
+      return true;
+    }
+    ops += run.ops.size();
+  }
+  printf("%s: %u runs, %llu ops, no divergence\n", kind.name, (unsigned)options.runs, (unsigned long long)ops);
+  printCosts(costs);
+  return false;
+}
+
+static void usage() {
+  fprintf(stderr, "usage: modelcheck [-t table] [-n runs] [-o ops] [-c capacity] [-s seed]\ntables:\n");
+  for (size_t i = 0; i < tableKindCount; i++) {
+    fprintf(stderr, "  %-16s %s\n", tableKinds[i].name, tableKinds[i].description);
+  }
+}
+
+int main(int argc, char **argv) {
+  Options options;
+  options.runs = 200;
+  options.ops = 2000;
+  options.maxCapacity = 256;
+  options.seed = 1;
+  const char *only = NULL;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "t:n:o:c:s:h")) != -1) {
+    switch (opt) {
+      case 't': only = optarg; break;
+      case 'n': options.runs = atoi(optarg); break;
+      case 'o': options.ops = atoi(optarg); break;
+      case 'c': options.maxCapacity = atoi(optarg); break;
+      case 's': options.seed = strtoull(optarg, NULL, 0); break;
+      default: usage(); return 2;
+    }
+  }
+  if (optind < argc || options.maxCapacity == 0 || options.maxCapacity > 1024) {
+    usage();
+    return 2;
+  }
+
+  bool diverged = false;
+  bool found = false;
+  for (size_t i = 0; i < tableKindCount; i++) {
+    if (only && strcmp(only, tableKinds[i].name) != 0) continue;
+    found = true;
+    diverged |= checkTable(tableKinds[i], options);
+    fflush(stdout);
+  }
+  if (!found) {
+    usage();
+    return 2;
+  }
+  return diverged ? 1 : 0;
+}
@@ -0,0 +1,488 @@
+/**
+* Python bindings of the host tools, for notebooks: module fccsensor.
+*   Decoder()              a sensor's SensorLink stream decoder (link_decoder.h)
+*     .feed(bytes)         decodes what is whole, returns the digests waiting
+*     .take()              the digests decoded so far, as a Digests batch
+*     .counters, .hop_stats, .link_stats, .sensor_link_stats
+*   replay(capture, ...)   runs a pcap through SnifferCore in thin-sensor
+*                          mode, as the replay tool does, and decodes what
+*                          the sensor sends; returns a dict of the digests
+*                          and the run's counters
+* A Digests batch owns its columns (time_ms, mac, rssi, channel, flags, seq,
+* ie_fingerprint; mac is n x 6). Each column is a read-only buffer with its
+* item format, so numpy.asarray(batch.rssi) or memoryview(batch.rssi) use
+* the batch's memory without a copy; batch.numpy() gives them all as a dict.
+* NumPy is needed only for numpy(), not to build. replay() runs with the
+* GIL released.
+* Build in this directory: python3 setup.py build_ext --inplace
+*/
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <string.h>
+#include <memory>
+#include <vector>
+
+#include <Arena.h>
+#include <SnifferCore.h>
+#include "../host/capture.h"
+#include "../host/host_hal.h"
+#include "../host/link_decoder.h"
+#include "../host/replay.h"
+
+#define SENSOR_LINK_TX 2048
+#define SENSOR_ARENA_SIZE 65536     // the replay tool's
+
+static const char *counterNames[DIGEST_COUNTER_COUNT] = {
+  "accepted", "emitted", "dropped_queue_full", "filtered_not_probe", "filtered_local_mac", "filtered_short",
+  "filtered_watch_exclude", "filtered_rules"
+};
+
+// Columns of a Digests batch, in DigestColumns order.
+struct ColumnSpec {
+  const char *name;
+  const char *format;
+  Py_ssize_t itemSize;
+  Py_ssize_t width;           // items a digest, mac has 6
+};
+
+enum { COLUMN_TIME, COLUMN_MAC, COLUMN_RSSI, COLUMN_CHANNEL, COLUMN_FLAGS, COLUMN_SEQ, COLUMN_IE, COLUMN_COUNT };
+
+static const ColumnSpec columnSpecs[COLUMN_COUNT] = {
+  { "time_ms", "I", 4, 1 },
+  { "mac", "B", 1, 6 },
+  { "rssi", "b", 1, 1 },
+  { "channel", "B", 1, 1 },
+  { "flags", "B", 1, 1 },
+  { "seq", "H", 2, 1 },
+  { "ie_fingerprint", "H", 2, 1 }
+};
+
+static const void *columnData(const DigestColumns &c, int column) {
+  static const uint32_t empty = 0;
+  if (c.size() == 0) return &empty;
+  switch (column) {
+    case COLUMN_TIME: return c.timeMs.data();
+    case COLUMN_MAC: return c.mac.data();
+    case COLUMN_RSSI: return c.rssi.data();
+    case COLUMN_CHANNEL: return c.channel.data();
+    case COLUMN_FLAGS: return c.flags.data();
+    case COLUMN_SEQ: return c.seq.data();
+    default: return c.ieFingerprint.data();
+  }
+}
+
+struct DigestsObject {
+  PyObject_HEAD
+  DigestColumns *columns;
+};
+
+struct ColumnObject {
+  PyObject_HEAD
+  DigestsObject *owner;
+  int column;
+  Py_ssize_t shape[2];
+  Py_ssize_t strides[2];
+};
+
+struct DecoderObject {
+  PyObject_HEAD
+  LinkDecoder *decoder;
+};
+
+static PyTypeObject DigestsType = { PyVarObject_HEAD_INIT(NULL, 0) };
+static PyTypeObject ColumnType = { PyVarObject_HEAD_INIT(NULL, 0) };
+static PyTypeObject DecoderType = { PyVarObject_HEAD_INIT(NULL, 0) };
+
+// Column buffers: the memory of the owning batch, which the column (and
+// so any view of it) keeps alive.
+static int columnGetBuffer(PyObject *self, Py_buffer *view, int flags) {
+  ColumnObject *column = (ColumnObject *)self;
+  const ColumnSpec &spec = columnSpecs[column->column];
+  if (flags & PyBUF_WRITABLE) {
+    PyErr_SetString(PyExc_BufferError, "digest columns are read-only");
+    view->obj = NULL;
+    return -1;
+  }
+  Py_ssize_t rows = column->owner->columns->size();
+  column->shape[0] = rows;
+  column->shape[1] = spec.width;
+  column->strides[0] = spec.itemSize * spec.width;
+  column->strides[1] = spec.itemSize;
+  view->buf = (void *)columnData(*column->owner->columns, column->column);
+  view->obj = self;
+  Py_INCREF(self);
+  view->len = rows * spec.width * spec.itemSize;
+  view->readonly = 1;
+  view->itemsize = spec.itemSize;
+  view->format = (flags & PyBUF_FORMAT) ? (char *)spec.format : NULL;
+  view->ndim = (flags & PyBUF_ND) && spec.width > 1 ? 2 : 1;
+  view->shape = (flags & PyBUF_ND) ? column->shape : NULL;
+  view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? column->strides : NULL;
+  view->suboffsets = NULL;
+  view->internal = NULL;
+  return 0;
+}
+
+static PyBufferProcs columnBuffer = { columnGetBuffer, NULL };
+
+static void columnDealloc(PyObject *self) {
+  Py_XDECREF(((ColumnObject *)self)->owner);
+  Py_TYPE(self)->tp_free(self);
+}
+
+static PyObject *digestsColumn(PyObject *self, void *closure) {
+  ColumnObject *column = PyObject_New(ColumnObject, &ColumnType);
+  if (!column) return NULL;
+  Py_INCREF(self);
+  column->owner = (DigestsObject *)self;
+  column->column = (int)(intptr_t)closure;
+  PyObject *view = PyMemoryView_FromObject((PyObject *)column);
+  Py_DECREF(column);
+  return view;
+}
+
+static DigestsObject *newDigests() {
+  DigestsObject *digests = PyObject_New(DigestsObject, &DigestsType);
+  if (!digests) return NULL;
+  digests->columns = new DigestColumns();
+  return digests;
+}
+
+static void digestsDealloc(PyObject *self) {
+  delete ((DigestsObject *)self)->columns;
+  Py_TYPE(self)->tp_free(self);
+}
+
+static Py_ssize_t digestsLength(PyObject *self) {
+  return ((DigestsObject *)self)->columns->size();
+}
+
+static PyObject *digestsRepr(PyObject *self) {
+  return PyUnicode_FromFormat("<fccsensor.Digests of %zd>", digestsLength(self));
+}
+
+static PyObject *digestsNumpy(PyObject *self, PyObject *unused) {
+  (void)unused;
+  PyObject *numpy = PyImport_ImportModule("numpy");
+  if (!numpy) return NULL;
+  PyObject *arrays = PyDict_New();
+  for (int i = 0; arrays && i < COLUMN_COUNT; i++) {
+    PyObject *view = digestsColumn(self, (void *)(intptr_t)i);
+    PyObject *array = view ? PyObject_CallMethod(numpy, "asarray", "O", view) : NULL;
+    Py_XDECREF(view);
+    if (!array || PyDict_SetItemString(arrays, columnSpecs[i].name, array) != 0) Py_CLEAR(arrays);
+    Py_XDECREF(array);
+  }
+  Py_DECREF(numpy);
+  return arrays;
+}
+
+static PyGetSetDef digestsGetSet[COLUMN_COUNT + 1];
+
+static PyMethodDef digestsMethods[] = {
+  { "numpy", digestsNumpy, METH_NOARGS, "The columns as NumPy arrays sharing the batch's memory, in a dict." },
+  { NULL, NULL, 0, NULL }
+};
+
+static PySequenceMethods digestsSequence;
+
+static PyObject *linkStatsDict(const LinkStats &s) {
+  return Py_BuildValue("{s:I,s:I,s:I,s:I,s:I,s:I,s:I,s:I,s:I,s:I}", "tx_frames", s.txFrames, "tx_bytes", s.txBytes,
+    "tx_dropped", s.txDropped, "rx_frames", s.rxFrames, "rx_bytes", s.rxBytes, "rx_crc_errors", s.rxCrcErrors,
+    "rx_lost", s.rxLost, "rx_resync_bytes", s.rxResyncBytes, "rx_oversize", s.rxOversize, "baud", s.baud);
+}
+
+static PyObject *countersDict(const LinkDecoder &decoder) {
+  if (!decoder.haveCounters()) Py_RETURN_NONE;
+  PyObject *counters = PyDict_New();
+  for (int i = 0; counters && i < DIGEST_COUNTER_COUNT; i++) {
+    PyObject *value = PyLong_FromUnsignedLong(decoder.counter((DigestCounter)i));
+    if (!value || PyDict_SetItemString(counters, counterNames[i], value) != 0) Py_CLEAR(counters);
+    Py_XDECREF(value);
+  }
+  return counters;
+}
+
+static PyObject *hopStatsDict(const HopStats &h) {
+  return Py_BuildValue("{s:I,s:I,s:I,s:I,s:I,s:I,s:d,s:I,s:I,s:I}", "hops", h.hops, "switch_us_total", h.switchUsTotal,
+    "switch_us_max", h.switchUsMax, "gaps", h.gaps, "gap_ms_total", h.gapMsTotal, "gap_ms_max", h.gapMsMax,
+    "lost_frames", h.lostMilliFrames / 1000.0, "deferred", h.deferred, "forced", h.forced,
+    "frames_saved", h.framesSaved);
+}
+
+static DigestsObject *takeDigests(LinkDecoder &decoder) {
+  DigestsObject *digests = newDigests();
+  if (digests) digests->columns->swap(decoder.digests());
+  return digests;
+}
+
+static PyObject *decoderNew(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
+  static const char *keywords[] = { NULL };
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, ":Decoder", (char **)keywords)) return NULL;
+  DecoderObject *self = (DecoderObject *)type->tp_alloc(type, 0);
+  if (self) self->decoder = new LinkDecoder();
+  return (PyObject *)self;
+}
+
+static void decoderDealloc(PyObject *self) {
+  delete ((DecoderObject *)self)->decoder;
+  Py_TYPE(self)->tp_free(self);
+}
+
+static PyObject *decoderFeed(PyObject *self, PyObject *args) {
+  Py_buffer data;
+  if (!PyArg_ParseTuple(args, "y*:feed", &data)) return NULL;
+  LinkDecoder &decoder = *((DecoderObject *)self)->decoder;
+  decoder.feed((const uint8_t *)data.buf, data.len);
+  PyBuffer_Release(&data);
+  return PyLong_FromSize_t(decoder.digests().size());
+}
+
+static PyObject *decoderTake(PyObject *self, PyObject *unused) {
+  (void)unused;
+  return (PyObject *)takeDigests(*((DecoderObject *)self)->decoder);
+}
+
+static PyObject *decoderCounters(PyObject *self, void *closure) {
+  (void)closure;
+  return countersDict(*((DecoderObject *)self)->decoder);
+}
+
+static PyObject *decoderHopStats(PyObject *self, void *closure) {
+  (void)closure;
+  LinkDecoder &decoder = *((DecoderObject *)self)->decoder;
+  if (!decoder.haveCounters()) Py_RETURN_NONE;
+  return hopStatsDict(decoder.hopStats());
+}
+
+static PyObject *decoderLinkStats(PyObject *self, void *closure) {
+  (void)closure;
+  return linkStatsDict(((DecoderObject *)self)->decoder->stats());
+}
+
+static PyObject *decoderSensorLinkStats(PyObject *self, void *closure) {
+  (void)closure;
+  LinkDecoder &decoder = *((DecoderObject *)self)->decoder;
+  if (!decoder.haveSensorStats()) Py_RETURN_NONE;
+  return linkStatsDict(decoder.sensorStats());
+}
+
+static PyMethodDef decoderMethods[] = {
+  { "feed", decoderFeed, METH_VARARGS, "feed(data): decodes the whole frames in data, returns the digests waiting." },
+  { "take", decoderTake, METH_NOARGS, "take(): the digests decoded since the last take(), as a Digests batch." },
+  { NULL, NULL, 0, NULL }
+};
+
+static PyGetSetDef decoderGetSet[] = {
+  { (char *)"counters", decoderCounters, NULL, (char *)"The sensor's last frame counters, or None.", NULL },
+  { (char *)"hop_stats", decoderHopStats, NULL, (char *)"The sensor's last channel hop statistics, or None.", NULL },
+  { (char *)"link_stats", decoderLinkStats, NULL, (char *)"This end's link counters.", NULL },
+  { (char *)"sensor_link_stats", decoderSensorLinkStats, NULL, (char *)"The sensor's last link counters, or None.",
+    NULL },
+  { NULL, NULL, NULL, NULL, NULL }
+};
+
+struct ReplayOptions {
+  SnifferConfig config;
+  bool allChannels;
+  const char *rules;
+};
+
+struct ReplayOutcome {
+  ReplayStats stats;
+  const char *openError;
+  const char *readError;
+  uint32_t records;
+  uint32_t skipped;
+  bool started;
+};
+
+// The replay tool's run with the sensor's loop() work after every frame:
+// digests drained into the link, which writes straight into the decoder.
+static void runReplay(const char *path, const ReplayOptions &options, LinkDecoder &decoder, ReplayOutcome &outcome) {
+  memset(&outcome, 0, sizeof(outcome));
+  std::unique_ptr<CaptureReader> reader(new CaptureReader());
+  if (!reader->open(path)) {
+    outcome.openError = reader->error();
+    return;
+  }
+  std::vector<uint64_t> pool(SENSOR_ARENA_SIZE / 8);
+  Arena arena((uint8_t *)pool.data(), SENSOR_ARENA_SIZE);
+  HostHal hal(NULL, options.config.initialChannel);
+  SnifferCore core(hal, options.config);
+  LinkDecoderPort port(decoder);
+  SensorLink link(port);
+  core.setLink(&link);
+  if (!core.begin(arena) || !link.begin(arena, SENSOR_LINK_TX, 256, LINK_DEFAULT_BAUD, LINK_DEFAULT_BAUD)) return;
+  arena.seal();
+  if (options.rules) {
+    core.handleFrame(FRAME_RULES, (const uint8_t *)options.rules, strlen(options.rules));
+    while (link.poll(1000)) {
+    }
+    if (!decoder.rulesLoaded()) return;
+  }
+  outcome.started = true;
+  Replay replay(core, hal, options.allChannels);
+  CaptureFrame frame;
+  while (reader->next(frame)) {
+    replay.feed(frame);
+    core.drainDigests(1000);
+    link.poll(1000);
+  }
+  // the virtual clock stops with the capture: run it on until the last
+  // partial batch is due, then send the counters that cover it.
+  replay.advance(hal.nowMs + options.config.digestBatchMaxMs);
+  while (core.drainDigests(1000) || link.poll(1000)) {
+  }
+  core.requestDigestStats();
+  while (core.drainDigests(1000) || link.poll(1000)) {
+  }
+  outcome.stats = replay.stats();
+  outcome.readError = reader->error();
+  outcome.records = reader->records();
+  outcome.skipped = reader->skipped();
+}
+
+static PyObject *replayCapture(PyObject *module, PyObject *args, PyObject *kwargs) {
+  (void)module;
+  static const char *keywords[] = {
+    "capture", "static", "channel", "hop_ms", "all_channels", "keep_local", "rules", "quiet_gap_ms", "defer_max_ms",
+    NULL
+  };
+  const char *path;
+  int staticMode = 0, allChannels = 0, keepLocal = 0;
+  unsigned channel = 1, hopMs = 30000, quietGapMs = 0, deferMaxMs = 200;
+  ReplayOptions options;
+  replayConfigDefaults(options.config);
+  options.rules = NULL;
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|$pIIppzII:replay", (char **)keywords, &path, &staticMode,
+                                   &channel, &hopMs, &allChannels, &keepLocal, &options.rules, &quietGapMs,
+                                   &deferMaxMs)) {
+    return NULL;
+  }
+  if (channel < 1 || channel > 14) {
+    PyErr_SetString(PyExc_ValueError, "channel is 1 to 14");
+    return NULL;
+  }
+  options.config.thinSensor = true;
+  options.config.staticMode = staticMode;
+  options.config.initialChannel = channel;
+  options.config.hopIntervalMs = hopMs;
+  options.config.ignoreLocalMacs = !keepLocal;
+  options.config.hopQuietGapMs = quietGapMs;
+  options.config.hopDeferMaxMs = deferMaxMs;
+  options.allChannels = allChannels;
+
+  std::unique_ptr<LinkDecoder> decoder(new LinkDecoder());
+  ReplayOutcome outcome;
+  Py_BEGIN_ALLOW_THREADS
+  runReplay(path, options, *decoder, outcome);
+  Py_END_ALLOW_THREADS
+  if (outcome.openError) {
+    PyErr_Format(PyExc_OSError, "%s: %s", path, outcome.openError);
+    return NULL;
+  }
+  if (!outcome.started) {
+    if (options.rules && decoder->rulesAcked()) {
+      PyErr_Format(PyExc_ValueError, "rules: error at %u: %s", decoder->rulesDetail(), decoder->rulesError());
+    } else {
+      PyErr_SetString(PyExc_MemoryError, "sensor buffers don't fit the arena");
+    }
+    return NULL;
+  }
+  if (outcome.readError &&
+      PyErr_WarnFormat(PyExc_RuntimeWarning, 1, "%s: %s after %u records", path, outcome.readError,
+                       outcome.records) != 0) {
+    return NULL;
+  }
+  if (outcome.skipped &&
+      PyErr_WarnFormat(PyExc_RuntimeWarning, 1, "%s: %u records with a bad radiotap header", path,
+                       outcome.skipped) != 0) {
+    return NULL;
+  }
+  // every accepted digest the queue kept must have reached the decoder.
+  uint32_t accepted = decoder->counter(DIGEST_ACCEPTED) - decoder->counter(DIGEST_DROP_QUEUE_FULL);
+  uint32_t emitted = decoder->counter(DIGEST_EMITTED);
+  if (!decoder->haveCounters() || emitted != accepted || decoder->digests().size() != emitted) {
+    PyErr_Format(PyExc_RuntimeError, "digests: %u accepted, %u emitted, %u decoded", accepted, emitted,
+                 (unsigned)decoder->digests().size());
+    return NULL;
+  }
+  PyObject *digests = (PyObject *)takeDigests(*decoder);
+  PyObject *counters = digests ? countersDict(*decoder) : NULL;
+  PyObject *hops = counters ? hopStatsDict(decoder->hopStats()) : NULL;
+  PyObject *result = hops ? Py_BuildValue("{s:O,s:K,s:K,s:K,s:I,s:O,s:O}", "digests", digests,
+    "frames", (unsigned long long)outcome.stats.frames, "delivered", (unsigned long long)outcome.stats.delivered,
+    "off_channel", (unsigned long long)outcome.stats.offChannel, "hops", outcome.stats.hops,
+    "counters", counters, "hop_stats", hops) : NULL;
+  Py_XDECREF(digests);
+  Py_XDECREF(counters);
+  Py_XDECREF(hops);
+  return result;
+}
+
+static PyMethodDef moduleMethods[] = {
+  { "replay", (PyCFunction)(void (*)(void))replayCapture, METH_VARARGS | METH_KEYWORDS,
+    "replay(capture, *, static=False, channel=1, hop_ms=30000, all_channels=False, keep_local=False,\n"
+    "       rules=None, quiet_gap_ms=0, defer_max_ms=200)\n"
+    "Runs a capture through the sensor core in thin-sensor mode on a virtual clock; returns a dict of\n"
+    "the digests (a Digests batch), the frame counts and the sensor's counters and hop statistics." },
+  { NULL, NULL, 0, NULL }
+};
+
+static struct PyModuleDef moduleDef = {
+  PyModuleDef_HEAD_INIT, "fccsensor", "Sensor link decoding and capture replay with columnar, zero-copy results.",
+  -1, moduleMethods, NULL, NULL, NULL, NULL
+};
+
+PyMODINIT_FUNC PyInit_fccsensor(void) {
+  for (int i = 0; i < COLUMN_COUNT; i++) {
+    PyGetSetDef &g = digestsGetSet[i];
+    g.name = (char *)columnSpecs[i].name;
+    g.get = digestsColumn;
+    g.set = NULL;
+    g.doc = NULL;
+    g.closure = (void *)(intptr_t)i;
+  }
+  digestsSequence.sq_length = digestsLength;
+
+  ColumnType.tp_name = "fccsensor.Column";
+  ColumnType.tp_basicsize = sizeof(ColumnObject);
+  ColumnType.tp_flags = Py_TPFLAGS_DEFAULT;
+  ColumnType.tp_dealloc = columnDealloc;
+  ColumnType.tp_as_buffer = &columnBuffer;
+  ColumnType.tp_doc = "A column of a Digests batch, exported through the buffer protocol.";
+
+  DigestsType.tp_name = "fccsensor.Digests";
+  DigestsType.tp_basicsize = sizeof(DigestsObject);
+  DigestsType.tp_flags = Py_TPFLAGS_DEFAULT;
+  DigestsType.tp_dealloc = digestsDealloc;
+  DigestsType.tp_repr = digestsRepr;
+  DigestsType.tp_as_sequence = &digestsSequence;
+  DigestsType.tp_methods = digestsMethods;
+  DigestsType.tp_getset = digestsGetSet;
+  DigestsType.tp_doc = "Decoded digests, column by column; each column is a read-only buffer.";
+
+  DecoderType.tp_name = "fccsensor.Decoder";
+  DecoderType.tp_basicsize = sizeof(DecoderObject);
+  DecoderType.tp_flags = Py_TPFLAGS_DEFAULT;
+  DecoderType.tp_new = decoderNew;
+  DecoderType.tp_dealloc = decoderDealloc;
+  DecoderType.tp_methods = decoderMethods;
+  DecoderType.tp_getset = decoderGetSet;
+  DecoderType.tp_doc = "Decoder(): decodes a sensor's SensorLink byte stream.";
+
+  if (PyType_Ready(&ColumnType) < 0 || PyType_Ready(&DigestsType) < 0 || PyType_Ready(&DecoderType) < 0) return NULL;
+  PyObject *module = PyModule_Create(&moduleDef);
+  if (!module) return NULL;
+  Py_INCREF(&DigestsType);
+  Py_INCREF(&DecoderType);
+  if (PyModule_AddObject(module, "Digests", (PyObject *)&DigestsType) != 0 ||
+      PyModule_AddObject(module, "Decoder", (PyObject *)&DecoderType) != 0) {
+    Py_DECREF(module);
+    return NULL;
+  }
+  return module;
+}
@@ -0,0 +1,34 @@
+"""Builds the fccsensor extension (fccsensor.cpp) from the host sources:
+    python3 setup.py build_ext --inplace
+"""
+
+import glob
+import os
+
+from setuptools import Extension, setup
+
+here = os.path.dirname(os.path.abspath(__file__))
+root = os.path.normpath(os.path.join(here, '..', '..'))
+
+
+def relative(paths):
+    return sorted(os.path.relpath(p, here) for p in paths)
+
+
+sources = ['fccsensor.cpp']
+sources += relative(glob.glob(os.path.join(root, 'lib', '*', '*.cpp')))
+sources += relative(os.path.join(root, 'src', 'host', name)
+                    for name in ('capture.cpp', 'host_hal.cpp', 'link_decoder.cpp', 'replay.cpp'))
+
+setup(
+    name='fccsensor',
+    version='1.0',
+    description='Sensor link decoding and capture replay for Python',
+    ext_modules=[Extension(
+        'fccsensor',
+        sources=sources,
+        include_dirs=relative(p for p in glob.glob(os.path.join(root, 'lib', '*')) if os.path.isdir(p)),
+        extra_compile_args=['-std=c++11', '-O2'],
+        language='c++',
+    )],
+)
@@ -0,0 +1,309 @@
+/**
+* Replays 802.11 captures through the sniffer core on a virtual clock and
+* evaluates the surge detector.
+* Each capture (pcap, radiotap or plain 802.11) is one run with a fresh
+* sensor; with -g the frames come from a synthetic crowd instead, -n runs
+* with consecutive seeds. Every run reports its surge alerts; with an event
+* onset (-E, or the synthetic surge start) it also reports the detection
+* delay and the alerts raised before the onset (false alarms), and the frame
+* gaps around its channel hops; -Q holds hops back for a quiet gap (up to -m
+* ms) as HOP_QUIET_GAP_MS does, to see how many frames that saves.
+* Usage: replay [sensor options] [-E onset_s] <capture.pcap|->...
+*        replay [sensor options] -g [-n runs] [scenario options] [-w out.pcap]
+*  sensor: -s static mode, -c initial channel, -i hop interval ms,
+*          -q quotient filter dedup, -l keep local MACs, -a hear all channels,
+*          -v print sensor output, -K k, -H h, -M min rate, -W warmup s,
+*          -f watchlist file loaded into the sensor, -F filter rules file,
+*          -Q hop quiet gap ms, -m longest hop wait ms (200)
+*  scenario: -x seed, -d duration s, -r arrivals/s, -S surge start s,
+*          -L surge length s, -R extra arrivals/s in the surge, -D dwell s,
+*          -p probe interval s
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+
+#include <Arena.h>
+#include <SnifferCore.h>
+#include "../host/capture.h"
+#include "../host/host_hal.h"
+#include "../host/replay.h"
+#include "../host/synthetic.h"
+#include "../host/text_file.h"
+#include "../host/watchlist_file.h"
+
+static uint8_t arenaPool[65536] __attribute__((aligned(8)));
+
+struct RunResult {
+  uint32_t endMs;
+  uint32_t falseAlarms;
+  bool detected;
+  uint32_t delayMs;
+};
+
+struct Options {
+  SnifferConfig config;
+  bool allChannels;
+  bool verbose;
+  bool haveOnset;
+  uint32_t onsetMs;
+  uint32_t windowMs;          // detections count within this long after the onset
+  std::vector<WatchRecord> watchlist;
+  std::string rules;
+};
+
+class Run {
+public:
+  Run(const Options &options)
+    : _options(options), _arena(arenaPool, sizeof(arenaPool)),
+      _hal(options.verbose ? stdout : NULL, options.config.initialChannel),
+      _core(_hal, options.config), _replay(_core, _hal, options.allChannels) {
+  }
+
+  bool begin() {
+    if (!_core.begin(_arena)) return false;
+    _arena.seal();
+    if (!_options.rules.empty()) {
+      _core.handleFrame(FRAME_RULES, (const uint8_t *)_options.rules.data(), _options.rules.size());
+    }
+    if (_options.watchlist.empty()) return true;
+    _core.handleFrame(FRAME_WATCHLIST_BEGIN, NULL, 0);
+    for (size_t i = 0; i < _options.watchlist.size(); i++) {
+      _core.handleFrame(FRAME_WATCHLIST_DATA, (const uint8_t *)&_options.watchlist[i], WATCH_RECORD_LENGTH);
+    }
+    uint16_t records = _options.watchlist.size();
+    _core.handleFrame(FRAME_WATCHLIST_COMMIT, (const uint8_t *)&records, sizeof(records));
+    while (_core.commitWatchlist(1000)) {}
+    return _core.watchlist().count() == watchlistDistinct(_options.watchlist);
+  }
+
+  Replay &replay() { return _replay; }
+
+  RunResult finish(const char *name) {
+    RunResult r;
+    memset(&r, 0, sizeof(r));
+    r.endMs = _hal.nowMs;
+    const std::vector<uint32_t> &alerts = _replay.alerts();
+    const ReplayStats &s = _replay.stats();
+    printf("%s: %.1f s, %llu frames, %llu delivered, %llu off channel, %d clients, %u alerts",
+      name, r.endMs / 1000.0, (unsigned long long)s.frames, (unsigned long long)s.delivered,
+      (unsigned long long)s.offChannel, _core.clientCount(), (unsigned)alerts.size());
+    for (size_t i = 0; i < alerts.size(); i++) {
+      printf("%s%.0f", i == 0 ? " at " : " ", alerts[i] / 1000.0);
+      if (!_options.haveOnset) continue;
+      if (alerts[i] < _options.onsetMs) {
+        r.falseAlarms++;
+      } else if (!r.detected && alerts[i] - _options.onsetMs < _options.windowMs) {
+        r.detected = true;
+        r.delayMs = alerts[i] - _options.onsetMs;
+      }
+    }
+    if (_options.haveOnset) {
+      if (r.detected) printf(", delay %.1f s", r.delayMs / 1000.0);
+      else printf(", missed");
+    }
+    printf("\n");
+    const HopStats &h = _core.hopStats();
+    if (h.hops) {
+      printf("%s: %u hops, gap avg %.1f ms max %u ms, ~%.1f frames lost", name, (unsigned)h.hops,
+        h.gaps ? (double)h.gapMsTotal / h.gaps : 0.0, (unsigned)h.gapMsMax, h.lostMilliFrames / 1000.0);
+      if (_options.config.hopQuietGapMs) {
+        printf(", %u deferred (%u at the deadline), %u frames heard while waiting", (unsigned)h.deferred,
+          (unsigned)h.forced, (unsigned)h.framesSaved);
+      }
+      printf("\n");
+    }
+    return r;
+  }
+
+private:
+  const Options &_options;
+  Arena _arena;
+  HostHal _hal;
+  SnifferCore _core;
+  Replay _replay;
+};
+
+static void summary(const Options &options, const std::vector<RunResult> &results) {
+  if (!options.haveOnset || results.empty()) return;
+  std::vector<uint32_t> delays;
+  uint32_t falseAlarms = 0;
+  double preOnsetS = 0;
+  for (size_t i = 0; i < results.size(); i++) {
+    if (results[i].detected) delays.push_back(results[i].delayMs);
+    falseAlarms += results[i].falseAlarms;
+    preOnsetS += std::min(results[i].endMs, options.onsetMs) / 1000.0;
+  }
+  printf("detected %u/%u", (unsigned)delays.size(), (unsigned)results.size());
+  if (!delays.empty()) {
+    std::sort(delays.begin(), delays.end());
+    double sum = 0;
+    for (size_t i = 0; i < delays.size(); i++) sum += delays[i];
+    printf(", delay median %.1f s mean %.1f s max %.1f s",
+      delays[delays.size() / 2] / 1000.0, sum / delays.size() / 1000.0, delays.back() / 1000.0);
+  }
+  printf(", %u false alarms (%.2f per hour)\n", (unsigned)falseAlarms,
+    preOnsetS > 0 ? falseAlarms * 3600.0 / preOnsetS : 0.0);
+}
+
+static bool replayCapture(const Options &options, const char *path, RunResult &result) {
+  CaptureReader reader;
+  if (!reader.open(path)) {
+    fprintf(stderr, "%s: %s\n", path, reader.error());
+    return false;
+  }
+  Run run(options);
+  if (!run.begin()) {
+    fprintf(stderr, "sensor buffers don't fit the arena or the watchlist doesn't fit\n");
+    return false;
+  }
+  CaptureFrame frame;
+  while (reader.next(frame)) run.replay().feed(frame);
+  if (reader.error()) fprintf(stderr, "%s: %s after %u records\n", path, reader.error(), reader.records());
+  if (reader.skipped()) fprintf(stderr, "%s: %u records with a bad radiotap header\n", path, reader.skipped());
+  result = run.finish(path);
+  return true;
+}
+
+static bool replaySynthetic(const Options &options, const CrowdScenario &scenario,
+                            const char *writePath, RunResult &result) {
+  CaptureWriter writer;
+  if (writePath && !writer.open(writePath, DATA_LENGTH)) {
+    fprintf(stderr, "%s: can't write\n", writePath);
+    return false;
+  }
+  Run run(options);
+  if (!run.begin()) {
+    fprintf(stderr, "sensor buffers don't fit the arena or the watchlist doesn't fit\n");
+    return false;
+  }
+  CrowdGenerator crowd(scenario);
+  CaptureFrame frame;
+  while (crowd.next(frame)) {
+    if (writePath) {
+      uint16_t captured = frame.packet.len < DATA_LENGTH ? frame.packet.len : DATA_LENGTH;
+      writer.write(frame.timeUs, frame.packet.data, captured, frame.packet.len,
+                   frame.channel, frame.packet.rx_ctrl.rssi);
+    }
+    run.replay().feed(frame);
+  }
+  run.replay().advance(scenario.durationS * 1000);
+  char name[32];
+  sprintf(name, "seed %u", (unsigned)scenario.seed);
+  result = run.finish(name);
+  return writer.close();
+}
+
+// Compiles the rules aside first, to report errors before any run.
+static bool checkRules(const SnifferConfig &config, const std::string &rules) {
+  static uint8_t pool[4096] __attribute__((aligned(8)));
+  Arena arena(pool, sizeof(pool));
+  FilterRules check;
+  RuleError error;
+  if (!check.begin(arena, config.rulesMaxInsns, config.rulesMaxOuis)) {
+    fprintf(stderr, "rules: no room\n");
+    return false;
+  }
+  if (!check.load(rules.data(), rules.size(), error)) {
+    fprintf(stderr, "rules: error at %u: %s\n", error.position, error.message);
+    return false;
+  }
+  return true;
+}
+
+static void usage() {
+  fprintf(stderr,
+    "usage: replay [sensor options] [-E onset_s] <capture.pcap|->...\n"
+    "       replay [sensor options] -g [-n runs] [scenario options] [-w out.pcap]\n"
+    "  sensor: -s static, -c channel, -i hop_ms, -q quotient filter, -l keep local MACs,\n"
+    "          -a hear all channels, -v print sensor output, -K k, -H h, -M min_rate, -W warmup_s,\n"
+    "          -f watchlist, -F rules, -Q hop_quiet_gap_ms, -m hop_wait_max_ms\n"
+    "  scenario: -x seed, -d duration_s, -r arrivals/s, -S surge_start_s, -L surge_length_s,\n"
+    "          -R surge_arrivals/s, -D dwell_s, -p probe_interval_s\n");
+}
+
+int main(int argc, char **argv) {
+  Options options;
+  replayConfigDefaults(options.config);
+  options.allChannels = false;
+  options.verbose = false;
+  options.haveOnset = false;
+  options.onsetMs = 0;
+  options.windowMs = 0xffffffff;
+
+  CrowdScenario scenario;
+  crowdScenarioDefaults(scenario);
+  bool synthetic = false;
+  unsigned runs = 1;
+  const char *writePath = NULL;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "sc:i:qlavK:H:M:W:f:F:Q:m:E:gn:w:x:d:r:S:L:R:D:p:h")) != -1) {
+    switch (opt) {
+      case 's': options.config.staticMode = true; break;
+      case 'c': options.config.initialChannel = atoi(optarg); break;
+      case 'i': options.config.hopIntervalMs = atoi(optarg); break;
+      case 'q': options.config.dedupQuotientFilter = true; break;
+      case 'l': options.config.ignoreLocalMacs = false; break;
+      case 'a': options.allChannels = true; break;
+      case 'v': options.verbose = true; break;
+      case 'K': options.config.surge.k = atof(optarg); break;
+      case 'H': options.config.surge.h = atof(optarg); break;
+      case 'M': options.config.surge.minRate = atoi(optarg); break;
+      case 'W': options.config.surge.warmupS = atoi(optarg); break;
+      case 'f': if (!readWatchlist(optarg, options.watchlist)) return 1; break;
+      case 'F': if (!readTextFile(optarg, options.rules)) return 1; break;
+      case 'Q': options.config.hopQuietGapMs = atoi(optarg); break;
+      case 'm': options.config.hopDeferMaxMs = atoi(optarg); break;
+      case 'E': options.haveOnset = true; options.onsetMs = atof(optarg) * 1000; break;
+      case 'g': synthetic = true; break;
+      case 'n': runs = atoi(optarg); break;
+      case 'w': writePath = optarg; break;
+      case 'x': scenario.seed = atoi(optarg); break;
+      case 'd': scenario.durationS = atoi(optarg); break;
+      case 'r': scenario.arrivalsPerS = atof(optarg); break;
+      case 'S': scenario.surgeStartS = atoi(optarg); break;
+      case 'L': scenario.surgeLengthS = atoi(optarg); break;
+      case 'R': scenario.surgeArrivalsPerS = atof(optarg); break;
+      case 'D': scenario.dwellS = atof(optarg); break;
+      case 'p': scenario.probeIntervalS = atof(optarg); break;
+      default: usage(); return 2;
+    }
+  }
+
+  if (!options.rules.empty() && !checkRules(options.config, options.rules)) return 1;
+
+  std::vector<RunResult> results;
+  RunResult result;
+  if (synthetic) {
+    if (optind != argc || (writePath && runs != 1)) {
+      usage();
+      return 2;
+    }
+    if (scenario.surgeLengthS > 0) {
+      options.haveOnset = true;
+      options.onsetMs = scenario.surgeStartS * 1000;
+      options.windowMs = scenario.surgeLengthS * 1000;
+    }
+    for (unsigned i = 0; i < runs; i++) {
+      if (!replaySynthetic(options, scenario, writePath, result)) return 1;
+      results.push_back(result);
+      scenario.seed++;
+    }
+  } else {
+    if (optind == argc) {
+      usage();
+      return 2;
+    }
+    for (int i = optind; i < argc; i++) {
+      if (!replayCapture(options, argv[i], result)) return 1;
+      results.push_back(result);
+    }
+  }
+  summary(options, results);
+  return 0;
+}
@@ -0,0 +1,239 @@
+/**
+* What-if evaluator: runs a grid of counting configurations (BUFFER_SIZE,
+* CHANNEL_HOP_INTERVAL_MS, STATIC_MODE, IGNORE_LOCAL_MACS) over a corpus of
+* captures through the sniffer core on virtual time, every combination and
+* corpus entry a job on a pool of threads, and prints per configuration
+* how well the reported counts follow the truth and what they cost.
+* The sensor reports a count per sweep (14 hops; in static mode the time 14
+* hops would take): hopping, the "Total clients" of the sweep, with the
+* buffer reset after it as with SPI_SEND_CLIENT_COUNT; static, the roll
+* buffer's count at the end of each period. The truth of a period is the
+* devices sending probe requests in it on any channel: distinct source MACs
+* in a capture (a randomizing phone counts once per MAC), the generator's
+* own devices for a synthetic crowd (-g).
+* Columns: sweeps compared, mean reported and true count, mean absolute
+* error, bias (mean reported - true, relative to the mean truth), sensor CPU
+* time per hour of traffic (thread time in the core) and its arena bytes.
+* Usage: whatif [grid] [-j threads] <capture.pcap>...
+*        whatif [grid] [-j threads] -g [-n runs] [scenario options]
+*  grid, comma separated lists: -b buffer sizes (100), -i hop intervals ms
+*          (30000), -s static modes 0/1 (0), -l ignore local MACs 0/1 (1)
+*  scenario: -x first seed, -d duration s, -r arrivals/s, -D dwell s,
+*          -p probe interval s, -m local MAC percent
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <Arena.h>
+#include <SnifferCore.h>
+#include "../host/corpus.h"
+#include "../host/host_hal.h"
+#include "../host/replay.h"
+#include "../host/synthetic.h"
+
+#define WHATIF_ARENA_SIZE (256 * 1024)
+
+struct Job {
+  size_t config;
+  size_t entry;
+  // results
+  bool ok;
+  uint32_t sweeps;
+  double reported;            // sums over the sweeps
+  double truth;
+  double absError;
+  double cpuS;
+  uint32_t arenaBytes;
+};
+
+static uint32_t sweepMs(const SnifferConfig &config) {
+  return 14 * config.hopIntervalMs;
+}
+
+static void runJob(const SnifferConfig &config, const CorpusEntry &entry, Job &job) {
+  std::vector<uint64_t> pool(WHATIF_ARENA_SIZE / sizeof(uint64_t));
+  Arena arena((uint8_t *)pool.data(), WHATIF_ARENA_SIZE);
+  HostHal hal(NULL, config.initialChannel);
+  SnifferCore core(hal, config);
+  Replay replay(core, hal, false);
+  std::vector<uint32_t> reported;
+  hal.onLine(collectTotalClients, &reported);
+  job.ok = core.begin(arena);
+  if (!job.ok) return;
+  arena.seal();
+  job.arenaBytes = arena.used();
+
+  uint32_t period = sweepMs(config);
+  uint32_t nextSampleMs = period;
+  double start = threadCpuS();
+  for (size_t i = 0; i < entry.frames.size(); i++) {
+    const CaptureFrame &frame = entry.frames[i];
+    // the roll buffer as it stands at the end of each period.
+    while (config.staticMode && frame.timeUs / 1000 >= nextSampleMs) {
+      replay.advance(nextSampleMs);
+      reported.push_back(core.clientCount());
+      nextSampleMs += period;
+    }
+    replay.feed(frame);
+  }
+  job.cpuS = threadCpuS() - start;
+
+  std::vector<uint32_t> truth = devicesPerPeriod(entry, period);
+  job.sweeps = std::min(truth.size(), reported.size());
+  job.reported = job.truth = job.absError = 0;
+  for (uint32_t i = 0; i < job.sweeps; i++) {
+    job.reported += reported[i];
+    job.truth += truth[i];
+    job.absError += reported[i] > truth[i] ? reported[i] - truth[i] : truth[i] - reported[i];
+  }
+}
+
+static bool parseList(const char *text, std::vector<uint32_t> &values) {
+  values.clear();
+  char *end;
+  for (const char *p = text; *p; p = *end ? end + 1 : end) {
+    values.push_back(strtoul(p, &end, 10));
+    if (end == p || (*end && *end != ',')) return false;
+  }
+  return !values.empty();
+}
+
+static void usage() {
+  fprintf(stderr,
+    "usage: whatif [grid] [-j threads] <capture.pcap>...\n"
+    "       whatif [grid] [-j threads] -g [-n runs] [scenario options]\n"
+    "  grid, comma separated: -b buffer_sizes, -i hop_ms, -s static 0/1, -l ignore_local 0/1\n"
+    "  scenario: -x seed, -d duration_s, -r arrivals/s, -D dwell_s, -p probe_interval_s,\n"
+    "          -m local_mac_percent\n");
+}
+
+int main(int argc, char **argv) {
+  std::vector<uint32_t> buffers(1, 100), hops(1, 30000), statics(1, 0), locals(1, 1);
+  unsigned threads = std::thread::hardware_concurrency();
+  CrowdScenario scenario;
+  crowdScenarioDefaults(scenario);
+  bool synthetic = false;
+  unsigned runs = 1;
+
+  int opt;
+  bool ok = true;
+  while ((opt = getopt(argc, argv, "b:i:s:l:j:gn:x:d:r:D:p:m:h")) != -1) {
+    switch (opt) {
+      case 'b': ok = parseList(optarg, buffers); break;
+      case 'i': ok = parseList(optarg, hops); break;
+      case 's': ok = parseList(optarg, statics); break;
+      case 'l': ok = parseList(optarg, locals); break;
+      case 'j': threads = atoi(optarg); break;
+      case 'g': synthetic = true; break;
+      case 'n': runs = atoi(optarg); break;
+      case 'x': scenario.seed = atoi(optarg); break;
+      case 'd': scenario.durationS = atoi(optarg); break;
+      case 'r': scenario.arrivalsPerS = atof(optarg); break;
+      case 'D': scenario.dwellS = atof(optarg); break;
+      case 'p': scenario.probeIntervalS = atof(optarg); break;
+      case 'm': scenario.localMacPercent = atoi(optarg); break;
+      default: ok = false; break;
+    }
+    if (!ok) {
+      usage();
+      return 2;
+    }
+  }
+  if (synthetic == (optind < argc)) {
+    usage();
+    return 2;
+  }
+  if (threads == 0) threads = 1;
+
+  std::vector<CorpusEntry> corpus(synthetic ? runs : argc - optind);
+  for (size_t i = 0; i < corpus.size(); i++) {
+    if (synthetic) {
+      char name[32];
+      sprintf(name, "seed %u", (unsigned)scenario.seed);
+      generateCorpusCrowd(scenario, name, corpus[i]);
+      scenario.seed++;
+    } else if (!loadCorpusCapture(argv[optind + i], corpus[i])) {
+      return 1;
+    }
+  }
+  double hours = 0;
+  for (size_t i = 0; i < corpus.size(); i++) hours += corpus[i].endMs / 3600000.0;
+
+  std::vector<SnifferConfig> configs;
+  for (size_t s = 0; s < statics.size(); s++) {
+    for (size_t l = 0; l < locals.size(); l++) {
+      for (size_t h = 0; h < hops.size(); h++) {
+        for (size_t b = 0; b < buffers.size(); b++) {
+          SnifferConfig config;
+          replayConfigDefaults(config);
+          config.staticMode = statics[s] != 0;
+          config.ignoreLocalMacs = locals[l] != 0;
+          config.hopIntervalMs = hops[h];
+          config.bufferSize = buffers[b];
+          config.spiSendClientCount = true;
+          configs.push_back(config);
+        }
+      }
+    }
+  }
+
+  std::vector<Job> jobs;
+  for (size_t c = 0; c < configs.size(); c++) {
+    for (size_t e = 0; e < corpus.size(); e++) {
+      Job job;
+      memset(&job, 0, sizeof(job));
+      job.config = c;
+      job.entry = e;
+      jobs.push_back(job);
+    }
+  }
+  std::atomic<size_t> nextJob(0);
+  std::vector<std::thread> pool;
+  for (unsigned t = 0; t < threads && t < jobs.size(); t++) {
+    pool.push_back(std::thread([&]() {
+      for (size_t j; (j = nextJob++) < jobs.size();) runJob(configs[jobs[j].config], corpus[jobs[j].entry], jobs[j]);
+    }));
+  }
+  for (size_t t = 0; t < pool.size(); t++) pool[t].join();
+
+  printf("%u configurations x %u corpus entries (%.1f h of traffic) on %u threads\n",
+    (unsigned)configs.size(), (unsigned)corpus.size(), hours, (unsigned)pool.size());
+  printf("static hop_s buffer local | sweeps reported   truth     mae   bias%% cpu_ms/h arena_B\n");
+  for (size_t c = 0; c < configs.size(); c++) {
+    const SnifferConfig &config = configs[c];
+    Job sum;
+    memset(&sum, 0, sizeof(sum));
+    sum.ok = true;
+    for (size_t e = 0; e < corpus.size(); e++) {
+      const Job &job = jobs[c * corpus.size() + e];
+      sum.ok = sum.ok && job.ok;
+      sum.sweeps += job.sweeps;
+      sum.reported += job.reported;
+      sum.truth += job.truth;
+      sum.absError += job.absError;
+      sum.cpuS += job.cpuS;
+      if (job.arenaBytes > sum.arenaBytes) sum.arenaBytes = job.arenaBytes;
+    }
+    printf("%6u %5.0f %6u %5u | ", config.staticMode, config.hopIntervalMs / 1000.0, (unsigned)config.bufferSize,
+      config.ignoreLocalMacs);
+    if (!sum.ok) {
+      printf("doesn't fit the arena\n");
+    } else if (sum.sweeps == 0) {
+      printf("no whole sweep in the corpus\n");
+    } else {
+      printf("%6u %8.1f %7.1f %7.2f %+7.1f %8.1f %7u\n", sum.sweeps, sum.reported / sum.sweeps,
+        sum.truth / sum.sweeps, sum.absError / sum.sweeps,
+        sum.truth > 0 ? 100 * (sum.reported - sum.truth) / sum.truth : 0.0,
+        hours > 0 ? sum.cpuS * 1000 / hours : 0.0, sum.arenaBytes);
+    }
+  }
+  return 0;
+}